@@ -0,0 +1,199 @@
+#ifndef ALLOCATOR_H
+#define ALLOCATOR_H
+#ifndef __cplusplus
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#else
+#include <cstdlib>
+#include <cstddef>
+#include <cstring>
+#endif
+
+/* c_allocator is what c_vector, rb_tree and c_map use to get memory. Every
+ * container keeps a pointer to the allocator it was created with, and all of its
+ * allocations (the struct itself, the element buffer, tree nodes) go through it.
+ * The allocator has to outlive every container that uses it.
+ *
+ * allocate returns uninitialized memory, or NULL on failure.
+ * reallocate is given the old size so that allocators which don't track sizes
+ * (like the arena below) can still copy the old contents.
+ * deallocate may be NULL. That tells the containers that memory is released all at
+ * once by whoever owns the context, so they skip freeing things one at a time.
+ * For a tree, that means destroy doesn't have to walk the nodes at all.
+ */
+typedef struct c_allocator {
+	void *(*allocate)(void *context, size_t bytes);
+	void *(*reallocate)(void *context, void *ptr, size_t old_bytes, size_t new_bytes);
+	void (*deallocate)(void *context, void *ptr);
+	void *context;
+} c_allocator;
+
+static inline void *malloc_allocate(void *context, size_t bytes) {
+	(void) context;
+	return malloc(bytes);
+}
+
+static inline void *malloc_reallocate(void *context, void *ptr, size_t old_bytes, size_t new_bytes) {
+	(void) context;
+	(void) old_bytes;
+	return realloc(ptr, new_bytes);
+}
+
+static inline void malloc_deallocate(void *context, void *ptr) {
+	(void) context;
+	free(ptr);
+}
+
+/* This is what every container uses unless it is told otherwise */
+static const c_allocator default_allocator = {
+	&malloc_allocate,
+	&malloc_reallocate,
+	&malloc_deallocate,
+	NULL
+};
+
+/* The containers used calloc everywhere, so this keeps that behavior for them */
+static inline void *allocator_calloc(const c_allocator *allocator, size_t bytes) {
+	void *ptr = allocator->allocate(allocator->context, bytes);
+	if (ptr != NULL)
+		memset(ptr, 0, bytes);
+	return ptr;
+}
+
+static inline void allocator_free(const c_allocator *allocator, void *ptr) {
+	if (ptr != NULL && allocator->deallocate != NULL)
+		allocator->deallocate(allocator->context, ptr);
+}
+
+/* c_arena is a bump allocator. Allocations are carved out of large chunks and
+ * are never freed individually, so its c_allocator has no deallocate. Everything
+ * allocated from it is released together by reset_arena or destroy_arena, which
+ * only has to free the chunks. That makes it a good fit for request-scoped
+ * containers: create them with &arena->allocator, and throw the arena away once the
+ * request is done, without destroying the containers first.
+ *
+ * c_arena *new_arena(size_t chunk_size)
+ * INPUT: size_t chunk_size -> bytes to reserve at a time, or 0 for ARENA_DEFAULT_CHUNK
+ * OUTPUT: pointer to the new arena, or NULL if allocation failed
+ * USAGE: c_arena *arena = new_arena(0);
+ * NOTES: Allocations larger than chunk_size get a chunk of their own
+ *
+ * void reset_arena(c_arena *arena)
+ * INPUT: c_arena *arena -> arena to reset
+ * OUTPUT: None
+ * USAGE: reset_arena(arena);
+ * NOTES: Frees every chunk but the first, which is kept for reuse. Anything that
+ * was allocated from the arena is invalid afterwards.
+ *
+ * c_arena *destroy_arena(c_arena *arena)
+ * INPUT: c_arena *arena -> arena to destroy
+ * OUTPUT: NULL
+ * USAGE: arena = destroy_arena(arena);
+ * NOTES:
+ */
+#define ARENA_DEFAULT_CHUNK	(64*1024)
+#define ARENA_ALIGNMENT	16
+
+typedef struct arena_chunk {
+	struct arena_chunk *next;
+	size_t size;
+} arena_chunk;
+
+typedef struct c_arena {
+	c_allocator allocator;
+	arena_chunk *chunks;
+	char *next;
+	char *end;
+	/* The most recent allocation can be grown in place */
+	char *last;
+	size_t chunk_size;
+} c_arena;
+
+/* The chunk header is padded so that the first allocation in a chunk is aligned */
+#define ARENA_HEADER_SIZE	((sizeof(arena_chunk) + ARENA_ALIGNMENT - 1) & ~((size_t) ARENA_ALIGNMENT - 1))
+
+static inline size_t arena_align(size_t bytes) {
+	return (bytes + ARENA_ALIGNMENT - 1) & ~((size_t) ARENA_ALIGNMENT - 1);
+}
+
+void *arena_allocate(void *context, size_t bytes) {
+	c_arena *arena = (c_arena *) context;
+	size_t needed = arena_align(bytes);
+	if (arena->next == NULL || (size_t) (arena->end - arena->next) < needed) {
+		size_t size = (needed > arena->chunk_size) ? needed : arena->chunk_size;
+		arena_chunk *chunk = (arena_chunk *) malloc(ARENA_HEADER_SIZE + size);
+		if (chunk == NULL)
+			return NULL;
+		chunk->next = arena->chunks;
+		chunk->size = size;
+		arena->chunks = chunk;
+		arena->next = (char *) chunk + ARENA_HEADER_SIZE;
+		arena->end = arena->next + size;
+	}
+	arena->last = arena->next;
+	arena->next += needed;
+	return arena->last;
+}
+
+void *arena_reallocate(void *context, void *ptr, size_t old_bytes, size_t new_bytes) {
+	c_arena *arena = (c_arena *) context;
+	void *temp = NULL;
+	if (ptr == NULL)
+		return arena_allocate(context, new_bytes);
+	/* Grow or shrink in place when ptr is the last thing handed out */
+	if ((char *) ptr == arena->last &&
+		(size_t) (arena->end - arena->last) >= arena_align(new_bytes)) {
+		arena->next = arena->last + arena_align(new_bytes);
+		return ptr;
+	}
+	if (new_bytes <= old_bytes)
+		return ptr;
+	temp = arena_allocate(context, new_bytes);
+	if (temp == NULL)
+		return NULL;
+	memcpy(temp, ptr, old_bytes);
+	return temp;
+}
+
+c_arena *new_arena(size_t chunk_size) {
+	c_arena *arena = (c_arena *) calloc(1, sizeof(c_arena));
+	if (arena == NULL)
+		return NULL;
+	arena->chunk_size = (chunk_size == 0) ? ARENA_DEFAULT_CHUNK : arena_align(chunk_size);
+	arena->allocator.allocate = &arena_allocate;
+	arena->allocator.reallocate = &arena_reallocate;
+	arena->allocator.deallocate = NULL;
+	arena->allocator.context = arena;
+	return arena;
+}
+
+void reset_arena(c_arena *arena) {
+	arena_chunk *chunk = arena->chunks;
+	if (chunk == NULL)
+		return;
+	/* The first chunk allocated is at the end of the list */
+	while (chunk->next != NULL) {
+		arena_chunk *next = chunk->next;
+		free(chunk);
+		chunk = next;
+	}
+	arena->chunks = chunk;
+	arena->next = (char *) chunk + ARENA_HEADER_SIZE;
+	arena->end = arena->next + chunk->size;
+	arena->last = NULL;
+}
+
+c_arena *destroy_arena(c_arena *arena) {
+	if (arena == NULL)
+		return NULL;
+	while (arena->chunks != NULL) {
+		arena_chunk *next = arena->chunks->next;
+		free(arena->chunks);
+		arena->chunks = next;
+	}
+	free(arena);
+	return NULL;
+}
+
+#endif
@@ -0,0 +1,207 @@
+#ifndef BENCH_H
+#define BENCH_H
+#ifndef __cplusplus
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#else
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#endif
+#include <sys/resource.h>
+#include <unistd.h>
+#include "allocator.h"
+
+/* Shared pieces of the bench_* programs.
+ *
+ * Every workload is run at sizes from BENCH_MIN_SIZE up to the largest size asked
+ * for, going up by a factor of ten. Keys and indices come from a xorshift generator
+ * with a fixed seed, so every run does exactly the same work and two builds can be
+ * compared against each other.
+ *
+ * The containers are created with counting_allocator, which counts the calls made to
+ * it on the way to malloc. Each result has the number of allocations, reallocations
+ * and frees made during that workload alone.
+ *
+ * Peak RSS is the high water mark of the whole process so far, as reported by
+ * getrusage. Sizes run smallest to largest, so it is the peak for the largest
+ * container built up to that point.
+ *
+ * Usage: bench_X [-n largest_size] [-j results.json]
+ * Results are printed as a table on stdout. -j also writes them to a file as a
+ * JSON array with one object per result.
+ */
+
+#define BENCH_MIN_SIZE	1000
+#define BENCH_MAX_SIZE	10000000
+#define BENCH_SEED	0x9e3779b97f4a7c15ULL
+
+typedef struct alloc_counts {
+	size_t allocations;
+	size_t reallocations;
+	size_t frees;
+	size_t bytes;
+} alloc_counts;
+
+static alloc_counts bench_counts;
+
+static void *counting_allocate(void *context, size_t bytes) {
+	(void) context;
+	++bench_counts.allocations;
+	bench_counts.bytes += bytes;
+	return malloc(bytes);
+}
+
+static void *counting_reallocate(void *context, void *ptr, size_t old_bytes, size_t new_bytes) {
+	(void) context;
+	++bench_counts.reallocations;
+	if (new_bytes > old_bytes)
+		bench_counts.bytes += new_bytes - old_bytes;
+	return realloc(ptr, new_bytes);
+}
+
+static void counting_deallocate(void *context, void *ptr) {
+	(void) context;
+	++bench_counts.frees;
+	free(ptr);
+}
+
+static const c_allocator counting_allocator = {
+	&counting_allocate,
+	&counting_reallocate,
+	&counting_deallocate,
+	NULL
+};
+
+/* Results are added to this so that the compiler can't drop the work being timed */
+static volatile uint64_t bench_sink;
+
+static inline uint64_t bench_random(uint64_t *state) {
+	uint64_t x = *state;
+	x ^= x >> 12;
+	x ^= x << 25;
+	x ^= x >> 27;
+	*state = x;
+	return x * 0x2545f4914f6cdd1dULL;
+}
+
+/* 0 through n - 1 in a shuffled order */
+static inline long *bench_permutation(size_t n, uint64_t seed) {
+	long *keys = (long *) malloc(n*sizeof(long));
+	uint64_t state = seed;
+	if (keys == NULL) {
+		fprintf(stderr, "Unable to allocate %ld keys\n", n);
+		exit(1);
+	}
+	for (size_t i = 0; i < n; ++i)
+		keys[i] = (long) i;
+	for (size_t i = n - 1; i > 0; --i) {
+		size_t j = bench_random(&state) % (i + 1);
+		long temp = keys[i];
+		keys[i] = keys[j];
+		keys[j] = temp;
+	}
+	return keys;
+}
+
+static inline uint64_t bench_now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec*1000000000ULL + (uint64_t) ts.tv_nsec;
+}
+
+static inline long bench_peak_rss_kb() {
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return usage.ru_maxrss;
+}
+
+typedef struct bench_options {
+	const char *container;
+	size_t max_size;
+	FILE *json;
+	size_t results;
+} bench_options;
+
+typedef struct bench_timer {
+	const char *workload;
+	size_t size;
+	uint64_t start;
+} bench_timer;
+
+static void bench_usage(const char *program) {
+	fprintf(stderr, "Usage: %s [-n largest_size] [-j results.json]\n", program);
+	exit(1);
+}
+
+static bench_options bench_parse(const char *container, int argc, char *argv[]) {
+	bench_options options = { container, BENCH_MAX_SIZE, NULL, 0 };
+	int opt = 0;
+	while ((opt = getopt(argc, argv, "n:j:")) != -1) {
+		if (opt == 'n')
+			options.max_size = (size_t) strtod(optarg, NULL);
+		else if (opt == 'j') {
+			options.json = fopen(optarg, "w");
+			if (options.json == NULL) {
+				perror(optarg);
+				exit(1);
+			}
+		}
+		else
+			bench_usage(argv[0]);
+	}
+	if (options.max_size < BENCH_MIN_SIZE)
+		options.max_size = BENCH_MIN_SIZE;
+	printf("%-10s %-14s %10s %10s %10s %14s %10s %8s %8s %8s\n", "container", "workload",
+			"size", "ops", "ns/op", "ops/sec", "peak KB", "allocs", "reallocs", "frees");
+	if (options.json != NULL)
+		fprintf(options.json, "[\n");
+	return options;
+}
+
+/* Call right before the timed loop */
+static inline bench_timer bench_start(const char *workload, size_t size) {
+	bench_timer timer;
+	memset(&bench_counts, 0, sizeof(alloc_counts));
+	timer.workload = workload;
+	timer.size = size;
+	timer.start = bench_now();
+	return timer;
+}
+
+/* Call right after the timed loop. ops is the number of operations it did */
+static void bench_stop(bench_options *options, bench_timer *timer, size_t ops) {
+	uint64_t elapsed = bench_now() - timer->start;
+	alloc_counts counts = bench_counts;
+	double ns = (ops == 0) ? 0.0 : (double) elapsed / (double) ops;
+	double rate = (elapsed == 0) ? 0.0 : (double) ops * 1e9 / (double) elapsed;
+	long rss = bench_peak_rss_kb();
+	printf("%-10s %-14s %10ld %10ld %10.2f %14.0f %10ld %8ld %8ld %8ld\n", options->container,
+			timer->workload, timer->size, ops, ns, rate, rss, counts.allocations,
+			counts.reallocations, counts.frees);
+	fflush(stdout);
+	if (options->json != NULL) {
+		fprintf(options->json, "%s  {\"container\": \"%s\", \"workload\": \"%s\", \"size\": %ld, "
+				"\"ops\": %ld, \"ns_per_op\": %.3f, \"ops_per_sec\": %.0f, \"peak_rss_kb\": %ld, "
+				"\"allocations\": %ld, \"reallocations\": %ld, \"frees\": %ld, \"bytes_allocated\": %ld}",
+				(options->results == 0) ? "" : ",\n", options->container, timer->workload,
+				timer->size, ops, ns, rate, rss, counts.allocations, counts.reallocations,
+				counts.frees, counts.bytes);
+	}
+	++options->results;
+}
+
+static void bench_finish(bench_options *options) {
+	if (options->json != NULL) {
+		fprintf(options->json, "\n]\n");
+		fclose(options->json);
+		options->json = NULL;
+	}
+}
+
+#endif
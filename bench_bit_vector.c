@@ -0,0 +1,80 @@
+#ifndef __cplusplus
+#include <stdio.h>
+#include <stdlib.h>
+#else
+#include <cstdio>
+#include <cstdlib>
+#endif
+#include "c_vector.h"
+#include "bit_vector.h"
+#include "error.h"
+#include "bench.h"
+
+/* bool is a macro, so it can't be pasted into a type name */
+typedef bool flag;
+define_vector(flag)
+
+/* About one flag in eight is set, as in a membership bitmap */
+#define bench_flag(i)	((((uint32_t) (i) * 0x9e3779b1u) >> 29) == 0)
+
+static void run_size(bench_options *options, size_t n) {
+	c_vector(flag) *flags = new_c_vector_with(flag, 0, &counting_allocator);
+	c_bit_vector *bits = new_c_bit_vector_with(0, &counting_allocator);
+	c_bit_vector *other = new_c_bit_vector_with(0, &counting_allocator);
+	uint64_t sum = 0;
+	bench_timer timer;
+
+	timer = bench_start("bool_push", n);
+	for (size_t i = 0; i < n; ++i)
+		c_vector_push(flag, flags, bench_flag(i));
+	bench_stop(options, &timer, n);
+
+	timer = bench_start("bit_push", n);
+	for (size_t i = 0; i < n; ++i)
+		c_bit_vector_push(bits, bench_flag(i));
+	bench_stop(options, &timer, n);
+
+	for (size_t i = 0; i < n; ++i)
+		c_bit_vector_push(other, i % 3 == 0);
+
+	/* Counting set flags */
+	timer = bench_start("bool_count", n);
+	for (size_t i = 0; i < n; ++i)
+		sum += flags->ops->value_at(flags, i);
+	bench_stop(options, &timer, n);
+
+	timer = bench_start("bit_popcount", n);
+	sum += bits->ops->popcount(bits);
+	bench_stop(options, &timer, n);
+
+	/* Visiting every set flag */
+	timer = bench_start("bool_scan_set", n);
+	for (size_t i = 0; i < n; ++i) {
+		if (c_vector_at(flag, flags, i))
+			sum += i;
+	}
+	bench_stop(options, &timer, n);
+
+	timer = bench_start("bit_scan_set", n);
+	for (size_t i = bits->ops->find_first_set(bits, 0); i < bits->curr_index; i = bits->ops->find_first_set(bits, i + 1))
+		sum += i;
+	bench_stop(options, &timer, n);
+
+	timer = bench_start("bit_and", n);
+	bits->ops->and_vector(bits, other);
+	bench_stop(options, &timer, n);
+
+	sum += bits->ops->popcount(bits);
+	bench_sink += sum;
+	flags = flags->ops->destroy_vector(flags);
+	bits = bits->ops->destroy_vector(bits);
+	other = other->ops->destroy_vector(other);
+}
+
+int main(int argc, char *argv[]) {
+	bench_options options = bench_parse("bit_vector", argc, argv);
+	for (size_t n = BENCH_MIN_SIZE; n <= options.max_size; n *= 10)
+		run_size(&options, n);
+	bench_finish(&options);
+	return 0;
+}
@@ -0,0 +1,56 @@
+#ifndef __cplusplus
+#include <stdio.h>
+#include <stdlib.h>
+#else
+#include <cstdio>
+#include <cstdlib>
+#endif
+#include "chunked_vector.h"
+#include "error.h"
+#include "bench.h"
+
+define_chunked_vector(long)
+
+static void run_size(bench_options *options, size_t n) {
+	long *lookups = bench_permutation(n, BENCH_SEED + n);
+	chunked_vector(long) *vector = new_chunked_vector_with(long, &counting_allocator);
+	generic_iterator *giter = NULL;
+	chunked_iterator(long) *iter = NULL;
+	uint64_t sum = 0;
+	bench_timer timer;
+
+	timer = bench_start("seq_insert", n);
+	for (size_t i = 0; i < n; ++i)
+		chunked_vector_push(long, vector, (long) i);
+	bench_stop(options, &timer, n);
+
+	timer = bench_start("lookup_hit", n);
+	for (size_t i = 0; i < n; ++i)
+		sum += chunked_vector_at(long, vector, lookups[i]);
+	bench_stop(options, &timer, n);
+
+	giter = new_chunked_iterator(long, vector);
+	iter = (chunked_iterator(long) *) giter;
+	timer = bench_start("iterate", n);
+	for (giter->first(giter); !giter->end(giter); giter->next(giter))
+		sum += *iter->value;
+	bench_stop(options, &timer, n);
+	giter = giter->destroy_iterator(giter);
+
+	timer = bench_start("delete", n);
+	for (size_t i = 0; i < n; ++i)
+		vector->ops->remove_top(vector);
+	bench_stop(options, &timer, n);
+
+	bench_sink += sum;
+	vector = vector->ops->destroy_vector(vector);
+	free(lookups);
+}
+
+int main(int argc, char *argv[]) {
+	bench_options options = bench_parse("chunked", argc, argv);
+	for (size_t n = BENCH_MIN_SIZE; n <= options.max_size; n *= 10)
+		run_size(&options, n);
+	bench_finish(&options);
+	return 0;
+}
@@ -0,0 +1,139 @@
+#ifndef __cplusplus
+#include <stdio.h>
+#include <stdlib.h>
+#else
+#include <cstdio>
+#include <cstdlib>
+#endif
+#include "c_map.h"
+#include "error.h"
+#include "bench.h"
+
+define_map(long, long)
+
+/* Same keys, but the tree keeps subtree counts for rank and select */
+typedef long counted_key;
+define_map_counted(counted_key, long)
+
+#define BENCH_RANGE	100
+
+/* Keys in the map are even, so odd keys are always misses */
+static void run_size(bench_options *options, size_t n) {
+	long *keys = bench_permutation(n, BENCH_SEED + n);
+	long *lookups = bench_permutation(n, BENCH_SEED + 2*n);
+	c_map(long, long) *map = new_c_map_with(long, long, &counting_allocator);
+	generic_iterator *giter = NULL;
+	map_iterator(long, long) *iter = NULL;
+	uint64_t state = BENCH_SEED;
+	uint64_t sum = 0;
+	bench_timer timer;
+
+	timer = bench_start("seq_insert", n);
+	for (size_t i = 0; i < n; ++i)
+		map->insert(map, 2*(long) i, (long) i);
+	bench_stop(options, &timer, n);
+	map = map->destroy_map(map);
+
+	map = new_c_map_with(long, long, &counting_allocator);
+	timer = bench_start("rand_insert", n);
+	for (size_t i = 0; i < n; ++i)
+		map->insert(map, 2*keys[i], keys[i]);
+	bench_stop(options, &timer, n);
+
+	timer = bench_start("lookup_hit", n);
+	for (size_t i = 0; i < n; ++i)
+		sum += map->get_value(map, 2*lookups[i]);
+	bench_stop(options, &timer, n);
+
+	timer = bench_start("lookup_miss", n);
+	for (size_t i = 0; i < n; ++i)
+		sum += map->is_key(map, 2*lookups[i] + 1);
+	bench_stop(options, &timer, n);
+
+	giter = new_map_iterator(long, long, map);
+	iter = (map_iterator(long, long) *) giter;
+	timer = bench_start("iterate", n);
+	for (giter->first(giter); !giter->end(giter); giter->next(giter))
+		sum += *iter->value;
+	bench_stop(options, &timer, n);
+	giter = giter->destroy_iterator(giter);
+
+	/* Ranges of about BENCH_RANGE keys starting anywhere, n keys visited in all */
+	timer = bench_start("range_scan", n);
+	for (size_t i = 0; i < n; i += BENCH_RANGE) {
+		long low = 2*lookups[i] - 1;
+		giter = new_map_range_iterator(long, long, map, low, low + 2*BENCH_RANGE);
+		iter = (map_iterator(long, long) *) giter;
+		for (; !giter->end(giter); giter->next(giter))
+			sum += *iter->value;
+		giter = giter->destroy_iterator(giter);
+	}
+	bench_stop(options, &timer, n);
+
+	/* The same ranges the old way, searching from the root for every key */
+	timer = bench_start("range_next_key", n);
+	for (size_t i = 0; i < n; i += BENCH_RANGE) {
+		long low = 2*lookups[i] - 1, key = 0;
+		if (!map->lower_bound(map, low, &key))
+			continue;
+		for (size_t k = 0; k < BENCH_RANGE && key < low + 2*BENCH_RANGE; ++k) {
+			sum += map->get_value(map, key);
+			key = map->tree->next_key(map->tree, key);
+			if (key == 0)
+				break;
+		}
+	}
+	bench_stop(options, &timer, n);
+
+	/* 80% lookups, 10% inserts and 10% deletes of odd keys */
+	timer = bench_start("mixed", n);
+	for (size_t i = 0; i < n; ++i) {
+		uint64_t r = bench_random(&state);
+		long key = 2*(long) ((r >> 8) % n);
+		switch (r % 10) {
+		case 8:
+			map->insert(map, key + 1, key);
+			break;
+		case 9:
+			map->delete_pair(map, key + 1);
+			break;
+		default:
+			sum += map->get_value(map, key);
+		}
+	}
+	bench_stop(options, &timer, n);
+
+	timer = bench_start("delete", n);
+	for (size_t i = 0; i < n; ++i)
+		map->delete_pair(map, 2*keys[i]);
+	bench_stop(options, &timer, n);
+
+	/* What the counts cost an insert, and what they buy a rank or select */
+	c_map(counted_key, long) *counted = new_c_map_with(counted_key, long, &counting_allocator);
+	timer = bench_start("counted_insert", n);
+	for (size_t i = 0; i < n; ++i)
+		counted->insert(counted, 2*keys[i], keys[i]);
+	bench_stop(options, &timer, n);
+
+	timer = bench_start("rank_select", n);
+	for (size_t i = 0; i < n; ++i) {
+		counted_key key = 0;
+		counted->select(counted, (size_t) lookups[i], &key);
+		sum += counted->rank(counted, key + 1);
+	}
+	bench_stop(options, &timer, n);
+	counted = counted->destroy_map(counted);
+
+	bench_sink += sum;
+	map = map->destroy_map(map);
+	free(keys);
+	free(lookups);
+}
+
+int main(int argc, char *argv[]) {
+	bench_options options = bench_parse("c_map", argc, argv);
+	for (size_t n = BENCH_MIN_SIZE; n <= options.max_size; n *= 10)
+		run_size(&options, n);
+	bench_finish(&options);
+	return 0;
+}
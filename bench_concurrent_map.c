@@ -0,0 +1,139 @@
+#ifndef __cplusplus
+#include <stdio.h>
+#include <stdlib.h>
+#else
+#include <cstdio>
+#include <cstdlib>
+#endif
+#include <pthread.h>
+#include "concurrent_map.h"
+#include "error.h"
+#include "bench.h"
+
+define_concurrent_map(long, long)
+
+#define MAX_THREADS	8
+
+/* Each thread does size / threads operations on a map that starts with size even
+ * keys: 90% lookups, 5% inserts and 5% deletes of odd keys. The c_map is behind one
+ * mutex, which is what sharing a map took before concurrent_map. counting_allocator
+ * isn't thread safe, so these maps use the default allocator and their allocation
+ * counts are always zero.
+ */
+typedef struct client {
+	concurrent_map(long, long) *concurrent;
+	c_map(long, long) *locked;
+	pthread_mutex_t *lock;
+	size_t count;
+	size_t keys;
+	uint64_t seed;
+	uint64_t sum;
+} client;
+
+static void *mix_concurrent(void *arg) {
+	client *self = (client *) arg;
+	uint64_t state = self->seed;
+	for (size_t i = 0; i < self->count; ++i) {
+		uint64_t r = bench_random(&state);
+		long key = 2*(long) ((r >> 8) % self->keys);
+		switch (r % 20) {
+		case 18:
+			self->concurrent->insert(self->concurrent, key + 1, key);
+			break;
+		case 19:
+			self->concurrent->delete_pair(self->concurrent, key + 1);
+			break;
+		default:
+			self->sum += self->concurrent->get_value(self->concurrent, key);
+		}
+	}
+	return NULL;
+}
+
+static void *mix_locked(void *arg) {
+	client *self = (client *) arg;
+	uint64_t state = self->seed;
+	for (size_t i = 0; i < self->count; ++i) {
+		uint64_t r = bench_random(&state);
+		long key = 2*(long) ((r >> 8) % self->keys);
+		pthread_mutex_lock(self->lock);
+		switch (r % 20) {
+		case 18:
+			self->locked->insert(self->locked, key + 1, key);
+			break;
+		case 19:
+			self->locked->delete_pair(self->locked, key + 1);
+			break;
+		default:
+			self->sum += self->locked->get_value(self->locked, key);
+		}
+		pthread_mutex_unlock(self->lock);
+	}
+	return NULL;
+}
+
+static void run_threads(void *(*job)(void *), client *clients, unsigned int threads) {
+	pthread_t ids[MAX_THREADS];
+	for (unsigned int t = 0; t < threads; ++t)
+		pthread_create(&ids[t], NULL, job, &clients[t]);
+	for (unsigned int t = 0; t < threads; ++t)
+		pthread_join(ids[t], NULL);
+}
+
+static void run_size(bench_options *options, size_t n) {
+	static const char *concurrent_names[] = { "sharded_1t", "sharded_2t", "sharded_4t", "sharded_8t" };
+	static const char *locked_names[] = { "mutex_1t", "mutex_2t", "mutex_4t", "mutex_8t" };
+	client clients[MAX_THREADS];
+	pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+	concurrent_map(long, long) *concurrent = new_concurrent_map(long, long, 0);
+	c_map(long, long) *locked = new_c_map(long, long);
+	c_flat_map(long, long) *snapshot = NULL;
+	uint64_t sum = 0;
+	bench_timer timer;
+
+	for (size_t i = 0; i < n; ++i) {
+		concurrent->insert(concurrent, 2*(long) i, (long) i);
+		locked->insert(locked, 2*(long) i, (long) i);
+	}
+
+	for (unsigned int shift = 0, threads = 1; threads <= MAX_THREADS; ++shift, threads *= 2) {
+		for (unsigned int t = 0; t < threads; ++t) {
+			clients[t].concurrent = concurrent;
+			clients[t].locked = locked;
+			clients[t].lock = &lock;
+			clients[t].count = n / threads;
+			clients[t].keys = n;
+			clients[t].seed = BENCH_SEED + t;
+			clients[t].sum = 0;
+		}
+
+		timer = bench_start(concurrent_names[shift], n);
+		run_threads(&mix_concurrent, clients, threads);
+		bench_stop(options, &timer, n);
+
+		timer = bench_start(locked_names[shift], n);
+		run_threads(&mix_locked, clients, threads);
+		bench_stop(options, &timer, n);
+
+		for (unsigned int t = 0; t < threads; ++t)
+			sum += clients[t].sum;
+	}
+
+	timer = bench_start("snapshot", n);
+	snapshot = concurrent->snapshot(concurrent);
+	bench_stop(options, &timer, n);
+
+	sum += snapshot->count;
+	snapshot = snapshot->destroy_map(snapshot);
+	bench_sink += sum;
+	concurrent = concurrent->destroy_map(concurrent);
+	locked = locked->destroy_map(locked);
+}
+
+int main(int argc, char *argv[]) {
+	bench_options options = bench_parse("sharded", argc, argv);
+	for (size_t n = BENCH_MIN_SIZE; n <= options.max_size; n *= 10)
+		run_size(&options, n);
+	bench_finish(&options);
+	return 0;
+}
@@ -0,0 +1,95 @@
+#ifndef __cplusplus
+#include <stdio.h>
+#include <stdlib.h>
+#else
+#include <cstdio>
+#include <cstdlib>
+#endif
+#include <pthread.h>
+#include "c_vector.h"
+#include "concurrent_vector.h"
+#include "error.h"
+#include "bench.h"
+
+define_vector(long)
+define_concurrent_vector(long)
+
+#define MAX_PRODUCERS	8
+
+/* Each producer appends size / threads elements. The c_vector is behind a mutex,
+ * which is what appending to a shared vector took before concurrent_vector.
+ * counting_allocator isn't thread safe, so these vectors use the default allocator
+ * and their allocation counts are always zero.
+ */
+typedef struct producer {
+	concurrent_vector(long) *concurrent;
+	c_vector(long) *locked;
+	pthread_mutex_t *lock;
+	size_t count;
+} producer;
+
+static void *append_concurrent(void *arg) {
+	producer *self = (producer *) arg;
+	for (size_t i = 0; i < self->count; ++i)
+		concurrent_vector_push(long, self->concurrent, (long) i);
+	return NULL;
+}
+
+static void *append_locked(void *arg) {
+	producer *self = (producer *) arg;
+	for (size_t i = 0; i < self->count; ++i) {
+		pthread_mutex_lock(self->lock);
+		c_vector_push(long, self->locked, (long) i);
+		pthread_mutex_unlock(self->lock);
+	}
+	return NULL;
+}
+
+static void run_threads(void *(*job)(void *), producer *producers, unsigned int threads) {
+	pthread_t ids[MAX_PRODUCERS];
+	for (unsigned int t = 0; t < threads; ++t)
+		pthread_create(&ids[t], NULL, job, &producers[t]);
+	for (unsigned int t = 0; t < threads; ++t)
+		pthread_join(ids[t], NULL);
+}
+
+static void run_size(bench_options *options, size_t n) {
+	static const char *concurrent_names[] = { "append_1t", "append_2t", "append_4t", "append_8t" };
+	static const char *locked_names[] = { "mutex_1t", "mutex_2t", "mutex_4t", "mutex_8t" };
+	producer producers[MAX_PRODUCERS];
+	pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+	uint64_t sum = 0;
+	bench_timer timer;
+
+	for (unsigned int shift = 0, threads = 1; threads <= MAX_PRODUCERS; ++shift, threads *= 2) {
+		concurrent_vector(long) *concurrent = new_concurrent_vector(long);
+		c_vector(long) *locked = new_c_vector(long, 0);
+		for (unsigned int t = 0; t < threads; ++t) {
+			producers[t].concurrent = concurrent;
+			producers[t].locked = locked;
+			producers[t].lock = &lock;
+			producers[t].count = n / threads;
+		}
+
+		timer = bench_start(concurrent_names[shift], n);
+		run_threads(&append_concurrent, producers, threads);
+		bench_stop(options, &timer, concurrent_vector_length(long, concurrent));
+
+		timer = bench_start(locked_names[shift], n);
+		run_threads(&append_locked, producers, threads);
+		bench_stop(options, &timer, c_vector_length(long, locked));
+
+		sum += concurrent_vector_at(long, concurrent, 0) + c_vector_at(long, locked, 0);
+		concurrent = concurrent->ops->destroy_vector(concurrent);
+		locked = locked->ops->destroy_vector(locked);
+	}
+	bench_sink += sum;
+}
+
+int main(int argc, char *argv[]) {
+	bench_options options = bench_parse("concurrent", argc, argv);
+	for (size_t n = BENCH_MIN_SIZE; n <= options.max_size; n *= 10)
+		run_size(&options, n);
+	bench_finish(&options);
+	return 0;
+}
@@ -0,0 +1,82 @@
+#ifndef __cplusplus
+#include <stdio.h>
+#include <stdlib.h>
+#else
+#include <cstdio>
+#include <cstdlib>
+#endif
+#include "flat_map.h"
+#include "error.h"
+#include "bench.h"
+
+define_flat_map(long, long)
+
+/* insert and delete_pair in the middle move half the map, so only this many are timed */
+#define RAND_INSERT_OPS	1000
+
+/* Keys in the map are even, so odd keys are always misses */
+static void run_size(bench_options *options, size_t n) {
+	long *keys = bench_permutation(n, BENCH_SEED + n);
+	long *lookups = bench_permutation(n, BENCH_SEED + 2*n);
+	long *values = (long *) malloc(n*sizeof(long));
+	c_flat_map(long, long) *map = new_c_flat_map_with(long, long, &counting_allocator);
+	uint64_t state = BENCH_SEED;
+	uint64_t sum = 0;
+	size_t ops = 0;
+	bench_timer timer;
+
+	timer = bench_start("seq_insert", n);
+	for (size_t i = 0; i < n; ++i)
+		map->insert(map, 2*(long) i, (long) i);
+	bench_stop(options, &timer, n);
+	map = map->destroy_map(map);
+
+	for (size_t i = 0; i < n; ++i) {
+		values[i] = keys[i];
+		keys[i] *= 2;
+	}
+	map = new_c_flat_map_with(long, long, &counting_allocator);
+	timer = bench_start("build", n);
+	map->build(map, keys, values, n);
+	bench_stop(options, &timer, n);
+
+	timer = bench_start("lookup_hit", n);
+	for (size_t i = 0; i < n; ++i)
+		sum += map->get_value(map, 2*lookups[i]);
+	bench_stop(options, &timer, n);
+
+	timer = bench_start("lookup_miss", n);
+	for (size_t i = 0; i < n; ++i)
+		sum += map->is_key(map, 2*lookups[i] + 1);
+	bench_stop(options, &timer, n);
+
+	timer = bench_start("iterate", n);
+	for (size_t i = 0; i < map->count; ++i)
+		sum += map->values[i];
+	bench_stop(options, &timer, n);
+
+	ops = (n < RAND_INSERT_OPS) ? n : RAND_INSERT_OPS;
+	timer = bench_start("rand_insert", n);
+	for (size_t i = 0; i < ops; ++i)
+		map->insert(map, 2*(long) (bench_random(&state) % n) + 1, (long) i);
+	bench_stop(options, &timer, ops);
+
+	timer = bench_start("delete", n);
+	for (size_t i = 0; i < ops; ++i)
+		map->delete_pair(map, keys[i]);
+	bench_stop(options, &timer, ops);
+
+	bench_sink += sum;
+	map = map->destroy_map(map);
+	free(keys);
+	free(lookups);
+	free(values);
+}
+
+int main(int argc, char *argv[]) {
+	bench_options options = bench_parse("c_flat_map", argc, argv);
+	for (size_t n = BENCH_MIN_SIZE; n <= options.max_size; n *= 10)
+		run_size(&options, n);
+	bench_finish(&options);
+	return 0;
+}
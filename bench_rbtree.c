@@ -0,0 +1,101 @@
+#ifndef __cplusplus
+#include <stdio.h>
+#include <stdlib.h>
+#else
+#include <cstdio>
+#include <cstdlib>
+#endif
+#include "red_black_tree.h"
+#include "error.h"
+#include "bench.h"
+
+define_rbtree(long, long)
+
+/* Keys in the tree are even, so odd keys are always misses */
+static void run_size(bench_options *options, size_t n) {
+	long *keys = bench_permutation(n, BENCH_SEED + n);
+	long *lookups = bench_permutation(n, BENCH_SEED + 2*n);
+	rb_tree(long, long) *tree = new_rbtree_with(long, long, &counting_allocator);
+	uint64_t state = BENCH_SEED;
+	uint64_t sum = 0;
+	bench_timer timer;
+
+	timer = bench_start("seq_insert", n);
+	for (size_t i = 0; i < n; ++i)
+		tree->insert(tree, 2*(long) i, (long) i);
+	bench_stop(options, &timer, n);
+	tree = tree->destroy_rbtree(tree);
+
+	/* The same keys, from arrays that are already sorted */
+	long *sorted_keys = (long *) malloc(n*sizeof(long));
+	long *sorted_values = (long *) malloc(n*sizeof(long));
+	for (size_t i = 0; i < n; ++i) {
+		sorted_keys[i] = 2*(long) i;
+		sorted_values[i] = (long) i;
+	}
+	tree = new_rbtree_with(long, long, &counting_allocator);
+	timer = bench_start("sorted_build", n);
+	tree->build_from_sorted(tree, sorted_keys, sorted_values, n);
+	bench_stop(options, &timer, n);
+	sum += tree->get_value(tree, 2*lookups[0]);
+	tree = tree->destroy_rbtree(tree);
+	free(sorted_keys);
+	free(sorted_values);
+
+	tree = new_rbtree_with(long, long, &counting_allocator);
+	timer = bench_start("rand_insert", n);
+	for (size_t i = 0; i < n; ++i)
+		tree->insert(tree, 2*keys[i], keys[i]);
+	bench_stop(options, &timer, n);
+
+	timer = bench_start("lookup_hit", n);
+	for (size_t i = 0; i < n; ++i)
+		sum += tree->get_value(tree, 2*lookups[i]);
+	bench_stop(options, &timer, n);
+
+	timer = bench_start("lookup_miss", n);
+	for (size_t i = 0; i < n; ++i)
+		sum += tree->check_key(tree, 2*lookups[i] + 1);
+	bench_stop(options, &timer, n);
+
+	timer = bench_start("iterate", n);
+	for (node(long, long) *node = first_node_long_long(tree); node != NULL; node = next_node_long_long(node))
+		sum += node->value;
+	bench_stop(options, &timer, n);
+
+	/* 80% lookups, 10% inserts and 10% deletes of odd keys */
+	timer = bench_start("mixed", n);
+	for (size_t i = 0; i < n; ++i) {
+		uint64_t r = bench_random(&state);
+		long key = 2*(long) ((r >> 8) % n);
+		switch (r % 10) {
+		case 8:
+			tree->insert(tree, key + 1, key);
+			break;
+		case 9:
+			tree->delete_pair(tree, key + 1);
+			break;
+		default:
+			sum += tree->get_value(tree, key);
+		}
+	}
+	bench_stop(options, &timer, n);
+
+	timer = bench_start("delete", n);
+	for (size_t i = 0; i < n; ++i)
+		tree->delete_pair(tree, 2*keys[i]);
+	bench_stop(options, &timer, n);
+
+	bench_sink += sum;
+	tree = tree->destroy_rbtree(tree);
+	free(keys);
+	free(lookups);
+}
+
+int main(int argc, char *argv[]) {
+	bench_options options = bench_parse("rb_tree", argc, argv);
+	for (size_t n = BENCH_MIN_SIZE; n <= options.max_size; n *= 10)
+		run_size(&options, n);
+	bench_finish(&options);
+	return 0;
+}
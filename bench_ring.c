@@ -0,0 +1,114 @@
+#ifndef __cplusplus
+#include <stdio.h>
+#include <stdlib.h>
+#else
+#include <cstdio>
+#include <cstdlib>
+#endif
+#include <pthread.h>
+#include <sched.h>
+#include "ring.h"
+#include "error.h"
+#include "bench.h"
+
+define_vector(long)
+define_ring(long)
+
+#define RING_BATCH	64
+
+/* The SPSC ring is small on purpose, so the producer and consumer keep meeting */
+#define SPSC_CAPACITY	1024
+
+typedef struct pipe_job {
+	c_ring(long) *ring;
+	size_t count;
+} pipe_job;
+
+static void *produce(void *arg) {
+	pipe_job *job = (pipe_job *) arg;
+	long batch[RING_BATCH];
+	size_t next = 0;
+	while (next < job->count) {
+		size_t count = (job->count - next < RING_BATCH) ? job->count - next : RING_BATCH;
+		for (size_t i = 0; i < count; ++i)
+			batch[i] = (long) (next + i);
+		count = job->ring->ops->enqueue(job->ring, batch, count);
+		/* Spinning on a full ring would hold up the consumer when they share a core */
+		if (count == 0)
+			sched_yield();
+		next += count;
+	}
+	return NULL;
+}
+
+static void run_size(bench_options *options, size_t n) {
+	c_ring(long) *ring = new_c_ring_with(long, 0, &counting_allocator);
+	long batch[RING_BATCH];
+	long value = 0;
+	uint64_t sum = 0;
+	bench_timer timer;
+	pipe_job job;
+	pthread_t producer;
+
+	timer = bench_start("push_back", n);
+	for (size_t i = 0; i < n; ++i)
+		c_ring_push(long, ring, (long) i);
+	bench_stop(options, &timer, n);
+
+	timer = bench_start("pop_front", n);
+	while (c_ring_pop(long, ring, &value) == success)
+		sum += value;
+	bench_stop(options, &timer, n);
+
+	/* A queue that stays short, the way one between two pipeline stages does */
+	timer = bench_start("push_pop", n);
+	for (size_t i = 0; i < n; ++i) {
+		c_ring_push(long, ring, (long) i);
+		if (i % 4 == 3) {
+			for (int j = 0; j < 4; ++j) {
+				c_ring_pop(long, ring, &value);
+				sum += value;
+			}
+		}
+	}
+	bench_stop(options, &timer, n);
+	while (c_ring_pop(long, ring, &value) == success)
+		;
+
+	timer = bench_start("batch", n);
+	for (size_t i = 0; i < n; i += RING_BATCH) {
+		for (size_t j = 0; j < RING_BATCH; ++j)
+			batch[j] = (long) (i + j);
+		ring->ops->enqueue(ring, batch, RING_BATCH);
+		ring->ops->dequeue(ring, batch, RING_BATCH);
+		sum += batch[0];
+	}
+	bench_stop(options, &timer, n);
+	ring = ring->ops->destroy_ring(ring);
+
+	job.ring = new_c_ring_spsc(long, SPSC_CAPACITY);
+	job.count = n;
+	timer = bench_start("spsc_pipe", n);
+	pthread_create(&producer, NULL, &produce, &job);
+	for (size_t received = 0; received < n; ) {
+		size_t count = job.ring->ops->dequeue(job.ring, batch, RING_BATCH);
+		if (count == 0)
+			sched_yield();
+		for (size_t i = 0; i < count; ++i)
+			sum += batch[i];
+		received += count;
+	}
+	pthread_join(producer, NULL);
+	bench_stop(options, &timer, n);
+	job.ring = job.ring->ops->destroy_ring(job.ring);
+
+	bench_sink += sum;
+}
+
+int main(int argc, char *argv[]) {
+	bench_options options = bench_parse("ring", argc, argv);
+	for (size_t n = BENCH_MIN_SIZE; n <= options.max_size; n *= 10)
+		run_size(&options, n);
+	bench_finish(&options);
+	return 0;
+}
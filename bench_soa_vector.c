@@ -0,0 +1,81 @@
+#ifndef __cplusplus
+#include <stdio.h>
+#include <stdlib.h>
+#else
+#include <cstdio>
+#include <cstdlib>
+#endif
+#include "c_vector.h"
+#include "soa_vector.h"
+#include "error.h"
+#include "bench.h"
+
+/* The same record stored row by row in a c_vector and column by column */
+typedef struct particle {
+	double x;
+	double y;
+	double z;
+	double mass;
+	long id;
+} particle;
+
+define_vector(particle)
+define_soa_vector(particle, (double, x), (double, y), (double, z), (double, mass), (long, id))
+
+static void run_size(bench_options *options, size_t n) {
+	c_vector(particle) *rows = new_c_vector_with(particle, 0, &counting_allocator);
+	soa_vector(particle) *columns = new_soa_vector_with(particle, 0, &counting_allocator);
+	double sum = 0.0;
+	bench_timer timer;
+
+	timer = bench_start("aos_push", n);
+	for (size_t i = 0; i < n; ++i) {
+		particle value = { (double) i, 1.0, 2.0, 0.5, (long) i };
+		c_vector_push(particle, rows, value);
+	}
+	bench_stop(options, &timer, n);
+
+	timer = bench_start("soa_push", n);
+	for (size_t i = 0; i < n; ++i) {
+		soa_row(particle) value = { (double) i, 1.0, 2.0, 0.5, (long) i };
+		soa_vector_push(particle, columns, value);
+	}
+	bench_stop(options, &timer, n);
+
+	/* Reading one field of every record */
+	timer = bench_start("aos_scan", n);
+	for (size_t i = 0; i < n; ++i)
+		sum += rows->data[i].x;
+	bench_stop(options, &timer, n);
+
+	timer = bench_start("soa_scan", n);
+	const double *xs = soa_vector_column(columns, x);
+	for (size_t i = 0; i < n; ++i)
+		sum += xs[i];
+	bench_stop(options, &timer, n);
+
+	/* Updating one field from another */
+	timer = bench_start("aos_update", n);
+	for (size_t i = 0; i < n; ++i)
+		rows->data[i].x += rows->data[i].mass;
+	bench_stop(options, &timer, n);
+
+	timer = bench_start("soa_update", n);
+	double *x = soa_vector_column(columns, x);
+	const double *mass = soa_vector_column(columns, mass);
+	for (size_t i = 0; i < n; ++i)
+		x[i] += mass[i];
+	bench_stop(options, &timer, n);
+
+	bench_sink += (uint64_t) sum + (uint64_t) rows->data[n - 1].x + (uint64_t) x[n - 1];
+	rows = rows->ops->destroy_vector(rows);
+	columns = columns->ops->destroy_vector(columns);
+}
+
+int main(int argc, char *argv[]) {
+	bench_options options = bench_parse("soa", argc, argv);
+	for (size_t n = BENCH_MIN_SIZE; n <= options.max_size; n *= 10)
+		run_size(&options, n);
+	bench_finish(&options);
+	return 0;
+}
@@ -0,0 +1,133 @@
+/* For mremap */
+#define _GNU_SOURCE
+#ifndef __cplusplus
+#include <stdio.h>
+#include <stdlib.h>
+#else
+#include <cstdio>
+#include <cstdlib>
+#endif
+#include "c_vector.h"
+#include "vector_kernels.h"
+#include "vector_sort.h"
+#include "vector_mmap.h"
+#include "error.h"
+#include "bench.h"
+
+define_vector(long)
+define_vector_kernels(long)
+define_vector_sort(long)
+define_vector_mmap(long)
+
+/* insert_range in the middle moves half the vector, so only this many are timed */
+#define RAND_INSERT_OPS	1000
+#define MAPPED_PATH	"bench_vector.vec"
+/* A miss and a sum are linear scans, so the number of scans shrinks as the vector grows */
+#define SCAN_ELEMENTS	10000000
+
+static void run_size(bench_options *options, size_t n) {
+	long *lookups = bench_permutation(n, BENCH_SEED + n);
+	c_vector(long) *vector = new_c_vector_with(long, 0, &counting_allocator);
+	generic_iterator *giter = NULL;
+	vector_iterator(long) *iter = NULL;
+	uint64_t state = BENCH_SEED;
+	uint64_t sum = 0;
+	size_t ops = 0;
+	bench_timer timer;
+
+	timer = bench_start("seq_insert", n);
+	for (size_t i = 0; i < n; ++i)
+		c_vector_push(long, vector, (long) i);
+	bench_stop(options, &timer, n);
+
+	timer = bench_start("lookup_hit", n);
+	for (size_t i = 0; i < n; ++i)
+		sum += c_vector_at(long, vector, lookups[i]);
+	bench_stop(options, &timer, n);
+
+	ops = (SCAN_ELEMENTS / n > 0) ? SCAN_ELEMENTS / n : 1;
+	timer = bench_start("lookup_miss", n);
+	for (size_t i = 0; i < ops; ++i)
+		sum += c_vector_find(long, vector, -1);
+	bench_stop(options, &timer, ops);
+
+	timer = bench_start("sum", n);
+	for (size_t i = 0; i < ops; ++i)
+		sum += c_vector_sum(long, vector);
+	bench_stop(options, &timer, ops);
+
+	giter = new_vector_iterator(long, vector);
+	iter = (vector_iterator(long) *) giter;
+	timer = bench_start("iterate", n);
+	for (giter->first(giter); !giter->end(giter); giter->next(giter))
+		sum += iter->current(iter);
+	bench_stop(options, &timer, n);
+	giter = giter->destroy_iterator(giter);
+
+	/* 80% reads, 10% pushes and 10% pops, so the length stays close to n */
+	timer = bench_start("mixed", n);
+	for (size_t i = 0; i < n; ++i) {
+		uint64_t r = bench_random(&state);
+		switch (r % 10) {
+		case 8:
+			c_vector_push(long, vector, (long) i);
+			break;
+		case 9:
+			vector->ops->remove_top(vector);
+			break;
+		default:
+			sum += c_vector_at(long, vector, (r >> 8) % c_vector_length(long, vector));
+		}
+	}
+	bench_stop(options, &timer, n);
+
+	for (size_t i = 0; i < c_vector_length(long, vector); ++i)
+		vector->data[i] = (long) bench_random(&state);
+	timer = bench_start("sort", c_vector_length(long, vector));
+	c_vector_sort(long, vector);
+	bench_stop(options, &timer, c_vector_length(long, vector));
+
+	ops = (n < RAND_INSERT_OPS) ? n : RAND_INSERT_OPS;
+	timer = bench_start("rand_insert", n);
+	for (size_t i = 0; i < ops; ++i) {
+		long value = (long) i;
+		size_t index = bench_random(&state) % (c_vector_length(long, vector) + 1);
+		vector->ops->insert_range(vector, index, &value, 1);
+	}
+	bench_stop(options, &timer, ops);
+
+	ops = c_vector_length(long, vector);
+	timer = bench_start("delete", ops);
+	for (size_t i = 0; i < ops; ++i)
+		vector->ops->remove_top(vector);
+	bench_stop(options, &timer, ops);
+
+	vector = vector->ops->destroy_vector(vector);
+
+	/* A restart rebuilds the vector one push at a time, or opens the file it was synced to */
+	vector = new_c_vector_mmap(long, MAPPED_PATH, map_create);
+	timer = bench_start("mmap_build", n);
+	for (size_t i = 0; i < n; ++i)
+		c_vector_push(long, vector, (long) i);
+	c_vector_sync(long, vector);
+	bench_stop(options, &timer, n);
+	vector = vector->ops->destroy_vector(vector);
+
+	timer = bench_start("mmap_open", n);
+	vector = new_c_vector_mmap(long, MAPPED_PATH, map_open);
+	sum += c_vector_at(long, vector, n - 1);
+	bench_stop(options, &timer, 1);
+	vector = vector->ops->destroy_vector(vector);
+	unlink(MAPPED_PATH);
+
+	bench_sink += sum;
+	free(lookups);
+}
+
+int main(int argc, char *argv[]) {
+	bench_options options = bench_parse("c_vector", argc, argv);
+	for (size_t n = BENCH_MIN_SIZE; n <= options.max_size; n *= 10)
+		run_size(&options, n);
+	bench_finish(&options);
+	return 0;
+}
@@ -0,0 +1,420 @@
+#ifndef BIT_VECTOR_H
+#define BIT_VECTOR_H
+#ifndef __cplusplus
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#else
+#include <cstdlib>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#endif
+#include "c_vector.h"
+#include "error.h"
+#include "allocator.h"
+#include "iterator.h"
+
+/* c_bit_vector is a vector of bools packed one per bit, 64 to a word, so it takes
+ * an eighth of the memory of a c_vector(bool). It has the same shape as a c_vector:
+ * add_top, remove_top, value_at, resize, shrink and an iterator, with set in place
+ * of insert, since insert overwrites in c_vector as well.
+ *
+ * Queries over many bits work a word at a time instead of calling value_at per
+ * bit. popcount counts set bits with one popcount instruction per word,
+ * find_first_set skips zero words and finds the bit in the first nonzero one with
+ * count trailing zeros, and and/or/xor combine whole words, in loops simple
+ * enough for the compiler to vectorize.
+ *
+ * Every bit past the length is kept clear, in the last word and in the words
+ * reserved after it. That is what lets popcount and the combining functions run
+ * over whole words without masking the end. It is also why growth always zeroes the
+ * new words and shrinking clears the bits it drops, whatever the vector's policy
+ * says about zeroing.
+ *
+ * c_bit_vector *new_bit_vector(size_t number, const c_allocator *allocator)
+ * INPUT: size_t number -> bits to reserve, const c_allocator *allocator -> where the
+ * vector gets its memory from
+ * OUTPUT: c_bit_vector struct pointer, or NULL if allocation failed
+ * USAGE: internal use only, use new_c_bit_vector
+ * NOTES: There is always room for at least one word
+ *
+ * error_code add_top_bit_vector(c_bit_vector *vector, bool value)
+ * OUTPUT: success, or realloc_failed
+ * USAGE: vector->ops->add_top(vector, true); or c_bit_vector_push(vector, true);
+ *
+ * error_code remove_top_bit_vector(c_bit_vector *vector)
+ * OUTPUT: success
+ * NOTES: Only the removed bit is cleared. An empty vector is left alone.
+ *
+ * bool value_at_bit_vector(c_bit_vector *vector, size_t index)
+ * OUTPUT: the bit at index, or false with err set to invalid_index past the end
+ *
+ * error_code set_bit_vector(c_bit_vector *vector, size_t index, bool value)
+ * OUTPUT: success, or invalid_index if index is past the end
+ *
+ * error_code resize_bit_vector(c_bit_vector *vector, size_t bits)
+ * OUTPUT: success, or realloc_failed
+ * NOTES: The length becomes bits. New bits are clear, and bits cut off are cleared.
+ *
+ * error_code shrink_bit_vector(c_bit_vector *vector)
+ * NOTES: Reserved words past the last one in use are given back
+ *
+ * size_t popcount_bit_vector(const c_bit_vector *vector)
+ * OUTPUT: the number of set bits
+ *
+ * size_t find_first_set_bit_vector(const c_bit_vector *vector, size_t from)
+ * OUTPUT: the index of the first set bit at or after from, or the vector's length
+ * if there is none
+ * USAGE: for (i = find_first_set(v, 0); i < v->curr_index; i = find_first_set(v, i + 1))
+ *
+ * error_code and_bit_vector(c_bit_vector *vector, const c_bit_vector *other)
+ * error_code or_bit_vector(c_bit_vector *vector, const c_bit_vector *other)
+ * error_code xor_bit_vector(c_bit_vector *vector, const c_bit_vector *other)
+ * OUTPUT: success, or realloc_failed if vector had to grow
+ * USAGE: vector->ops->and_vector(vector, other);
+ * NOTES: vector becomes vector op other. A vector shorter than the other one counts
+ * as having clear bits past its end, so or and xor grow vector to other's length,
+ * while and keeps vector's length. other may be vector itself.
+ */
+typedef uint64_t bit_word;
+
+#define BIT_WORD_BITS	64
+#define BIT_WORD_SHIFT	6
+
+static inline size_t bit_words(size_t bits) {
+	return (bits + BIT_WORD_BITS - 1) >> BIT_WORD_SHIFT;
+}
+
+static inline bit_word bit_mask(size_t index) {
+	return (bit_word) 1 << (index & (BIT_WORD_BITS - 1));
+}
+
+typedef struct c_bit_vector {
+	size_t max_size;
+	size_t curr_index;
+	bit_word *data;
+	const struct c_bit_vector_ops *ops;
+	vector_policy *policy;
+	const c_allocator *allocator;
+} c_bit_vector;
+
+typedef struct c_bit_vector_ops {
+	struct c_bit_vector *(*destroy_vector)(struct c_bit_vector*);
+	error_code (*add_top)(struct c_bit_vector*, bool);
+	error_code (*remove_top)(struct c_bit_vector*);
+	bool (*value_at)(struct c_bit_vector*, size_t);
+	error_code (*set)(struct c_bit_vector*, size_t, bool);
+	error_code (*resize)(struct c_bit_vector*, size_t);
+	error_code (*shrink)(struct c_bit_vector*);
+	size_t (*popcount)(const struct c_bit_vector*);
+	size_t (*find_first_set)(const struct c_bit_vector*, size_t);
+	error_code (*and_vector)(struct c_bit_vector*, const struct c_bit_vector*);
+	error_code (*or_vector)(struct c_bit_vector*, const struct c_bit_vector*);
+	error_code (*xor_vector)(struct c_bit_vector*, const struct c_bit_vector*);
+} c_bit_vector_ops;
+
+/* Makes room for at least words words. New words are always zeroed */
+static error_code grow_bit_vector(c_bit_vector *vector, size_t words, const char *functname) {
+	vector_policy *policy = vector->policy;
+	size_t newsize = next_capacity(policy, vector->max_size, words*sizeof(bit_word), sizeof(bit_word));
+	bit_word *temp = (bit_word *) vector->allocator->reallocate(vector->allocator->context,
+			(void *) vector->data, vector->max_size, newsize);
+	if (temp == NULL) {
+		err = realloc_failed;
+		set_error_info(__FILE__, functname, __LINE__);
+		return err;
+	}
+	add_growth_stat(&policy->stats.grow_count, 1);
+	add_growth_stat(&policy->stats.bytes_reserved, newsize - vector->max_size);
+	add_growth_stat(&policy->stats.bytes_zeroed, newsize - vector->max_size);
+	if (temp != vector->data)
+		add_growth_stat(&policy->stats.bytes_moved, vector->max_size);
+	memset((void *) ((char *) temp + vector->max_size), 0, newsize - vector->max_size);
+	vector->data = temp;
+	vector->max_size = newsize;
+	return success;
+}
+
+/* Clears every bit from bits up to the end of the words in use */
+static inline void clear_bits_from(c_bit_vector *vector, size_t bits) {
+	size_t used = bit_words(vector->curr_index);
+	size_t keep = bit_words(bits);
+	if (bits % BIT_WORD_BITS != 0)
+		vector->data[keep - 1] &= bit_mask(bits) - 1;
+	if (used > keep)
+		memset((void *) &vector->data[keep], 0, (used - keep)*sizeof(bit_word));
+}
+
+c_bit_vector *destroy_bit_vector(c_bit_vector *vector) {
+	if (vector == NULL) {
+		return NULL;
+	}
+	allocator_free(vector->allocator, vector->data);
+	allocator_free(vector->allocator, vector);
+	return NULL;
+}
+
+error_code add_top_bit_vector(c_bit_vector *vector, bool value) {
+	size_t index = vector->curr_index;
+	if (index == vector->max_size*8 && grow_bit_vector(vector, bit_words(index + 1), "add_top") != success)
+		return err;
+	/* The bit is already clear, so it only has to be or'd in */
+	vector->data[index >> BIT_WORD_SHIFT] |= (bit_word) value << (index & (BIT_WORD_BITS - 1));
+	++vector->curr_index;
+	err = success;
+	return success;
+}
+
+/* The common case of pushing into spare capacity, without going through ops */
+static inline error_code push_inline_bit_vector(c_bit_vector *vector, bool value) {
+	size_t index = vector->curr_index;
+	if (index == vector->max_size*8)
+		return add_top_bit_vector(vector, value);
+	vector->data[index >> BIT_WORD_SHIFT] |= (bit_word) value << (index & (BIT_WORD_BITS - 1));
+	++vector->curr_index;
+	return success;
+}
+
+error_code remove_top_bit_vector(c_bit_vector *vector) {
+	if (vector->curr_index == 0) {
+		err = success;
+		return success;
+	}
+	--vector->curr_index;
+	vector->data[vector->curr_index >> BIT_WORD_SHIFT] &= ~bit_mask(vector->curr_index);
+	err = success;
+	return success;
+}
+
+bool value_at_bit_vector(c_bit_vector *vector, size_t index) {
+	if (index >= vector->curr_index) {
+		err = invalid_index;
+		set_error_info(__FILE__, "value_at", __LINE__);
+		return false;
+	}
+	return (vector->data[index >> BIT_WORD_SHIFT] & bit_mask(index)) != 0;
+}
+
+error_code set_bit_vector(c_bit_vector *vector, size_t index, bool value) {
+	bit_word *word = NULL;
+	if (index >= vector->curr_index) {
+		err = invalid_index;
+		set_error_info(__FILE__, "set", __LINE__);
+		return err;
+	}
+	word = &vector->data[index >> BIT_WORD_SHIFT];
+	*word = (*word & ~bit_mask(index)) | (-(bit_word) value & bit_mask(index));
+	err = success;
+	return success;
+}
+
+error_code resize_bit_vector(c_bit_vector *vector, size_t bits) {
+	if (bits < vector->curr_index)
+		clear_bits_from(vector, bits);
+	else if (bit_words(bits)*sizeof(bit_word) > vector->max_size &&
+		grow_bit_vector(vector, bit_words(bits), "resize") != success)
+		return err;
+	vector->curr_index = bits;
+	err = success;
+	return success;
+}
+
+error_code shrink_bit_vector(c_bit_vector *vector) {
+	/* Like new_bit_vector, one word is always kept */
+	size_t newsize = ((vector->curr_index == 0) ? 1 : bit_words(vector->curr_index))*sizeof(bit_word);
+	bit_word *temp = NULL;
+	if (newsize == vector->max_size) {
+		err = success;
+		return success;
+	}
+	temp = (bit_word *) vector->allocator->reallocate(vector->allocator->context,
+			(void *) vector->data, vector->max_size, newsize);
+	if (temp == NULL) {
+		err = realloc_failed;
+		set_error_info(__FILE__, "shrink", __LINE__);
+		return err;
+	}
+	vector->data = temp;
+	vector->max_size = newsize;
+	err = success;
+	return success;
+}
+
+size_t popcount_bit_vector(const c_bit_vector *vector) {
+	size_t words = bit_words(vector->curr_index);
+	size_t count = 0;
+	for (size_t i = 0; i < words; ++i)
+		count += (size_t) __builtin_popcountll(vector->data[i]);
+	return count;
+}
+
+size_t find_first_set_bit_vector(const c_bit_vector *vector, size_t from) {
+	size_t words = bit_words(vector->curr_index);
+	size_t i = from >> BIT_WORD_SHIFT;
+	bit_word word = 0;
+	if (from >= vector->curr_index)
+		return vector->curr_index;
+	/* The bits below from in its word are masked off, and the rest are zero past the end */
+	word = vector->data[i] & ~(bit_mask(from) - 1);
+	while (word == 0) {
+		if (++i == words)
+			return vector->curr_index;
+		word = vector->data[i];
+	}
+	return (i << BIT_WORD_SHIFT) + (size_t) __builtin_ctzll(word);
+}
+
+error_code and_bit_vector(c_bit_vector *vector, const c_bit_vector *other) {
+	size_t words = bit_words(vector->curr_index);
+	size_t common = bit_words(other->curr_index);
+	if (common > words)
+		common = words;
+	for (size_t i = 0; i < common; ++i)
+		vector->data[i] &= other->data[i];
+	/* other's bits past its end count as clear */
+	if (words > common)
+		memset((void *) &vector->data[common], 0, (words - common)*sizeof(bit_word));
+	err = success;
+	return success;
+}
+
+/* or and xor both grow vector to other's length first, so they only differ in the loop */
+static inline error_code match_bit_vector(c_bit_vector *vector, const c_bit_vector *other, const char *functname) {
+	if (other->curr_index <= vector->curr_index)
+		return success;
+	if (bit_words(other->curr_index)*sizeof(bit_word) > vector->max_size &&
+		grow_bit_vector(vector, bit_words(other->curr_index), functname) != success)
+		return err;
+	vector->curr_index = other->curr_index;
+	return success;
+}
+
+error_code or_bit_vector(c_bit_vector *vector, const c_bit_vector *other) {
+	size_t words = bit_words(other->curr_index);
+	if (match_bit_vector(vector, other, "or_vector") != success)
+		return err;
+	for (size_t i = 0; i < words; ++i)
+		vector->data[i] |= other->data[i];
+	err = success;
+	return success;
+}
+
+error_code xor_bit_vector(c_bit_vector *vector, const c_bit_vector *other) {
+	size_t words = bit_words(other->curr_index);
+	if (match_bit_vector(vector, other, "xor_vector") != success)
+		return err;
+	for (size_t i = 0; i < words; ++i)
+		vector->data[i] ^= other->data[i];
+	err = success;
+	return success;
+}
+
+static const c_bit_vector_ops bit_vector_ops = {
+	&destroy_bit_vector,
+	&add_top_bit_vector,
+	&remove_top_bit_vector,
+	&value_at_bit_vector,
+	&set_bit_vector,
+	&resize_bit_vector,
+	&shrink_bit_vector,
+	&popcount_bit_vector,
+	&find_first_set_bit_vector,
+	&and_bit_vector,
+	&or_bit_vector,
+	&xor_bit_vector
+};
+
+c_bit_vector *new_bit_vector(size_t number, const c_allocator *allocator) {
+	c_bit_vector *vector = NULL;
+	size_t words = (number == 0) ? 1 : bit_words(number);
+
+	vector = (c_bit_vector *) allocator_calloc(allocator, sizeof(c_bit_vector));
+
+	if (vector == NULL) {
+		return NULL;
+	}
+
+	vector->data = (bit_word *) allocator_calloc(allocator, words*sizeof(bit_word));
+
+	if (vector->data == NULL) {
+		allocator_free(allocator, vector);
+		return NULL;
+	}
+
+	vector->max_size = words*sizeof(bit_word);
+	vector->ops = &bit_vector_ops;
+	vector->policy = &default_vector_policy;
+	vector->allocator = allocator;
+	return vector;
+}
+
+/* bit_vector_iterator walks the bits from first to last, like vector_iterator */
+typedef struct bit_vector_iterator {
+	generic_iterator geniter;
+	bool (*current)(struct bit_vector_iterator *);
+	const c_bit_vector *vector;
+	size_t current_index;
+} bit_vector_iterator;
+
+void first_bit_vector_iterator(generic_iterator *generic) {
+	bit_vector_iterator *iter = (bit_vector_iterator *) generic;
+	iter->current_index = 0;
+}
+
+void next_bit_vector_iterator(generic_iterator *generic) {
+	bit_vector_iterator *iter = (bit_vector_iterator *) generic;
+	++(iter->current_index);
+}
+
+void last_bit_vector_iterator(generic_iterator *generic) {
+	bit_vector_iterator *iter = (bit_vector_iterator *) generic;
+	iter->current_index = iter->vector->curr_index;
+}
+
+bool end_bit_vector_iterator(generic_iterator *generic) {
+	bit_vector_iterator *iter = (bit_vector_iterator *) generic;
+	if (iter->current_index >= iter->vector->curr_index) {
+		iter->current_index = 0;
+		return true;
+	}
+	return false;
+}
+
+bool current_bit_vector_iterator(bit_vector_iterator *iter) {
+	return (iter->vector->data[iter->current_index >> BIT_WORD_SHIFT] & bit_mask(iter->current_index)) != 0;
+}
+
+generic_iterator *new_bit_vector_iterator(c_bit_vector *vector) {
+	generic_iterator *generic = NULL;
+	bit_vector_iterator *iter = NULL;
+	if (vector == NULL) {
+		return NULL;
+	}
+
+	generic = (generic_iterator *) calloc(1, sizeof(bit_vector_iterator));
+	if (generic == NULL) {
+		return NULL;
+	}
+	generic->first = &first_bit_vector_iterator;
+	generic->next = &next_bit_vector_iterator;
+	generic->last = &last_bit_vector_iterator;
+	generic->end = &end_bit_vector_iterator;
+	generic->destroy_iterator = &destroy_iterator;
+	iter = (bit_vector_iterator *) generic;
+	iter->current = &current_bit_vector_iterator;
+	iter->vector = vector;
+	return generic;
+}
+
+#define new_c_bit_vector(NUMBER)	new_bit_vector((size_t) NUMBER, &default_allocator)
+#define new_c_bit_vector_with(NUMBER, ALLOCATOR)	new_bit_vector((size_t) NUMBER, ALLOCATOR)
+#define c_bit_vector_push(VECTOR, VALUE)	push_inline_bit_vector(VECTOR, VALUE)
+#define c_bit_vector_at(VECTOR, INDEX)	(((VECTOR)->data[(size_t) (INDEX) >> BIT_WORD_SHIFT] & bit_mask((size_t) (INDEX))) != 0)
+#define c_bit_vector_length(VECTOR)	((VECTOR)->curr_index)
+/* The policy must outlive the vector. NULL goes back to default_vector_policy */
+#define c_bit_vector_set_policy(VECTOR, POLICY)	((VECTOR)->policy = ((POLICY) != NULL) ? (POLICY) : &default_vector_policy)
+
+#endif
@@ -9,21 +9,71 @@
 #include "red_black_tree.h"
 #include "iterator.h"
 #include "error.h"
+#include "allocator.h"
 
 /* c_map acts as a high level wrapper for the red and black tree 
  * One advantage to having this wrapper is that different map schemes
  * (ordered, unordered) can be accomodated.
+ * c_unordered_map in unordered_map.h is the unordered scheme. It has the same
+ * insert, delete_pair, get_value, is_key and iterator, backed by a hash table.
  */
 
-#define define_map(K, V)	\
-	define_rbtree(K,V)		\
+/* define_map_cmp(K, V, CMP)
+ * INPUT: K -> key data type, V -> value data type, CMP -> comparator for K
+ * OUTPUT: None
+ * USAGE: define_map_cmp(long, char, compare_long)
+ * NOTES: Keys are ordered by CMP. See define_rbtree_cmp and compare.h.
+ * define_map(K, V) orders keys with default_compare.
+ *
+ * bool lower_bound_map_##K##_##V(c_map(K,V) *map, K key, K *result)
+ * bool upper_bound_map_##K##_##V(c_map(K,V) *map, K key, K *result)
+ * bool floor_key_map_##K##_##V(c_map(K,V) *map, K key, K *result)
+ * bool ceiling_key_map_##K##_##V(c_map(K,V) *map, K key, K *result)
+ * INPUT: c_map(K,V) *map -> the map, K key -> key to search around, which doesn't
+ * have to be in the map, K *result -> where the key found is written
+ * OUTPUT: true with *result set to the smallest key >= key (lower_bound, ceiling_key),
+ * the smallest key > key (upper_bound) or the largest key <= key (floor_key).
+ * false with err set to key_not_found if there is no such key.
+ * USAGE: if (map->floor_key(map, now, &key)) value = map->get_value(map, key);
+ * NOTES: Each is a single O(log n) search. To visit every pair in a range, use a
+ * map_range_iterator instead of calling these repeatedly.
+ *
+ * size_t size_map_##K##_##V(c_map(K,V) *map)
+ * size_t rank_map_##K##_##V(c_map(K,V) *map, K key)
+ * bool select_map_##K##_##V(c_map(K,V) *map, size_t index, K *result)
+ * INPUT: c_map(K,V) *map -> the map, K key -> a key that doesn't have to be in the
+ * map, size_t index -> position from 0 in key order, K *result -> where the key is written
+ * OUTPUT: size gives the number of pairs in the map, and rank the number of keys less
+ * than key. select gives true with *result set to the key at index, or false with
+ * err set to invalid_index if index isn't less than the size.
+ * USAGE: if (map->select(map, map->size(map) / 2, &median)) ...
+ * NOTES: size is O(1) for every map. rank and select are O(log n) in a map made by
+ * define_map_counted or define_map_counted_cmp, whose tree keeps subtree counts
+ * (see define_rbtree_counted), and O(n) otherwise.
+ */
+#define define_map(K, V)	define_map_cmp(K, V, default_compare)
+#define define_map_cmp(K, V, CMP)	define_map_mode(K, V, CMP, 0)
+#define define_map_counted(K, V)	define_map_counted_cmp(K, V, default_compare)
+#define define_map_counted_cmp(K, V, CMP)	define_map_mode(K, V, CMP, 1)
+
+#define define_map_mode(K, V, CMP, COUNTED)	\
+	define_rbtree_mode(K,V, CMP, COUNTED)		\
 	typedef struct c_map_##K##_##V {	\
 		rb_tree(K,V) *tree;	\
+		const c_allocator *allocator;	\
 		struct c_map_##K##_##V *(*destroy_map)(struct c_map_##K##_##V*);	\
 		error_code (*insert)(struct c_map_##K##_##V*, K, V);	\
 		error_code (*delete_pair)(struct c_map_##K##_##V*, K);	\
 		V (*get_value)(struct c_map_##K##_##V*, K);	\
 		bool (*is_key)(struct c_map_##K##_##V*, K);	\
+		error_code (*build_from_sorted)(struct c_map_##K##_##V*, const K*, const V*, size_t);	\
+		bool (*lower_bound)(struct c_map_##K##_##V*, K, K*);	\
+		bool (*upper_bound)(struct c_map_##K##_##V*, K, K*);	\
+		bool (*floor_key)(struct c_map_##K##_##V*, K, K*);	\
+		bool (*ceiling_key)(struct c_map_##K##_##V*, K, K*);	\
+		size_t (*size)(struct c_map_##K##_##V*);	\
+		size_t (*rank)(struct c_map_##K##_##V*, K);	\
+		bool (*select)(struct c_map_##K##_##V*, size_t, K*);	\
 	} c_map_##K##_##V;	\
 								\
 	c_map(K,V) *destroy_map_##K##_##V(c_map(K,V) *map) {	\
@@ -34,7 +84,7 @@
 		if (map->tree != NULL) {	\
 			map->tree = map->tree->destroy_rbtree(map->tree);	\
 		}	\
-		free(map);	\
+		allocator_free(map->allocator, map);	\
 		return NULL;	\
 	}	\
 		\
@@ -76,91 +126,148 @@
 		return map->tree->get_value(map->tree, key);	\
 	}	\
 		\
+	/* Hands back the key of a node found by one of the bound searches */	\
+	static inline bool bound_key_map_##K##_##V(node(K,V) *node, K *result, const char *functname) {	\
+		if (node == NULL) {	\
+			err = key_not_found;	\
+			set_error_info(__FILE__, functname, __LINE__);	\
+			return false;	\
+		}	\
+		*result = node->key;	\
+		return true;	\
+	}	\
+		\
+	bool lower_bound_map_##K##_##V(c_map(K,V) *map, K key, K *result) {	\
+		return bound_key_map_##K##_##V(lower_bound_node_##K##_##V(map->tree, key), result, "lower_bound");	\
+	}	\
+		\
+	bool upper_bound_map_##K##_##V(c_map(K,V) *map, K key, K *result) {	\
+		return bound_key_map_##K##_##V(upper_bound_node_##K##_##V(map->tree, key), result, "upper_bound");	\
+	}	\
+		\
+	bool floor_key_map_##K##_##V(c_map(K,V) *map, K key, K *result) {	\
+		return bound_key_map_##K##_##V(floor_node_##K##_##V(map->tree, key), result, "floor_key");	\
+	}	\
+		\
+	bool ceiling_key_map_##K##_##V(c_map(K,V) *map, K key, K *result) {	\
+		return bound_key_map_##K##_##V(ceiling_node_##K##_##V(map->tree, key), result, "ceiling_key");	\
+	}	\
+		\
+	size_t size_map_##K##_##V(c_map(K,V) *map) {	\
+		return map->tree->size;	\
+	}	\
+		\
+	size_t rank_map_##K##_##V(c_map(K,V) *map, K key) {	\
+		return map->tree->rank(map->tree, key);	\
+	}	\
+		\
+	bool select_map_##K##_##V(c_map(K,V) *map, size_t index, K *result) {	\
+		node(K,V) *node = select_node_##K##_##V(map->tree, index);	\
+		if (node == NULL) {	\
+			err = invalid_index;	\
+			set_error_info(__FILE__, "select", __LINE__);	\
+			return false;	\
+		}	\
+		*result = node->key;	\
+		return true;	\
+	}	\
+		\
+	/* Replaces the map's contents in O(n). See build_from_sorted in red_black_tree.h */	\
+	error_code build_from_sorted_map_##K##_##V(c_map(K,V) *map, const K *keys, const V *values, size_t n) {	\
+		return map->tree->build_from_sorted(map->tree, keys, values, n);	\
+	}	\
+		\
 	static inline void set_map_ptr_##K##_##V(c_map(K,V) *map) {	\
 		map->destroy_map = &destroy_map_##K##_##V;	\
 		map->insert = &insert_map_##K##_##V;	\
 		map->delete_pair = &delete_pair_map_##K##_##V;	\
 		map->get_value = &get_value_map_##K##_##V;	\
 		map->is_key = &is_key_map_##K##_##V;	\
+		map->build_from_sorted = &build_from_sorted_map_##K##_##V;	\
+		map->lower_bound = &lower_bound_map_##K##_##V;	\
+		map->upper_bound = &upper_bound_map_##K##_##V;	\
+		map->floor_key = &floor_key_map_##K##_##V;	\
+		map->ceiling_key = &ceiling_key_map_##K##_##V;	\
+		map->size = &size_map_##K##_##V;	\
+		map->rank = &rank_map_##K##_##V;	\
+		map->select = &select_map_##K##_##V;	\
 	}	\
 		\
-	c_map(K,V) *new_map_##K##_##V() {	\
+	c_map(K,V) *new_map_##K##_##V(const c_allocator *allocator) {	\
 		c_map(K,V) *map = NULL;	\
 									\
-		map = (c_map(K,V) *) calloc(1, sizeof(c_map(K,V)));	\
+		map = (c_map(K,V) *) allocator_calloc(allocator, sizeof(c_map(K,V)));	\
 								\
 		if (map == NULL) {	\
 			return NULL;	\
 		}					\
 							\
-		map->tree = new_rbtree(K,V);	\
+		map->allocator = allocator;	\
+		map->tree = new_rbtree_with(K,V, allocator);	\
 						\
 		if (map->tree == NULL) {	\
-			free(map);	\
+			allocator_free(allocator, map);	\
 			return NULL;	\
 		}	\
 		set_map_ptr_##K##_##V(map);	\
 		return map;	\
 	}	\
 	define_map_iterator(K,V)	\
+	define_map_range_iterator(K,V, CMP)	\
 
 
+/* map_iterator walks the map in key order. It holds the node it is on, so next and
+ * prev step straight to the neighboring node and a full scan is O(n) in either
+ * direction. key and value point into that node, and are NULL once end is true.
+ * The value can be changed through the pointer, but the key must not be, since that
+ * would break the order of the tree. Deleting the pair the iterator is on
+ * invalidates the iterator.
+ *
+ * USAGE: for (giter->first(giter); !giter->end(giter); giter->next(giter))
+ *     printf("%d\n", *iter->key);
+ *        for (giter->last(giter); !giter->end(giter); iter->prev(giter))
+ */
 #define	define_map_iterator(K,V)	\
 typedef struct map_iterator_##K##_##V {	\
 	generic_iterator geniter;	\
-	K key;	\
-	V value;	\
-	bool lastkey;	\
+	void (*prev)(generic_iterator*);	\
+	K *key;	\
+	V *value;	\
+	node(K,V) *node;	\
 	c_map(K,V) *map;	\
 } map_iterator_##K##_##V;	\
 	\
+static inline void move_map_iterator_##K##_##V(map_iterator(K,V) *iter, node(K,V) *node) {	\
+	iter->node = node;	\
+	iter->key = (node == NULL) ? NULL : &(node->key);	\
+	iter->value = (node == NULL) ? NULL : &(node->value);	\
+}	\
+	\
 void first_map_iterator_##K##_##V(generic_iterator *generic) {	\
 	map_iterator(K,V) *iter = (map_iterator(K,V) *) generic;	\
-	iter->key = first_key_map_##K##_##V(iter->map);	\
-	iter->value = iter->map->get_value(iter->map, iter->key);	\
-	iter->lastkey = false;	\
+	move_map_iterator_##K##_##V(iter, first_node_##K##_##V(iter->map->tree));	\
 }	\
 	\
 void next_map_iterator_##K##_##V(generic_iterator *generic) {	\
 	map_iterator(K,V) *iter = (map_iterator(K,V) *) generic;	\
-	K key;	\
-	K prevkey;	\
-	memset(&key, 0, sizeof(K));	\
-	prevkey = iter->key;	\
-	iter->key = next_key_map_##K##_##V(iter->map, iter->key);	\
-	/* next_key will return 0 in two cases. In the first case, */	\
-	/* next_key returns 0 if the provided key was not found */	\
-	/* It also returns 0 if it was unable to find a successor. */	\
-	/* The latter case is most likely. Eventually a more sophisticated method will be found */	\
-	if (iter->key == key) {	\
-		iter->key = prevkey;	\
-		return; \
-	}	\
-		\
-	iter->value = iter->map->get_value(iter->map, iter->key);	\
+	move_map_iterator_##K##_##V(iter, next_node_##K##_##V(iter->node));	\
 }	\
 	\
-/* Set the iterator key and value to the maximum of the tree */	\
+void prev_map_iterator_##K##_##V(generic_iterator *generic) {	\
+	map_iterator(K,V) *iter = (map_iterator(K,V) *) generic;	\
+	move_map_iterator_##K##_##V(iter, prev_node_##K##_##V(iter->node));	\
+}	\
+	\
+/* Move the iterator to the maximum of the tree */	\
 void last_map_iterator_##K##_##V(generic_iterator *generic) {	\
 	map_iterator(K,V) *iter = (map_iterator(K,V) *) generic;	\
-	iter->key = last_key_map_##K##_##V(iter->map);	\
-	iter->value = iter->map->get_value(iter->map, iter->key);	\
+	move_map_iterator_##K##_##V(iter, last_node_##K##_##V(iter->map->tree));	\
 }	\
 	\
-/* Compare the iterator key and value with the maximum of the tree */	\
+/* The iterator has walked off one end of the tree or the other */	\
 bool end_map_iterator_##K##_##V(generic_iterator *generic) {	\
 	map_iterator(K,V) *iter = (map_iterator(K,V) *) generic;	\
-	if (iter->lastkey) {	\
-		iter->lastkey = false;	\
-		return true;	\
-	}	\
-	K lastkey = last_key_map_##K##_##V(iter->map);	\
-	/* If we got the last key, set lastkey and then return false */	\
-	/* this will allow the last key to be counted before terminating */	\
-	if (iter->key == lastkey)	\
-		iter->lastkey = true;	\
-								\
-	return false;	\
+	return iter->node == NULL;	\
 }	\
 	\
 static inline void set_map_iterator_ptr_##K##_##V(map_iterator(K,V) *iter) {	\
@@ -170,6 +277,7 @@ static inline void set_map_iterator_ptr_##K##_##V(map_iterator(K,V) *iter) {	\
 	giter->last = &last_map_iterator_##K##_##V;	\
 	giter->end = &end_map_iterator_##K##_##V;	\
 	giter->destroy_iterator = &destroy_iterator;	\
+	iter->prev = &prev_map_iterator_##K##_##V;	\
 }	\
 	\
 generic_iterator *new_map_iterator_##K##_##V(c_map(K,V) *map) {	\
@@ -180,16 +288,93 @@ generic_iterator *new_map_iterator_##K##_##V(c_map(K,V) *map) {	\
 	if (mi == NULL)	\
 		return NULL;	\
 	iter->map = map;	\
-	iter->key = first_key_map_##K##_##V(iter->map);	\
-	iter->value = iter->map->get_value(iter->map, iter->key);	\
-	iter->lastkey = false;	\
 	set_map_iterator_ptr_##K##_##V(iter);	\
+	first_map_iterator_##K##_##V(mi);	\
 	return mi;	\
 }	\
 	
+/* map_range_iterator walks the keys in [low, high) in order, or backwards with prev.
+ * first and last each find their end of the range with one O(log n) search, and
+ * next and prev then step to the neighboring node like map_iterator does, so
+ * visiting k keys costs O(log n + k) rather than a search per key. end is true once
+ * the iterator steps outside the range. Its members up to map are the same as
+ * map_iterator's, and key and value are used the same way.
+ *
+ * USAGE: generic_iterator *giter = new_map_range_iterator(long, double, map, start, stop);
+ *        map_range_iterator(long, double) *iter = (map_range_iterator(long, double) *) giter;
+ *        for (giter->first(giter); !giter->end(giter); giter->next(giter))
+ *            total += *iter->value;
+ */
+#define define_map_range_iterator(K,V, CMP)	\
+typedef struct map_range_iterator_##K##_##V {	\
+	generic_iterator geniter;	\
+	void (*prev)(generic_iterator*);	\
+	K *key;	\
+	V *value;	\
+	node(K,V) *node;	\
+	c_map(K,V) *map;	\
+	K low;	\
+	K high;	\
+} map_range_iterator_##K##_##V;	\
+	\
+/* Moves to node, or off the end if node is outside the range */	\
+static inline void move_map_range_iterator_##K##_##V(map_range_iterator(K,V) *iter, node(K,V) *node) {	\
+	if (node != NULL && (CMP(node->key, iter->high) >= 0 || CMP(node->key, iter->low) < 0))	\
+		node = NULL;	\
+	move_map_iterator_##K##_##V((map_iterator(K,V) *) iter, node);	\
+}	\
+	\
+void first_map_range_iterator_##K##_##V(generic_iterator *generic) {	\
+	map_range_iterator(K,V) *iter = (map_range_iterator(K,V) *) generic;	\
+	move_map_range_iterator_##K##_##V(iter, lower_bound_node_##K##_##V(iter->map->tree, iter->low));	\
+}	\
+	\
+void next_map_range_iterator_##K##_##V(generic_iterator *generic) {	\
+	map_range_iterator(K,V) *iter = (map_range_iterator(K,V) *) generic;	\
+	move_map_range_iterator_##K##_##V(iter, next_node_##K##_##V(iter->node));	\
+}	\
+	\
+void prev_map_range_iterator_##K##_##V(generic_iterator *generic) {	\
+	map_range_iterator(K,V) *iter = (map_range_iterator(K,V) *) generic;	\
+	move_map_range_iterator_##K##_##V(iter, prev_node_##K##_##V(iter->node));	\
+}	\
+	\
+void last_map_range_iterator_##K##_##V(generic_iterator *generic) {	\
+	map_range_iterator(K,V) *iter = (map_range_iterator(K,V) *) generic;	\
+	move_map_range_iterator_##K##_##V(iter, below_node_##K##_##V(iter->map->tree, iter->high));	\
+}	\
+	\
+generic_iterator *new_map_range_iterator_##K##_##V(c_map(K,V) *map, K low, K high) {	\
+	if (map == NULL)	\
+		return NULL;	\
+	generic_iterator *ri = (generic_iterator *) calloc(1, sizeof(map_range_iterator(K,V)));	\
+	map_range_iterator(K,V) *iter = (map_range_iterator(K,V) *) ri;	\
+	if (ri == NULL)	\
+		return NULL;	\
+	iter->map = map;	\
+	iter->low = low;	\
+	iter->high = high;	\
+	ri->first = &first_map_range_iterator_##K##_##V;	\
+	ri->next = &next_map_range_iterator_##K##_##V;	\
+	ri->last = &last_map_range_iterator_##K##_##V;	\
+	/* Off the end looks the same whether or not there is a range */	\
+	ri->end = &end_map_iterator_##K##_##V;	\
+	ri->destroy_iterator = &destroy_iterator;	\
+	iter->prev = &prev_map_range_iterator_##K##_##V;	\
+	first_map_range_iterator_##K##_##V(ri);	\
+	return ri;	\
+}	\
+
 #define c_map(K,V)	c_map_##K##_##V
-#define	new_c_map(K, V)	new_map_##K##_##V()
+#define	new_c_map(K, V)	new_map_##K##_##V(&default_allocator)
+/* Same as new_c_map, except that the map, its tree and the tree's nodes all come
+ * from ALLOCATOR. With an arena, the map can be dropped along with the arena
+ * without calling destroy_map first.
+ */
+#define	new_c_map_with(K, V, ALLOCATOR)	new_map_##K##_##V(ALLOCATOR)
 #define map_iterator(K,V)	map_iterator_##K##_##V
 #define new_map_iterator(K,V, MAP)	new_map_iterator_##K##_##V(MAP)
+#define map_range_iterator(K,V)	map_range_iterator_##K##_##V
+#define new_map_range_iterator(K,V, MAP, LOW, HIGH)	new_map_range_iterator_##K##_##V(MAP, LOW, HIGH)
 
 #endif
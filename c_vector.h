@@ -16,9 +16,83 @@
 #endif
 #include "iterator.h"
 #include "error.h"
+#include "allocator.h"
 
 // This can be used to get type information for a c_vector
 #define type_name(DATA_TYPE)	#DATA_TYPE
+
+/* vector_policy decides how a c_vector grows once it runs out of room.
+ * grow_factor multiplies the capacity by numerator / denominator (2/1 doubles,
+ * 3/2 gives 1.5x) and grow_chunk adds a fixed number of bytes every time.
+ * max_step caps how many bytes a single growth may add (0 means no cap).
+ * When zero_on_grow is false, newly reserved memory is left as realloc returned it,
+ * which avoids touching pages that may never be used.
+ * 
+ * The stats member is shared by every vector using the policy, so it shows what
+ * the policy costs across all of them: how often they grew, how many bytes were
+ * reserved and zeroed, and how many bytes realloc had to move. Vectors in different
+ * threads may grow at once, so the counters are only updated with add_growth_stat.
+ * A policy is not copied by the vectors that use it, so it must outlive them.
+ */
+typedef enum growth_kind { grow_factor, grow_chunk } growth_kind;
+
+typedef struct vector_growth_stats {
+	size_t grow_count;
+	size_t bytes_reserved;
+	size_t bytes_zeroed;
+	size_t bytes_moved;
+} vector_growth_stats;
+
+typedef struct vector_policy {
+	growth_kind kind;
+	size_t numerator;
+	size_t denominator;
+	size_t chunk;
+	size_t max_step;
+	bool zero_on_grow;
+	vector_growth_stats stats;
+} vector_policy;
+
+/* Initializers for the common policies. 
+ * USAGE: vector_policy policy = VECTOR_POLICY_FACTOR(3, 2, 0, false);
+ */
+#define VECTOR_POLICY_FACTOR(NUM, DEN, MAX_STEP, ZERO)	{ grow_factor, NUM, DEN, 0, MAX_STEP, ZERO, { 0, 0, 0, 0 } }
+#define VECTOR_POLICY_CHUNK(BYTES, ZERO)	{ grow_chunk, 1, 1, BYTES, 0, ZERO, { 0, 0, 0, 0 } }
+
+/* Where a c_vector's elements live. Only heap storage came from the vector's allocator */
+typedef enum vector_storage { heap_storage, inline_storage } vector_storage;
+
+/* Doubling and zeroing is how c_vector has always behaved, so it is the default */
+vector_policy default_vector_policy = VECTOR_POLICY_FACTOR(2, 1, 0, true);
+
+/* The counters are only totals, so they need atomicity but no ordering */
+static inline void add_growth_stat(size_t *stat, size_t amount) {
+	__atomic_fetch_add(stat, amount, __ATOMIC_RELAXED);
+}
+
+/* Returns the capacity in bytes that a vector with current bytes reserved should
+ * grow to when it needs room for at least needed bytes. The result is always a
+ * whole number of elements.
+ */
+static inline size_t next_capacity(const vector_policy *policy, size_t current, size_t needed, size_t elemsize) {
+	size_t step = 0;
+	size_t newsize = 0;
+	if (policy->kind == grow_chunk)
+		step = policy->chunk;
+	else if (policy->denominator != 0 && policy->numerator > policy->denominator)
+		step = (current / policy->denominator) * policy->numerator - current;
+	if (policy->max_step != 0 && step > policy->max_step)
+		step = policy->max_step;
+	/* A vector with nothing reserved still starts with room for two elements */
+	if (current == 0 && step < 2*elemsize)
+		step = 2*elemsize;
+	newsize = current + step;
+	if (newsize < needed)
+		newsize = needed;
+	if (newsize % elemsize != 0)
+		newsize += elemsize - (newsize % elemsize);
+	return newsize;
+}
 /* 
  * The name has been changed from array to c_vector
  * The following method allows the added advantage of compile-time typechecking
@@ -41,78 +115,121 @@
  * c_vector_##DATA *destroy_c_vector_##DATA(c_vector_##DATA *vector)
  * INPUT: c_vector_##DATA* -> c_vector struct pointer of a given data type
  * OUTPUT: None
- * USAGE: vector = vector->destroy_c_vector(vector);
+ * USAGE: vector = vector->ops->destroy_vector(vector);
  * NOTES: Destructor for the c_vector
  * 
  * array_code add_top_##DATA(c_vector_##DATA *vector, DATA value)
  * INPUT: c_vector_##DATA* -> c_vector struct pointer, DATA -> value of given data type
  * OUTPUT: enum array_code to indicate error or 0 to indicate success
- * USAGE: array_code code = vector->add_top(vector, value);
+ * USAGE: array_code code = vector->ops->add_top(vector, value);
  * NOTES: This function is meant to mirror the vector's push_back method. If
- * new memory needs to be allocated, this function will zero the newly allocated
- * memory.
+ * new memory needs to be allocated, the vector's policy decides how much to allocate
+ * and whether to zero it.
  * 
  * void remove_top_##DATA(c_vector_##DATA *vector)
  * INPUT: c_vector_##DATA -> c_vector struct pointer
  * OUTPUT: none
- * USAGE: vector->remove_top(vector);
+ * USAGE: vector->ops->remove_top(vector);
  * NOTES: This function uses memset to zero the given index
  * This is important because the data type may not be primitive
  *
  * size_t get_current_index_##DATA(c_vector_##DATA *vector)
  * INPUT: c_vector_##DATA -> c_vector struct pointer
  * OUTPUT: value of c_vector's curr_index member
- * USAGE: size_t value = vector->get_current_index(vector);
+ * USAGE: size_t value = vector->ops->get_current_index(vector);
  * NOTES: The current index is the next index available for the add_top function.
  * 
  * size_t get_current_size_##DATA(c_vector_##DATA *vector)
  * INPUT: c_vector_##DATA -> c_vector struct pointer
  * OUTPUT: current size of *data member
- * USAGE: size_t value = vector->get_current_size(vector);
+ * USAGE: size_t value = vector->ops->get_current_size(vector);
  * NOTES: 
  *
  * size_t get_max_size_##DATA(c_vector_##DATA *vector)
  * INPUT: c_vector_##DATA -> c_vector struct pointer
  * OUTPUT: max size of *data member
- * USAGE: size_t value = vector->get_max_size(vector);
+ * USAGE: size_t value = vector->ops->get_max_size(vector);
  * NOTES: 
  * 
  * array_code insert_##DATA(c_vector_##DATA *vector, size_t index, DATA value)
  * INPUT: c_vector_##DATA -> c_vector struct pointer
  * size_t index -> index at which to insert value, DATA value -> value to insert
  * OUTPUT: array_code for error or 0 for success
- * USAGE: array_code code = vector->insert(vector, index, value);
+ * USAGE: array_code code = vector->ops->insert(vector, index, value);
  * NOTES: 
  * 
  * DATA value_at_##DATA(c_vector_##DATA *vector, size_t index)
  * INPUT: c_vector_##DATA -> c_vector struct pointer, size_t index -> index at which to insert
  * OUTPUT: value at index on success or 0 if index is out of bounds
- * USAGE: DATA value = vector->value_at(vector, index);
+ * USAGE: DATA value = vector->ops->value_at(vector, index);
  * NOTES: This will return the value at curr_index if the index is out of bounds
  * 
  * array_code resize_##DATA(c_vector_##DATA *vector, size_t elementnum)
  * INPUT: c_vector_##DATA -> c_vector struct pointer
  * size_t elementnum -> number of elements that array should now have
  * OUTPUT: 0 for success or array_code for error
- * USAGE: array_code code = vector->resize(vector, elementnum);
+ * USAGE: array_code code = vector->ops->resize(vector, elementnum);
  * NOTES: elementnum should be the number of elements, not the number of bytes
  * 
  * array_code shrink_##DATA(c_vector_##DATA *vector)
  * INPUT: c_vector_##DATA -> c_vector struct pointer
  * OUTPUT: 0 for success or array_code for error
- * USAGE: array_code code = vector->shrink(vector);
+ * USAGE: array_code code = vector->ops->shrink(vector);
  * NOTES: This will make max size equal to current size.
  * If current size is already 0, it will free the memory.
  * If the max size is equal to the current size, it will return 0
  *
- * static inline void set_vector_ptr_##DATA(c_vector_##DATA *vector)
- * INPUT: c_vector_##DATA -> c_vector struct pointer
+ * array_code append_array_##DATA(c_vector_##DATA *vector, const DATA *values, size_t count)
+ * INPUT: c_vector_##DATA -> c_vector struct pointer, const DATA *values -> elements to append,
+ * size_t count -> number of elements in values
+ * OUTPUT: 0 for success or array_code for error
+ * USAGE: array_code code = vector->ops->append_array(vector, batch, 10000);
+ * NOTES: This is add_top for a whole batch. The buffer is grown at most once, to
+ * fit all count elements, and the batch is copied in with a single memcpy.
+ * values must not point into vector's own buffer; use append_vector for that.
+ *
+ * array_code append_vector_##DATA(c_vector_##DATA *vector, const c_vector_##DATA *other)
+ * INPUT: c_vector_##DATA -> destination vector, const c_vector_##DATA -> source vector
+ * OUTPUT: 0 for success or array_code for error
+ * USAGE: array_code code = vector->ops->append_vector(vector, other);
+ * NOTES: Appends elements 0 through other's current index. other may be vector itself.
+ *
+ * array_code insert_range_##DATA(c_vector_##DATA *vector, size_t index, const DATA *values, size_t count)
+ * INPUT: c_vector_##DATA -> c_vector struct pointer, size_t index -> position of the first
+ * new element, const DATA *values -> elements to insert, size_t count -> number of elements
+ * OUTPUT: 0 for success or array_code for error
+ * USAGE: array_code code = vector->ops->insert_range(vector, 0, batch, 100);
+ * NOTES: Unlike insert, this shifts the elements from index onward up by count instead
+ * of overwriting them. index may be anywhere from 0 to the current index.
+ *
+ * void set_default_policy_##DATA(vector_policy *policy)
+ * INPUT: vector_policy *policy -> policy for vectors of this type, or NULL for default_vector_policy
  * OUTPUT: None
+ * USAGE: c_vector_set_default_policy(int, &policy);
+ * NOTES: Only vectors created after the call pick up the new policy
+ *
+ * void set_policy_##DATA(c_vector_##DATA *vector, vector_policy *policy)
+ * INPUT: c_vector_##DATA -> c_vector struct pointer, vector_policy *policy -> policy for this
+ * vector, or NULL for the type's default
+ * OUTPUT: None
+ * USAGE: c_vector_set_policy(int, vector, &policy);
+ * NOTES: 
+ *
+ * static inline array_code grow_vector_##DATA(c_vector_##DATA *vector, size_t bytes, const char *functname)
+ * USAGE: Internal use only
+ * NOTES: Makes max_size at least bytes, sized according to the vector's policy. If the policy
+ * zeroes on growth, the only bytes that get zeroed are the ones past bytes, since everything
+ * before that is about to be written by the caller.
+ *
+ * static const c_vector_ops_##DATA vector_ops_##DATA
  * USAGE: Internal use only
- * NOTES: This sets the function pointers for c_vector struct when new_vector is called
+ * NOTES: Every vector of a given data type shares this one table of operations.
+ * new_vector points the ops member at it, so an instance only pays for a single
+ * pointer instead of carrying its own copy of every function pointer.
  *  
- * c_vector_##DATA *new_vector_##DATA(size_t number) 
- * INPUT: size_t number -> number of elements to allocate
+ * c_vector_##DATA *new_vector_##DATA(size_t number, const c_allocator *allocator) 
+ * INPUT: size_t number -> number of elements to allocate, const c_allocator *allocator ->
+ * where the vector gets its memory from
  * OUTPUT: c_vector struct pointer
  * USAGE: internal use only, use the macro wrapper defined above
  * NOTES: This creates a new vector of a given data type. If the number of elements to
@@ -126,6 +243,13 @@
 		size_t curr_index; \
 		DATA *data; \
 		const char *data_type; \
+		const struct c_vector_ops_##DATA *ops;	\
+		vector_policy *policy;	\
+		vector_storage storage;	\
+		const c_allocator *allocator;	\
+	} c_vector_##DATA;	\
+		\
+	typedef struct c_vector_ops_##DATA {	\
 		struct c_vector_##DATA *(*destroy_vector)(struct c_vector_##DATA*);	\
 		error_code (*add_top)(struct c_vector_##DATA*, DATA value);	\
 		error_code (*remove_top)(struct c_vector_##DATA*);	\
@@ -136,50 +260,83 @@
 		DATA (*value_at)(struct c_vector_##DATA*, size_t);	\
 		error_code (*resize)(struct c_vector_##DATA*, size_t);	\
 		error_code (*shrink)(struct c_vector_##DATA*);	\
-	} c_vector_##DATA;	\
+		error_code (*append_array)(struct c_vector_##DATA*, const DATA*, size_t);	\
+		error_code (*append_vector)(struct c_vector_##DATA*, const struct c_vector_##DATA*);	\
+		error_code (*insert_range)(struct c_vector_##DATA*, size_t, const DATA*, size_t);	\
+	} c_vector_ops_##DATA;	\
+		\
+	static vector_policy *default_policy_##DATA = &default_vector_policy;	\
+		\
+	void set_default_policy_##DATA(vector_policy *policy) {	\
+		default_policy_##DATA = (policy != NULL) ? policy : &default_vector_policy;	\
+	}	\
+		\
+	void set_policy_##DATA(c_vector_##DATA *vector, vector_policy *policy) {	\
+		vector->policy = (policy != NULL) ? policy : default_policy_##DATA;	\
+	}	\
 						\
 	c_vector_##DATA *destroy_c_vector_##DATA(c_vector_##DATA* vector) {	\
 		if (vector == NULL) {	\
 			return NULL;	\
 		}	\
 			\
-		if (vector->data != NULL) {	\
-			free(vector->data);	\
+		/* Inline storage is part of the same allocation as the vector */	\
+		if (vector->data != NULL && vector->storage == heap_storage) {	\
+			allocator_free(vector->allocator, vector->data);	\
 		}	\
-		free(vector);	\
+		allocator_free(vector->allocator, vector);	\
 		return NULL;	\
 	}					\
 						\
-	error_code add_top_##DATA(c_vector_##DATA *vector, DATA value) {	\
-		DATA* temp = NULL;	\
-		DATA* memtemp = NULL;	\
-		if ((vector->curr_index+1) > vector->current_size) {	\
-			temp = (DATA*) realloc((void *) vector->data, sizeof(DATA)*2*vector->max_size);	\
-				\
-			if (temp == NULL) {	\
-				err = realloc_failed;	\
-				set_error_info(__FILE__, "add_top", __LINE__);	\
-				return err;	\
-			}	\
-			vector->data = temp;	\
-			size_t index = (vector->max_size / sizeof(DATA)) - 1;	\
-			memtemp = (DATA*) memset((void *) &(vector->data[index]), 0, sizeof(DATA)*vector->max_size);	\
-			if (memtemp == NULL) {	\
-				err = memset_failed;	\
-				set_error_info(__FILE__, "add_top", __LINE__);	\
-				return err;	\
+	static inline error_code grow_vector_##DATA(c_vector_##DATA *vector, size_t bytes, const char *functname) {	\
+		vector_policy *policy = vector->policy;	\
+		size_t newsize = next_capacity(policy, vector->max_size, bytes, sizeof(DATA));	\
+		DATA *temp = NULL;	\
+		/* Inline storage can't be handed to realloc, so it is copied out to the heap */	\
+		if (vector->storage == inline_storage) {	\
+			temp = (DATA *) vector->allocator->allocate(vector->allocator->context, newsize);	\
+			if (temp != NULL) {	\
+				memcpy((void *) temp, (const void *) vector->data, vector->max_size);	\
+				vector->storage = heap_storage;	\
 			}	\
-			temp = NULL;	\
-			vector->data[vector->curr_index] = value;	\
-			vector->current_size = vector->max_size;	\
-			vector->max_size *= 2;	\
-			++(vector->curr_index);	\
-			err = success;	\
-			return success;	\
+		}	\
+		else {	\
+			temp = (DATA *) vector->allocator->reallocate(vector->allocator->context,	\
+					(void *) vector->data, vector->max_size, newsize);	\
+		}	\
+		if (temp == NULL) {	\
+			err = realloc_failed;	\
+			set_error_info(__FILE__, (char *) functname, __LINE__);	\
+			return err;	\
+		}	\
+		add_growth_stat(&policy->stats.grow_count, 1);	\
+		add_growth_stat(&policy->stats.bytes_reserved, newsize - vector->max_size);	\
+		if (temp != vector->data) {	\
+			add_growth_stat(&policy->stats.bytes_moved, vector->max_size);	\
+		}	\
+		/* Bytes below the requested size are about to be overwritten */	\
+		if (policy->zero_on_grow) {	\
+			size_t zerofrom = (bytes > vector->max_size) ? bytes : vector->max_size;	\
+			memset((void *) ((char *) temp + zerofrom), 0, newsize - zerofrom);	\
+			add_growth_stat(&policy->stats.bytes_zeroed, newsize - zerofrom);	\
+		}	\
+		vector->data = temp;	\
+		vector->max_size = newsize;	\
+		return success;	\
+	}	\
+		\
+	error_code add_top_##DATA(c_vector_##DATA *vector, DATA value) {	\
+		size_t bytes = (vector->curr_index+1)*sizeof(DATA);	\
+		/* max_size is in bytes, so compare against the bytes needed for one more element */	\
+		if (bytes > vector->max_size && grow_vector_##DATA(vector, bytes, "add_top") != success) {	\
+			return err;	\
 		}	\
 			\
 		vector->data[vector->curr_index] = value;	\
 		++vector->curr_index;	\
+		if (bytes > vector->current_size) {	\
+			vector->current_size = bytes;	\
+		}	\
 		err = success;	\
 		return success;	\
 	}	\
@@ -246,12 +403,11 @@
 	error_code resize_##DATA(c_vector_##DATA *vector, size_t elementnum) {	\
 		size_t newsize = elementnum*sizeof(DATA);	\
 		DATA *temp = NULL;	\
-		DATA *memtemp = NULL;	\
 		if (newsize == vector->current_size) {	\
 			err = success;	\
 			return success;	\
 		}	\
-		else if (newsize > vector->current_size && newsize < vector->max_size) {	\
+		else if (newsize > vector->current_size && newsize <= vector->max_size) {	\
 			vector->current_size = newsize;	\
 			err = success;	\
 			return success;	\
@@ -274,35 +430,28 @@
 			return success;	\
 		}	\
 			\
-		temp = (DATA*) realloc((void *) vector->data, 2*newsize);	\
-		if (temp == NULL) {	\
-			err = realloc_failed;	\
-			set_error_info(__FILE__, "resize", __LINE__);	\
-			return err;	\
-		}	\
-		vector->data = temp;	\
-		temp = NULL;	\
-		size_t index = (vector->max_size / sizeof(DATA)) - 1;	\
-		memtemp = (DATA*) memset((void *) &(vector->data[index]), 0, ((2*newsize) - vector->max_size));	\
-		if (memtemp == NULL) {	\
-			err = memset_failed;	\
-			set_error_info(__FILE__, "resize", __LINE__);	\
+		/* The elements between the old and new size are not written by the */	\
+		/* caller, so they are always zeroed, whatever the policy says */	\
+		if (grow_vector_##DATA(vector, newsize, "resize") != success) {	\
 			return err;	\
 		}	\
+		memset((void *) ((char *) vector->data + vector->current_size), 0, newsize - vector->current_size);	\
+		add_growth_stat(&vector->policy->stats.bytes_zeroed, newsize - vector->current_size);	\
 		vector->current_size = newsize;	\
-		vector->max_size = 2*newsize;	\
 		err = success;	\
 		return success;	\
 	}	\
 		\
 	error_code shrink_##DATA(c_vector_##DATA* vector) {	\
-		if (vector->max_size == vector->current_size) {	\
+		/* There is nothing to give back while the elements are stored inline */	\
+		if (vector->max_size == vector->current_size || vector->storage == inline_storage) {	\
 			err = success;	\
 			return success;	\
 		}	\
 			\
 		DATA *temp = NULL;	\
-		temp = (DATA *) realloc((void *) vector->data, vector->current_size);	\
+		temp = (DATA *) vector->allocator->reallocate(vector->allocator->context,	\
+				(void *) vector->data, vector->max_size, vector->current_size);	\
 			\
 		if (temp == NULL) {	\
 			err = realloc_failed;	\
@@ -316,33 +465,121 @@
 		return success;	\
 	}	\
 		\
-	static inline void set_vector_ptr_##DATA(c_vector_##DATA* vector) {	\
-		vector->destroy_vector = &destroy_c_vector_##DATA;	\
-		vector->add_top = &add_top_##DATA;	\
-		vector->get_current_index = &get_current_index_##DATA; \
-		vector->get_current_size = &get_current_size_##DATA; \
-		vector->get_max_size = &get_max_size_##DATA; \
-		vector->remove_top = &remove_top_##DATA;	\
-		vector->insert = &insert_##DATA;	\
-		vector->value_at = &value_at_##DATA;	\
-		vector->resize = &resize_##DATA;	\
-		vector->shrink = &shrink_##DATA;	\
+	error_code append_array_##DATA(c_vector_##DATA *vector, const DATA *values, size_t count) {	\
+		size_t bytes = (vector->curr_index + count)*sizeof(DATA);	\
+		if (count == 0) {	\
+			err = success;	\
+			return success;	\
+		}	\
+		if (bytes > vector->max_size && grow_vector_##DATA(vector, bytes, "append_array") != success) {	\
+			return err;	\
+		}	\
+		memcpy((void *) &(vector->data[vector->curr_index]), (const void *) values, count*sizeof(DATA));	\
+		vector->curr_index += count;	\
+		if (bytes > vector->current_size) {	\
+			vector->current_size = bytes;	\
+		}	\
+		err = success;	\
+		return success;	\
+	}	\
+		\
+	error_code append_vector_##DATA(c_vector_##DATA *vector, const c_vector_##DATA *other) {	\
+		size_t count = other->curr_index;	\
+		size_t bytes = (vector->curr_index + count)*sizeof(DATA);	\
+		if (count == 0) {	\
+			err = success;	\
+			return success;	\
+		}	\
+		/* Grow before reading other->data in case other is vector itself */	\
+		if (bytes > vector->max_size && grow_vector_##DATA(vector, bytes, "append_vector") != success) {	\
+			return err;	\
+		}	\
+		memcpy((void *) &(vector->data[vector->curr_index]), (const void *) other->data, count*sizeof(DATA));	\
+		vector->curr_index += count;	\
+		if (bytes > vector->current_size) {	\
+			vector->current_size = bytes;	\
+		}	\
+		err = success;	\
+		return success;	\
+	}	\
+		\
+	error_code insert_range_##DATA(c_vector_##DATA *vector, size_t index, const DATA *values, size_t count) {	\
+		size_t bytes = (vector->curr_index + count)*sizeof(DATA);	\
+		if (index > vector->curr_index) {	\
+			err = invalid_index;	\
+			set_error_info(__FILE__, "insert_range", __LINE__);	\
+			return err;	\
+		}	\
+		if (count == 0) {	\
+			err = success;	\
+			return success;	\
+		}	\
+		if (bytes > vector->max_size && grow_vector_##DATA(vector, bytes, "insert_range") != success) {	\
+			return err;	\
+		}	\
+		memmove((void *) &(vector->data[index + count]), (const void *) &(vector->data[index]),	\
+				(vector->curr_index - index)*sizeof(DATA));	\
+		memcpy((void *) &(vector->data[index]), (const void *) values, count*sizeof(DATA));	\
+		vector->curr_index += count;	\
+		if (bytes > vector->current_size) {	\
+			vector->current_size = bytes;	\
+		}	\
+		err = success;	\
+		return success;	\
+	}	\
+		\
+	static const c_vector_ops_##DATA vector_ops_##DATA = {	\
+		&destroy_c_vector_##DATA,	\
+		&add_top_##DATA,	\
+		&remove_top_##DATA,	\
+		&get_current_index_##DATA,	\
+		&get_current_size_##DATA,	\
+		&get_max_size_##DATA,	\
+		&insert_##DATA,	\
+		&value_at_##DATA,	\
+		&resize_##DATA,	\
+		&shrink_##DATA,	\
+		&append_array_##DATA,	\
+		&append_vector_##DATA,	\
+		&insert_range_##DATA	\
+	};	\
+		\
+	/* The fast path is a capacity check and a store. Growth is left to add_top */	\
+	static inline error_code push_inline_##DATA(c_vector_##DATA *vector, DATA value) {	\
+		size_t bytes = (vector->curr_index+1)*sizeof(DATA);	\
+		if (bytes <= vector->max_size) {	\
+			vector->data[vector->curr_index] = value;	\
+			++(vector->curr_index);	\
+			if (bytes > vector->current_size) {	\
+				vector->current_size = bytes;	\
+			}	\
+			return success;	\
+		}	\
+		return add_top_##DATA(vector, value);	\
+	}	\
+		\
+	static inline DATA at_inline_##DATA(const c_vector_##DATA *vector, size_t index) {	\
+		return vector->data[index];	\
+	}	\
+		\
+	static inline size_t length_inline_##DATA(const c_vector_##DATA *vector) {	\
+		return vector->curr_index;	\
 	}	\
 	\
-	c_vector_##DATA *new_vector_##DATA(size_t number) {	\
+	c_vector_##DATA *new_vector_##DATA(size_t number, const c_allocator *allocator) {	\
 		c_vector(DATA) *vector = NULL;	\
 										\
-		vector = (c_vector(DATA) *) calloc(1, sizeof(c_vector(DATA)));	\
+		vector = (c_vector(DATA) *) allocator_calloc(allocator, sizeof(c_vector(DATA)));	\
 				\
 		if (vector == NULL) {	\
 			return NULL;	\
 		}	\
 			\
 		if (number == 0) {	\
-			vector->data = (DATA*) calloc(2, sizeof(DATA));	\
+			vector->data = (DATA*) allocator_calloc(allocator, 2*sizeof(DATA));	\
 				\
 			if (vector->data == NULL) {	\
-				free(vector);	\
+				allocator_free(allocator, vector);	\
 				return NULL;	\
 			}	\
 				\
@@ -351,23 +588,73 @@
 		}	\
 			\
 		else {	\
-			vector->data = (DATA*) calloc(2*number, sizeof(DATA));	\
+			vector->data = (DATA*) allocator_calloc(allocator, 2*number*sizeof(DATA));	\
 				\
 			if (vector->data == NULL) {	\
-				free(vector);	\
+				allocator_free(allocator, vector);	\
 				return NULL;	\
 			}	\
 				\
-			vector->max_size = 2*number;	\
-			vector->current_size = number;	\
+			vector->max_size = 2*number*sizeof(DATA);	\
+			vector->current_size = number*sizeof(DATA);	\
 		}	\
 		vector->curr_index = 0;	\
 		vector->data_type = type_name(DATA);	\
-		set_vector_ptr_##DATA(vector);	\
+		vector->ops = &vector_ops_##DATA;	\
+		vector->policy = default_policy_##DATA;	\
+		vector->storage = heap_storage;	\
+		vector->allocator = allocator;	\
 		return vector;	\
 	}	\
 	define_vector_iterator(DATA)	\
-	
+
+/* define_small_vector(DATA, N)
+ * INPUT: DATA -> data type for desired vector, N -> number of elements stored inline
+ * OUTPUT: None
+ * USAGE: define_small_vector(int, 8)
+ * NOTES: define_vector(DATA) must be called first. A small vector is a c_vector
+ * followed by room for N elements in the same allocation. data points at that room
+ * until the vector grows past N elements, at which point the elements are copied to
+ * the heap and it behaves like any other c_vector. Since the constructor hands back a
+ * plain c_vector(DATA) pointer, add_top, value_at, the inline entry points and the
+ * vector iterator all work on it unchanged.
+ *
+ * c_vector_##DATA *new_small_vector_##DATA##_##N(const c_allocator *allocator)
+ * INPUT: const c_allocator *allocator -> allocator for the vector and any heap storage
+ * OUTPUT: c_vector struct pointer
+ * USAGE: internal use only, use the new_small_c_vector macro wrappers
+ * NOTES: This only makes one allocation. Nothing is zeroed after that
+ * allocation, since allocator_calloc already did it.
+ */
+#define define_small_vector(DATA, N)	\
+	typedef struct small_vector_##DATA##_##N {	\
+		c_vector_##DATA vector;	\
+		DATA inline_data[N];	\
+	} small_vector_##DATA##_##N;	\
+		\
+	c_vector_##DATA *new_small_vector_##DATA##_##N(const c_allocator *allocator) {	\
+		small_vector_##DATA##_##N *small = NULL;	\
+		c_vector_##DATA *vector = NULL;	\
+			\
+		small = (small_vector_##DATA##_##N *) allocator_calloc(allocator, sizeof(small_vector_##DATA##_##N));	\
+			\
+		if (small == NULL) {	\
+			return NULL;	\
+		}	\
+			\
+		vector = &(small->vector);	\
+		vector->data = small->inline_data;	\
+		vector->max_size = N*sizeof(DATA);	\
+		vector->current_size = 0;	\
+		vector->curr_index = 0;	\
+		vector->data_type = type_name(DATA);	\
+		vector->ops = &vector_ops_##DATA;	\
+		vector->policy = default_policy_##DATA;	\
+		vector->storage = inline_storage;	\
+		vector->allocator = allocator;	\
+		return vector;	\
+	}	\
+
 /* c_vector(DATA)
  * INPUT: DATA -> the data type desired for the array
  * OUTPUT: None
@@ -388,7 +675,38 @@
  * how exactly how the data type is used to uniquely name the function, one need only specify the 
  * data type and number of elements.
  */
-#define new_c_vector(DATA, NUMBER) new_vector_##DATA((size_t) NUMBER)
+#define new_c_vector(DATA, NUMBER) new_vector_##DATA((size_t) NUMBER, &default_allocator)
+/* new_c_vector_with(DATA, NUMBER, ALLOCATOR)
+ * INPUT: DATA -> the data type desired for the array, NUMBER -> the number of elements to preallocate,
+ * ALLOCATOR -> const c_allocator pointer
+ * OUTPUT: Pointer to newly created c_vector struct
+ * USAGE: c_vector(int) *vector = new_c_vector_with(int, 0, &arena->allocator);
+ * NOTES: Same as new_c_vector, except that the vector and its buffer come from ALLOCATOR.
+ * If ALLOCATOR is an arena, the vector does not need to be destroyed before the arena is.
+ */
+#define new_c_vector_with(DATA, NUMBER, ALLOCATOR) new_vector_##DATA((size_t) NUMBER, ALLOCATOR)
+/* c_vector_push(DATA, VECTOR, VALUE), c_vector_at(DATA, VECTOR, INDEX), c_vector_length(DATA, VECTOR)
+ * INPUT: DATA -> the data type of the vector, VECTOR -> c_vector pointer
+ * OUTPUT: same as add_top, the value at INDEX, and the current index respectively
+ * USAGE: for (int i = 0; i < n; ++i) c_vector_push(int, vector, i);
+ * NOTES: These call the static inline versions directly rather than going through
+ * vector->ops, so the compiler is able to inline them into hot loops. c_vector_push only
+ * falls back to add_top when the vector has to grow, and it does not touch err on the
+ * fast path. c_vector_at does no bounds checking; use value_at if the index is untrusted.
+ */
+#define c_vector_push(DATA, VECTOR, VALUE)	push_inline_##DATA(VECTOR, VALUE)
+#define c_vector_at(DATA, VECTOR, INDEX)	at_inline_##DATA(VECTOR, (size_t) INDEX)
+#define c_vector_length(DATA, VECTOR)	length_inline_##DATA(VECTOR)
+/* small_vector(DATA, N) and new_small_c_vector(DATA, N)
+ * USAGE: c_vector(int) *vector = new_small_c_vector(int, 8);
+ * NOTES: small_vector(DATA, N) names the underlying struct, which is only needed
+ * for things like sizeof. Everything else should go through the c_vector pointer.
+ */
+#define small_vector(DATA, N)	small_vector_##DATA##_##N
+#define new_small_c_vector(DATA, N)	new_small_vector_##DATA##_##N(&default_allocator)
+#define new_small_c_vector_with(DATA, N, ALLOCATOR)	new_small_vector_##DATA##_##N(ALLOCATOR)
+#define c_vector_set_policy(DATA, VECTOR, POLICY)	set_policy_##DATA(VECTOR, POLICY)
+#define c_vector_set_default_policy(DATA, POLICY)	set_default_policy_##DATA(POLICY)
 
 #define define_vector_iterator(TYPE)	\
 typedef struct vector_iterator_##c_vector_##TYPE {	\
@@ -0,0 +1,332 @@
+#ifndef CHUNKED_VECTOR_H
+#define CHUNKED_VECTOR_H
+#ifndef __cplusplus
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdbool.h>
+#else
+#include <cstdlib>
+#include <cstddef>
+#include <cstring>
+#endif
+#include "iterator.h"
+#include "error.h"
+#include "allocator.h"
+
+/* chunked_vector stores its elements in fixed size blocks instead of one buffer.
+ * A small block index (an array of block pointers) finds the block for an index,
+ * so element i is blocks[i >> block_shift][i & block_mask], which is two loads
+ * and no division.
+ *
+ * Appending only ever allocates a new block, and a block never moves once it is
+ * allocated. So unlike c_vector, growing never copies the elements, never needs
+ * room for two copies of them at once, and never invalidates a pointer to an
+ * element. The only thing that is reallocated is the block index, which is one
+ * pointer per block and is doubled when it fills up.
+ *
+ * Blocks are CHUNKED_BLOCK_BYTES long, rounded down so that they hold a power of
+ * two elements. An element larger than that gets a block of its own. Blocks are
+ * not zeroed, since every element is written by the append that adds it.
+ *
+ * remove_top keeps emptied blocks around for the next append. shrink gives back
+ * every block past the last element.
+ */
+
+#define CHUNKED_BLOCK_BYTES	(64*1024)
+
+static inline unsigned int chunked_block_shift(size_t elemsize) {
+	unsigned int shift = 0;
+	while (((size_t) 2 << shift)*elemsize <= CHUNKED_BLOCK_BYTES)
+		++shift;
+	return shift;
+}
+
+/* define_chunked_vector(DATA)
+ * INPUT: DATA -> data type for the vector
+ * OUTPUT: None
+ * USAGE: define_chunked_vector(int)
+ * NOTES: The operations mirror c_vector's, and are reached the same way, through
+ * vector->ops.
+ *
+ * error_code add_top_chunked_##DATA(chunked_vector_##DATA *vector, DATA value)
+ * OUTPUT: success, or realloc_failed if a block or the block index couldn't be allocated
+ * USAGE: vector->ops->add_top(vector, value); or chunked_vector_push(int, vector, value);
+ *
+ * error_code append_array_chunked_##DATA(chunked_vector_##DATA *vector, const DATA *values, size_t count)
+ * OUTPUT: success, or realloc_failed
+ * USAGE: vector->ops->append_array(vector, batch, 10000);
+ * NOTES: Copies a block at a time. Every block needed is allocated before anything
+ * is copied, so on failure the vector is unchanged.
+ *
+ * error_code remove_top_chunked_##DATA(chunked_vector_##DATA *vector)
+ * NOTES: Zeroes the last element and drops it, the same as c_vector's remove_top.
+ *
+ * DATA value_at_chunked_##DATA(chunked_vector_##DATA *vector, size_t index)
+ * OUTPUT: the element at index, or a zeroed DATA with err set to invalid_index
+ *
+ * error_code shrink_chunked_##DATA(chunked_vector_##DATA *vector)
+ * NOTES: Frees the blocks past the last element. The block index keeps its size.
+ */
+#define define_chunked_vector(DATA)	\
+	typedef struct chunked_vector_##DATA {	\
+		DATA **blocks;	\
+		size_t block_count;	\
+		size_t index_capacity;	\
+		size_t length;	\
+		unsigned int block_shift;	\
+		size_t block_mask;	\
+		const struct chunked_vector_ops_##DATA *ops;	\
+		const c_allocator *allocator;	\
+	} chunked_vector_##DATA;	\
+		\
+	typedef struct chunked_vector_ops_##DATA {	\
+		struct chunked_vector_##DATA *(*destroy_vector)(struct chunked_vector_##DATA*);	\
+		error_code (*add_top)(struct chunked_vector_##DATA*, DATA);	\
+		error_code (*remove_top)(struct chunked_vector_##DATA*);	\
+		DATA (*value_at)(struct chunked_vector_##DATA*, size_t);	\
+		error_code (*append_array)(struct chunked_vector_##DATA*, const DATA*, size_t);	\
+		error_code (*shrink)(struct chunked_vector_##DATA*);	\
+		size_t (*length)(struct chunked_vector_##DATA*);	\
+	} chunked_vector_ops_##DATA;	\
+		\
+	static inline size_t chunked_capacity_##DATA(const chunked_vector_##DATA *vector) {	\
+		return vector->block_count << vector->block_shift;	\
+	}	\
+		\
+	/* Allocates blocks until there is room for at least needed elements */	\
+	static error_code add_blocks_##DATA(chunked_vector_##DATA *vector, size_t needed, const char *functname) {	\
+		const c_allocator *allocator = vector->allocator;	\
+		size_t blocks = (needed + vector->block_mask) >> vector->block_shift;	\
+		if (blocks > vector->index_capacity) {	\
+			size_t capacity = (vector->index_capacity == 0) ? 4 : vector->index_capacity;	\
+			DATA **index = NULL;	\
+			while (capacity < blocks)	\
+				capacity *= 2;	\
+			index = (DATA **) allocator->reallocate(allocator->context, vector->blocks,	\
+					vector->index_capacity*sizeof(DATA *), capacity*sizeof(DATA *));	\
+			if (index == NULL) {	\
+				err = realloc_failed;	\
+				set_error_info(__FILE__, functname, __LINE__);	\
+				return err;	\
+			}	\
+			vector->blocks = index;	\
+			vector->index_capacity = capacity;	\
+		}	\
+		while (vector->block_count < blocks) {	\
+			DATA *block = (DATA *) allocator->allocate(allocator->context, (vector->block_mask + 1)*sizeof(DATA));	\
+			if (block == NULL) {	\
+				err = realloc_failed;	\
+				set_error_info(__FILE__, functname, __LINE__);	\
+				return err;	\
+			}	\
+			vector->blocks[vector->block_count++] = block;	\
+		}	\
+		return success;	\
+	}	\
+		\
+	static inline DATA *ptr_inline_chunked_##DATA(const chunked_vector_##DATA *vector, size_t index) {	\
+		return &vector->blocks[index >> vector->block_shift][index & vector->block_mask];	\
+	}	\
+		\
+	error_code add_top_chunked_##DATA(chunked_vector_##DATA *vector, DATA value) {	\
+		if (vector->length == chunked_capacity_##DATA(vector) &&	\
+			add_blocks_##DATA(vector, vector->length + 1, "add_top") != success)	\
+			return err;	\
+		*ptr_inline_chunked_##DATA(vector, vector->length) = value;	\
+		++vector->length;	\
+		err = success;	\
+		return success;	\
+	}	\
+		\
+	error_code append_array_chunked_##DATA(chunked_vector_##DATA *vector, const DATA *values, size_t count) {	\
+		size_t done = 0;	\
+		if (vector->length + count > chunked_capacity_##DATA(vector) &&	\
+			add_blocks_##DATA(vector, vector->length + count, "append_array") != success)	\
+			return err;	\
+		while (done < count) {	\
+			size_t offset = (vector->length + done) & vector->block_mask;	\
+			size_t n = vector->block_mask + 1 - offset;	\
+			if (n > count - done)	\
+				n = count - done;	\
+			memcpy((void *) ptr_inline_chunked_##DATA(vector, vector->length + done), (const void *) &values[done], n*sizeof(DATA));	\
+			done += n;	\
+		}	\
+		vector->length += count;	\
+		err = success;	\
+		return success;	\
+	}	\
+		\
+	error_code remove_top_chunked_##DATA(chunked_vector_##DATA *vector) {	\
+		if (vector->length == 0) {	\
+			err = success;	\
+			return success;	\
+		}	\
+		--vector->length;	\
+		memset((void *) ptr_inline_chunked_##DATA(vector, vector->length), 0, sizeof(DATA));	\
+		err = success;	\
+		return success;	\
+	}	\
+		\
+	DATA value_at_chunked_##DATA(chunked_vector_##DATA *vector, size_t index) {	\
+		DATA value;	\
+		if (index >= vector->length) {	\
+			memset(&value, 0, sizeof(DATA));	\
+			err = invalid_index;	\
+			set_error_info(__FILE__, "value_at", __LINE__);	\
+			return value;	\
+		}	\
+		return *ptr_inline_chunked_##DATA(vector, index);	\
+	}	\
+		\
+	error_code shrink_chunked_##DATA(chunked_vector_##DATA *vector) {	\
+		size_t keep = (vector->length + vector->block_mask) >> vector->block_shift;	\
+		while (vector->block_count > keep)	\
+			allocator_free(vector->allocator, vector->blocks[--vector->block_count]);	\
+		err = success;	\
+		return success;	\
+	}	\
+		\
+	size_t length_chunked_##DATA(chunked_vector_##DATA *vector) {	\
+		return vector->length;	\
+	}	\
+		\
+	chunked_vector_##DATA *destroy_chunked_vector_##DATA(chunked_vector_##DATA *vector) {	\
+		if (vector == NULL) {	\
+			return NULL;	\
+		}	\
+		for (size_t i = 0; i < vector->block_count; ++i)	\
+			allocator_free(vector->allocator, vector->blocks[i]);	\
+		allocator_free(vector->allocator, vector->blocks);	\
+		allocator_free(vector->allocator, vector);	\
+		return NULL;	\
+	}	\
+		\
+	static const chunked_vector_ops_##DATA chunked_ops_##DATA = {	\
+		&destroy_chunked_vector_##DATA,	\
+		&add_top_chunked_##DATA,	\
+		&remove_top_chunked_##DATA,	\
+		&value_at_chunked_##DATA,	\
+		&append_array_chunked_##DATA,	\
+		&shrink_chunked_##DATA,	\
+		&length_chunked_##DATA	\
+	};	\
+		\
+	/* The fast path is a capacity check and a store. New blocks are left to add_top */	\
+	static inline error_code push_inline_chunked_##DATA(chunked_vector_##DATA *vector, DATA value) {	\
+		if (vector->length < chunked_capacity_##DATA(vector)) {	\
+			*ptr_inline_chunked_##DATA(vector, vector->length) = value;	\
+			++vector->length;	\
+			return success;	\
+		}	\
+		return add_top_chunked_##DATA(vector, value);	\
+	}	\
+		\
+	chunked_vector_##DATA *new_chunked_vector_##DATA(const c_allocator *allocator) {	\
+		chunked_vector_##DATA *vector = NULL;	\
+			\
+		vector = (chunked_vector_##DATA *) allocator_calloc(allocator, sizeof(chunked_vector_##DATA));	\
+			\
+		if (vector == NULL) {	\
+			return NULL;	\
+		}	\
+			\
+		vector->block_shift = chunked_block_shift(sizeof(DATA));	\
+		vector->block_mask = ((size_t) 1 << vector->block_shift) - 1;	\
+		vector->ops = &chunked_ops_##DATA;	\
+		vector->allocator = allocator;	\
+		return vector;	\
+	}	\
+	define_chunked_iterator(DATA)	\
+
+/* chunked_iterator walks the vector from first to last, or back with prev. value
+ * points at the current element and is NULL once end is true. Since elements
+ * never move, value stays good after the iterator moves on, and appending while
+ * iterating is fine.
+ *
+ * USAGE: for (giter->first(giter); !giter->end(giter); giter->next(giter))
+ *     printf("%d\n", *iter->value);
+ */
+#define define_chunked_iterator(DATA)	\
+typedef struct chunked_iterator_##DATA {	\
+	generic_iterator geniter;	\
+	void (*prev)(generic_iterator*);	\
+	DATA *value;	\
+	size_t index;	\
+	chunked_vector_##DATA *vector;	\
+} chunked_iterator_##DATA;	\
+	\
+static inline void move_chunked_iterator_##DATA(chunked_iterator_##DATA *iter, size_t index) {	\
+	iter->index = index;	\
+	iter->value = (index < iter->vector->length) ? ptr_inline_chunked_##DATA(iter->vector, index) : NULL;	\
+}	\
+	\
+void first_chunked_iterator_##DATA(generic_iterator *generic) {	\
+	move_chunked_iterator_##DATA((chunked_iterator_##DATA *) generic, 0);	\
+}	\
+	\
+/* Within a block the next element is right after this one */	\
+void next_chunked_iterator_##DATA(generic_iterator *generic) {	\
+	chunked_iterator_##DATA *iter = (chunked_iterator_##DATA *) generic;	\
+	size_t index = iter->index + 1;	\
+	if (iter->value != NULL && index < iter->vector->length && (index & iter->vector->block_mask) != 0) {	\
+		iter->index = index;	\
+		++iter->value;	\
+	}	\
+	else	\
+		move_chunked_iterator_##DATA(iter, index);	\
+}	\
+	\
+/* Stepping back from the first element ends the iteration */	\
+void prev_chunked_iterator_##DATA(generic_iterator *generic) {	\
+	chunked_iterator_##DATA *iter = (chunked_iterator_##DATA *) generic;	\
+	move_chunked_iterator_##DATA(iter, (iter->index == 0) ? iter->vector->length : iter->index - 1);	\
+}	\
+	\
+void last_chunked_iterator_##DATA(generic_iterator *generic) {	\
+	chunked_iterator_##DATA *iter = (chunked_iterator_##DATA *) generic;	\
+	move_chunked_iterator_##DATA(iter, (iter->vector->length == 0) ? 0 : iter->vector->length - 1);	\
+}	\
+	\
+bool end_chunked_iterator_##DATA(generic_iterator *generic) {	\
+	return ((chunked_iterator_##DATA *) generic)->value == NULL;	\
+}	\
+	\
+static inline void set_chunked_iterator_ptr_##DATA(chunked_iterator_##DATA *iter) {	\
+	generic_iterator *giter = (generic_iterator *) iter;	\
+	giter->first = &first_chunked_iterator_##DATA;	\
+	giter->next = &next_chunked_iterator_##DATA;	\
+	giter->last = &last_chunked_iterator_##DATA;	\
+	giter->end = &end_chunked_iterator_##DATA;	\
+	giter->destroy_iterator = &destroy_iterator;	\
+	iter->prev = &prev_chunked_iterator_##DATA;	\
+}	\
+	\
+generic_iterator *new_chunked_iterator_##DATA(chunked_vector_##DATA *vector) {	\
+	if (vector == NULL)	\
+		return NULL;	\
+	generic_iterator *ci = (generic_iterator *) calloc(1, sizeof(chunked_iterator_##DATA));	\
+	chunked_iterator_##DATA *iter = (chunked_iterator_##DATA *) ci;	\
+	if (ci == NULL)	\
+		return NULL;	\
+	iter->vector = vector;	\
+	set_chunked_iterator_ptr_##DATA(iter);	\
+	first_chunked_iterator_##DATA(ci);	\
+	return ci;	\
+}	\
+
+#define chunked_vector(DATA)	chunked_vector_##DATA
+#define new_chunked_vector(DATA)	new_chunked_vector_##DATA(&default_allocator)
+#define new_chunked_vector_with(DATA, ALLOCATOR)	new_chunked_vector_##DATA(ALLOCATOR)
+/* Same as c_vector_push, c_vector_at and c_vector_length. chunked_vector_ptr is the
+ * address of the element at INDEX, which stays the same until the element is removed.
+ * None of these check INDEX.
+ */
+#define chunked_vector_push(DATA, VECTOR, VALUE)	push_inline_chunked_##DATA(VECTOR, VALUE)
+#define chunked_vector_at(DATA, VECTOR, INDEX)	(*ptr_inline_chunked_##DATA(VECTOR, (size_t) INDEX))
+#define chunked_vector_ptr(DATA, VECTOR, INDEX)	ptr_inline_chunked_##DATA(VECTOR, (size_t) INDEX)
+#define chunked_vector_length(DATA, VECTOR)	((VECTOR)->length)
+#define chunked_iterator(DATA)	chunked_iterator_##DATA
+#define new_chunked_iterator(DATA, VECTOR)	new_chunked_iterator_##DATA(VECTOR)
+
+#endif
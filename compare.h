@@ -0,0 +1,151 @@
+#ifndef COMPARE_H
+#define COMPARE_H
+#ifndef __cplusplus
+#include <stdio.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+#else
+#include <cstdio>
+#include <cstddef>
+#include <cstdint>
+#endif
+
+/* Key comparison for the containers that keep their elements in order.
+ * A comparator takes two keys by value and returns a negative number, zero or
+ * a positive number, like strcmp. Anything that can be called that way works,
+ * whether it is a function or a macro, so a comparator passed to one of the
+ * *_cmp define macros is inlined straight into the search loop.
+ */
+
+/* rb_tree used to compare the byte value of every key. This means that the endianness
+ * of the machine matters. For that reason, a custom memcmp type function
+ * is used that accounts for endianness. It is still what default_compare falls back
+ * on for keys that aren't a built in number type, such as structs.
+ */
+
+static inline bool is_little() {
+#if defined(__BYTE_ORDER__) && defined(__ORDER_LITTLE_ENDIAN__)
+	return __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__;
+#else
+	int n = 1;
+	if (*(char *) &n == 1)
+		return true;
+	return false;
+#endif
+}
+
+/* This is used for debugging the custom memcmp. */
+static inline void print_bytes(const void *key, size_t bytes) {
+	unsigned char *temp = (unsigned char *) key;
+	for (size_t i = 0; i < bytes; ++i)
+		printf("%02x", temp[i]);
+	printf("\n");
+}
+
+/* memcmp does not account for endianness. This could mess up the insert function */
+/* This comparison function accounts for endianness. */
+static inline int compare_little_endian(const unsigned char *key, const unsigned char *nkey, size_t bytes) {
+	for (size_t i = bytes; i > 0; --i) {
+		if (key[i - 1] > nkey[i - 1])
+			return 1;
+		else if (key[i - 1] < nkey[i - 1])
+			return -1;
+	}
+	return 0;
+}
+static inline int compare_big_endian(const unsigned char *key, const unsigned char *nkey, size_t bytes) {
+	for (size_t i = 0; i < bytes; ++i) {
+		if (key[i] >  nkey[i])
+			return 1;
+		else if (key[i] <  nkey[i])
+			return -1;
+	}
+	return 0;
+}
+
+/* This will not necessarily work with machines that are neither big nor little endian */
+static inline int compare_bytes(const void *key, const void *nkey, size_t bytes) {
+	if (is_little())
+		return compare_little_endian((unsigned char *) key, (unsigned char *)  nkey, bytes);
+	else
+		return compare_big_endian((unsigned char *) key, (unsigned char *)  nkey, bytes);
+}
+
+/* define_compare(NAME, TYPE)
+ * INPUT: NAME -> suffix for the function name, TYPE -> type being compared
+ * OUTPUT: None
+ * USAGE: define_compare(uint, unsigned int)
+ * NOTES: Defines int compare_##NAME(TYPE a, TYPE b). The result is computed
+ * without branches. NaN is not ordered against anything, so float and double keys
+ * must not be NaN.
+ */
+#define define_compare(NAME, TYPE)	\
+static inline int compare_##NAME(TYPE a, TYPE b) {	\
+	return (a > b) - (a < b);	\
+}	\
+	\
+static inline int compare_ref_##NAME(const void *a, const void *b, size_t bytes) {	\
+	(void) bytes;	\
+	return compare_##NAME(*(const TYPE *) a, *(const TYPE *) b);	\
+}	\
+
+define_compare(char, char)
+define_compare(schar, signed char)
+define_compare(uchar, unsigned char)
+define_compare(short, short)
+define_compare(ushort, unsigned short)
+define_compare(int, int)
+define_compare(uint, unsigned int)
+define_compare(long, long)
+define_compare(ulong, unsigned long)
+define_compare(llong, long long)
+define_compare(ullong, unsigned long long)
+define_compare(float, float)
+define_compare(double, double)
+define_compare(ldouble, long double)
+define_compare(bool, bool)
+
+/* Pointer keys are ordered by address. Any object pointer converts to const void *,
+ * so this works for every pointer key type.
+ * USAGE: define_map_cmp(string, int, compare_ptr)
+ */
+static inline int compare_ptr(const void *a, const void *b) {
+	uintptr_t x = (uintptr_t) a;
+	uintptr_t y = (uintptr_t) b;
+	return (x > y) - (x < y);
+}
+
+/* default_compare(a, b)
+ * INPUT: a, b -> lvalues of the key type
+ * OUTPUT: negative, zero or positive
+ * USAGE: define_rbtree(K,V) uses it when no comparator is given
+ * NOTES: Built in number types are compared natively, so signed keys sort with
+ * negative numbers first. Every other type is compared with compare_bytes.
+ * The choice is made at compile time, so nothing is left but the comparison.
+ * C++ has no _Generic, so it always uses compare_bytes.
+ */
+#ifndef __cplusplus
+#define default_compare(a, b)	\
+	_Generic((a),	\
+		char: compare_ref_char,	\
+		signed char: compare_ref_schar,	\
+		unsigned char: compare_ref_uchar,	\
+		short: compare_ref_short,	\
+		unsigned short: compare_ref_ushort,	\
+		int: compare_ref_int,	\
+		unsigned int: compare_ref_uint,	\
+		long: compare_ref_long,	\
+		unsigned long: compare_ref_ulong,	\
+		long long: compare_ref_llong,	\
+		unsigned long long: compare_ref_ullong,	\
+		float: compare_ref_float,	\
+		double: compare_ref_double,	\
+		long double: compare_ref_ldouble,	\
+		bool: compare_ref_bool,	\
+		default: compare_bytes)(&(a), &(b), sizeof(a))
+#else
+#define default_compare(a, b)	compare_bytes(&(a), &(b), sizeof(a))
+#endif
+
+#endif
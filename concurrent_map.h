@@ -0,0 +1,341 @@
+#ifndef CONCURRENT_MAP_H
+#define CONCURRENT_MAP_H
+#ifndef __cplusplus
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#else
+#include <cstdlib>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#endif
+#include <pthread.h>
+#include "c_map.h"
+#include "flat_map.h"
+#include "hash.h"
+#include "compare.h"
+#include "error.h"
+#include "allocator.h"
+
+/* concurrent_map is a c_map that any number of threads can use at once. The keys
+ * are split across a power of two number of shards by their hash, and each shard
+ * is an ordinary c_map behind its own reader-writer lock. Lookups take the read
+ * lock of one shard, so readers never wait for each other, and a writer only holds
+ * up the keys of its own shard. The shards are padded apart so that their locks
+ * don't share a cache line.
+ *
+ * snapshot copies every pair into a new c_flat_map. It read locks all of the shards
+ * in order before copying any of them, so the snapshot is the map as it was at one
+ * moment, and writers are only held up while the pairs are copied. Everything the
+ * copy needs is allocated before the locks are taken. Each shard comes out as a
+ * sorted run, and once the locks are released the runs are merged straight into the
+ * snapshot's arrays. Nothing ever changes a snapshot after that, so any number of
+ * threads can read it without a lock, and its keys and values arrays are the way
+ * to walk every pair in order.
+ * Whoever took the snapshot destroys it.
+ *
+ * err is per thread (see error.h), so a miss in one thread doesn't show up in another.
+ * The allocator has to be safe to call from several threads at once, which rules
+ * out sharing a c_arena between writers.
+ */
+
+/* Shards a map gets when it is created with 0 */
+#define CONCURRENT_MAP_DEFAULT_SHARDS	64
+#define CONCURRENT_MAP_CACHE_LINE	64
+
+/* define_concurrent_map_hash(K, V, HASH, CMP)
+ * INPUT: K -> key data type, V -> value data type, HASH -> hash for K, CMP ->
+ * comparator for K
+ * OUTPUT: None
+ * USAGE: define_concurrent_map_hash(string, int, hash_ptr, compare_ptr)
+ * NOTES: HASH picks the shard and CMP orders the keys in each shard and in a
+ * snapshot. Keys that CMP calls equal must hash the same. This also defines c_map(K,V)
+ * and c_flat_map(K,V), so those can't be defined again for the same K and V.
+ * define_concurrent_map(K, V) uses default_hash and default_compare, and
+ * define_concurrent_map_cmp(K, V, CMP) uses default_hash.
+ *
+ * concurrent_map(K,V) *new_concurrent_map_##K##_##V(size_t shards, const c_allocator *allocator)
+ * INPUT: shards -> number of shards, rounded up to a power of two, or 0 for
+ * CONCURRENT_MAP_DEFAULT_SHARDS, allocator -> where the shards and their maps come from
+ * OUTPUT: the map, or NULL if it couldn't be allocated
+ * USAGE: concurrent_map(long, char) *map = new_concurrent_map(long, char, 0);
+ * NOTES: Several times more shards than threads keeps two writers from landing on
+ * the same shard very often.
+ *
+ * error_code insert_concurrent_map_##K##_##V(concurrent_map(K,V) *map, K key, V value)
+ * error_code delete_pair_concurrent_map_##K##_##V(concurrent_map(K,V) *map, K key)
+ * V get_value_concurrent_map_##K##_##V(concurrent_map(K,V) *map, K key)
+ * bool is_key_concurrent_map_##K##_##V(concurrent_map(K,V) *map, K key)
+ * INPUT: map -> the map, key -> key to find, value -> value for the key
+ * OUTPUT: The same as the c_map functions of the same name
+ * USAGE: if (map->is_key(map, key)) value = map->get_value(map, key);
+ * NOTES: Each locks the key's shard for as long as the c_map call takes, with the
+ * read lock for get_value and is_key and the write lock otherwise.
+ *
+ * size_t size_concurrent_map_##K##_##V(concurrent_map(K,V) *map)
+ * INPUT: map -> the map
+ * OUTPUT: the number of pairs
+ * USAGE: size_t pairs = map->size(map);
+ * NOTES: The shards are counted one at a time, so while writers are busy the total
+ * is only a close guess. A snapshot's count is exact.
+ *
+ * c_flat_map(K,V) *snapshot_concurrent_map_##K##_##V(concurrent_map(K,V) *map)
+ * INPUT: map -> the map
+ * OUTPUT: a new flat map with every pair in the map, or NULL with err set to
+ * realloc_failed if memory ran out
+ * USAGE: c_flat_map(long, char) *view = map->snapshot(map);
+ *        for (size_t i = 0; i < view->count; ++i) total += view->values[i];
+ *        view = view->destroy_map(view);
+ */
+#define define_concurrent_map(K, V)	define_concurrent_map_hash(K, V, default_hash, default_compare)
+#define define_concurrent_map_cmp(K, V, CMP)	define_concurrent_map_hash(K, V, default_hash, CMP)
+
+#define define_concurrent_map_hash(K, V, HASH, CMP)	\
+	define_map_cmp(K, V, CMP)	\
+	define_flat_map_cmp(K, V, CMP)	\
+		\
+	typedef struct concurrent_shard_##K##_##V {	\
+		pthread_rwlock_t lock;	\
+		c_map(K,V) *map;	\
+		char pad[CONCURRENT_MAP_CACHE_LINE];	\
+	} concurrent_shard_##K##_##V;	\
+		\
+	typedef struct concurrent_map_##K##_##V {	\
+		concurrent_shard_##K##_##V *shards;	\
+		size_t shard_count;	\
+		size_t mask;	\
+		const c_allocator *allocator;	\
+		struct concurrent_map_##K##_##V *(*destroy_map)(struct concurrent_map_##K##_##V*);	\
+		error_code (*insert)(struct concurrent_map_##K##_##V*, K, V);	\
+		error_code (*delete_pair)(struct concurrent_map_##K##_##V*, K);	\
+		V (*get_value)(struct concurrent_map_##K##_##V*, K);	\
+		bool (*is_key)(struct concurrent_map_##K##_##V*, K);	\
+		size_t (*size)(struct concurrent_map_##K##_##V*);	\
+		c_flat_map(K,V) *(*snapshot)(struct concurrent_map_##K##_##V*);	\
+	} concurrent_map_##K##_##V;	\
+		\
+	static inline concurrent_shard_##K##_##V *shard_of_##K##_##V(concurrent_map(K,V) *map, K key) {	\
+		return &map->shards[(size_t) HASH(key) & map->mask];	\
+	}	\
+		\
+	concurrent_map(K,V) *destroy_concurrent_map_##K##_##V(concurrent_map(K,V) *map) {	\
+		if (map == NULL) {	\
+			return NULL;	\
+		}	\
+		for (size_t i = 0; i < map->shard_count; ++i) {	\
+			if (map->shards[i].map != NULL) {	\
+				map->shards[i].map->destroy_map(map->shards[i].map);	\
+				pthread_rwlock_destroy(&map->shards[i].lock);	\
+			}	\
+		}	\
+		allocator_free(map->allocator, map->shards);	\
+		allocator_free(map->allocator, map);	\
+		return NULL;	\
+	}	\
+		\
+	error_code insert_concurrent_map_##K##_##V(concurrent_map(K,V) *map, K key, V value) {	\
+		concurrent_shard_##K##_##V *shard = shard_of_##K##_##V(map, key);	\
+		error_code result;	\
+		pthread_rwlock_wrlock(&shard->lock);	\
+		result = shard->map->insert(shard->map, key, value);	\
+		pthread_rwlock_unlock(&shard->lock);	\
+		return result;	\
+	}	\
+		\
+	error_code delete_pair_concurrent_map_##K##_##V(concurrent_map(K,V) *map, K key) {	\
+		concurrent_shard_##K##_##V *shard = shard_of_##K##_##V(map, key);	\
+		error_code result;	\
+		pthread_rwlock_wrlock(&shard->lock);	\
+		result = shard->map->delete_pair(shard->map, key);	\
+		pthread_rwlock_unlock(&shard->lock);	\
+		return result;	\
+	}	\
+		\
+	V get_value_concurrent_map_##K##_##V(concurrent_map(K,V) *map, K key) {	\
+		concurrent_shard_##K##_##V *shard = shard_of_##K##_##V(map, key);	\
+		V val;	\
+		pthread_rwlock_rdlock(&shard->lock);	\
+		val = shard->map->get_value(shard->map, key);	\
+		pthread_rwlock_unlock(&shard->lock);	\
+		return val;	\
+	}	\
+		\
+	bool is_key_concurrent_map_##K##_##V(concurrent_map(K,V) *map, K key) {	\
+		concurrent_shard_##K##_##V *shard = shard_of_##K##_##V(map, key);	\
+		bool found;	\
+		pthread_rwlock_rdlock(&shard->lock);	\
+		found = shard->map->is_key(shard->map, key);	\
+		pthread_rwlock_unlock(&shard->lock);	\
+		return found;	\
+	}	\
+		\
+	size_t size_concurrent_map_##K##_##V(concurrent_map(K,V) *map) {	\
+		size_t size = 0;	\
+		for (size_t i = 0; i < map->shard_count; ++i) {	\
+			pthread_rwlock_rdlock(&map->shards[i].lock);	\
+			size += map->shards[i].map->size(map->shards[i].map);	\
+			pthread_rwlock_unlock(&map->shards[i].lock);	\
+		}	\
+		return size;	\
+	}	\
+		\
+	/* Merges the sorted runs starts[r] to starts[r + 1] - 1 in pairs, back and forth */	\
+	/* between the two sets of arrays, starting from keys and values. There is one pass */	\
+	/* for every doubling of the run width, and after an odd number of them the result */	\
+	/* is in other_keys and other_values */	\
+	static void merge_runs_##K##_##V(K *keys, V *values, K *other_keys, V *other_values, const size_t *starts, size_t runs) {	\
+		for (size_t width = 1; width < runs; width *= 2) {	\
+			for (size_t r = 0; r < runs; r += 2*width) {	\
+				size_t i = starts[r];	\
+				size_t mid = starts[(r + width < runs) ? r + width : runs];	\
+				size_t end = starts[(r + 2*width < runs) ? r + 2*width : runs];	\
+				size_t j = mid;	\
+				for (size_t out = i; out < end; ++out) {	\
+					size_t take = (j == end || (i < mid && CMP(keys[i], keys[j]) < 0)) ? i++ : j++;	\
+					other_keys[out] = keys[take];	\
+					other_values[out] = values[take];	\
+				}	\
+			}	\
+			K *swap_keys = keys;	\
+			V *swap_values = values;	\
+			keys = other_keys;	\
+			values = other_values;	\
+			other_keys = swap_keys;	\
+			other_values = swap_values;	\
+		}	\
+	}	\
+		\
+	c_flat_map(K,V) *snapshot_concurrent_map_##K##_##V(concurrent_map(K,V) *map) {	\
+		const c_allocator *allocator = map->allocator;	\
+		c_flat_map(K,V) *snapshot = new_flat_map_##K##_##V(allocator);	\
+		K *spare_keys = NULL;	\
+		V *spare_values = NULL;	\
+		K *keys = NULL;	\
+		V *values = NULL;	\
+		size_t *starts = (size_t *) allocator->allocate(allocator->context, (map->shard_count + 1)*sizeof(size_t));	\
+		size_t capacity = 0;	\
+		size_t count = size_concurrent_map_##K##_##V(map);	\
+		bool odd_passes = false;	\
+		bool copied = false;	\
+		/* The runs are copied to whichever arrays make the last merge pass land in the */	\
+		/* snapshot's own, and the spare ones only have to hold them in between */	\
+		for (size_t width = 1; width < map->shard_count; width *= 2)	\
+			odd_passes = !odd_passes;	\
+		/* Everything is allocated before the shards are locked. The count is only a */	\
+		/* guess until they are, so if the map has grown past it, this goes round again */	\
+		while (snapshot != NULL && starts != NULL && !copied) {	\
+			if (count > capacity) {	\
+				if (reserve_flat_map_##K##_##V(snapshot, count, "snapshot") != success)	\
+					break;	\
+				/* A single shard is already in order, so it needs no spare arrays */	\
+				if (map->shard_count > 1) {	\
+					K *grown_keys = (K *) allocator->reallocate(allocator->context, spare_keys,	\
+							capacity*sizeof(K), snapshot->capacity*sizeof(K));	\
+					if (grown_keys == NULL)	\
+						break;	\
+					spare_keys = grown_keys;	\
+					V *grown_values = (V *) allocator->reallocate(allocator->context, spare_values,	\
+							capacity*sizeof(V), snapshot->capacity*sizeof(V));	\
+					if (grown_values == NULL)	\
+						break;	\
+					spare_values = grown_values;	\
+				}	\
+				capacity = snapshot->capacity;	\
+			}	\
+			keys = odd_passes ? spare_keys : snapshot->keys;	\
+			values = odd_passes ? spare_values : snapshot->values;	\
+			/* Every shard stays locked until all of them have been copied */	\
+			count = 0;	\
+			for (size_t i = 0; i < map->shard_count; ++i) {	\
+				pthread_rwlock_rdlock(&map->shards[i].lock);	\
+				count += map->shards[i].map->size(map->shards[i].map);	\
+			}	\
+			if (count <= capacity) {	\
+				count = 0;	\
+				for (size_t i = 0; i < map->shard_count; ++i) {	\
+					node(K,V) *node = first_node_##K##_##V(map->shards[i].map->tree);	\
+					starts[i] = count;	\
+					for (; node != NULL; node = next_node_##K##_##V(node)) {	\
+						keys[count] = node->key;	\
+						values[count] = node->value;	\
+						++count;	\
+					}	\
+				}	\
+				starts[map->shard_count] = count;	\
+				copied = true;	\
+			}	\
+			for (size_t i = 0; i < map->shard_count; ++i)	\
+				pthread_rwlock_unlock(&map->shards[i].lock);	\
+		}	\
+		/* Each shard is already a sorted run, and no key is in two of them */	\
+		if (copied) {	\
+			merge_runs_##K##_##V(keys, values, odd_passes ? snapshot->keys : spare_keys,	\
+					odd_passes ? snapshot->values : spare_values, starts, map->shard_count);	\
+			snapshot->count = count;	\
+		}	\
+		else	\
+			snapshot = destroy_flat_map_##K##_##V(snapshot);	\
+		allocator_free(allocator, spare_keys);	\
+		allocator_free(allocator, spare_values);	\
+		allocator_free(allocator, starts);	\
+		if (snapshot == NULL) {	\
+			err = realloc_failed;	\
+			set_error_info(__FILE__, "snapshot", __LINE__);	\
+		}	\
+		return snapshot;	\
+	}	\
+		\
+	static inline void set_concurrent_map_ptr_##K##_##V(concurrent_map(K,V) *map) {	\
+		map->destroy_map = &destroy_concurrent_map_##K##_##V;	\
+		map->insert = &insert_concurrent_map_##K##_##V;	\
+		map->delete_pair = &delete_pair_concurrent_map_##K##_##V;	\
+		map->get_value = &get_value_concurrent_map_##K##_##V;	\
+		map->is_key = &is_key_concurrent_map_##K##_##V;	\
+		map->size = &size_concurrent_map_##K##_##V;	\
+		map->snapshot = &snapshot_concurrent_map_##K##_##V;	\
+	}	\
+		\
+	concurrent_map(K,V) *new_concurrent_map_##K##_##V(size_t shards, const c_allocator *allocator) {	\
+		concurrent_map(K,V) *map = NULL;	\
+		size_t count = 1;	\
+		if (shards == 0)	\
+			shards = CONCURRENT_MAP_DEFAULT_SHARDS;	\
+		while (count < shards)	\
+			count *= 2;	\
+			\
+		map = (concurrent_map(K,V) *) allocator_calloc(allocator, sizeof(concurrent_map(K,V)));	\
+			\
+		if (map == NULL) {	\
+			return NULL;	\
+		}	\
+			\
+		map->allocator = allocator;	\
+		map->shards = (concurrent_shard_##K##_##V *) allocator_calloc(allocator, count*sizeof(concurrent_shard_##K##_##V));	\
+		if (map->shards == NULL) {	\
+			allocator_free(allocator, map);	\
+			return NULL;	\
+		}	\
+		map->shard_count = count;	\
+		map->mask = count - 1;	\
+		for (size_t i = 0; i < count; ++i) {	\
+			/* A shard only gets a lock once it has a map, so destroy knows which to clean up */	\
+			map->shards[i].map = new_c_map_with(K, V, allocator);	\
+			if (map->shards[i].map == NULL || pthread_rwlock_init(&map->shards[i].lock, NULL) != 0) {	\
+				if (map->shards[i].map != NULL)	\
+					map->shards[i].map = map->shards[i].map->destroy_map(map->shards[i].map);	\
+				return destroy_concurrent_map_##K##_##V(map);	\
+			}	\
+		}	\
+		set_concurrent_map_ptr_##K##_##V(map);	\
+		return map;	\
+	}	\
+
+#define concurrent_map(K,V)	concurrent_map_##K##_##V
+#define new_concurrent_map(K, V, SHARDS)	new_concurrent_map_##K##_##V(SHARDS, &default_allocator)
+/* Same as new_concurrent_map, except that the shards and their maps come from ALLOCATOR */
+#define new_concurrent_map_with(K, V, SHARDS, ALLOCATOR)	new_concurrent_map_##K##_##V(SHARDS, ALLOCATOR)
+
+#endif
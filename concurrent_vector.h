@@ -0,0 +1,288 @@
+#ifndef CONCURRENT_VECTOR_H
+#define CONCURRENT_VECTOR_H
+#ifndef __cplusplus
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdbool.h>
+#else
+#include <cstdlib>
+#include <cstddef>
+#include <cstring>
+#endif
+#include "error.h"
+#include "allocator.h"
+
+/* concurrent_vector is an append only vector that any number of threads can push
+ * to at once without a lock. It is meant for things like a log that many producers
+ * write to and a few readers follow.
+ *
+ * An appender claims its slot with one atomic fetch-add on the reserved count, so
+ * appenders never wait for each other. The elements live in segments that double
+ * in size (CONCURRENT_FIRST_SEGMENT, then twice that, and so on) and are never
+ * moved or freed until the vector is destroyed. Growing is just allocating the
+ * next segment, so a pointer to an element stays good for the life of the vector.
+ * If two appenders race to allocate the same segment, one of them frees its copy
+ * and uses the other's.
+ *
+ * Reserving a slot is not the same as publishing it. Each slot has a ready flag
+ * that is set once the element has been written, and the published length only
+ * moves past a slot once it and every slot before it are ready. The appender of
+ * the slot at the published length moves it forward past every slot that is
+ * ready by then, so a slow appender holds back the length but never blocks the
+ * others, and each slot is only looked at by about one appender. Readers that load
+ * the length get a prefix of the vector that is completely written, and any
+ * element below it can be read without a lock.
+ *
+ * The atomics are the GCC __atomic builtins, so this works from C and C++ alike.
+ * The allocator has to be safe to call from several threads at once, which rules
+ * out sharing a c_arena between appenders.
+ */
+
+/* The first segment holds this many elements. It has to be a power of two */
+#define CONCURRENT_FIRST_SEGMENT	64
+#define CONCURRENT_FIRST_SHIFT	6
+/* Enough segments for CONCURRENT_FIRST_SEGMENT * (2^40 - 1) elements */
+#define CONCURRENT_SEGMENTS	40
+
+static inline unsigned int concurrent_log2(size_t value) {
+#if defined(__GNUC__)
+	return (unsigned int) (8*sizeof(unsigned long long) - 1 - __builtin_clzll((unsigned long long) value));
+#else
+	unsigned int result = 0;
+	while (value >>= 1)
+		++result;
+	return result;
+#endif
+}
+
+/* Segment k starts at index FIRST * (2^k - 1) and holds FIRST * 2^k elements */
+static inline unsigned int concurrent_segment(size_t index) {
+	return concurrent_log2(index + CONCURRENT_FIRST_SEGMENT) - CONCURRENT_FIRST_SHIFT;
+}
+
+static inline size_t concurrent_segment_start(unsigned int segment) {
+	return ((size_t) CONCURRENT_FIRST_SEGMENT << segment) - CONCURRENT_FIRST_SEGMENT;
+}
+
+static inline size_t concurrent_segment_size(unsigned int segment) {
+	return (size_t) CONCURRENT_FIRST_SEGMENT << segment;
+}
+
+/* define_concurrent_vector(DATA)
+ * INPUT: DATA -> data type of the vector
+ * OUTPUT: None
+ * USAGE: define_concurrent_vector(int)
+ * NOTES: Segment k is a single allocation: its elements, followed by one ready
+ * flag per element.
+ *
+ * error_code add_top_concurrent_##DATA(concurrent_vector_##DATA *vector, DATA value)
+ * INPUT: vector -> concurrent vector, value -> element to append
+ * OUTPUT: success, or realloc_failed if a new segment couldn't be allocated
+ * USAGE: vector->ops->add_top(vector, value); or concurrent_vector_push(int, vector, value);
+ * NOTES: Safe to call from any number of threads. The element is readable once
+ * concurrent_vector_length is past it, which may be after add_top returns if an
+ * earlier slot is still being written.
+ *
+ * error_code append_array_concurrent_##DATA(concurrent_vector_##DATA *vector, const DATA *values, size_t count)
+ * INPUT: vector -> concurrent vector, values -> elements to append, count -> number of elements
+ * OUTPUT: success, or realloc_failed if a new segment couldn't be allocated
+ * USAGE: vector->ops->append_array(vector, batch, 100);
+ * NOTES: All count slots are claimed with one fetch-add, so the batch ends up
+ * contiguous and in order, even with other appenders running.
+ *
+ * size_t length_concurrent_##DATA(const concurrent_vector_##DATA *vector)
+ * OUTPUT: the published length. Every element below it is written.
+ *
+ * DATA value_at_concurrent_##DATA(concurrent_vector_##DATA *vector, size_t index)
+ * OUTPUT: the element at index, or a zeroed DATA with err set to invalid_index if
+ * index isn't below the published length
+ *
+ * If a segment can't be allocated, the slots that were claimed in it are never
+ * published, and neither is anything after them.
+ */
+#define define_concurrent_vector(DATA)	\
+	typedef struct concurrent_vector_##DATA {	\
+		DATA *segments[CONCURRENT_SEGMENTS];	\
+		size_t reserved;	\
+		size_t published;	\
+		const struct concurrent_vector_ops_##DATA *ops;	\
+		const c_allocator *allocator;	\
+	} concurrent_vector_##DATA;	\
+		\
+	typedef struct concurrent_vector_ops_##DATA {	\
+		struct concurrent_vector_##DATA *(*destroy_vector)(struct concurrent_vector_##DATA*);	\
+		error_code (*add_top)(struct concurrent_vector_##DATA*, DATA);	\
+		error_code (*append_array)(struct concurrent_vector_##DATA*, const DATA*, size_t);	\
+		DATA (*value_at)(struct concurrent_vector_##DATA*, size_t);	\
+		size_t (*length)(const struct concurrent_vector_##DATA*);	\
+	} concurrent_vector_ops_##DATA;	\
+		\
+	static inline unsigned char *ready_flags_##DATA(DATA *segment, unsigned int k) {	\
+		return (unsigned char *) (segment + concurrent_segment_size(k));	\
+	}	\
+		\
+	/* Returns segment k, allocating it if no one has yet */	\
+	static DATA *load_segment_##DATA(concurrent_vector_##DATA *vector, unsigned int k) {	\
+		DATA *segment = __atomic_load_n(&vector->segments[k], __ATOMIC_ACQUIRE);	\
+		DATA *expected = NULL;	\
+		size_t size = concurrent_segment_size(k);	\
+		if (segment != NULL)	\
+			return segment;	\
+		segment = (DATA *) allocator_calloc(vector->allocator, size*(sizeof(DATA) + 1));	\
+		if (segment == NULL)	\
+			return NULL;	\
+		if (!__atomic_compare_exchange_n(&vector->segments[k], &expected, segment, false,	\
+				__ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {	\
+			allocator_free(vector->allocator, segment);	\
+			segment = expected;	\
+		}	\
+		return segment;	\
+	}	\
+		\
+	static inline bool slot_ready_##DATA(concurrent_vector_##DATA *vector, size_t index) {	\
+		unsigned int k = concurrent_segment(index);	\
+		DATA *segment = (k < CONCURRENT_SEGMENTS) ? __atomic_load_n(&vector->segments[k], __ATOMIC_ACQUIRE) : NULL;	\
+		return segment != NULL &&	\
+			__atomic_load_n(&ready_flags_##DATA(segment, k)[index - concurrent_segment_start(k)], __ATOMIC_SEQ_CST);	\
+	}	\
+		\
+	/* Called once the slots from first on are ready. If an earlier slot isn't */	\
+	/* published yet, whoever publishes it will carry on through these, so there is */	\
+	/* nothing to do. Otherwise published is moved past every ready slot, with one CAS */	\
+	/* per run. reserved, the flags and published are all sequentially consistent, */	\
+	/* so an appender that claims or fills a slot after this loop has looked at it is */	\
+	/* sure to see the new length and carry on itself. A relaxed load of reserved */	\
+	/* could miss a slot that was filled in time, and nobody would publish it */	\
+	static inline void publish_concurrent_##DATA(concurrent_vector_##DATA *vector, size_t first) {	\
+		size_t index = __atomic_load_n(&vector->published, __ATOMIC_SEQ_CST);	\
+		if (index < first)	\
+			return;	\
+		for (;;) {	\
+			size_t reserved = __atomic_load_n(&vector->reserved, __ATOMIC_SEQ_CST);	\
+			size_t end = index;	\
+			while (end < reserved && slot_ready_##DATA(vector, end))	\
+				++end;	\
+			if (end == index)	\
+				return;	\
+			/* On failure, index is reloaded with whatever another appender published */	\
+			if (__atomic_compare_exchange_n(&vector->published, &index, end, false,	\
+					__ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST))	\
+				index = end;	\
+		}	\
+	}	\
+		\
+	/* Writes count values into the slots starting at first, which have already been claimed */	\
+	static error_code fill_slots_##DATA(concurrent_vector_##DATA *vector, size_t first, const DATA *values, size_t count) {	\
+		size_t index = first;	\
+		while (index < first + count) {	\
+			unsigned int k = concurrent_segment(index);	\
+			DATA *segment = NULL;	\
+			size_t offset = index - concurrent_segment_start(k);	\
+			size_t n = concurrent_segment_size(k) - offset;	\
+			if (k >= CONCURRENT_SEGMENTS || (segment = load_segment_##DATA(vector, k)) == NULL) {	\
+				err = realloc_failed;	\
+				set_error_info(__FILE__, "add_top", __LINE__);	\
+				return err;	\
+			}	\
+			if (n > first + count - index)	\
+				n = first + count - index;	\
+			memcpy((void *) &segment[offset], (const void *) &values[index - first], n*sizeof(DATA));	\
+			for (size_t i = 0; i < n; ++i)	\
+				__atomic_store_n(&ready_flags_##DATA(segment, k)[offset + i], 1, __ATOMIC_SEQ_CST);	\
+			index += n;	\
+		}	\
+		publish_concurrent_##DATA(vector, first);	\
+		return success;	\
+	}	\
+		\
+	error_code add_top_concurrent_##DATA(concurrent_vector_##DATA *vector, DATA value) {	\
+		size_t index = __atomic_fetch_add(&vector->reserved, 1, __ATOMIC_SEQ_CST);	\
+		return fill_slots_##DATA(vector, index, &value, 1);	\
+	}	\
+		\
+	error_code append_array_concurrent_##DATA(concurrent_vector_##DATA *vector, const DATA *values, size_t count) {	\
+		size_t index = 0;	\
+		if (count == 0)	\
+			return success;	\
+		index = __atomic_fetch_add(&vector->reserved, count, __ATOMIC_SEQ_CST);	\
+		return fill_slots_##DATA(vector, index, values, count);	\
+	}	\
+		\
+	static inline size_t length_inline_concurrent_##DATA(const concurrent_vector_##DATA *vector) {	\
+		return __atomic_load_n(&vector->published, __ATOMIC_ACQUIRE);	\
+	}	\
+		\
+	/* No bounds check. index must be below a length this thread has loaded */	\
+	static inline DATA at_inline_concurrent_##DATA(const concurrent_vector_##DATA *vector, size_t index) {	\
+		unsigned int k = concurrent_segment(index);	\
+		/* Loading the length already ordered this. The load is atomic because an */	\
+		/* appender that loses the race for a segment still does a CAS on it */	\
+		const DATA *segment = __atomic_load_n(&vector->segments[k], __ATOMIC_RELAXED);	\
+		return segment[index - concurrent_segment_start(k)];	\
+	}	\
+		\
+	size_t length_concurrent_##DATA(const concurrent_vector_##DATA *vector) {	\
+		return length_inline_concurrent_##DATA(vector);	\
+	}	\
+		\
+	DATA value_at_concurrent_##DATA(concurrent_vector_##DATA *vector, size_t index) {	\
+		DATA value;	\
+		if (index >= length_inline_concurrent_##DATA(vector)) {	\
+			memset(&value, 0, sizeof(DATA));	\
+			err = invalid_index;	\
+			set_error_info(__FILE__, "value_at", __LINE__);	\
+			return value;	\
+		}	\
+		return at_inline_concurrent_##DATA(vector, index);	\
+	}	\
+		\
+	/* Only call once every appender and reader is done with the vector */	\
+	concurrent_vector_##DATA *destroy_concurrent_vector_##DATA(concurrent_vector_##DATA *vector) {	\
+		if (vector == NULL) {	\
+			return NULL;	\
+		}	\
+		for (unsigned int k = 0; k < CONCURRENT_SEGMENTS; ++k)	\
+			allocator_free(vector->allocator, vector->segments[k]);	\
+		allocator_free(vector->allocator, vector);	\
+		return NULL;	\
+	}	\
+		\
+	static const concurrent_vector_ops_##DATA concurrent_ops_##DATA = {	\
+		&destroy_concurrent_vector_##DATA,	\
+		&add_top_concurrent_##DATA,	\
+		&append_array_concurrent_##DATA,	\
+		&value_at_concurrent_##DATA,	\
+		&length_concurrent_##DATA	\
+	};	\
+		\
+	concurrent_vector_##DATA *new_concurrent_vector_##DATA(const c_allocator *allocator) {	\
+		concurrent_vector_##DATA *vector = NULL;	\
+			\
+		vector = (concurrent_vector_##DATA *) allocator_calloc(allocator, sizeof(concurrent_vector_##DATA));	\
+			\
+		if (vector == NULL) {	\
+			return NULL;	\
+		}	\
+			\
+		vector->ops = &concurrent_ops_##DATA;	\
+		vector->allocator = allocator;	\
+		/* The first segment is made up front so that short logs never race for it */	\
+		if (load_segment_##DATA(vector, 0) == NULL) {	\
+			allocator_free(allocator, vector);	\
+			return NULL;	\
+		}	\
+		return vector;	\
+	}	\
+
+#define concurrent_vector(DATA)	concurrent_vector_##DATA
+#define new_concurrent_vector(DATA)	new_concurrent_vector_##DATA(&default_allocator)
+#define new_concurrent_vector_with(DATA, ALLOCATOR)	new_concurrent_vector_##DATA(ALLOCATOR)
+/* Same as c_vector_push, c_vector_at and c_vector_length. concurrent_vector_at does
+ * no bounds checking, so INDEX must be below a length loaded by the caller.
+ */
+#define concurrent_vector_push(DATA, VECTOR, VALUE)	add_top_concurrent_##DATA(VECTOR, VALUE)
+#define concurrent_vector_at(DATA, VECTOR, INDEX)	at_inline_concurrent_##DATA(VECTOR, (size_t) INDEX)
+#define concurrent_vector_length(DATA, VECTOR)	length_inline_concurrent_##DATA(VECTOR)
+
+#endif
@@ -1,13 +1,28 @@
+/* For mremap */
+#define _GNU_SOURCE
 #ifndef __cplusplus
 #include <stdio.h>
+#include <string.h>
 #else
 #include <cstdio>
+#include <cstring>
 #endif
 #include "c_vector.h"
+#include "vector_kernels.h"
+#include "vector_sort.h"
+#include "vector_mmap.h"
 #include "error.h"
 
 
 define_vector(int)
+define_vector(double)
+define_small_vector(int, 8)
+define_vector_kernels(int)
+define_vector_kernels(double)
+define_vector_sort(int)
+define_vector_sort(double)
+define_vector_mmap(int)
+define_vector_mmap(double)
 
 int main(int argc, char *argv[]) {
 	printf("The size of data type: %d\n", sizeof(int));
@@ -23,9 +38,9 @@ int main(int argc, char *argv[]) {
 	vector_iterator(int) *iter = (vector_iterator(int) *) new_vector_iterator(int, vector);
 	generic_iterator *giter = (generic_iterator *) iter;
 	
-	currindex = vector->get_current_index(vector);
-	currsize = vector->get_current_size(vector);
-	maxsize = vector->get_max_size(vector);
+	currindex = vector->ops->get_current_index(vector);
+	currsize = vector->ops->get_current_size(vector);
+	maxsize = vector->ops->get_max_size(vector);
 	
 	printf("int vector creation successful\n");
 	
@@ -33,27 +48,27 @@ int main(int argc, char *argv[]) {
 	
 	printf("Testing add_top function\n");
 	
-	code = vector->add_top(vector, 1);
+	code = vector->ops->add_top(vector, 1);
 	
 	if (code != 0) {
 		fprintf(stderr, "Value of code: %s", err_struct.code);
 	}
 	
-	currindex = vector->get_current_index(vector);
-	currsize = vector->get_current_size(vector);
-	maxsize = vector->get_max_size(vector);
+	currindex = vector->ops->get_current_index(vector);
+	currsize = vector->ops->get_current_size(vector);
+	maxsize = vector->ops->get_max_size(vector);
 	
 	printf("current index: %ld, current size: %ld, max size: %ld\n", currindex, currsize, maxsize);
 	
-	code = vector->add_top(vector, 2);
+	code = vector->ops->add_top(vector, 2);
 	
 	if (code != 0) {
 		fprintf(stderr, "Value of code: %s", err_struct.code);
 	}
 	
-	currindex = vector->get_current_index(vector);
-	currsize = vector->get_current_size(vector);
-	maxsize = vector->get_max_size(vector);
+	currindex = vector->ops->get_current_index(vector);
+	currsize = vector->ops->get_current_size(vector);
+	maxsize = vector->ops->get_max_size(vector);
 	
 	printf("current index: %ld, current size: %ld, max size: %ld\n", currindex, currsize, maxsize);
 	
@@ -61,40 +76,40 @@ int main(int argc, char *argv[]) {
 	
 	printf("Testing resize function\n");
 
-	code = vector->resize(vector, 24);
+	code = vector->ops->resize(vector, 24);
 
 	if (code != 0) {
 		fprintf(stderr, "Value of code: %s", err_struct.code);
 	}
 
-	currindex = vector->get_current_index(vector);
-	currsize = vector->get_current_size(vector);
-	maxsize = vector->get_max_size(vector);
+	currindex = vector->ops->get_current_index(vector);
+	currsize = vector->ops->get_current_size(vector);
+	maxsize = vector->ops->get_max_size(vector);
 
 	printf("current index: %ld, current size: %ld, max size: %ld\n", currindex, currsize, maxsize);
 
-	code = vector->resize(vector, 36);
+	code = vector->ops->resize(vector, 36);
 
 	if (code != 0) {
 		fprintf(stderr, "Value of code: %s", err_struct.code);
 	}
 
-	currindex = vector->get_current_index(vector);
-	currsize = vector->get_current_size(vector);
-	maxsize = vector->get_max_size(vector);
+	currindex = vector->ops->get_current_index(vector);
+	currsize = vector->ops->get_current_size(vector);
+	maxsize = vector->ops->get_max_size(vector);
 
 
 	printf("current index: %ld, current size: %ld, max size %ld\n", currindex, currsize, maxsize);	
 
-	code = vector->resize(vector, 24);
+	code = vector->ops->resize(vector, 24);
 
 	if (code != 0) {
 		fprintf(stderr, "Value of code: %s", err_struct.code);
 	}
 
-	currindex = vector->get_current_index(vector);
-	currsize = vector->get_current_size(vector);
-	maxsize = vector->get_max_size(vector);
+	currindex = vector->ops->get_current_index(vector);
+	currsize = vector->ops->get_current_size(vector);
+	maxsize = vector->ops->get_max_size(vector);
 
 	printf("current index: %ld, current size: %ld, max size: %ld\n", currindex, currsize, maxsize);
 	
@@ -102,15 +117,15 @@ int main(int argc, char *argv[]) {
 	
 	printf("Testing add_top after use of resize function\n");
 
-	code = vector->add_top(vector, 3);
+	code = vector->ops->add_top(vector, 3);
 
 	if (code != 0) {
 		fprintf(stderr, "Value of code: %s", err_struct.code);
 	}	
 
-	currindex = vector->get_current_index(vector);
-	currsize = vector->get_current_size(vector);
-	maxsize = vector->get_max_size(vector);
+	currindex = vector->ops->get_current_index(vector);
+	currsize = vector->ops->get_current_size(vector);
+	maxsize = vector->ops->get_max_size(vector);
 	
 	printf("current index: %ld, current size: %ld, max size: %ld\n", currindex, currsize, maxsize);
 	
@@ -118,27 +133,27 @@ int main(int argc, char *argv[]) {
 	
 	printf("Testing shrink function\n");
 	
-	code = vector->shrink(vector);
+	code = vector->ops->shrink(vector);
 	
 	if (code != 0) {
 		fprintf(stderr, "Value of code: %s", err_struct.code);
 	}
 	
-	currindex = vector->get_current_index(vector);
-	currsize = vector->get_current_size(vector);
-	maxsize = vector->get_max_size(vector);
+	currindex = vector->ops->get_current_index(vector);
+	currsize = vector->ops->get_current_size(vector);
+	maxsize = vector->ops->get_max_size(vector);
 
 	printf("current index: %ld, current size: %ld, max size: %ld\n", currindex, currsize, maxsize);
 	
-	code = vector->shrink(vector);
+	code = vector->ops->shrink(vector);
 	
 	if (code != 0) {
 		fprintf(stderr, "Value of code: %s", err_struct.code);
 	}
 	
-	currindex = vector->get_current_index(vector);
-	currsize = vector->get_current_size(vector);
-	maxsize = vector->get_max_size(vector);
+	currindex = vector->ops->get_current_index(vector);
+	currsize = vector->ops->get_current_size(vector);
+	maxsize = vector->ops->get_max_size(vector);
 	
 	printf("current index: %ld, current size: %ld, max size: %ld\n", currindex, currsize, maxsize);
 	
@@ -151,7 +166,7 @@ int main(int argc, char *argv[]) {
 	
 	printf("Testing remove_top function\n");
 	
-	vector->remove_top(vector);
+	vector->ops->remove_top(vector);
 	
 	for (giter; !giter->end(giter); giter->next(giter))
 		printf("Value at next index is %d\n", iter->current(iter));
@@ -159,13 +174,349 @@ int main(int argc, char *argv[]) {
 	printf("remove_top test successful\n");
 	
 	printf("Testing insert function\n");
-	vector->insert(vector, 1,  500);
+	vector->ops->insert(vector, 1,  500);
 
 	for (giter; !giter->end(giter); giter->next(giter))
 		printf("Value at next index is %d\n", iter->current(iter));
 	
 	printf("insert function test successful\n");
-		
+
+	printf("Testing inline push and at\n");
+	c_vector(int) *pushed = new_c_vector(int, 0);
+
+	for (int i = 0; i < 1000; ++i) {
+		code = c_vector_push(int, pushed, i);
+		if (code != 0) {
+			fprintf(stderr, "Value of code: %s", err_struct.code);
+			return 1;
+		}
+	}
+
+	for (int i = 0; i < 1000; ++i) {
+		if (c_vector_at(int, pushed, i) != i || pushed->ops->value_at(pushed, i) != i) {
+			fprintf(stderr, "Value at index %d is wrong\n", i);
+			return 1;
+		}
+	}
+
+	/* Pushing has to keep the size up to date, or shrink cuts off the pushed elements */
+	if (pushed->ops->shrink(pushed) != success || pushed->ops->get_current_size(pushed) != 1000 ||
+		c_vector_at(int, pushed, 999) != 999) {
+		fprintf(stderr, "Shrink after push lost elements\n");
+		return 1;
+	}
+
+	printf("current index: %ld, max size: %ld\n", c_vector_length(int, pushed),
+			pushed->ops->get_max_size(pushed));
+	printf("inline push and at test successful\n");
+
+	printf("Testing append_array, append_vector and insert_range\n");
+	int batch[4] = { -1, -2, -3, -4 };
+	c_vector(int) *appended = new_c_vector(int, 0);
+
+	code = appended->ops->append_array(appended, batch, 4);
+	if (code == 0)
+		code = appended->ops->append_vector(appended, pushed);
+	if (code == 0)
+		code = appended->ops->append_vector(appended, appended);
+	if (code == 0)
+		code = appended->ops->insert_range(appended, 2, batch, 4);
+
+	if (code != 0) {
+		fprintf(stderr, "Value of code: %s", err_struct.code);
+		return 1;
+	}
+
+	if (c_vector_length(int, appended) != 2012 || c_vector_at(int, appended, 1) != -2 ||
+		c_vector_at(int, appended, 2) != -1 || c_vector_at(int, appended, 6) != -3 ||
+		c_vector_at(int, appended, 1007) != 999 || c_vector_at(int, appended, 1008) != -1 ||
+		c_vector_at(int, appended, 2011) != 999) {
+		fprintf(stderr, "Bulk append produced the wrong contents\n");
+		return 1;
+	}
+
+	printf("current index: %ld, max size: %ld\n", c_vector_length(int, appended),
+			appended->ops->get_max_size(appended));
+	appended = appended->ops->destroy_vector(appended);
+	pushed = pushed->ops->destroy_vector(pushed);
+	printf("append_array, append_vector and insert_range test successful\n");
+
+	printf("Testing growth policies\n");
+	vector_policy golden = VECTOR_POLICY_FACTOR(3, 2, 4096, false);
+	vector_policy chunked = VECTOR_POLICY_CHUNK(64*sizeof(int), true);
+	c_vector(int) *policied = new_c_vector(int, 0);
+
+	c_vector_set_policy(int, policied, &golden);
+	for (int i = 0; i < 10000; ++i)
+		c_vector_push(int, policied, i);
+	c_vector_set_policy(int, policied, &chunked);
+	for (int i = 10000; i < 20000; ++i)
+		c_vector_push(int, policied, i);
+
+	for (int i = 0; i < 20000; ++i) {
+		if (c_vector_at(int, policied, i) != i) {
+			fprintf(stderr, "Value at index %d is wrong\n", i);
+			return 1;
+		}
+	}
+
+	printf("1.5x policy: %ld grows, %ld bytes reserved, %ld bytes zeroed, %ld bytes moved\n",
+			golden.stats.grow_count, golden.stats.bytes_reserved,
+			golden.stats.bytes_zeroed, golden.stats.bytes_moved);
+	printf("chunk policy: %ld grows, %ld bytes reserved, %ld bytes zeroed, %ld bytes moved\n",
+			chunked.stats.grow_count, chunked.stats.bytes_reserved,
+			chunked.stats.bytes_zeroed, chunked.stats.bytes_moved);
+	policied = policied->ops->destroy_vector(policied);
+
+	/* Resizing past the capacity zeroes everything after the old size, even under a */
+	/* policy that doesn't zero and with stale values left between the size and capacity */
+	policied = new_c_vector(int, 0);
+	c_vector_set_policy(int, policied, &golden);
+	for (int i = 0; i < 6; ++i)
+		c_vector_push(int, policied, i);
+	size_t capacity = policied->ops->get_max_size(policied);
+	for (size_t i = 6; i < capacity; ++i)
+		policied->data[i] = -1;
+	policied->ops->resize(policied, 2*capacity);
+	for (size_t i = 6; i < 2*capacity; ++i) {
+		if (policied->data[i] != 0) {
+			fprintf(stderr, "Value at index %ld was not zeroed by resize\n", i);
+			return 1;
+		}
+	}
+	policied = policied->ops->destroy_vector(policied);
+	printf("growth policy test successful\n");
+
+	printf("Testing small vector\n");
+	c_vector(int) *small = new_small_c_vector(int, 8);
+
+	for (int i = 0; i < 8; ++i)
+		small->ops->add_top(small, i);
+
+	if (small->storage != inline_storage) {
+		fprintf(stderr, "Small vector left inline storage too early\n");
+		return 1;
+	}
+
+	for (int i = 8; i < 100; ++i)
+		c_vector_push(int, small, i);
+
+	generic_iterator *gsmall = new_vector_iterator(int, small);
+	vector_iterator(int) *smalliter = (vector_iterator(int) *) gsmall;
+	int expected = 0;
+
+	for (gsmall->first(gsmall); !gsmall->end(gsmall); gsmall->next(gsmall), ++expected) {
+		if (smalliter->current(smalliter) != expected) {
+			fprintf(stderr, "Value at index %d is wrong\n", expected);
+			return 1;
+		}
+	}
+
+	printf("current index: %ld, max size: %ld, size of small_vector(int, 8): %ld bytes\n",
+			c_vector_length(int, small), small->ops->get_max_size(small), sizeof(small_vector(int, 8)));
+	gsmall = gsmall->destroy_iterator(gsmall);
+	small = small->ops->destroy_vector(small);
+	printf("small vector test successful\n");
+
+	printf("Testing vectors allocated from an arena\n");
+	c_arena *arena = new_arena(1024);
+	c_vector(int) *first = new_c_vector_with(int, 0, &arena->allocator);
+	c_vector(int) *second = new_small_c_vector_with(int, 8, &arena->allocator);
+
+	for (int i = 0; i < 5000; ++i) {
+		c_vector_push(int, first, i);
+		c_vector_push(int, second, -i);
+	}
+
+	for (int i = 0; i < 5000; ++i) {
+		if (c_vector_at(int, first, i) != i || c_vector_at(int, second, i) != -i) {
+			fprintf(stderr, "Value at index %d is wrong\n", i);
+			return 1;
+		}
+	}
+
+	/* Neither vector needs to be destroyed on its own */
+	arena = destroy_arena(arena);
+	printf("arena vector test successful\n");
+
+	printf("Testing search and reduction kernels\n");
+	c_vector(int) *scanned = new_c_vector(int, 0);
+	c_vector(double) *reals = new_c_vector(double, 0);
+	long long expected_sum = 0;
+	size_t expected_count = 0;
+
+	if (c_vector_max(int, scanned) != 0 || err != invalid_index || c_vector_sum(int, scanned) != 0 ||
+		c_vector_find(int, scanned, 0) != VECTOR_NPOS) {
+		fprintf(stderr, "Kernels on an empty vector are wrong\n");
+		return 1;
+	}
+
+	/* 1003 is not a multiple of any block size, so the tail loops get used too */
+	for (int i = 0; i < 1003; ++i) {
+		int value = (i * 7919) % 1000 - 500;
+		c_vector_push(int, scanned, value);
+		c_vector_push(double, reals, value / 4.0);
+		expected_sum += value;
+		expected_count += (value == 13);
+	}
+
+	if (c_vector_find(int, scanned, c_vector_at(int, scanned, 777)) > 777 ||
+		c_vector_find(int, scanned, 5000) != VECTOR_NPOS || c_vector_contains(int, scanned, 5000) ||
+		!c_vector_contains(int, scanned, 13) || c_vector_count(int, scanned, 13) != expected_count ||
+		c_vector_min(int, scanned) != -500 || c_vector_max(int, scanned) != 499 ||
+		c_vector_sum(int, scanned) != expected_sum) {
+		fprintf(stderr, "int kernels gave the wrong answer\n");
+		return 1;
+	}
+
+	if (c_vector_find(double, reals, 3.25) != c_vector_find(int, scanned, 13) ||
+		c_vector_min(double, reals) != -125.0 || c_vector_max(double, reals) != 124.75 ||
+		c_vector_sum(double, reals) != expected_sum / 4.0) {
+		fprintf(stderr, "double kernels gave the wrong answer\n");
+		return 1;
+	}
+
+#ifdef SIMD_KERNELS
+	/* Every build has to agree with the scalar one */
+	const vector_kernels_int *builds[2] = { &sse2_kernels_int, &avx2_kernels_int };
+	for (int b = 0; b < (__builtin_cpu_supports("avx2") ? 2 : 1); ++b) {
+		for (size_t n = 1; n <= 1003; n += 17) {
+			int value = c_vector_at(int, scanned, n / 2);
+			if (builds[b]->find(scanned->data, n, value) != scalar_kernels_int.find(scanned->data, n, value) ||
+				builds[b]->count(scanned->data, n, value) != scalar_kernels_int.count(scanned->data, n, value) ||
+				builds[b]->min(scanned->data, n) != scalar_kernels_int.min(scanned->data, n) ||
+				builds[b]->max(scanned->data, n) != scalar_kernels_int.max(scanned->data, n) ||
+				builds[b]->sum(scanned->data, n) != scalar_kernels_int.sum(scanned->data, n)) {
+				fprintf(stderr, "%s kernels disagree with scalar kernels at n = %ld\n", builds[b]->name, n);
+				return 1;
+			}
+		}
+	}
+#endif
+
+	printf("kernels in use: %s\n", kernels_int()->name);
+	scanned = scanned->ops->destroy_vector(scanned);
+	reals = reals->ops->destroy_vector(reals);
+	printf("search and reduction kernel test successful\n");
+
+	printf("Testing sort\n");
+	sort_config threaded = SORT_CONFIG(1000, 4);
+	c_vector(int) *unsorted = new_c_vector(int, 0);
+	c_vector(double) *unsorted_reals = new_c_vector(double, 0);
+
+	for (int round = 0; round < 2; ++round) {
+		for (int i = 0; i < 100000; ++i) {
+			c_vector_push(int, unsorted, rand() - RAND_MAX / 2);
+			c_vector_push(double, unsorted_reals, (rand() - RAND_MAX / 2) / 3.0);
+		}
+		/* The first round is sorted on one thread and the second on four */
+		if (round == 0) {
+			c_vector_sort(int, unsorted);
+			c_vector_sort(double, unsorted_reals);
+		}
+		else {
+			c_vector_sort_with(int, unsorted, &threaded);
+			c_vector_sort_with(double, unsorted_reals, &threaded);
+		}
+		for (size_t i = 1; i < c_vector_length(int, unsorted); ++i) {
+			if (c_vector_at(int, unsorted, i) < c_vector_at(int, unsorted, i - 1) ||
+				c_vector_at(double, unsorted_reals, i) < c_vector_at(double, unsorted_reals, i - 1)) {
+				fprintf(stderr, "Vector is out of order at index %ld\n", i);
+				return 1;
+			}
+		}
+	}
+
+	unsorted = unsorted->ops->destroy_vector(unsorted);
+	unsorted_reals = unsorted_reals->ops->destroy_vector(unsorted_reals);
+	printf("sort test successful\n");
+
+	printf("Testing memory mapped vector\n");
+	const char *path = "driver_vector.vec";
+	c_vector(int) *mapped = new_c_vector_mmap(int, path, map_create);
+
+	if (mapped == NULL) {
+		fprintf(stderr, "Mapped vector creation failed\n");
+		return 1;
+	}
+	for (int i = 0; i < 100000; ++i)
+		c_vector_push(int, mapped, i);
+	/* Shrinking truncates the file, so it must not cut it below the pushed elements */
+	if (mapped->ops->shrink(mapped) != success || c_vector_sync(int, mapped) != success) {
+		fprintf(stderr, "Mapped vector sync failed\n");
+		return 1;
+	}
+	mapped = mapped->ops->destroy_vector(mapped);
+
+	/* Everything has to be there again without being pushed */
+	mapped = new_c_vector_mmap(int, path, map_open);
+	if (mapped == NULL || c_vector_length(int, mapped) != 100000) {
+		fprintf(stderr, "Mapped vector did not reopen with its elements\n");
+		return 1;
+	}
+	for (int i = 0; i < 100000; ++i) {
+		if (c_vector_at(int, mapped, i) != i) {
+			fprintf(stderr, "Mapped vector has the wrong value at index %d\n", i);
+			return 1;
+		}
+	}
+	/* destroy_vector records the count without a sync */
+	for (int i = 100000; i < 150000; ++i)
+		mapped->ops->add_top(mapped, i);
+	mapped = mapped->ops->destroy_vector(mapped);
+
+	/* Changes to a private mapping stay in memory, even after it moves to the heap */
+	mapped = new_c_vector_mmap(int, path, map_private);
+	if (mapped == NULL || c_vector_length(int, mapped) != 150000) {
+		fprintf(stderr, "Mapped vector did not reopen privately\n");
+		return 1;
+	}
+	mapped->data[0] = -1;
+	while (c_vector_length(int, mapped) < 300000)
+		c_vector_push(int, mapped, -1);
+	mapped = mapped->ops->destroy_vector(mapped);
+
+	mapped = new_c_vector_mmap(int, path, map_open_or_create);
+	if (mapped == NULL || c_vector_length(int, mapped) != 150000 || c_vector_at(int, mapped, 0) != 0 ||
+		c_vector_at(int, mapped, 149999) != 149999) {
+		fprintf(stderr, "Private changes reached the file\n");
+		return 1;
+	}
+	mapped->ops->shrink(mapped);
+	mapped = mapped->ops->destroy_vector(mapped);
+
+	if (new_c_vector_mmap(double, path, map_open) != NULL || err != map_failed) {
+		fprintf(stderr, "A file of ints was opened as doubles\n");
+		return 1;
+	}
+	unlink(path);
+	if (new_c_vector_mmap(int, path, map_open) != NULL) {
+		fprintf(stderr, "A missing file was opened\n");
+		return 1;
+	}
+	printf("memory mapped vector test successful\n");
+
+	printf("Testing error reporting\n");
+	c_vector(int) *missing = new_c_vector(int, 0);
+	c_vector_push(int, missing, 1);
+	missing->ops->value_at(missing, 5);
+
+	if (err != invalid_index) {
+		fprintf(stderr, "value_at out of range did not set err\n");
+		return 1;
+	}
+#ifndef NO_ERROR_INFO
+	if (strcmp(err_struct.code, "invalid_index") != 0 || strcmp(err_struct.functname, "value_at") != 0 ||
+		err_struct.line <= 0) {
+		fprintf(stderr, "value_at out of range did not set err_struct\n");
+		return 1;
+	}
+	printf("%s: %s line %d: %s\n", err_struct.filename, err_struct.functname, err_struct.line,
+			err_struct.code);
+#endif
+	missing = missing->ops->destroy_vector(missing);
+	printf("error reporting test successful\n");
+
 	size_t vsize = sizeof(c_vector(int));
 	size_t isize = sizeof(vector_iterator(int));
 
@@ -173,7 +524,7 @@ int main(int argc, char *argv[]) {
 	printf("Size of vector_iterator is %ld bytes.\n", isize);
 	
 	printf("Testing destroy_vector function\n");
-	vector->destroy_vector(vector);
+	vector->ops->destroy_vector(vector);
 	giter = giter->destroy_iterator(giter);
 	printf("destroy vector_function test successful\n");
 	return 0;
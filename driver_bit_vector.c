@@ -0,0 +1,217 @@
+#ifndef __cplusplus
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <stddef.h>
+#else
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <cstddef>
+#endif
+#include "bit_vector.h"
+#include "error.h"
+
+#define BITS	10000
+
+/* Every query is checked against a plain array of bools */
+static int check_against(c_bit_vector *vector, const bool *expected, size_t length) {
+	size_t count = 0;
+	if (vector->curr_index != length) {
+		fprintf(stderr, "Length is %ld, expected %ld\n", vector->curr_index, length);
+		return 1;
+	}
+	for (size_t i = 0; i < length; ++i) {
+		if (vector->ops->value_at(vector, i) != expected[i] || c_bit_vector_at(vector, i) != expected[i]) {
+			fprintf(stderr, "Bit %ld is wrong\n", i);
+			return 1;
+		}
+		count += expected[i];
+	}
+	if (vector->ops->popcount(vector) != count) {
+		fprintf(stderr, "popcount is %ld, expected %ld\n", vector->ops->popcount(vector), count);
+		return 1;
+	}
+	for (size_t from = 0; from <= length; from += 1 + (size_t) (rand() % 100)) {
+		size_t next = from;
+		while (next < length && !expected[next])
+			++next;
+		if (vector->ops->find_first_set(vector, from) != next) {
+			fprintf(stderr, "find_first_set from %ld gave %ld, expected %ld\n", from,
+				vector->ops->find_first_set(vector, from), next);
+			return 1;
+		}
+	}
+	return 0;
+}
+
+static c_bit_vector *random_vector(bool *expected, size_t length, int density) {
+	c_bit_vector *vector = new_c_bit_vector(0);
+	for (size_t i = 0; i < length; ++i) {
+		expected[i] = (rand() % 100) < density;
+		c_bit_vector_push(vector, expected[i]);
+	}
+	return vector;
+}
+
+int main(void) {
+	static bool expected[BITS], other_bits[BITS];
+
+	srand(time(NULL));
+
+	fprintf(stderr, "Testing constructor\n");
+
+	c_bit_vector *vector = new_c_bit_vector(0);
+
+	if (vector == NULL) {
+		fprintf(stderr, "Vector creation failed!\n");
+		return 1;
+	}
+
+	if (vector->max_size != sizeof(bit_word) || c_bit_vector_length(vector) != 0) {
+		fprintf(stderr, "A new vector should hold one empty word\n");
+		return 1;
+	}
+
+	fprintf(stderr, "Constructor testing successful\n\n");
+
+	fprintf(stderr, "Testing add_top, set and remove_top\n");
+
+	for (size_t i = 0; i < BITS; ++i) {
+		expected[i] = rand() % 3 == 0;
+		if (vector->ops->add_top(vector, expected[i]) != success) {
+			fprintf(stderr, "add_top failed!\n");
+			return 1;
+		}
+	}
+
+	if (check_against(vector, expected, BITS) != 0)
+		return 1;
+
+	for (size_t i = 0; i < 1000; ++i) {
+		size_t index = (size_t) (rand() % BITS);
+		expected[index] = !expected[index];
+		vector->ops->set(vector, index, expected[index]);
+	}
+
+	if (check_against(vector, expected, BITS) != 0)
+		return 1;
+
+	err = success;
+	if (vector->ops->value_at(vector, BITS) || err != invalid_index ||
+		vector->ops->set(vector, BITS, true) != invalid_index) {
+		fprintf(stderr, "Indexing past the end did not set invalid_index\n");
+		return 1;
+	}
+
+	for (size_t i = 0; i < 1234; ++i)
+		vector->ops->remove_top(vector);
+
+	if (check_against(vector, expected, BITS - 1234) != 0)
+		return 1;
+
+	fprintf(stderr, "%ld bits in %ld bytes\n", vector->curr_index, vector->max_size);
+	fprintf(stderr, "add_top, set and remove_top successful\n\n");
+
+	fprintf(stderr, "Testing resize and shrink\n");
+
+	/* Bits dropped by a shrink have to come back clear when the vector grows again */
+	vector->ops->resize(vector, 3001);
+	vector->ops->resize(vector, BITS);
+	for (size_t i = 3001; i < BITS; ++i)
+		expected[i] = false;
+
+	if (check_against(vector, expected, BITS) != 0)
+		return 1;
+
+	vector->ops->resize(vector, 130);
+	if (vector->ops->shrink(vector) != success || vector->max_size != 3*sizeof(bit_word) ||
+		check_against(vector, expected, 130) != 0) {
+		fprintf(stderr, "Shrink failed!\n");
+		return 1;
+	}
+
+	vector->ops->resize(vector, 0);
+	if (vector->ops->popcount(vector) != 0 || vector->ops->find_first_set(vector, 0) != 0) {
+		fprintf(stderr, "An empty vector still has bits set\n");
+		return 1;
+	}
+
+	fprintf(stderr, "Resize and shrink successful\n\n");
+
+	fprintf(stderr, "Testing and, or and xor\n");
+
+	static const char *names[] = { "and", "or", "xor" };
+	for (int op = 0; op < 3; ++op) {
+		for (int round = 0; round < 20; ++round) {
+			size_t length = (size_t) (rand() % BITS);
+			size_t other_length = (size_t) (rand() % BITS);
+			size_t result_length = (op == 0 || length > other_length) ? length : other_length;
+			vector = vector->ops->destroy_vector(vector);
+			vector = random_vector(expected, length, rand() % 100);
+			c_bit_vector *other = random_vector(other_bits, other_length, rand() % 100);
+
+			for (size_t i = 0; i < result_length; ++i) {
+				bool a = i < length && expected[i];
+				bool b = i < other_length && other_bits[i];
+				expected[i] = (op == 0) ? (a && b) : (op == 1) ? (a || b) : (a != b);
+			}
+
+			if (op == 0)
+				vector->ops->and_vector(vector, other);
+			else if (op == 1)
+				vector->ops->or_vector(vector, other);
+			else
+				vector->ops->xor_vector(vector, other);
+
+			if (check_against(vector, expected, result_length) != 0) {
+				fprintf(stderr, "%s of %ld and %ld bits went wrong\n", names[op], length, other_length);
+				return 1;
+			}
+			other = other->ops->destroy_vector(other);
+		}
+	}
+
+	/* A vector combined with itself */
+	vector->ops->xor_vector(vector, vector);
+	if (vector->ops->popcount(vector) != 0) {
+		fprintf(stderr, "xor with itself left bits set\n");
+		return 1;
+	}
+
+	fprintf(stderr, "and, or and xor successful\n\n");
+
+	fprintf(stderr, "Testing iterator\n");
+
+	vector = vector->ops->destroy_vector(vector);
+	vector = random_vector(expected, BITS, 50);
+
+	generic_iterator *giter = new_bit_vector_iterator(vector);
+	bit_vector_iterator *iter = (bit_vector_iterator *) giter;
+	size_t index = 0;
+	for (giter->first(giter); !giter->end(giter); giter->next(giter)) {
+		if (iter->current(iter) != expected[index++]) {
+			fprintf(stderr, "Iterator gave the wrong bit at %ld\n", index - 1);
+			return 1;
+		}
+	}
+
+	if (index != BITS) {
+		fprintf(stderr, "Iterator visited %ld bits\n", index);
+		return 1;
+	}
+
+	giter = giter->destroy_iterator(giter);
+
+	fprintf(stderr, "Iterator testing successful\n\n");
+
+	fprintf(stderr, "Testing destructor\n");
+
+	vector = vector->ops->destroy_vector(vector);
+
+	fprintf(stderr, "Destructor testing successful\n\n");
+
+	fprintf(stderr, "Size of c_bit_vector: %ld bytes\n", sizeof(c_bit_vector));
+
+	return 0;
+}
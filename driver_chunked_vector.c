@@ -0,0 +1,147 @@
+#ifndef __cplusplus
+#include <stdio.h>
+#include <stdlib.h>
+#else
+#include <cstdio>
+#include <cstdlib>
+#endif
+#include "chunked_vector.h"
+#include "error.h"
+
+typedef struct big_record {
+	char bytes[100000];
+} big_record;
+
+define_chunked_vector(long)
+define_chunked_vector(big_record)
+
+#define COUNT	1000000
+
+int main(void) {
+	long batch[5000];
+	long *pinned[100];
+	size_t count = 0;
+
+	printf("Testing chunked vector creation\n");
+	chunked_vector(long) *vector = new_chunked_vector(long);
+
+	if (vector == NULL) {
+		fprintf(stderr, "Chunked vector creation failed\n");
+		return 1;
+	}
+	printf("Block size is %ld elements\n", vector->block_mask + 1);
+	printf("chunked vector creation successful\n");
+
+	printf("Testing add_top and stable addresses\n");
+	for (long i = 0; i < COUNT; ++i) {
+		if (chunked_vector_push(long, vector, i) != success) {
+			fprintf(stderr, "add_top failed at %ld\n", i);
+			return 1;
+		}
+		if (i % (COUNT / 100) == 0)
+			pinned[i / (COUNT / 100)] = chunked_vector_ptr(long, vector, i);
+	}
+
+	/* Growing never moves an element */
+	for (long i = 0; i < 100; ++i) {
+		if (pinned[i] != chunked_vector_ptr(long, vector, i*(COUNT / 100)) || *pinned[i] != i*(COUNT / 100)) {
+			fprintf(stderr, "Element %ld moved\n", i*(COUNT / 100));
+			return 1;
+		}
+	}
+	for (long i = 0; i < COUNT; ++i) {
+		if (chunked_vector_at(long, vector, i) != i || vector->ops->value_at(vector, i) != i) {
+			fprintf(stderr, "Wrong value at %ld\n", i);
+			return 1;
+		}
+	}
+
+	vector->ops->value_at(vector, COUNT);
+	if (err != invalid_index) {
+		fprintf(stderr, "value_at out of range did not set err\n");
+		return 1;
+	}
+	printf("add_top and stable address test successful\n");
+
+	printf("Testing append_array across blocks\n");
+	for (long i = 0; i < 5000; ++i)
+		batch[i] = -i;
+	/* Start part way into a block so that the batch spans three of them */
+	for (int round = 0; round < 3; ++round) {
+		if (vector->ops->append_array(vector, batch, 5000) != success) {
+			fprintf(stderr, "append_array failed\n");
+			return 1;
+		}
+	}
+	if (chunked_vector_length(long, vector) != COUNT + 15000) {
+		fprintf(stderr, "Expected %d elements, found %ld\n", COUNT + 15000, chunked_vector_length(long, vector));
+		return 1;
+	}
+	for (long i = 0; i < 15000; ++i) {
+		if (chunked_vector_at(long, vector, COUNT + i) != -(i % 5000)) {
+			fprintf(stderr, "Wrong value at %ld after append_array\n", COUNT + i);
+			return 1;
+		}
+	}
+	printf("append_array test successful\n");
+
+	printf("Testing iterator\n");
+	generic_iterator *giter = new_chunked_iterator(long, vector);
+	chunked_iterator(long) *iter = (chunked_iterator(long) *) giter;
+
+	for (giter->first(giter); !giter->end(giter); giter->next(giter), ++count) {
+		if (iter->value != chunked_vector_ptr(long, vector, count)) {
+			fprintf(stderr, "Iterator is on the wrong element at %ld\n", count);
+			return 1;
+		}
+	}
+	if (count != chunked_vector_length(long, vector)) {
+		fprintf(stderr, "Iterated %ld elements out of %ld\n", count, chunked_vector_length(long, vector));
+		return 1;
+	}
+	for (giter->last(giter); !giter->end(giter); iter->prev(giter))
+		--count;
+	if (count != 0) {
+		fprintf(stderr, "Reverse iteration missed %ld elements\n", count);
+		return 1;
+	}
+	giter = giter->destroy_iterator(giter);
+	printf("iterator test successful\n");
+
+	printf("Testing remove_top and shrink\n");
+	while (chunked_vector_length(long, vector) > 10)
+		vector->ops->remove_top(vector);
+	vector->ops->shrink(vector);
+	if (vector->block_count != 1 || chunked_vector_at(long, vector, 9) != 9) {
+		fprintf(stderr, "shrink kept %ld blocks\n", vector->block_count);
+		return 1;
+	}
+	chunked_vector_push(long, vector, 10);
+	if (vector->ops->value_at(vector, 10) != 10) {
+		fprintf(stderr, "add_top after shrink failed\n");
+		return 1;
+	}
+	printf("remove_top and shrink test successful\n");
+
+	printf("Testing elements larger than a block\n");
+	chunked_vector(big_record) *records = new_chunked_vector(big_record);
+	static big_record record;
+	for (int i = 0; i < 10; ++i) {
+		record.bytes[0] = (char) i;
+		record.bytes[sizeof(record.bytes) - 1] = (char) i;
+		records->ops->add_top(records, record);
+	}
+	if (records->block_mask != 0 || records->block_count != 10 ||
+		chunked_vector_ptr(big_record, records, 7)->bytes[sizeof(record.bytes) - 1] != 7) {
+		fprintf(stderr, "Large elements were stored wrong\n");
+		return 1;
+	}
+	records = records->ops->destroy_vector(records);
+	printf("large element test successful\n");
+
+	printf("Size of chunked vector is %ld bytes.\n", sizeof(chunked_vector(long)));
+	printf("Testing destroy_vector function\n");
+	vector = vector->ops->destroy_vector(vector);
+	printf("destroy_vector test successful\n");
+	return 0;
+}
@@ -14,6 +14,13 @@
 
 define_map(int, char)
 
+/* Largest key first */
+#define compare_descending(a, b)	compare_long(b, a)
+define_map_cmp(long, char, compare_descending)
+
+/* Keeps subtree counts for rank and select */
+define_map_counted(short, char)
+
 #define get_key()	({ int x = rand() % 100000; x; })
 #define get_val()	({ int x = (rand() % 10) + 48; x; })
 
@@ -71,14 +78,40 @@ int main(void) {
 	}
 		
 	for (giter->first(giter); !giter->end(giter); giter->next(giter), ++count) {
-		iterkey = iter->key;
-		iterval = iter->value;
+		iterkey = *iter->key;
+		iterval = *iter->value;
 		fprintf(stderr, "Key %d, value %d\n", iterkey, iterval);
 	}
 	
 	fprintf(stderr, "Number of keys iterated: %ld\n", count);
 	fprintf(stderr, "Insertion and iteration successful\n");
 	
+	fprintf(stderr, "Testing reverse iteration\n");
+	
+	size_t forward = count;
+	count = 0;
+	for (giter->last(giter); !giter->end(giter); iter->prev(giter), ++count) {
+		if (*iter->value != map->get_value(map, *iter->key)) {
+			fprintf(stderr, "Value for key %d is wrong\n", *iter->key);
+			return 1;
+		}
+		*iter->value = 'z';
+	}
+	
+	for (giter->first(giter); !giter->end(giter); giter->next(giter)) {
+		if (map->get_value(map, *iter->key) != 'z') {
+			fprintf(stderr, "Value was not written through the iterator\n");
+			return 1;
+		}
+	}
+	
+	if (count != forward) {
+		fprintf(stderr, "Iterated %ld keys forward but %ld keys backward\n", forward, count);
+		return 1;
+	}
+	
+	fprintf(stderr, "Reverse iteration successful\n");
+	
 	fprintf(stderr, "Testing destructor\n");
 	
 	map = map->destroy_map(map);
@@ -86,6 +119,265 @@ int main(void) {
 	
 	fprintf(stderr, "Destructor testing successful\n\n");
 	
+	fprintf(stderr, "Testing map allocated from an arena\n");
+	
+	c_arena *arena = new_arena(0);
+	
+	if (arena == NULL) {
+		fprintf(stderr, "Arena creation failed!\n");
+		return 1;
+	}
+	
+	for (int round = 0; round < 3; ++round) {
+		c_map(int, char) *scoped = new_c_map_with(int, char, &arena->allocator);
+		if (scoped == NULL) {
+			fprintf(stderr, "Map creation failed!\n");
+			return 1;
+		}
+		for (int i = 0; i < 1000; ++i) {
+			if (scoped->insert(scoped, i, (char) (i % 10) + 48) != 0) {
+				fprintf(stderr, "Insertion failed!\n");
+				return 1;
+			}
+		}
+		for (int i = 0; i < 1000; i += 2)
+			scoped->delete_pair(scoped, i);
+		for (int i = 0; i < 1000; ++i) {
+			if (scoped->is_key(scoped, i) != (i % 2 == 1)) {
+				fprintf(stderr, "Key %d is wrong after deletion\n", i);
+				return 1;
+			}
+		}
+		/* No destroy_map. Everything goes away with the arena */
+		reset_arena(arena);
+	}
+	
+	arena = destroy_arena(arena);
+	
+	fprintf(stderr, "Arena map test successful\n\n");
+	
+	fprintf(stderr, "Testing key comparators\n");
+	
+	c_map(int, char) *signedmap = new_c_map(int, char);
+	
+	/* -50 through 50 in a scrambled order */
+	for (int i = 0; i <= 100; ++i)
+		signedmap->insert(signedmap, (i * 37) % 101 - 50, 'a');
+	
+	key = signedmap->tree->first_key(signedmap->tree);
+	for (int expected = -50; expected <= 50; ++expected) {
+		if (key != expected) {
+			fprintf(stderr, "Expected key %d, got key %d\n", expected, key);
+			return 1;
+		}
+		if (expected < 50)
+			key = signedmap->tree->next_key(signedmap->tree, key);
+	}
+	
+	signedmap = signedmap->destroy_map(signedmap);
+	
+	c_map(long, char) *reversed = new_c_map(long, char);
+	
+	for (long i = 0; i < 100; ++i)
+		reversed->insert(reversed, i, 'b');
+	
+	if (reversed->tree->first_key(reversed->tree) != 99 ||
+		reversed->tree->last_key(reversed->tree) != 0 || !reversed->is_key(reversed, 42)) {
+		fprintf(stderr, "Custom comparator was not used\n");
+		return 1;
+	}
+	
+	reversed = reversed->destroy_map(reversed);
+	
+	fprintf(stderr, "Key comparator test successful\n\n");
+	
+	fprintf(stderr, "Testing build from sorted input\n");
+	
+	static long sorted_keys[5000];
+	static char sorted_values[5000];
+	
+	/* Sorted for this map means largest key first */
+	reversed = new_c_map(long, char);
+	for (long i = 0; i < 5000; ++i) {
+		sorted_keys[i] = 5000 - i;
+		sorted_values[i] = (char) (i % 10) + 48;
+	}
+	
+	if (reversed->build_from_sorted(reversed, sorted_keys, sorted_values, 5000) != success) {
+		fprintf(stderr, "Build failed!\n");
+		return 1;
+	}
+	
+	key = 5000;
+	generic_iterator *built_iter = new_map_iterator(long, char, reversed);
+	map_iterator(long, char) *built_pairs = (map_iterator(long, char) *) built_iter;
+	for (built_iter->first(built_iter); !built_iter->end(built_iter); built_iter->next(built_iter)) {
+		if (*built_pairs->key != key || *built_pairs->value != (char) ((5000 - key) % 10) + 48) {
+			fprintf(stderr, "Built map holds the wrong pair at key %d\n", key);
+			return 1;
+		}
+		--key;
+	}
+	
+	if (key != 0) {
+		fprintf(stderr, "Built map is missing keys\n");
+		return 1;
+	}
+	
+	built_iter = built_iter->destroy_iterator(built_iter);
+	reversed = reversed->destroy_map(reversed);
+	
+	fprintf(stderr, "Build from sorted input successful\n\n");
+	
+	fprintf(stderr, "Testing bounds and range iteration\n");
+	
+	c_map(int, char) *bounded = new_c_map(int, char);
+	static bool in_map[3000];
+	int found = 0;
+	
+	if (bounded->lower_bound(bounded, 0, &found) || bounded->floor_key(bounded, 0, &found)) {
+		fprintf(stderr, "An empty map found a bound\n");
+		return 1;
+	}
+	
+	for (int i = 0; i < 1000; ++i) {
+		key = rand() % 3000;
+		in_map[key] = true;
+		bounded->insert(bounded, key, 'r');
+	}
+	
+	for (int probe = -5; probe < 3005; ++probe) {
+		/* The answers worked out by scanning, with -1 for none */
+		int lower = -1, upper = -1, floor = -1;
+		for (int k = (probe < 0) ? 0 : probe; k < 3000 && lower < 0; ++k)
+			lower = in_map[k] ? k : -1;
+		for (int k = (probe < 0) ? 0 : probe + 1; k < 3000 && upper < 0; ++k)
+			upper = in_map[k] ? k : -1;
+		for (int k = (probe >= 3000) ? 2999 : probe; k >= 0 && floor < 0; --k)
+			floor = in_map[k] ? k : -1;
+		if (bounded->lower_bound(bounded, probe, &found) != (lower >= 0) || (lower >= 0 && found != lower) ||
+			bounded->ceiling_key(bounded, probe, &found) != (lower >= 0) || (lower >= 0 && found != lower) ||
+			bounded->upper_bound(bounded, probe, &found) != (upper >= 0) || (upper >= 0 && found != upper) ||
+			bounded->floor_key(bounded, probe, &found) != (floor >= 0) || (floor >= 0 && found != floor)) {
+			fprintf(stderr, "Bounds around %d are wrong\n", probe);
+			return 1;
+		}
+	}
+	
+	for (int round = 0; round < 200; ++round) {
+		int low = rand() % 3100 - 50;
+		int high = low + rand() % 500;
+		generic_iterator *rgiter = new_map_range_iterator(int, char, bounded, low, high);
+		map_range_iterator(int, char) *range = (map_range_iterator(int, char) *) rgiter;
+		int expected = low - 1;
+		for (rgiter->first(rgiter); !rgiter->end(rgiter); rgiter->next(rgiter)) {
+			do
+				++expected;
+			while (expected < high && (expected < 0 || expected >= 3000 || !in_map[expected]));
+			if (*range->key != expected) {
+				fprintf(stderr, "Range [%d, %d) gave key %d, expected %d\n", low, high, *range->key, expected);
+				return 1;
+			}
+		}
+		do
+			++expected;
+		while (expected < high && (expected < 0 || expected >= 3000 || !in_map[expected]));
+		if (expected < high) {
+			fprintf(stderr, "Range [%d, %d) stopped before key %d\n", low, high, expected);
+			return 1;
+		}
+		/* And back down again */
+		for (rgiter->last(rgiter); !rgiter->end(rgiter); range->prev(rgiter)) {
+			do
+				--expected;
+			while (expected >= low && (expected < 0 || expected >= 3000 || !in_map[expected]));
+			if (*range->key != expected) {
+				fprintf(stderr, "Range [%d, %d) backwards gave key %d, expected %d\n", low, high, *range->key, expected);
+				return 1;
+			}
+		}
+		rgiter = rgiter->destroy_iterator(rgiter);
+	}
+	
+	bounded = bounded->destroy_map(bounded);
+	
+	/* Bounds follow the map's comparator, so low comes first in its order */
+	reversed = new_c_map(long, char);
+	for (long i = 0; i < 100; i += 10)
+		reversed->insert(reversed, i, 'b');
+	
+	long found_long = 0;
+	if (!reversed->lower_bound(reversed, 55, &found_long) || found_long != 50 ||
+		!reversed->floor_key(reversed, 55, &found_long) || found_long != 60) {
+		fprintf(stderr, "Bounds ignored the comparator\n");
+		return 1;
+	}
+	
+	generic_iterator *rgiter = new_map_range_iterator(long, char, reversed, 75, 25);
+	map_range_iterator(long, char) *range = (map_range_iterator(long, char) *) rgiter;
+	key = 70;
+	for (; !rgiter->end(rgiter); rgiter->next(rgiter)) {
+		if (*range->key != key) {
+			fprintf(stderr, "Reversed range gave key %ld, expected %d\n", *range->key, key);
+			return 1;
+		}
+		key -= 10;
+	}
+	if (key != 20) {
+		fprintf(stderr, "Reversed range stopped at the wrong key\n");
+		return 1;
+	}
+	
+	rgiter = rgiter->destroy_iterator(rgiter);
+	reversed = reversed->destroy_map(reversed);
+	
+	fprintf(stderr, "Bounds and range iteration successful\n\n");
+	
+	fprintf(stderr, "Testing size, rank and select\n");
+	
+	c_map(short, char) *ranked = new_c_map(short, char);
+	for (short i = 1000; i > 0; --i)
+		ranked->insert(ranked, 5*i, 's');
+	for (short i = 5; i <= 5000; i += 10)
+		ranked->delete_pair(ranked, i);
+	
+	/* The keys left are 10, 20, ... 5000 */
+	short found_short = 0;
+	if (ranked->size(ranked) != 500 || ranked->rank(ranked, 10) != 0 || ranked->rank(ranked, 2005) != 200 ||
+		ranked->rank(ranked, 9999) != 500 || !ranked->select(ranked, 199, &found_short) || found_short != 2000) {
+		fprintf(stderr, "Size, rank or select is wrong\n");
+		return 1;
+	}
+	
+	for (size_t i = 0; i < 500; ++i) {
+		if (!ranked->select(ranked, i, &found_short) || ranked->rank(ranked, found_short) != i) {
+			fprintf(stderr, "Select and rank disagree at %ld\n", i);
+			return 1;
+		}
+	}
+	
+	err = success;
+	if (ranked->select(ranked, 500, &found_short) || err != invalid_index) {
+		fprintf(stderr, "Select past the end did not set invalid_index\n");
+		return 1;
+	}
+	
+	/* A map without counts gives the same answers by walking its nodes */
+	c_map(int, char) *plain = new_c_map(int, char);
+	for (int i = 0; i < 100; ++i)
+		plain->insert(plain, i, 'p');
+	int found_int = 0;
+	if (plain->size(plain) != 100 || plain->rank(plain, 50) != 50 || !plain->select(plain, 42, &found_int) ||
+		found_int != 42) {
+		fprintf(stderr, "Rank and select are wrong without counts\n");
+		return 1;
+	}
+	plain = plain->destroy_map(plain);
+	
+	ranked = ranked->destroy_map(ranked);
+	
+	fprintf(stderr, "Size, rank and select successful\n\n");
+	
 	fprintf(stderr, "Size of c_map: %ld bytes\n", sizeof(c_map(int,char)));
 	fprintf(stderr, "Size of map_iterator %ld bytes\n", sizeof(map_iterator(int, char)));
 	
@@ -0,0 +1,221 @@
+#ifndef __cplusplus
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#else
+#include <cstdio>
+#include <cstdlib>
+#endif
+#include <pthread.h>
+#include "concurrent_map.h"
+#include "error.h"
+
+define_concurrent_map(long, long)
+
+#define WRITERS	4
+#define READERS	2
+#define KEYS	20000
+
+/* Writer w owns the keys w*KEYS to (w + 1)*KEYS - 1, and every value is twice its key */
+typedef struct worker {
+	concurrent_map(long, long) *map;
+	long id;
+	bool *done;
+	bool deleting;
+	int failed;
+	size_t snapshots;
+} worker;
+
+static void *write_keys(void *arg) {
+	worker *self = (worker *) arg;
+	for (long i = 0; i < KEYS; ++i) {
+		if (self->map->insert(self->map, self->id*KEYS + i, 2*(self->id*KEYS + i)) != success)
+			self->failed = 1;
+	}
+	return NULL;
+}
+
+static void *delete_keys(void *arg) {
+	worker *self = (worker *) arg;
+	for (long i = 0; i < KEYS; i += 2) {
+		if (self->map->delete_pair(self->map, self->id*KEYS + i) != success)
+			self->failed = 1;
+	}
+	return NULL;
+}
+
+/* Each writer works through its keys in order, so a snapshot taken while they run */
+/* has to show every writer stopped at some key. Before it, the writer's keys are all */
+/* inserted (or its even keys all deleted), and after it none of them are yet. */
+static int check_snapshot(c_flat_map(long, long) *snapshot, bool deleting) {
+	size_t index = 0;
+	for (long w = 0; w < WRITERS; ++w) {
+		bool reached = false;
+		for (long key = w*KEYS; key < (w + 1)*KEYS; ++key) {
+			bool found = index < snapshot->count && snapshot->keys[index] == key;
+			if (found && snapshot->values[index++] != 2*key)
+				return 1;
+			if (deleting && key % 2 == 1) {
+				if (!found)
+					return 1;
+			}
+			else {
+				/* Past the writer, inserted keys aren't there yet and deleted ones still are */
+				if (reached && found != deleting)
+					return 1;
+				if (found == deleting)
+					reached = true;
+			}
+		}
+	}
+	return index != snapshot->count;
+}
+
+static void *read_keys(void *arg) {
+	worker *self = (worker *) arg;
+	unsigned int seed = (unsigned int) self->id;
+	while (!__atomic_load_n(self->done, __ATOMIC_ACQUIRE)) {
+		long key = rand_r(&seed) % (WRITERS*KEYS);
+		/* A key is either missing or has its value, never anything in between */
+		if (self->map->is_key(self->map, key)) {
+			if (self->map->get_value(self->map, key) != 2*key)
+				self->failed = 1;
+		}
+		if (rand_r(&seed) % 1000 == 0) {
+			c_flat_map(long, long) *snapshot = self->map->snapshot(self->map);
+			if (snapshot == NULL || check_snapshot(snapshot, self->deleting) != 0)
+				self->failed = 1;
+			snapshot = snapshot->destroy_map(snapshot);
+			++self->snapshots;
+		}
+	}
+	return NULL;
+}
+
+static int run_workers(concurrent_map(long, long) *map, void *(*job)(void *)) {
+	pthread_t threads[WRITERS + READERS];
+	worker workers[WRITERS + READERS];
+	bool done = false;
+	size_t snapshots = 0;
+	int failed = 0;
+	for (long t = 0; t < WRITERS + READERS; ++t) {
+		workers[t].map = map;
+		workers[t].id = (t < WRITERS) ? t : t + 1000;
+		workers[t].done = &done;
+		workers[t].deleting = (job == &delete_keys);
+		workers[t].failed = 0;
+		workers[t].snapshots = 0;
+		pthread_create(&threads[t], NULL, (t < WRITERS) ? job : &read_keys, &workers[t]);
+	}
+	for (int t = 0; t < WRITERS; ++t)
+		pthread_join(threads[t], NULL);
+	__atomic_store_n(&done, true, __ATOMIC_RELEASE);
+	for (int t = WRITERS; t < WRITERS + READERS; ++t)
+		pthread_join(threads[t], NULL);
+	for (int t = 0; t < WRITERS + READERS; ++t) {
+		failed |= workers[t].failed;
+		snapshots += workers[t].snapshots;
+	}
+	fprintf(stderr, "Readers took %ld snapshots\n", snapshots);
+	return failed;
+}
+
+int main(void) {
+	fprintf(stderr, "Testing constructor\n");
+
+	concurrent_map(long, long) *map = new_concurrent_map(long, long, 10);
+
+	if (map == NULL) {
+		fprintf(stderr, "Map creation failed!\n");
+		return 1;
+	}
+
+	if (map->shard_count != 16 || map->size(map) != 0) {
+		fprintf(stderr, "A new map should be empty with 16 shards\n");
+		return 1;
+	}
+
+	fprintf(stderr, "Constructor testing successful\n\n");
+
+	fprintf(stderr, "Testing insert, get_value and delete_pair\n");
+
+	for (long i = 0; i < 1000; ++i)
+		map->insert(map, i, 2*i);
+	map->insert(map, 5, 11);
+
+	err = success;
+	if (map->size(map) != 1000 || map->get_value(map, 5) != 11 || map->get_value(map, 999) != 1998 ||
+		map->get_value(map, 1000) != 0 || err != key_not_found) {
+		fprintf(stderr, "Lookups are wrong\n");
+		return 1;
+	}
+
+	for (long i = 0; i < 1000; i += 3)
+		map->delete_pair(map, i);
+
+	if (map->delete_pair(map, 0) != key_not_found || map->is_key(map, 3) || !map->is_key(map, 4)) {
+		fprintf(stderr, "Deletes are wrong\n");
+		return 1;
+	}
+
+	fprintf(stderr, "Insert, get_value and delete_pair successful\n\n");
+
+	fprintf(stderr, "Testing snapshot\n");
+
+	c_flat_map(long, long) *snapshot = map->snapshot(map);
+	size_t index = 0;
+	for (long i = 0; i < 1000; ++i) {
+		if (i % 3 == 0)
+			continue;
+		if (index >= snapshot->count || snapshot->keys[index] != i || snapshot->values[index] != (i == 5 ? 11 : 2*i)) {
+			fprintf(stderr, "Snapshot is wrong at key %ld\n", i);
+			return 1;
+		}
+		++index;
+	}
+
+	/* The snapshot doesn't follow the map, and still works as a flat map */
+	map->insert(map, 3, 6);
+	if (index != snapshot->count || snapshot->is_key(snapshot, 3) || snapshot->get_value(snapshot, 4) != 8) {
+		fprintf(stderr, "Snapshot changed with the map\n");
+		return 1;
+	}
+
+	snapshot = snapshot->destroy_map(snapshot);
+	map = map->destroy_map(map);
+
+	fprintf(stderr, "Snapshot testing successful\n\n");
+
+	fprintf(stderr, "Testing concurrent writers and readers\n");
+
+	map = new_concurrent_map(long, long, 0);
+
+	if (run_workers(map, &write_keys) != 0 || map->size(map) != WRITERS*KEYS) {
+		fprintf(stderr, "Concurrent inserts went wrong\n");
+		return 1;
+	}
+
+	if (run_workers(map, &delete_keys) != 0 || map->size(map) != WRITERS*KEYS / 2) {
+		fprintf(stderr, "Concurrent deletes went wrong\n");
+		return 1;
+	}
+
+	for (long key = 0; key < WRITERS*KEYS; ++key) {
+		if (map->is_key(map, key) != (key % 2 == 1)) {
+			fprintf(stderr, "Key %ld is wrong after concurrent deletes\n", key);
+			return 1;
+		}
+	}
+
+	fprintf(stderr, "Concurrent testing successful\n\n");
+
+	fprintf(stderr, "Testing destructor\n");
+
+	map = map->destroy_map(map);
+
+	fprintf(stderr, "Destructor testing successful\n\n");
+
+	fprintf(stderr, "Size of a shard: %ld bytes\n", sizeof(concurrent_shard_long_long));
+
+	return 0;
+}
@@ -0,0 +1,116 @@
+#ifndef __cplusplus
+#include <stdio.h>
+#include <stdlib.h>
+#else
+#include <cstdio>
+#include <cstdlib>
+#endif
+#include <pthread.h>
+#include "concurrent_vector.h"
+#include "error.h"
+
+define_concurrent_vector(long)
+
+#define PRODUCERS	4
+#define APPENDS	100000
+#define BATCH	100
+
+/* Every value is producer * APPENDS + sequence + 1, so a zero means an unwritten slot */
+typedef struct producer {
+	concurrent_vector(long) *vector;
+	long id;
+} producer;
+
+static void *produce(void *arg) {
+	producer *self = (producer *) arg;
+	long batch[BATCH];
+	for (long i = 0; i < APPENDS; ) {
+		/* Odd producers append in batches, even ones one at a time */
+		if (self->id % 2 == 1 && APPENDS - i >= BATCH) {
+			for (long j = 0; j < BATCH; ++j)
+				batch[j] = self->id*APPENDS + i + j + 1;
+			self->vector->ops->append_array(self->vector, batch, BATCH);
+			i += BATCH;
+		}
+		else {
+			concurrent_vector_push(long, self->vector, self->id*APPENDS + i + 1);
+			++i;
+		}
+	}
+	return NULL;
+}
+
+/* The published length must only grow, and everything below it must be written */
+static void *follow(void *arg) {
+	concurrent_vector(long) *vector = (concurrent_vector(long) *) arg;
+	size_t seen = 0;
+	while (seen < PRODUCERS*APPENDS) {
+		size_t length = concurrent_vector_length(long, vector);
+		if (length < seen) {
+			fprintf(stderr, "Published length went from %ld to %ld\n", seen, length);
+			exit(1);
+		}
+		for (; seen < length; ++seen) {
+			if (concurrent_vector_at(long, vector, seen) == 0) {
+				fprintf(stderr, "Element %ld was published before it was written\n", seen);
+				exit(1);
+			}
+		}
+	}
+	return NULL;
+}
+
+int main(void) {
+	pthread_t threads[PRODUCERS + 1];
+	producer producers[PRODUCERS];
+	long next[PRODUCERS];
+
+	printf("Testing concurrent vector creation\n");
+	concurrent_vector(long) *vector = new_concurrent_vector(long);
+
+	if (vector == NULL) {
+		fprintf(stderr, "Concurrent vector creation failed\n");
+		return 1;
+	}
+
+	if (vector->ops->length(vector) != 0 || vector->ops->value_at(vector, 0) != 0 || err != invalid_index) {
+		fprintf(stderr, "Empty vector has elements\n");
+		return 1;
+	}
+	printf("concurrent vector creation successful\n");
+
+	printf("Testing concurrent appends\n");
+	pthread_create(&threads[PRODUCERS], NULL, &follow, vector);
+	for (long t = 0; t < PRODUCERS; ++t) {
+		producers[t].vector = vector;
+		producers[t].id = t;
+		pthread_create(&threads[t], NULL, &produce, &producers[t]);
+	}
+	for (int t = 0; t <= PRODUCERS; ++t)
+		pthread_join(threads[t], NULL);
+
+	if (concurrent_vector_length(long, vector) != PRODUCERS*APPENDS) {
+		fprintf(stderr, "Expected %d elements, published %ld\n", PRODUCERS*APPENDS,
+				concurrent_vector_length(long, vector));
+		return 1;
+	}
+
+	/* Each producer's values have to appear once each, in the order they were appended */
+	for (int t = 0; t < PRODUCERS; ++t)
+		next[t] = 0;
+	for (size_t i = 0; i < PRODUCERS*APPENDS; ++i) {
+		long value = vector->ops->value_at(vector, i) - 1;
+		long t = value / APPENDS;
+		if (t < 0 || t >= PRODUCERS || value % APPENDS != next[t]) {
+			fprintf(stderr, "Element %ld is out of order or duplicated\n", i);
+			return 1;
+		}
+		++next[t];
+	}
+	printf("concurrent append test successful\n");
+
+	printf("Testing destroy_vector function\n");
+	vector = vector->ops->destroy_vector(vector);
+	printf("destroy_vector test successful\n");
+	return 0;
+}
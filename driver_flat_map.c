@@ -0,0 +1,176 @@
+#ifndef __cplusplus
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <stddef.h>
+#else
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <cstddef>
+#endif
+#include "flat_map.h"
+#include "c_map.h"
+#include "error.h"
+
+define_flat_map(int, char)
+define_map(int, char)
+
+/* Largest key first */
+#define compare_descending(a, b)	compare_long(b, a)
+define_flat_map_cmp(long, char, compare_descending)
+
+#define get_key()	({ int x = rand() % 1000; x; })
+#define get_val()	({ int x = (rand() % 10) + 48; x; })
+
+/* The flat map has to hold exactly what the tree holds, in increasing order */
+static int check_against_map(c_flat_map(int, char) *flat, c_map(int, char) *map) {
+	for (size_t i = 0; i < flat->count; ++i) {
+		if (i > 0 && flat->keys[i - 1] >= flat->keys[i]) {
+			fprintf(stderr, "Keys %d and %d are out of order\n", flat->keys[i - 1], flat->keys[i]);
+			return 1;
+		}
+		if (!map->is_key(map, flat->keys[i]) || map->get_value(map, flat->keys[i]) != flat->values[i]) {
+			fprintf(stderr, "Key %d does not match the map\n", flat->keys[i]);
+			return 1;
+		}
+	}
+	for (int key = -1; key <= 1000; ++key) {
+		if (flat->is_key(flat, key) != map->is_key(map, key)) {
+			fprintf(stderr, "is_key disagrees for key %d\n", key);
+			return 1;
+		}
+	}
+	return 0;
+}
+
+int main(void) {
+	int keys[2000];
+	char values[2000];
+	int key;
+	char val;
+
+	srand(time(NULL));
+
+	fprintf(stderr, "Testing constructor\n");
+
+	c_flat_map(int, char) *flat = new_c_flat_map(int, char);
+	c_map(int, char) *map = new_c_map(int, char);
+
+	if (flat == NULL || map == NULL) {
+		fprintf(stderr, "Map creation failed!\n");
+		return 1;
+	}
+
+	fprintf(stderr, "Constructor testing successful\n\n");
+
+	fprintf(stderr, "Testing insertion and deletion\n");
+
+	for (size_t i = 0; i < 5000; ++i) {
+		key = get_key();
+		val = get_val();
+		if (rand() % 3 == 0) {
+			error_code expected = map->is_key(map, key) ? success : key_not_found;
+			if (flat->delete_pair(flat, key) != expected) {
+				fprintf(stderr, "Deleting key %d returned the wrong code\n", key);
+				return 1;
+			}
+			map->delete_pair(map, key);
+		}
+		else if (flat->insert(flat, key, val) != success) {
+			fprintf(stderr, "Insertion failed!\n");
+			return 1;
+		}
+		else
+			map->insert(map, key, val);
+	}
+
+	if (check_against_map(flat, map) != 0)
+		return 1;
+
+	err = success;
+	flat->get_value(flat, 1000);
+	if (err != key_not_found) {
+		fprintf(stderr, "A missing key did not set key_not_found\n");
+		return 1;
+	}
+
+	fprintf(stderr, "%ld keys after insertion and deletion\n", flat->count);
+	fprintf(stderr, "Insertion and deletion successful\n\n");
+
+	fprintf(stderr, "Testing bulk build\n");
+
+	/* Lots of duplicates. The last value given for a key has to win */
+	for (size_t i = 0; i < 2000; ++i) {
+		keys[i] = get_key();
+		values[i] = get_val();
+	}
+
+	map = map->destroy_map(map);
+	map = new_c_map(int, char);
+	for (size_t i = 0; i < 2000; ++i)
+		map->insert(map, keys[i], values[i]);
+
+	if (flat->build(flat, keys, values, 2000) != success) {
+		fprintf(stderr, "Build failed!\n");
+		return 1;
+	}
+
+	if (check_against_map(flat, map) != 0)
+		return 1;
+
+	/* Sorted input is copied as is */
+	for (int i = 0; i < 2000; ++i) {
+		keys[i] = 2*i;
+		values[i] = (char) (i % 10) + 48;
+	}
+
+	if (flat->build(flat, keys, values, 2000) != success || flat->count != 2000) {
+		fprintf(stderr, "Build from sorted input failed!\n");
+		return 1;
+	}
+
+	for (int i = 0; i < 4000; ++i) {
+		if (flat->is_key(flat, i) != (i % 2 == 0) ||
+			(i % 2 == 0 && flat->get_value(flat, i) != (char) ((i / 2) % 10) + 48)) {
+			fprintf(stderr, "Key %d is wrong after a sorted build\n", i);
+			return 1;
+		}
+	}
+
+	if (flat->build(flat, keys, values, 0) != success || flat->count != 0 || flat->is_key(flat, 0)) {
+		fprintf(stderr, "Empty build failed!\n");
+		return 1;
+	}
+
+	fprintf(stderr, "Bulk build successful\n\n");
+
+	fprintf(stderr, "Testing destructor\n");
+
+	flat = flat->destroy_map(flat);
+	map = map->destroy_map(map);
+
+	fprintf(stderr, "Destructor testing successful\n\n");
+
+	fprintf(stderr, "Testing key comparators\n");
+
+	c_flat_map(long, char) *reversed = new_c_flat_map(long, char);
+
+	for (long i = 0; i < 100; ++i)
+		reversed->insert(reversed, (i * 37) % 100, 'b');
+
+	for (size_t i = 0; i < reversed->count; ++i) {
+		if (reversed->keys[i] != 99 - (long) i) {
+			fprintf(stderr, "Custom comparator was not used\n");
+			return 1;
+		}
+	}
+
+	reversed = reversed->destroy_map(reversed);
+
+	fprintf(stderr, "Key comparator test successful\n\n");
+
+	fprintf(stderr, "Size of c_flat_map: %ld bytes\n", sizeof(c_flat_map(int, char)));
+
+	return 0;
+}
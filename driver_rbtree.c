@@ -14,6 +14,7 @@
 #include "error.h"
 
 define_rbtree(int, char)
+define_rbtree_counted(long, char)
 
 #define get_key()	({ int x = rand() % 100000; x; })
 #define get_val()	({ int x = (rand() % 10) + 48; x; })
@@ -52,6 +53,34 @@ int choose_key(key_holder *holder) {
 	}
 }
 
+/* Returns the black height of the subtree, or -1 if it breaks one of the rules */
+int check_subtree(generic_node *node, generic_node *sentinel) {
+	if (node == sentinel)
+		return 1;
+	if (node->lchild != sentinel && node_parent(node->lchild) != node)
+		return -1;
+	if (node->rchild != sentinel && node_parent(node->rchild) != node)
+		return -1;
+	if (node_color(node) == RED && (node_color(node->lchild) == RED || node_color(node->rchild) == RED))
+		return -1;
+	int left = check_subtree(node->lchild, sentinel);
+	int right = check_subtree(node->rchild, sentinel);
+	if (left < 0 || left != right)
+		return -1;
+	return left + (node_color(node) == BLACK);
+}
+
+/* Returns the size of a counted subtree, or -1 if a node's count disagrees with it */
+long check_counts(generic_node *node, generic_node *sentinel) {
+	if (node == sentinel)
+		return node_count(node) == 0 ? 0 : -1;
+	long left = check_counts(node->lchild, sentinel);
+	long right = check_counts(node->rchild, sentinel);
+	if (left < 0 || right < 0 || node_count(node) != (size_t) (left + right + 1))
+		return -1;
+	return left + right + 1;
+}
+
 int main() {
 	srand(time(NULL));
 	int key;
@@ -124,6 +153,229 @@ int main() {
 	
 	fprintf(stderr, "Get value test successful\n\n");
 	
+	fprintf(stderr, "Testing random inserts and deletes\n");
+	
+	rb_tree(int, char) *random = new_rbtree(int, char);
+	static bool present[5000];
+	
+	for (int i = 0; i < 200000; ++i) {
+		key = rand() % 5000;
+		if (rand() % 2) {
+			random->insert(random, key, 'r');
+			present[key] = true;
+		}
+		else if (present[key]) {
+			if (random->delete_pair(random, key) != 0) {
+				fprintf(stderr, "Unable to delete key %d\n", key);
+				return 1;
+			}
+			present[key] = false;
+		}
+		if (i % 1000 == 0 && random->root != NULL &&
+			check_subtree((generic_node *) random->root, random->sentinel) < 0) {
+			fprintf(stderr, "Tree is unbalanced after %d operations\n", i);
+			return 1;
+		}
+	}
+	
+	for (key = 0; key < 5000; ++key) {
+		if (random->check_key(random, key) != present[key]) {
+			fprintf(stderr, "Key %d is wrong after random deletes\n", key);
+			return 1;
+		}
+		if (present[key])
+			random->delete_pair(random, key);
+	}
+	
+	if (random->root != NULL) {
+		fprintf(stderr, "Tree is not empty after deleting every key\n");
+		return 1;
+	}
+	
+	random = random->destroy_rbtree(random);
+	
+	fprintf(stderr, "Random insert and delete test successful\n\n");
+	
+	fprintf(stderr, "Testing node pool under churn\n");
+	
+	rb_tree(int, char) *churn = new_rbtree(int, char);
+	
+	for (int i = 0; i < 100000; ++i)
+		churn->insert(churn, i, 'a');
+	
+	size_t chunks = churn->pool.chunk_count;
+	
+	for (int round = 0; round < 5; ++round) {
+		for (int i = round; i < 100000; i += 2)
+			churn->delete_pair(churn, i);
+		for (int i = round; i < 100000; i += 2)
+			churn->insert(churn, i, 'b');
+	}
+	
+	for (int i = 0; i < 100000; ++i) {
+		if (!churn->check_key(churn, i)) {
+			fprintf(stderr, "Key %d missing after churn\n", i);
+			return 1;
+		}
+	}
+	
+	if (churn->pool.chunk_count != chunks) {
+		fprintf(stderr, "Churn allocated %ld new chunks\n", churn->pool.chunk_count - chunks);
+		return 1;
+	}
+	
+	fprintf(stderr, "Chunks used for 100000 nodes: %ld\n", chunks);
+	churn = churn->destroy_rbtree(churn);
+	
+	fprintf(stderr, "Node pool test successful\n\n");
+	
+	fprintf(stderr, "Testing build from sorted input\n");
+	
+	static int keys[100000];
+	static char values[100000];
+	rb_tree(int, char) *built = new_rbtree(int, char);
+	
+	/* Every size up to 300 covers perfect trees and every way of being one level short */
+	for (size_t n = 0; n <= 300; ++n) {
+		for (size_t i = 0; i < n; ++i) {
+			keys[i] = 3*(int) i;
+			values[i] = (char) (i % 10) + 48;
+		}
+		if (built->build_from_sorted(built, keys, values, n) != success) {
+			fprintf(stderr, "Build of %ld keys failed!\n", n);
+			return 1;
+		}
+		if (n == 0 ? built->root != NULL : check_subtree((generic_node *) built->root, built->sentinel) < 0 ||
+			node_color((generic_node *) built->root) != BLACK) {
+			fprintf(stderr, "Tree built from %ld keys is not a red and black tree\n", n);
+			return 1;
+		}
+		for (int k = -1; k <= 3*(int) n; ++k) {
+			if (built->check_key(built, k) != (k >= 0 && k % 3 == 0 && k < 3*(int) n)) {
+				fprintf(stderr, "Key %d is wrong after building from %ld keys\n", k, n);
+				return 1;
+			}
+		}
+	}
+	
+	/* Duplicates keep the last value, and the tree still works normally afterwards */
+	for (int i = 0; i < 100000; ++i) {
+		keys[i] = i / 2;
+		values[i] = (i % 2 == 0) ? 'x' : 'y';
+	}
+	built->build_from_sorted(built, keys, values, 100000);
+	if (built->pool.chunk_count != 1 || built->get_value(built, 49999) != 'y' || built->check_key(built, 50000)) {
+		fprintf(stderr, "Build with duplicate keys went wrong\n");
+		return 1;
+	}
+	for (int i = 0; i < 50000; i += 3)
+		built->delete_pair(built, i);
+	for (int i = 50000; i < 60000; ++i)
+		built->insert(built, i, 'z');
+	if (check_subtree((generic_node *) built->root, built->sentinel) < 0) {
+		fprintf(stderr, "Tree is unbalanced after changes to a built tree\n");
+		return 1;
+	}
+	for (int i = 0; i < 60000; ++i) {
+		if (built->check_key(built, i) != (i >= 50000 || i % 3 != 0)) {
+			fprintf(stderr, "Key %d is wrong after changes to a built tree\n", i);
+			return 1;
+		}
+	}
+	
+	/* Unsorted input still ends up in the tree */
+	for (int i = 0; i < 1000; ++i)
+		keys[i] = (i * 7919) % 1000;
+	built->build_from_sorted(built, keys, values, 1000);
+	for (int i = 0; i < 1000; ++i) {
+		if (!built->check_key(built, i) || built->check_key(built, 50000)) {
+			fprintf(stderr, "Build from unsorted keys lost key %d\n", i);
+			return 1;
+		}
+	}
+	
+	built = built->destroy_rbtree(built);
+	
+	fprintf(stderr, "Build from sorted input successful\n\n");
+	
+	fprintf(stderr, "Testing rank and select\n");
+	
+	rb_tree(long, char) *counted = new_rbtree(long, char);
+	static bool in_counted[5000];
+	size_t size = 0;
+	
+	for (int i = 0; i < 100000; ++i) {
+		long k = rand() % 5000;
+		if (rand() % 3) {
+			counted->insert(counted, k, 'c');
+			size += !in_counted[k];
+			in_counted[k] = true;
+		}
+		else if (in_counted[k]) {
+			counted->delete_pair(counted, k);
+			--size;
+			in_counted[k] = false;
+		}
+		if (i % 1000 == 0 && counted->root != NULL &&
+			(check_subtree((generic_node *) counted->root, counted->sentinel) < 0 ||
+			check_counts((generic_node *) counted->root, counted->sentinel) != (long) size)) {
+			fprintf(stderr, "Subtree counts are wrong after %d operations\n", i);
+			return 1;
+		}
+	}
+	
+	if (counted->size != size) {
+		fprintf(stderr, "Size is %ld, expected %ld\n", counted->size, size);
+		return 1;
+	}
+	
+	/* Every key's rank is the number of present keys below it, and select undoes rank */
+	size_t below = 0;
+	for (long k = 0; k < 5000; ++k) {
+		if (counted->rank(counted, k) != below) {
+			fprintf(stderr, "Rank of %ld is %ld, expected %ld\n", k, counted->rank(counted, k), below);
+			return 1;
+		}
+		if (in_counted[k] && counted->select(counted, below) != k) {
+			fprintf(stderr, "Select of %ld gave %ld, expected %ld\n", below, counted->select(counted, below), k);
+			return 1;
+		}
+		below += in_counted[k];
+	}
+	
+	err = success;
+	counted->select(counted, size);
+	if (err != invalid_index || counted->rank(counted, 5000) != size) {
+		fprintf(stderr, "Select past the end did not set invalid_index\n");
+		return 1;
+	}
+	
+	/* A built tree starts out with correct counts */
+	static long long_keys[1000];
+	for (int i = 0; i < 1000; ++i)
+		long_keys[i] = 2*i;
+	counted->build_from_sorted(counted, long_keys, values, 1000);
+	if (counted->size != 1000 || check_counts((generic_node *) counted->root, counted->sentinel) != 1000 ||
+		counted->select(counted, 500) != 1000 || counted->rank(counted, 1001) != 501) {
+		fprintf(stderr, "Counts are wrong in a built tree\n");
+		return 1;
+	}
+	
+	counted = counted->destroy_rbtree(counted);
+	
+	/* A tree without counts gives the same answers by walking */
+	for (int i = 0; i < 1000; ++i)
+		tree->insert(tree, 1000 + 2*i, 'u');
+	size = 0;
+	for (node(int, char) *n = first_node_int_char(tree); n != NULL; n = next_node_int_char(n))
+		++size;
+	if (tree->size != size || tree->select(tree, tree->rank(tree, 2000)) != 2000) {
+		fprintf(stderr, "Rank and select are wrong without counts\n");
+		return 1;
+	}
+	
+	fprintf(stderr, "Rank and select successful\n\n");
+	
 	fprintf(stderr, "Testing destroy_tree function\n");
 	
 	tree = tree->destroy_rbtree(tree);
@@ -0,0 +1,194 @@
+#ifndef __cplusplus
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <stddef.h>
+#else
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <cstddef>
+#endif
+#include <pthread.h>
+#include <sched.h>
+#include "ring.h"
+#include "error.h"
+
+define_vector(int)
+define_ring(int)
+
+#define SPSC_ITEMS	1000000
+
+static void *produce(void *arg) {
+	c_ring(int) *ring = (c_ring(int) *) arg;
+	int batch[37];
+	int next = 0;
+	while (next < SPSC_ITEMS) {
+		/* Mix single pushes with batches so both paths race the consumer */
+		if (next % 3 == 0) {
+			if (c_ring_push(int, ring, next) == success)
+				++next;
+			else
+				sched_yield();
+			continue;
+		}
+		int count = (SPSC_ITEMS - next < 37) ? SPSC_ITEMS - next : 37;
+		for (int i = 0; i < count; ++i)
+			batch[i] = next + i;
+		count = (int) ring->ops->enqueue(ring, batch, (size_t) count);
+		if (count == 0)
+			sched_yield();
+		next += count;
+	}
+	return NULL;
+}
+
+int main(void) {
+	int values[1000];
+	int value = 0;
+	int front = 0, back = 0;
+
+	srand(time(NULL));
+
+	fprintf(stderr, "Testing constructor\n");
+
+	c_ring(int) *ring = new_c_ring(int, 3);
+
+	if (ring == NULL) {
+		fprintf(stderr, "Ring creation failed!\n");
+		return 1;
+	}
+
+	if (ring->capacity != 4 || c_ring_length(int, ring) != 0) {
+		fprintf(stderr, "Capacity was not rounded up to a power of two\n");
+		return 1;
+	}
+
+	fprintf(stderr, "Constructor testing successful\n\n");
+
+	fprintf(stderr, "Testing push and pop\n");
+
+	err = success;
+	if (c_ring_pop(int, ring, &value) != queue_empty || err != queue_empty) {
+		fprintf(stderr, "Popping an empty ring did not return queue_empty\n");
+		return 1;
+	}
+
+	/* Random pushes and pops keep the contents wrapped around the end when the ring grows */
+	for (size_t i = 0; i < 100000; ++i) {
+		if (rand() % 5 < 3) {
+			if (c_ring_push(int, ring, back) != success) {
+				fprintf(stderr, "Push failed!\n");
+				return 1;
+			}
+			++back;
+		}
+		else if (front < back) {
+			if (c_ring_pop(int, ring, &value) != success || value != front) {
+				fprintf(stderr, "Popped %d, expected %d\n", value, front);
+				return 1;
+			}
+			++front;
+		}
+		if (c_ring_length(int, ring) != (size_t) (back - front)) {
+			fprintf(stderr, "Length is %ld, expected %d\n", c_ring_length(int, ring), back - front);
+			return 1;
+		}
+	}
+
+	fprintf(stderr, "%d elements in a ring of %ld\n", back - front, ring->capacity);
+	fprintf(stderr, "Push and pop successful\n\n");
+
+	fprintf(stderr, "Testing batch enqueue and dequeue\n");
+
+	for (size_t round = 0; round < 2000; ++round) {
+		size_t count = (size_t) (rand() % 1000);
+		if (rand() % 2 == 0) {
+			for (size_t i = 0; i < count; ++i)
+				values[i] = back + (int) i;
+			if (ring->ops->enqueue(ring, values, count) != count) {
+				fprintf(stderr, "Enqueue stopped short!\n");
+				return 1;
+			}
+			back += (int) count;
+		}
+		else {
+			size_t expected = ((size_t) (back - front) < count) ? (size_t) (back - front) : count;
+			if (ring->ops->dequeue(ring, values, count) != expected) {
+				fprintf(stderr, "Dequeue returned the wrong count\n");
+				return 1;
+			}
+			for (size_t i = 0; i < expected; ++i) {
+				if (values[i] != front + (int) i) {
+					fprintf(stderr, "Dequeued %d, expected %d\n", values[i], front + (int) i);
+					return 1;
+				}
+			}
+			front += (int) expected;
+		}
+	}
+
+	while (ring->ops->dequeue(ring, values, 1000) > 0)
+		;
+	if (c_ring_length(int, ring) != 0 || c_ring_pop(int, ring, &value) != queue_empty) {
+		fprintf(stderr, "Ring was not empty after draining it\n");
+		return 1;
+	}
+
+	fprintf(stderr, "Batch enqueue and dequeue successful\n\n");
+
+	fprintf(stderr, "Testing destructor\n");
+
+	ring = ring->ops->destroy_ring(ring);
+
+	fprintf(stderr, "Destructor testing successful\n\n");
+
+	fprintf(stderr, "Testing SPSC mode\n");
+
+	c_ring(int) *queue = new_c_ring_spsc(int, 4);
+
+	for (int i = 0; i < 4; ++i)
+		c_ring_push(int, queue, i);
+	if (c_ring_push(int, queue, 4) != queue_full || queue->capacity != 4) {
+		fprintf(stderr, "A full SPSC ring did not return queue_full\n");
+		return 1;
+	}
+	if (queue->ops->enqueue(queue, values, 10) != 0 || queue->ops->dequeue(queue, values, 10) != 4) {
+		fprintf(stderr, "Batches on a full SPSC ring went wrong\n");
+		return 1;
+	}
+	queue = queue->ops->destroy_ring(queue);
+
+	queue = new_c_ring_spsc(int, 256);
+	pthread_t producer;
+	pthread_create(&producer, NULL, &produce, queue);
+
+	front = 0;
+	while (front < SPSC_ITEMS) {
+		size_t count = (front % 2 == 0) ? queue->ops->dequeue(queue, values, 50) :
+			(size_t) (c_ring_pop(int, queue, values) == success);
+		if (count == 0)
+			sched_yield();
+		for (size_t i = 0; i < count; ++i) {
+			if (values[i] != front) {
+				fprintf(stderr, "Consumer got %d, expected %d\n", values[i], front);
+				return 1;
+			}
+			++front;
+		}
+	}
+
+	pthread_join(producer, NULL);
+	if (c_ring_length(int, queue) != 0) {
+		fprintf(stderr, "SPSC ring was not empty at the end\n");
+		return 1;
+	}
+	queue = queue->ops->destroy_ring(queue);
+
+	fprintf(stderr, "%d elements passed between threads in order\n", SPSC_ITEMS);
+	fprintf(stderr, "SPSC testing successful\n\n");
+
+	fprintf(stderr, "Size of c_ring: %ld bytes\n", sizeof(c_ring(int)));
+
+	return 0;
+}
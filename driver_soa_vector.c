@@ -0,0 +1,192 @@
+#ifndef __cplusplus
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <stddef.h>
+#else
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <cstddef>
+#endif
+#include "soa_vector.h"
+#include "error.h"
+
+define_soa_vector(particle, (float, x), (float, y), (double, mass), (int, id))
+
+/* The smallest and largest number of fields */
+define_soa_vector(single, (long, value))
+define_soa_vector(wide, (char, a), (short, b), (int, c), (long, d), (float, e), (double, f), (char, g), (long, h))
+
+/* Growth is measured in the bytes of a row's fields, not of the padded row struct */
+vector_policy chunk_policy = VECTOR_POLICY_CHUNK(3*(2*sizeof(float) + sizeof(double) + sizeof(int)), false);
+
+static soa_row(particle) make_particle(int i) {
+	soa_row(particle) row = { (float) i, (float) (2*i), i / 4.0, i };
+	return row;
+}
+
+static int check_particle(soa_vector(particle) *particles, size_t i, int expected) {
+	soa_row(particle) row = soa_vector_get(particle, particles, i);
+	if (row.x != (float) expected || row.y != (float) (2*expected) || row.mass != expected / 4.0 || row.id != expected ||
+		particles->x[i] != row.x || particles->mass[i] != row.mass) {
+		fprintf(stderr, "Row %ld does not hold particle %d\n", i, expected);
+		return 1;
+	}
+	return 0;
+}
+
+int main(void) {
+	double mass = 0.0;
+	long total = 0;
+
+	srand(time(NULL));
+
+	fprintf(stderr, "Testing constructor\n");
+
+	soa_vector(particle) *particles = new_soa_vector(particle, 0);
+
+	if (particles == NULL) {
+		fprintf(stderr, "Vector creation failed!\n");
+		return 1;
+	}
+
+	if (particles->capacity != 2 || soa_vector_length(particle, particles) != 0) {
+		fprintf(stderr, "A new vector should have room for two rows\n");
+		return 1;
+	}
+
+	fprintf(stderr, "Constructor testing successful\n\n");
+
+	fprintf(stderr, "Testing push and get\n");
+
+	for (int i = 0; i < 10000; ++i) {
+		if (soa_vector_push(particle, particles, make_particle(i)) != success) {
+			fprintf(stderr, "Push failed!\n");
+			return 1;
+		}
+	}
+
+	for (size_t i = 0; i < 10000; ++i) {
+		if (check_particle(particles, i, (int) i) != 0)
+			return 1;
+	}
+
+	err = success;
+	soa_vector_get(particle, particles, 10000);
+	if (err != invalid_index) {
+		fprintf(stderr, "Reading past the end did not set invalid_index\n");
+		return 1;
+	}
+
+	fprintf(stderr, "%ld rows in a capacity of %ld\n", particles->length, particles->capacity);
+	fprintf(stderr, "Push and get successful\n\n");
+
+	fprintf(stderr, "Testing set and remove_top\n");
+
+	for (size_t i = 0; i < 1000; ++i) {
+		size_t index = (size_t) (rand() % 10000);
+		soa_vector_set(particle, particles, index, make_particle(20000 + (int) index));
+		if (check_particle(particles, index, 20000 + (int) index) != 0)
+			return 1;
+		soa_vector_set(particle, particles, index, make_particle((int) index));
+	}
+
+	if (soa_vector_set(particle, particles, 10000, make_particle(0)) != invalid_index) {
+		fprintf(stderr, "Writing past the end did not return invalid_index\n");
+		return 1;
+	}
+
+	while (particles->ops->remove_top(particles) == success)
+		;
+	if (particles->length != 0 || particles->ops->remove_top(particles) != invalid_index) {
+		fprintf(stderr, "remove_top did not empty the vector\n");
+		return 1;
+	}
+
+	fprintf(stderr, "Set and remove_top successful\n\n");
+
+	fprintf(stderr, "Testing column scans\n");
+
+	for (int i = 0; i < 1000; ++i)
+		particles->ops->push(particles, make_particle(i));
+
+	/* One field at a time, straight through its column */
+	float *xs = soa_vector_column(particles, x);
+	double *masses = soa_vector_column(particles, mass);
+	for (size_t i = 0; i < particles->length; ++i) {
+		mass += masses[i];
+		total += (long) xs[i];
+	}
+
+	if (mass != 999.0 * 1000.0 / 8.0 || total != 999L * 1000L / 2) {
+		fprintf(stderr, "Column sums are wrong\n");
+		return 1;
+	}
+
+	fprintf(stderr, "Column scan successful\n\n");
+
+	fprintf(stderr, "Testing growth policies\n");
+
+	particles = particles->ops->destroy_vector(particles);
+	particles = new_soa_vector(particle, 0);
+	soa_vector_set_policy(particle, particles, &chunk_policy);
+
+	for (int i = 0; i < 100; ++i) {
+		soa_vector_push(particle, particles, make_particle(i));
+		/* The chunk is three rows, so capacity only ever steps from 2 to 5, 8, 11... */
+		if ((particles->capacity - 2) % 3 != 0) {
+			fprintf(stderr, "Capacity %ld did not follow the chunk policy\n", particles->capacity);
+			return 1;
+		}
+	}
+
+	for (size_t i = 0; i < 100; ++i) {
+		if (check_particle(particles, i, (int) i) != 0)
+			return 1;
+	}
+
+	if (particles->ops->reserve(particles, 5000) != success || particles->capacity < 5000 ||
+		check_particle(particles, 99, 99) != 0) {
+		fprintf(stderr, "Reserve failed!\n");
+		return 1;
+	}
+
+	fprintf(stderr, "%ld grows under the chunk policy\n", chunk_policy.stats.grow_count);
+	fprintf(stderr, "Growth policy testing successful\n\n");
+
+	fprintf(stderr, "Testing field counts\n");
+
+	soa_vector(single) *singles = new_soa_vector(single, 4);
+	soa_vector(wide) *wides = new_soa_vector(wide, 4);
+
+	for (long i = 0; i < 500; ++i) {
+		soa_row(single) one = { i };
+		soa_row(wide) row = { 'a', (short) i, (int) i, i, (float) i, (double) i, 'z', -i };
+		soa_vector_push(single, singles, one);
+		soa_vector_push(wide, wides, row);
+	}
+
+	for (long i = 0; i < 500; ++i) {
+		soa_row(wide) row = soa_vector_get(wide, wides, i);
+		if (singles->value[i] != i || row.a != 'a' || row.b != (short) i || row.d != i || row.f != (double) i ||
+			row.g != 'z' || row.h != -i) {
+			fprintf(stderr, "Row %ld is wrong\n", i);
+			return 1;
+		}
+	}
+
+	fprintf(stderr, "Field count testing successful\n\n");
+
+	fprintf(stderr, "Testing destructor\n");
+
+	particles = particles->ops->destroy_vector(particles);
+	singles = singles->ops->destroy_vector(singles);
+	wides = wides->ops->destroy_vector(wides);
+
+	fprintf(stderr, "Destructor testing successful\n\n");
+
+	fprintf(stderr, "Size of soa_vector(particle): %ld bytes\n", sizeof(soa_vector(particle)));
+
+	return 0;
+}
@@ -0,0 +1,258 @@
+#ifndef __cplusplus
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <stddef.h>
+#include <stdbool.h>
+#else
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <cstddef>
+#endif
+#include "unordered_map.h"
+#include "error.h"
+
+#define KEYS	5000
+
+define_unordered_map(int, char)
+
+/* Only eight home slots for every key, so probes are long and keys get displaced */
+#define hash_collide(a)	((uint64_t) (a) % 8)
+define_unordered_map_hash(long, int, hash_collide, default_compare)
+
+/* Struct keys go through hash_bytes and compare_bytes */
+typedef struct point {
+	int x;
+	int y;
+} point;
+define_unordered_map(point, long)
+
+/* Checks every key against a plain array, and that the iterator sees each pair once */
+static int check_map(c_unordered_map(long, int) *map, const bool *present, const int *values) {
+	size_t count = 0;
+	static bool seen[KEYS];
+	for (long k = 0; k < KEYS; ++k) {
+		seen[k] = false;
+		count += present[k];
+		if (map->is_key(map, k) != present[k] || (present[k] && map->get_value(map, k) != values[k])) {
+			fprintf(stderr, "Key %ld is wrong\n", k);
+			return 1;
+		}
+	}
+	if (map->size(map) != count) {
+		fprintf(stderr, "Size is %ld, expected %ld\n", map->size(map), count);
+		return 1;
+	}
+	generic_iterator *giter = new_unordered_map_iterator(long, int, map);
+	unordered_map_iterator(long, int) *iter = (unordered_map_iterator(long, int) *) giter;
+	for (giter->first(giter); !giter->end(giter); giter->next(giter)) {
+		if (*iter->key < 0 || *iter->key >= KEYS || !present[*iter->key] || seen[*iter->key] ||
+			*iter->value != values[*iter->key]) {
+			fprintf(stderr, "Iterator gave key %ld\n", *iter->key);
+			return 1;
+		}
+		seen[*iter->key] = true;
+		--count;
+	}
+	giter = giter->destroy_iterator(giter);
+	if (count != 0) {
+		fprintf(stderr, "Iterator missed %ld keys\n", count);
+		return 1;
+	}
+	return 0;
+}
+
+int main(void) {
+	static bool present[KEYS];
+	static int values[KEYS];
+	error_code result;
+	int key;
+	char val;
+
+	srand(time(NULL));
+
+	fprintf(stderr, "Testing constructor\n");
+
+	c_unordered_map(int, char) *map = new_c_unordered_map(int, char);
+
+	if (map == NULL) {
+		fprintf(stderr, "Map creation failed!\n");
+		return 1;
+	}
+
+	/* Nothing is allocated until the first insert, and an empty map finds nothing */
+	err = success;
+	if (map->capacity != 0 || map->is_key(map, 5) || map->get_value(map, 5) != 0 || err != key_not_found) {
+		fprintf(stderr, "A new map should be empty\n");
+		return 1;
+	}
+
+	fprintf(stderr, "Constructor testing successful\n\n");
+
+	fprintf(stderr, "Testing insert, get_value and delete_pair\n");
+
+	for (key = 0; key < 1000; ++key) {
+		result = map->insert(map, key*7919, (char) (key % 26) + 'a');
+		if (result != success) {
+			fprintf(stderr, "Insert failed!\n");
+			return 1;
+		}
+	}
+
+	/* Inserting a key again only replaces its value */
+	map->insert(map, 0, 'Z');
+
+	for (key = 0; key < 1000; ++key) {
+		val = map->get_value(map, key*7919);
+		if (val != (key == 0 ? 'Z' : (char) (key % 26) + 'a') || map->is_key(map, key*7919 + 1)) {
+			fprintf(stderr, "Key %d is wrong\n", key*7919);
+			return 1;
+		}
+	}
+
+	if (map->size(map) != 1000 || unordered_map_too_full(map->count, map->capacity)) {
+		fprintf(stderr, "Map holds %ld keys in %ld slots\n", map->count, map->capacity);
+		return 1;
+	}
+
+	for (key = 0; key < 1000; key += 2) {
+		if (map->delete_pair(map, key*7919) != success) {
+			fprintf(stderr, "Delete failed!\n");
+			return 1;
+		}
+	}
+
+	if (map->delete_pair(map, 0) != key_not_found || map->size(map) != 500) {
+		fprintf(stderr, "Deleting a missing key did not set key_not_found\n");
+		return 1;
+	}
+
+	for (key = 0; key < 1000; ++key) {
+		if (map->is_key(map, key*7919) != (key % 2 == 1)) {
+			fprintf(stderr, "Key %d is wrong after deletes\n", key*7919);
+			return 1;
+		}
+	}
+
+	fprintf(stderr, "%ld keys in %ld slots\n", map->count, map->capacity);
+	fprintf(stderr, "Insert, get_value and delete_pair successful\n\n");
+
+	fprintf(stderr, "Testing random inserts and deletes with colliding hashes\n");
+
+	c_unordered_map(long, int) *collide = new_c_unordered_map(long, int);
+
+	for (int i = 0; i < 200000; ++i) {
+		long k = rand() % KEYS;
+		if (rand() % 2) {
+			values[k] = rand();
+			collide->insert(collide, k, values[k]);
+			present[k] = true;
+		}
+		else if (present[k]) {
+			if (collide->delete_pair(collide, k) != success) {
+				fprintf(stderr, "Unable to delete key %ld\n", k);
+				return 1;
+			}
+			present[k] = false;
+		}
+		if (i % 20000 == 0 && check_map(collide, present, values) != 0)
+			return 1;
+	}
+
+	if (check_map(collide, present, values) != 0)
+		return 1;
+
+	for (long k = 0; k < KEYS; ++k) {
+		if (present[k])
+			collide->delete_pair(collide, k);
+		present[k] = false;
+	}
+
+	if (collide->size(collide) != 0 || check_map(collide, present, values) != 0) {
+		fprintf(stderr, "Map is not empty after deleting every key\n");
+		return 1;
+	}
+
+	collide = collide->destroy_map(collide);
+
+	fprintf(stderr, "Random insert and delete test successful\n\n");
+
+	fprintf(stderr, "Testing reserve\n");
+
+	c_unordered_map(point, long) *points = new_c_unordered_map(point, long);
+
+	if (points->reserve(points, 10000) != success) {
+		fprintf(stderr, "Reserve failed!\n");
+		return 1;
+	}
+
+	size_t capacity = points->capacity;
+	for (int i = 0; i < 10000; ++i) {
+		point p = { i % 100, i / 100 };
+		points->insert(points, p, (long) i);
+	}
+
+	if (points->capacity != capacity || points->size(points) != 10000) {
+		fprintf(stderr, "Inserting after reserve grew the table\n");
+		return 1;
+	}
+
+	for (int i = 0; i < 10000; ++i) {
+		point p = { i % 100, i / 100 };
+		point q = { i / 100, 100 + i % 100 };
+		if (points->get_value(points, p) != (long) i || points->is_key(points, q)) {
+			fprintf(stderr, "Point (%d, %d) is wrong\n", p.x, p.y);
+			return 1;
+		}
+	}
+
+	fprintf(stderr, "Reserve testing successful\n\n");
+
+	fprintf(stderr, "Testing iterator\n");
+
+	generic_iterator *giter = new_unordered_map_iterator(int, char, map);
+	unordered_map_iterator(int, char) *iter = (unordered_map_iterator(int, char) *) giter;
+	size_t forward = 0, backward = 0;
+	long sum = 0;
+
+	for (giter->first(giter); !giter->end(giter); giter->next(giter)) {
+		sum += *iter->key;
+		++forward;
+	}
+
+	for (giter->last(giter); !giter->end(giter); iter->prev(giter)) {
+		sum -= *iter->key;
+		++backward;
+	}
+
+	if (forward != 500 || backward != 500 || sum != 0) {
+		fprintf(stderr, "Iterator visited %ld keys forwards and %ld backwards\n", forward, backward);
+		return 1;
+	}
+
+	/* Values may be written through the iterator */
+	for (giter->first(giter); !giter->end(giter); giter->next(giter))
+		*iter->value = '!';
+
+	if (map->get_value(map, 7919) != '!') {
+		fprintf(stderr, "Writing through the iterator failed\n");
+		return 1;
+	}
+
+	giter = giter->destroy_iterator(giter);
+
+	fprintf(stderr, "Iterator testing successful\n\n");
+
+	fprintf(stderr, "Testing destructor\n");
+
+	map = map->destroy_map(map);
+	points = points->destroy_map(points);
+
+	fprintf(stderr, "Destructor testing successful\n\n");
+
+	fprintf(stderr, "Size of c_unordered_map: %ld bytes\n", sizeof(c_unordered_map(int, char)));
+	fprintf(stderr, "Size of a slot: %ld bytes\n", sizeof(unordered_slot_int_char));
+
+	return 0;
+}
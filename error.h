@@ -12,14 +12,36 @@
 
 #define TO_STRING(ENUM) #ENUM
 
+/* err and err_struct describe the last error seen by the calling thread. Each thread
+ * has its own copy, so containers used from different threads don't overwrite each
+ * other's errors.
+ *
+ * Nothing here allocates. filename and functname point at the string literals the
+ * containers pass in, and code points into error_code_string, so setting the error
+ * on a failed lookup is a handful of stores.
+ *
+ * Building with -DNO_ERROR_INFO turns set_error_info into a no-op, and err_struct
+ * is never filled in. err is still set, since that is how get_value and value_at
+ * report a miss.
+ */
+#if defined(__cplusplus) && __cplusplus >= 201103L
+	#define ERROR_THREAD_LOCAL	thread_local
+#elif defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L
+	#define ERROR_THREAD_LOCAL	_Thread_local
+#elif defined(__GNUC__)
+	#define ERROR_THREAD_LOCAL	__thread
+#else
+	#define ERROR_THREAD_LOCAL
+#endif
+
 typedef struct error_info {	
-	char *filename;	
-	char *functname;
-	char *line;	
-	char *code;	
+	const char *filename;	
+	const char *functname;
+	int line;	
+	const char *code;	
 } error_info;	
 
-error_info err_struct;
+ERROR_THREAD_LOCAL error_info err_struct;
 
 // This will be shared by c_vector, c_map, and red_and_black_tree
 typedef enum error_code {
@@ -32,7 +54,10 @@ typedef enum error_code {
 	basic_insert_failed,
 	memcpy_failed,
 	key_not_found,
-	null_tree
+	null_tree,
+	map_failed,
+	queue_full,
+	queue_empty
 } error_code;
 
 static const char *error_code_string[] = {
@@ -45,74 +70,29 @@ static const char *error_code_string[] = {
 	TO_STRING(basic_insert_failed),
 	TO_STRING(memcpy_failed),
 	TO_STRING(key_not_found),
-	TO_STRING(null_tree)
+	TO_STRING(null_tree),
+	TO_STRING(map_failed),
+	TO_STRING(queue_full),
+	TO_STRING(queue_empty)
 };
 
-error_code err;
+ERROR_THREAD_LOCAL error_code err;
 
-/* The reason why I use this macro is because I intend to use the
- * __attribute__ macro in order to have it deallocate memory as soon 
- * this goes out of scope (in other words, before the program ends).
- */
-#ifndef __GNUC__
-	// If we're not using gcc, the programmer will need to manually deallocate
-	static inline void free_error_info() {
-		if (err_struct.filename != NULL) {
-			free(err_struct.filename);
-			err_struct.filename = NULL;
-		}
-		if (err_struct.functname != NULL) {
-			free(err_struct.functname);
-			err_struct.functname = NULL;
-		}
-		if (err_struct.line != NULL) {
-			free(err_struct.line);
-			err_struct.line = NULL;
-		}
-		if (err_struct.code != NULL) {
-			free(err_struct.code);
-			err_struct.code = NULL;
-		}
-	}
-#else
-	__attribute__((destructor)) static inline void free_error_info() {
-		if (err_struct.filename != NULL) {
-			free(err_struct.filename); 
-			err_struct.filename = NULL;
-		}
-		if (err_struct.functname != NULL) {
-			free(err_struct.functname); 
-			err_struct.functname = NULL;
-		}
-		if (err_struct.line != NULL) {
-			free(err_struct.line);
-			err_struct.line = NULL;
-		}
-		if (err_struct.code != NULL) {
-			free(err_struct.code);
-			err_struct.code = NULL;
-		}
-	}
-#endif
+/* There is nothing to free anymore. This just clears the calling thread's error info */
+static inline void free_error_info() {
+	memset(&err_struct, 0, sizeof(error_info));
+}
 
-static inline void set_error_info(char *filename, char *functname, int line) {
-	free_error_info();
-	/* This makes error.c dependent on C99 standard. However, it seems
-	 * to be the best way to convert an integer to a string (short of
-	 * writing a custom function).
-	 */
-	 // Get array size based on digits in line number
-	size_t arrsize = snprintf(NULL, 0, "%d", line);
-	// Create array and add another byte for '\000
-	char *ptr = (char *) malloc(arrsize + 1);
-	// Copy line number into buffer
-	snprintf(ptr, arrsize+1, "%d", line);
-		
-	err_struct.filename = strdup(filename);
-	err_struct.functname = strdup(functname);
-	err_struct.line = ptr;
+#ifndef NO_ERROR_INFO
+static inline void set_error_info(const char *filename, const char *functname, int line) {
+	err_struct.filename = filename;
+	err_struct.functname = functname;
+	err_struct.line = line;
 	// The code member is determined by the error_code member
-	err_struct.code = strdup(error_code_string[err]);
+	err_struct.code = error_code_string[err];
 }
+#else
+#define set_error_info(FILENAME, FUNCTNAME, LINE)	((void) 0)
+#endif
 
 #endif
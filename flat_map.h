@@ -0,0 +1,265 @@
+#ifndef FLAT_MAP_H
+#define FLAT_MAP_H
+#ifndef __cplusplus
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdbool.h>
+#else
+#include <cstdlib>
+#include <cstddef>
+#include <cstring>
+#endif
+#include "c_vector.h"
+#include "vector_sort.h"
+#include "compare.h"
+#include "error.h"
+#include "allocator.h"
+
+/* c_flat_map is an ordered map for data that is read far more often than it is
+ * changed. The keys are kept sorted in one array and the values in a second array
+ * of the same length, so a lookup is a binary search over contiguous keys instead
+ * of a walk down the nodes of a tree. The keys are only ever compared, and the
+ * values are only touched once the key has been found.
+ *
+ * The search is branchless. Each step picks the next half with a conditional
+ * move rather than a jump, so the loop always runs log2(n) times and never
+ * mispredicts on random keys.
+ *
+ * insert and delete_pair keep the arrays sorted, so they shift everything after
+ * the key and are O(n). When a map is filled all at once, build sorts the input
+ * and drops duplicate keys in O(n log n) instead.
+ *
+ * The arrays grow the same way as a c_vector (see default_vector_policy) and come
+ * from the map's allocator. keys[i] and values[i] for i < count may be read
+ * directly, but only values may be written through them.
+ */
+
+/* define_flat_map_cmp(K, V, CMP)
+ * INPUT: K -> key data type, V -> value data type, CMP -> comparator for K
+ * OUTPUT: None
+ * USAGE: define_flat_map_cmp(long, char, compare_long)
+ * NOTES: Keys are ordered by CMP. See define_rbtree_cmp and compare.h.
+ * define_flat_map(K, V) orders keys with default_compare.
+ *
+ * error_code insert_flat_map_##K##_##V(c_flat_map_##K##_##V *map, K key, V value)
+ * INPUT: map -> flat map, key -> key to insert, value -> value for the key
+ * OUTPUT: success, or realloc_failed if the arrays could not grow
+ * USAGE: map->insert(map, key, value);
+ * NOTES: If the key is already in the map, its value is replaced.
+ *
+ * error_code build_flat_map_##K##_##V(c_flat_map_##K##_##V *map, const K *keys, const V *values, size_t n)
+ * INPUT: map -> flat map, keys and values -> n pairs in any order
+ * OUTPUT: success, or realloc_failed if memory ran out
+ * USAGE: map->build(map, keys, values, n);
+ * NOTES: Replaces whatever the map held. When a key appears more than once, the
+ * last value given for it wins, the same as inserting the pairs in order. Input
+ * that is already sorted without duplicates is copied as is.
+ *
+ * V get_value_flat_map_##K##_##V(c_flat_map_##K##_##V *map, K key)
+ * INPUT: map -> flat map, key -> key to look up
+ * OUTPUT: the value, or a zeroed V with err set to key_not_found
+ * USAGE: V value = map->get_value(map, key);
+ */
+#define define_flat_map(K, V)	define_flat_map_cmp(K, V, default_compare)
+
+#define define_flat_map_cmp(K, V, CMP)	\
+	typedef struct c_flat_map_##K##_##V {	\
+		K *keys;	\
+		V *values;	\
+		size_t count;	\
+		size_t capacity;	\
+		const c_allocator *allocator;	\
+		struct c_flat_map_##K##_##V *(*destroy_map)(struct c_flat_map_##K##_##V*);	\
+		error_code (*insert)(struct c_flat_map_##K##_##V*, K, V);	\
+		error_code (*delete_pair)(struct c_flat_map_##K##_##V*, K);	\
+		V (*get_value)(struct c_flat_map_##K##_##V*, K);	\
+		bool (*is_key)(struct c_flat_map_##K##_##V*, K);	\
+		error_code (*build)(struct c_flat_map_##K##_##V*, const K*, const V*, size_t);	\
+	} c_flat_map_##K##_##V;	\
+		\
+	/* A pair for build to sort. order breaks ties, so the last duplicate is found */	\
+	typedef struct flat_entry_##K##_##V {	\
+		K key;	\
+		V value;	\
+		size_t order;	\
+	} flat_entry_##K##_##V;	\
+		\
+	static inline int compare_flat_entry_##K##_##V(const flat_entry_##K##_##V a, const flat_entry_##K##_##V b) {	\
+		int result = CMP(a.key, b.key);	\
+		if (result != 0)	\
+			return result;	\
+		return (a.order > b.order) - (a.order < b.order);	\
+	}	\
+		\
+	define_array_sort(flat_entry_##K##_##V, compare_flat_entry_##K##_##V, radix_none)	\
+		\
+	/* Index of the first key that is not less than key, or count if there is none */	\
+	static inline size_t lower_bound_flat_map_##K##_##V(const c_flat_map(K,V) *map, K key) {	\
+		const K *base = map->keys;	\
+		size_t n = map->count;	\
+		if (n == 0)	\
+			return 0;	\
+		while (n > 1) {	\
+			size_t half = n / 2;	\
+			base = (CMP(base[half], key) < 0) ? base + half : base;	\
+			n -= half;	\
+		}	\
+		return (size_t) (base - map->keys) + (CMP(*base, key) < 0);	\
+	}	\
+		\
+	static inline bool found_flat_map_##K##_##V(const c_flat_map(K,V) *map, size_t index, K key) {	\
+		return index < map->count && CMP(map->keys[index], key) == 0;	\
+	}	\
+		\
+	/* Make room for at least needed pairs in both arrays */	\
+	static error_code reserve_flat_map_##K##_##V(c_flat_map(K,V) *map, size_t needed, const char *functname) {	\
+		const c_allocator *allocator = map->allocator;	\
+		size_t capacity = 0;	\
+		K *keys = NULL;	\
+		V *values = NULL;	\
+		if (needed <= map->capacity)	\
+			return success;	\
+		capacity = next_capacity(&default_vector_policy, map->capacity*sizeof(K), needed*sizeof(K), sizeof(K)) / sizeof(K);	\
+		keys = (K *) allocator->reallocate(allocator->context, map->keys, map->capacity*sizeof(K), capacity*sizeof(K));	\
+		if (keys != NULL) {	\
+			/* If values can't grow, keys is just larger than it has to be */	\
+			map->keys = keys;	\
+			values = (V *) allocator->reallocate(allocator->context, map->values, map->capacity*sizeof(V), capacity*sizeof(V));	\
+		}	\
+		if (values == NULL) {	\
+			err = realloc_failed;	\
+			set_error_info(__FILE__, functname, __LINE__);	\
+			return err;	\
+		}	\
+		map->values = values;	\
+		map->capacity = capacity;	\
+		return success;	\
+	}	\
+		\
+	c_flat_map(K,V) *destroy_flat_map_##K##_##V(c_flat_map(K,V) *map) {	\
+		if (map == NULL) {	\
+			return NULL;	\
+		}	\
+		allocator_free(map->allocator, map->keys);	\
+		allocator_free(map->allocator, map->values);	\
+		allocator_free(map->allocator, map);	\
+		return NULL;	\
+	}	\
+		\
+	error_code insert_flat_map_##K##_##V(c_flat_map(K,V) *map, K key, V value) {	\
+		size_t index = lower_bound_flat_map_##K##_##V(map, key);	\
+		if (found_flat_map_##K##_##V(map, index, key)) {	\
+			map->values[index] = value;	\
+			return success;	\
+		}	\
+		if (reserve_flat_map_##K##_##V(map, map->count + 1, "insert") != success)	\
+			return err;	\
+		memmove(&map->keys[index + 1], &map->keys[index], (map->count - index)*sizeof(K));	\
+		memmove(&map->values[index + 1], &map->values[index], (map->count - index)*sizeof(V));	\
+		map->keys[index] = key;	\
+		map->values[index] = value;	\
+		++map->count;	\
+		return success;	\
+	}	\
+		\
+	error_code delete_pair_flat_map_##K##_##V(c_flat_map(K,V) *map, K key) {	\
+		size_t index = lower_bound_flat_map_##K##_##V(map, key);	\
+		if (!found_flat_map_##K##_##V(map, index, key)) {	\
+			err = key_not_found;	\
+			set_error_info(__FILE__, "delete_pair", __LINE__);	\
+			return err;	\
+		}	\
+		--map->count;	\
+		memmove(&map->keys[index], &map->keys[index + 1], (map->count - index)*sizeof(K));	\
+		memmove(&map->values[index], &map->values[index + 1], (map->count - index)*sizeof(V));	\
+		return success;	\
+	}	\
+		\
+	bool is_key_flat_map_##K##_##V(c_flat_map(K,V) *map, K key) {	\
+		return found_flat_map_##K##_##V(map, lower_bound_flat_map_##K##_##V(map, key), key);	\
+	}	\
+		\
+	V get_value_flat_map_##K##_##V(c_flat_map(K,V) *map, K key) {	\
+		V val;	\
+		size_t index = lower_bound_flat_map_##K##_##V(map, key);	\
+		if (found_flat_map_##K##_##V(map, index, key))	\
+			val = map->values[index];	\
+		else {	\
+			memset(&val, 0, sizeof(V));	\
+			err = key_not_found;	\
+			set_error_info(__FILE__, "get_value", __LINE__);	\
+		}	\
+		return val;	\
+	}	\
+		\
+	error_code build_flat_map_##K##_##V(c_flat_map(K,V) *map, const K *keys, const V *values, size_t n) {	\
+		flat_entry_##K##_##V *entries = NULL;	\
+		size_t sorted = 1;	\
+		map->count = 0;	\
+		if (n == 0)	\
+			return success;	\
+		if (reserve_flat_map_##K##_##V(map, n, "build") != success)	\
+			return err;	\
+		/* Sorted input with no duplicates needs no sort at all */	\
+		while (sorted < n && CMP(keys[sorted - 1], keys[sorted]) < 0)	\
+			++sorted;	\
+		if (sorted == n) {	\
+			memcpy(map->keys, keys, n*sizeof(K));	\
+			memcpy(map->values, values, n*sizeof(V));	\
+			map->count = n;	\
+			return success;	\
+		}	\
+		entries = (flat_entry_##K##_##V *) map->allocator->allocate(map->allocator->context, n*sizeof(flat_entry_##K##_##V));	\
+		if (entries == NULL) {	\
+			err = realloc_failed;	\
+			set_error_info(__FILE__, "build", __LINE__);	\
+			return err;	\
+		}	\
+		for (size_t i = 0; i < n; ++i) {	\
+			entries[i].key = keys[i];	\
+			entries[i].value = values[i];	\
+			entries[i].order = i;	\
+		}	\
+		sort_array_flat_entry_##K##_##V(entries, n, &default_sort_config, map->allocator);	\
+		/* Keep the last entry of each run of equal keys */	\
+		for (size_t i = 0; i < n; ++i) {	\
+			if (i + 1 < n && CMP(entries[i].key, entries[i + 1].key) == 0)	\
+				continue;	\
+			map->keys[map->count] = entries[i].key;	\
+			map->values[map->count] = entries[i].value;	\
+			++map->count;	\
+		}	\
+		allocator_free(map->allocator, entries);	\
+		return success;	\
+	}	\
+		\
+	static inline void set_flat_map_ptr_##K##_##V(c_flat_map(K,V) *map) {	\
+		map->destroy_map = &destroy_flat_map_##K##_##V;	\
+		map->insert = &insert_flat_map_##K##_##V;	\
+		map->delete_pair = &delete_pair_flat_map_##K##_##V;	\
+		map->get_value = &get_value_flat_map_##K##_##V;	\
+		map->is_key = &is_key_flat_map_##K##_##V;	\
+		map->build = &build_flat_map_##K##_##V;	\
+	}	\
+		\
+	c_flat_map(K,V) *new_flat_map_##K##_##V(const c_allocator *allocator) {	\
+		c_flat_map(K,V) *map = NULL;	\
+			\
+		map = (c_flat_map(K,V) *) allocator_calloc(allocator, sizeof(c_flat_map(K,V)));	\
+			\
+		if (map == NULL) {	\
+			return NULL;	\
+		}	\
+			\
+		map->allocator = allocator;	\
+		set_flat_map_ptr_##K##_##V(map);	\
+		return map;	\
+	}	\
+
+#define c_flat_map(K,V)	c_flat_map_##K##_##V
+#define new_c_flat_map(K, V)	new_flat_map_##K##_##V(&default_allocator)
+/* Same as new_c_flat_map, except that the map and both arrays come from ALLOCATOR */
+#define new_c_flat_map_with(K, V, ALLOCATOR)	new_flat_map_##K##_##V(ALLOCATOR)
+
+#endif
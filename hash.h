@@ -0,0 +1,151 @@
+#ifndef HASH_H
+#define HASH_H
+#ifndef __cplusplus
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#else
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#endif
+
+/* Key hashing for the containers that find their elements by hash instead of by
+ * order. A hash takes a key by value and returns a uint64_t, and keys that compare
+ * equal must hash the same. The tables use the low bits of the hash to pick a
+ * slot, so every bit of the result has to depend on every bit of the key. Like a
+ * comparator, a hash can be a function or a macro, and one passed to a *_hash
+ * define macro is inlined straight into the probe loop.
+ */
+
+/* The finalizer of splitmix64. It is a bijection, so distinct words never collide */
+static inline uint64_t hash_u64(uint64_t x) {
+	x ^= x >> 30;
+	x *= 0xbf58476d1ce4e5b9ULL;
+	x ^= x >> 27;
+	x *= 0x94d049bb133111ebULL;
+	x ^= x >> 31;
+	return x;
+}
+
+/* Hashes the bytes of a key a word at a time. Like compare_bytes, this sees any
+ * padding inside a struct, so struct keys should be zeroed before they are filled in.
+ */
+static inline uint64_t hash_bytes(const void *key, size_t bytes) {
+	const unsigned char *temp = (const unsigned char *) key;
+	uint64_t hash = 0x9e3779b97f4a7c15ULL ^ bytes;
+	uint64_t word = 0;
+	for (; bytes >= sizeof(uint64_t); bytes -= sizeof(uint64_t), temp += sizeof(uint64_t)) {
+		memcpy(&word, temp, sizeof(uint64_t));
+		hash = hash_u64(hash ^ word);
+	}
+	if (bytes > 0) {
+		word = 0;
+		memcpy(&word, temp, bytes);
+		hash = hash_u64(hash ^ word);
+	}
+	return hash;
+}
+
+/* define_hash(NAME, TYPE)
+ * INPUT: NAME -> suffix for the function name, TYPE -> integer type being hashed
+ * OUTPUT: None
+ * USAGE: define_hash(uint, unsigned int)
+ * NOTES: Defines uint64_t hash_##NAME(TYPE a), which widens the key to 64 bits and
+ * mixes it with hash_u64.
+ */
+#define define_hash(NAME, TYPE)	\
+static inline uint64_t hash_##NAME(TYPE a) {	\
+	return hash_u64((uint64_t) a);	\
+}	\
+	\
+static inline uint64_t hash_ref_##NAME(const void *a, size_t bytes) {	\
+	(void) bytes;	\
+	return hash_##NAME(*(const TYPE *) a);	\
+}	\
+
+define_hash(char, char)
+define_hash(schar, signed char)
+define_hash(uchar, unsigned char)
+define_hash(short, short)
+define_hash(ushort, unsigned short)
+define_hash(int, int)
+define_hash(uint, unsigned int)
+define_hash(long, long)
+define_hash(ulong, unsigned long)
+define_hash(llong, long long)
+define_hash(ullong, unsigned long long)
+define_hash(bool, bool)
+
+/* -0.0 and 0.0 compare equal, so they have to hash the same. As with compare_double,
+ * NaN keys don't work.
+ */
+static inline uint64_t hash_double(double a) {
+	uint64_t bits = 0;
+	if (a != 0.0)
+		memcpy(&bits, &a, sizeof(double));
+	return hash_u64(bits);
+}
+
+/* A float or long double that equals another still does once it is a double */
+static inline uint64_t hash_float(float a) {
+	return hash_double((double) a);
+}
+
+static inline uint64_t hash_ldouble(long double a) {
+	return hash_double((double) a);
+}
+
+static inline uint64_t hash_ref_float(const void *a, size_t bytes) {
+	(void) bytes;
+	return hash_float(*(const float *) a);
+}
+
+static inline uint64_t hash_ref_double(const void *a, size_t bytes) {
+	(void) bytes;
+	return hash_double(*(const double *) a);
+}
+
+static inline uint64_t hash_ref_ldouble(const void *a, size_t bytes) {
+	(void) bytes;
+	return hash_ldouble(*(const long double *) a);
+}
+
+/* Pointer keys are hashed by address, to go with compare_ptr */
+static inline uint64_t hash_ptr(const void *a) {
+	return hash_u64((uint64_t) (uintptr_t) a);
+}
+
+/* default_hash(a)
+ * INPUT: a -> lvalue of the key type
+ * OUTPUT: a 64 bit hash of the key
+ * USAGE: define_unordered_map(K,V) uses it when no hash is given
+ * NOTES: Built in number types are hashed by value, and every other type with
+ * hash_bytes, which agrees with default_compare on what counts as equal. The choice
+ * is made at compile time. C++ has no _Generic, so it always uses hash_bytes.
+ */
+#ifndef __cplusplus
+#define default_hash(a)	\
+	_Generic((a),	\
+		char: hash_ref_char,	\
+		signed char: hash_ref_schar,	\
+		unsigned char: hash_ref_uchar,	\
+		short: hash_ref_short,	\
+		unsigned short: hash_ref_ushort,	\
+		int: hash_ref_int,	\
+		unsigned int: hash_ref_uint,	\
+		long: hash_ref_long,	\
+		unsigned long: hash_ref_ulong,	\
+		long long: hash_ref_llong,	\
+		unsigned long long: hash_ref_ullong,	\
+		float: hash_ref_float,	\
+		double: hash_ref_double,	\
+		long double: hash_ref_ldouble,	\
+		bool: hash_ref_bool,	\
+		default: hash_bytes)(&(a), sizeof(a))
+#else
+#define default_hash(a)	hash_bytes(&(a), sizeof(a))
+#endif
+
+#endif
@@ -14,21 +14,58 @@
 #include <cstdint>
 #include <cstddef>
 #endif
+#include "allocator.h"
+#include "compare.h"
 
-#define PRINT_COLOR(NODE)	fprintf(stderr, "%s", NODE->color == RED ? "RED" : "BLACK")
+#define PRINT_COLOR(NODE)	fprintf(stderr, "%s", node_color(NODE) == RED ? "RED" : "BLACK")
 
-/* rb_tree compares the byte value of keys. This means that the endianness
- * of the machine matters. For that reason, a custom memcmp type function
- * is used that accounts for endianness
- */
-
-static inline bool is_little() {
-	int n = 1;
-	if (*(char *) &n == 1)
-		return true;
-	return false;
+/* inorder_traverse prints keys and values of any type. Built in numbers get their */
+/* own format, and anything else, such as a struct, is printed as hex bytes. */
+/* C++ has no _Generic, so it always prints hex bytes */
+static inline void print_rb_char(const void *p, size_t bytes) { (void) bytes; fprintf(stderr, "%c", *(const char *) p); }
+static inline void print_rb_schar(const void *p, size_t bytes) { (void) bytes; fprintf(stderr, "%hhd", *(const signed char *) p); }
+static inline void print_rb_uchar(const void *p, size_t bytes) { (void) bytes; fprintf(stderr, "%hhu", *(const unsigned char *) p); }
+static inline void print_rb_short(const void *p, size_t bytes) { (void) bytes; fprintf(stderr, "%hd", *(const short *) p); }
+static inline void print_rb_ushort(const void *p, size_t bytes) { (void) bytes; fprintf(stderr, "%hu", *(const unsigned short *) p); }
+static inline void print_rb_int(const void *p, size_t bytes) { (void) bytes; fprintf(stderr, "%d", *(const int *) p); }
+static inline void print_rb_uint(const void *p, size_t bytes) { (void) bytes; fprintf(stderr, "%u", *(const unsigned int *) p); }
+static inline void print_rb_long(const void *p, size_t bytes) { (void) bytes; fprintf(stderr, "%ld", *(const long *) p); }
+static inline void print_rb_ulong(const void *p, size_t bytes) { (void) bytes; fprintf(stderr, "%lu", *(const unsigned long *) p); }
+static inline void print_rb_llong(const void *p, size_t bytes) { (void) bytes; fprintf(stderr, "%lld", *(const long long *) p); }
+static inline void print_rb_ullong(const void *p, size_t bytes) { (void) bytes; fprintf(stderr, "%llu", *(const unsigned long long *) p); }
+static inline void print_rb_float(const void *p, size_t bytes) { (void) bytes; fprintf(stderr, "%g", (double) *(const float *) p); }
+static inline void print_rb_double(const void *p, size_t bytes) { (void) bytes; fprintf(stderr, "%g", *(const double *) p); }
+static inline void print_rb_ldouble(const void *p, size_t bytes) { (void) bytes; fprintf(stderr, "%Lg", *(const long double *) p); }
+static inline void print_rb_bool(const void *p, size_t bytes) { (void) bytes; fprintf(stderr, "%s", *(const bool *) p ? "true" : "false"); }
+static inline void print_rb_bytes(const void *p, size_t bytes) {
+	fprintf(stderr, "0x");
+	for (size_t i = 0; i < bytes; ++i)
+		fprintf(stderr, "%02x", ((const unsigned char *) p)[i]);
 }
 
+#ifndef __cplusplus
+#define PRINT_ELEMENT(X)	\
+	_Generic((X),	\
+		char: print_rb_char,	\
+		signed char: print_rb_schar,	\
+		unsigned char: print_rb_uchar,	\
+		short: print_rb_short,	\
+		unsigned short: print_rb_ushort,	\
+		int: print_rb_int,	\
+		unsigned int: print_rb_uint,	\
+		long: print_rb_long,	\
+		unsigned long: print_rb_ulong,	\
+		long long: print_rb_llong,	\
+		unsigned long long: print_rb_ullong,	\
+		float: print_rb_float,	\
+		double: print_rb_double,	\
+		long double: print_rb_ldouble,	\
+		bool: print_rb_bool,	\
+		default: print_rb_bytes)((const void *) &(X), sizeof(X))
+#else
+#define PRINT_ELEMENT(X)	print_rb_bytes((const void *) &(X), sizeof(X))
+#endif
+
 typedef enum color_t { BLACK, RED } color_t;
 
 /* define_node(K,V)
@@ -37,53 +74,91 @@ typedef enum color_t { BLACK, RED } color_t;
  * USAGE define_node(int, char)
  * NOTES: This is designed to be used internally by the red and black tree
  * 
- * node(K,V) *destroy_node_##K##_##V(node(K,V) *node)
- * INPUT: node(K,V) *node -> pointer to node based on a given key type and value type
- * OUTPUT: node(K,V) * -> pointer to node based on a given key type and value type
- * USAGE: node = node->destroy_node(node);
- * NOTES: This will recursively delete all child nodes
+ * generic_node *destroy_gnode(generic_node *node)
+ * INPUT: generic_node *node -> node to destroy along with its children
+ * OUTPUT: NULL
+ * USAGE: node = destroy_gnode(node);
+ * NOTES: This will recursively delete all child nodes. The tree doesn't
+ * need it, since it frees its node pool instead.
  * 
- * void set_sentinels_##K##_##V(node(K,V) *node)
- * INPUT: node(K,V) *node -> pointer to node of key and value data types
- * OUTPUT: none
- * USAGE: node->set_sentinels(node);
+ * generic_node *set_sentinels(generic_node *node, generic_node *sentinel)
+ * INPUT: generic_node *node -> node whose children are set, generic_node *sentinel ->
+ * the tree's sentinel, or NULL to make a new one
+ * OUTPUT: the sentinel
+ * USAGE: tree->sentinel = set_sentinels(node, tree->sentinel);
  * NOTES: This is used internally to initialize sentinel nodes. It will
  * not test to see if the sentinel nodes already exist.
  * 
- * node(K,V) *new_node_##K##_##V()
- * INPUT: none
+ * node(K,V) *new_node_##K##_##V(const c_allocator *allocator)
+ * INPUT: const c_allocator *allocator -> where the node gets its memory from
  * OUTPUT: node pointer of given key type and value type
  * USAGE: node(K,V) *node = new_node(K,V);
- * NOTES: This will create and initialize two sentinal children
+ * NOTES: This will create and initialize two sentinal children. new_node(K,V)
+ * uses the default allocator; the tree passes its own.
  */
 
-/* generic_node contains all of the operations and members that are common to all nodes.
+/* generic_node contains all of the members that are common to all nodes.
  * generic_node will be a member of node_##K##_##V (not as a pointer). By using indirection,
- * it can appear as though the generic_node members and operations belong to node_##K##_##V.
+ * it can appear as though the generic_node members belong to node_##K##_##V.
  * It seems that this could be used to implement a kind of inheritance in C. The real advantage
  * to generic_node is that the functions and struct will only need to be defined once. I think
  * that will make a big difference in terms of executable size. My original method will lead to
  * the same functions being defined repeatedly for each node_##K##_##V defined. 
- * The purpose of kvnodesize is to allow for efficient copying of nodes
+ * 
+ * The operations on nodes (sibling, successor and so on) used to be function pointers
+ * stored in every node. They are now plain functions that are called directly, which
+ * keeps the node down to three words plus the key and value. The color lives in the
+ * low bit of the parent pointer, which is always zero since nodes are at least
+ * pointer aligned. Use node_parent and node_color to read them, and set_parent and
+ * set_color to write them.
  */
 
 typedef struct generic_node {
-	color_t color;
-	struct generic_node *parent;
+	uintptr_t parent_color;
 	struct generic_node *rchild;
 	struct generic_node *lchild;
-	struct generic_node *(*destroy_gnode)(struct generic_node*);
-	bool (*is_sentinel)(struct generic_node*);
-	struct generic_node *(*set_sentinels)(struct generic_node*, struct generic_node*);
-	struct generic_node *(*sibling)(struct generic_node*);
-	struct generic_node *(*uncle)(struct generic_node*);
-	struct generic_node *(*grandparent)(struct generic_node*);
-	struct generic_node *(*minimum)(struct generic_node*);
-	struct generic_node *(*maximum)(struct generic_node*);
-	struct generic_node *(*successor)(struct generic_node*);
-	struct generic_node *(*predecessor)(struct generic_node*);
 } generic_node;
 
+static inline generic_node *node_parent(const generic_node *node) {
+	return (generic_node *) (node->parent_color & ~(uintptr_t) 1);
+}
+
+static inline color_t node_color(const generic_node *node) {
+	return (color_t) (node->parent_color & 1);
+}
+
+static inline void set_parent(generic_node *node, generic_node *parent) {
+	node->parent_color = (uintptr_t) parent | (node->parent_color & 1);
+}
+
+static inline void set_color(generic_node *node, color_t color) {
+	node->parent_color = (node->parent_color & ~(uintptr_t) 1) | (uintptr_t) color;
+}
+
+/* In a counted tree (see define_rbtree_counted) every node also records how many
+ * nodes its subtree holds, itself included. The count comes right after the
+ * generic_node, so the functions here can reach it without knowing K or V. Every
+ * function that changes the shape of the tree takes a counted flag and leaves the
+ * counts alone when it is false, since nodes of other trees don't have one.
+ */
+typedef struct counted_node {
+	generic_node node;
+	size_t count;
+} counted_node;
+
+static inline size_t node_count(const generic_node *node) {
+	return ((const counted_node *) node)->count;
+}
+
+static inline void set_count(generic_node *node, size_t count) {
+	((counted_node *) node)->count = count;
+}
+
+/* The children's counts are already right, so node's follows from them */
+static inline void update_count(generic_node *node) {
+	set_count(node, node_count(node->lchild) + node_count(node->rchild) + 1);
+}
+
 static inline bool is_sentinel(generic_node *node) {
 	bool result = true;
 	if (node->lchild != NULL && node->rchild != NULL)
@@ -91,17 +166,18 @@ static inline bool is_sentinel(generic_node *node) {
 	return result;
 }
 
-static inline generic_node *make_sentinel() {
-	generic_node *node = (generic_node *) calloc(1, sizeof(generic_node));
-	node->color = BLACK;
-	/* this is done so that sentinels are able to check if they are sentinels */
-	node->is_sentinel = &is_sentinel;
+static inline generic_node *make_sentinel(const c_allocator *allocator) {
+	/* Sentinels are big enough for a count, so a counted tree reads 0 for them */
+	generic_node *node = (generic_node *) allocator_calloc(allocator, sizeof(counted_node));
+	if (node == NULL)
+		return NULL;
+	/* A zeroed node is already black and has no parent or children */
 	return node;
 }
 
 generic_node *set_sentinels(generic_node *node, generic_node *sentinel) {
 	if (sentinel == NULL) {
-		sentinel = make_sentinel();
+		sentinel = make_sentinel(&default_allocator);
 		if (sentinel == NULL)
 			return NULL;
 	}
@@ -110,46 +186,51 @@ generic_node *set_sentinels(generic_node *node, generic_node *sentinel) {
 	return sentinel;
 }
 
-generic_node *destroy_gnode(generic_node *node) {
+/* Nodes are handed back to the allocator that they came from */
+generic_node *destroy_gnode_with(generic_node *node, const c_allocator *allocator) {
 	if (node == NULL)
 		return NULL;
 	/* only a sentinel will have null children. the tree will take care of this */
-	else if (node->is_sentinel(node))
+	else if (is_sentinel(node))
 		return NULL;
 	if (node->rchild != NULL) {
-		node->rchild = destroy_gnode(node->rchild);
+		node->rchild = destroy_gnode_with(node->rchild, allocator);
 	}
 	
 	if (node->lchild != NULL)
-		node->lchild = destroy_gnode(node->lchild);
+		node->lchild = destroy_gnode_with(node->lchild, allocator);
 
-	free(node);
+	allocator_free(allocator, node);
 	return NULL;
 }
 
+generic_node *destroy_gnode(generic_node *node) {
+	return destroy_gnode_with(node, &default_allocator);
+}
+
 generic_node *sibling(generic_node *node) {
 	if (node == NULL)
 		return NULL;
-	generic_node *p = node->parent;
+	generic_node *p = node_parent(node);
 	if (p == NULL)
 		return NULL;
 	return (node == p->lchild) ? p->rchild : p->lchild;
 }
 
 generic_node *uncle(generic_node *node) {
-	generic_node *p = node->parent;
-	return p->sibling(p);
+	generic_node *p = node_parent(node);
+	return sibling(p);
 }
 
 generic_node *grandparent(generic_node *node) {
-	generic_node *p = node->parent;
-	return (p == NULL) ? NULL : p->parent;
+	generic_node *p = node_parent(node);
+	return (p == NULL) ? NULL : node_parent(p);
 }
 
 generic_node *minimum(generic_node *node) {
 	generic_node *temp = node;
-	while (!temp->is_sentinel(temp)) {
-		if (temp->is_sentinel(temp->lchild))
+	while (!is_sentinel(temp)) {
+		if (is_sentinel(temp->lchild))
 			break;
 		temp = temp->lchild;
 	}
@@ -158,8 +239,8 @@ generic_node *minimum(generic_node *node) {
 
 generic_node *maximum(generic_node *node) {
 	generic_node *temp = node;
-	while (!node->is_sentinel(temp)) {
-		if (temp->is_sentinel(temp->rchild))
+	while (!is_sentinel(temp)) {
+		if (is_sentinel(temp->rchild))
 			break;
 		temp = temp->rchild;
 	}
@@ -168,13 +249,13 @@ generic_node *maximum(generic_node *node) {
 
 generic_node *successor(generic_node *node) {
 	generic_node *temp = node;
-	generic_node *p = node->parent;
-	if (node->is_sentinel(temp))
+	generic_node *p = node_parent(node);
+	if (is_sentinel(temp))
 		return NULL;
-	else if (node->is_sentinel(temp->rchild)) {
+	else if (is_sentinel(temp->rchild)) {
 		while (p != NULL && temp != p->lchild) {
 			temp = p;
-			p = p->parent;
+			p = node_parent(p);
 		}
 		return p;
 	}
@@ -186,13 +267,13 @@ generic_node *successor(generic_node *node) {
 
 generic_node *predecessor(generic_node *node) {
 	generic_node *temp = node;
-	generic_node *parent = node->parent;
-	if (node->is_sentinel(temp))
+	generic_node *parent = node_parent(node);
+	if (is_sentinel(temp))
 		return NULL;
-	else if (node->is_sentinel(temp->lchild)) {
+	else if (is_sentinel(temp->lchild)) {
 		while (parent != NULL && temp != parent->rchild) {
 			temp = parent;
-			parent = parent->parent;
+			parent = node_parent(parent);
 		}
 		return parent;
 	}
@@ -202,78 +283,133 @@ generic_node *predecessor(generic_node *node) {
 	return NULL;
 }
 
-static inline void set_node_ptr(generic_node *node) {
-	node->destroy_gnode = &destroy_gnode;
-	node->set_sentinels = &set_sentinels;
-	node->is_sentinel = &is_sentinel;
-	node->sibling = &sibling;
-	node->uncle = &uncle;
-	node->grandparent = &grandparent;
-	node->minimum = &minimum;
-	node->maximum = &maximum;
-	node->successor = &successor;
-	node->predecessor = &predecessor;
+/* node_pool is a slab of tree nodes. Nodes are carved out of large chunks that
+ * come from the tree's allocator, and deleted nodes go on a free list to be handed
+ * out again by the next insert. Once a tree has grown to its working size, inserts
+ * and deletes stop going to the allocator at all. Destroying the pool frees the
+ * chunks themselves, so the tree never has to be walked node by node.
+ * Chunks start at POOL_MIN_CHUNK nodes and double up to POOL_MAX_CHUNK nodes.
+ */
+#define POOL_MIN_CHUNK	64
+#define POOL_MAX_CHUNK	8192
+
+typedef struct pool_chunk {
+	struct pool_chunk *next;
+	/* Keeps the nodes after the header aligned for any key or value type */
+	max_align_t align;
+} pool_chunk;
+
+typedef struct node_pool {
+	size_t node_size;
+	size_t chunk_nodes;
+	size_t chunk_count;
+	pool_chunk *chunks;
+	void *free_list;
+	char *next;
+	char *end;
+	const c_allocator *allocator;
+} node_pool;
+
+/* A node's size is already a multiple of its alignment, and every node holds
+ * pointers, so node_size can be used as the slot size as it is
+ */
+static inline void init_node_pool(node_pool *pool, size_t node_size, const c_allocator *allocator) {
+	memset(pool, 0, sizeof(node_pool));
+	pool->node_size = node_size;
+	pool->chunk_nodes = POOL_MIN_CHUNK;
+	pool->allocator = allocator;
+}
+
+/* Adds a chunk with room for count nodes and makes it the one being carved up */
+static inline bool pool_add_chunk(node_pool *pool, size_t count) {
+	size_t header = offsetof(pool_chunk, align);
+	pool_chunk *chunk = (pool_chunk *) pool->allocator->allocate(pool->allocator->context,
+						header + count*pool->node_size);
+	if (chunk == NULL)
+		return false;
+	chunk->next = pool->chunks;
+	pool->chunks = chunk;
+	++(pool->chunk_count);
+	pool->next = (char *) chunk + header;
+	pool->end = pool->next + count*pool->node_size;
+	return true;
 }
 
-#define define_node(K,V)	\
+/* Memory handed out by the pool is not zeroed */
+static inline void *pool_allocate(node_pool *pool) {
+	void *node = pool->free_list;
+	if (node != NULL) {
+		pool->free_list = *(void **) node;
+		return node;
+	}
+	if (pool->next == pool->end) {
+		if (!pool_add_chunk(pool, pool->chunk_nodes))
+			return NULL;
+		if (pool->chunk_nodes < POOL_MAX_CHUNK)
+			pool->chunk_nodes *= 2;
+	}
+	node = pool->next;
+	pool->next += pool->node_size;
+	return node;
+}
+
+static inline void pool_release(node_pool *pool, void *node) {
+	*(void **) node = pool->free_list;
+	pool->free_list = node;
+}
+
+void destroy_node_pool(node_pool *pool) {
+	while (pool->chunks != NULL) {
+		pool_chunk *next = pool->chunks->next;
+		allocator_free(pool->allocator, pool->chunks);
+		pool->chunks = next;
+	}
+	pool->chunk_count = 0;
+	pool->free_list = NULL;
+	pool->next = pool->end = NULL;
+}
+
+#define RB_COUNT_MEMBER_0
+#define RB_COUNT_MEMBER_1	size_t count;
+
+#define define_node(K,V)	define_counted_node(K,V, 0)
+
+/* COUNTED is 1 for the nodes of a counted tree, which carry a subtree count */
+#define define_counted_node(K,V, COUNTED)	\
 typedef struct node_##K##_##V {	\
 	generic_node gen_node;	\
+	RB_COUNT_MEMBER_##COUNTED	\
 	K key;	\
 	V value;	\
 } node_##K##_##V;	\
 	\
-node(K,V) *new_node_##K##_##V() {	\
+/* This is how the tree gets its nodes. They come out of the tree's node_pool */	\
+static inline node(K,V) *pool_node_##K##_##V(node_pool *pool) {	\
+	node(K,V) *node = (node(K,V) *) pool_allocate(pool);	\
+	generic_node *base = NULL;	\
+	if (node == NULL) {	\
+		return NULL;	\
+	}	\
+	memset(node, 0, sizeof(node(K,V)));	\
+	base = (generic_node *) node;	\
+	set_color(base, RED);	\
+	return node;	\
+}	\
+	\
+node(K,V) *new_node_##K##_##V(const c_allocator *allocator) {	\
 	node(K,V) *node = NULL;	\
 	generic_node *base = NULL;	\
 	\
-	node = (node(K,V) *) calloc(1, sizeof(node(K,V)));	\
+	node = (node(K,V) *) allocator_calloc(allocator, sizeof(node(K,V)));	\
 	if (node == NULL) {	\
 		return NULL;	\
 	}	\
 		\
 	base = (generic_node *) node;	\
-	base->color = RED;	\
-	set_node_ptr(base);	\
+	set_color(base, RED);	\
 	return node;	\
 }	\
 
-/* This is used for debugging the custom memcmp. */
-static inline void print_bytes(const void *key, size_t bytes) {
-	unsigned char *temp = (unsigned char *) key;
-	for (size_t i = 0; i < bytes; ++i) 
-		printf("%02x", temp[i]);
-	printf("\n");
-}
-
-/* memcmp does not account for endianness. This could mess up the insert function */
-/* This comparison function accounts for endianness. */
-static inline int compare_little_endian(const unsigned char *key, const unsigned char *nkey, size_t bytes) {
-	for (int i = bytes - 1; i >= 0; --i) {
-		if (key[i] > nkey[i])
-			return 1;
-		else if (key[i] < nkey[i])
-			return -1;
-	}
-	return 0;
-}
-static inline int compare_big_endian(const unsigned char *key, const unsigned char *nkey, size_t bytes) {
-	for (int i = 0; i < bytes; ++i) {
-		if (key[i] >  nkey[i])
-			return 1;
-		else if (key[i] <  nkey[i])
-			return -1;
-	}
-	return 0;
-}
-
-/* This will not necessarily work with machines that are neither big nor little endian */
-static inline int compare_bytes(const void *key, const void *nkey, size_t bytes) {
-	if (is_little())
-		return compare_little_endian((unsigned char *) key, (unsigned char *)  nkey, bytes);
-	else
-		return compare_big_endian((unsigned char *) key, (unsigned char *)  nkey, bytes);
-}
-
 /* These functions do not require a tree as the first argument. Moreover, 
  * they also don't depend on the key and value members of node(K,V).
  * For that reason, I have moved them outside of define_rbtree in order to
@@ -282,56 +418,61 @@ static inline int compare_bytes(const void *key, const void *nkey, size_t bytes)
  
 static inline color_t uncle_color(generic_node *node) {
 	generic_node *temp = node;
-	generic_node *u = temp->uncle(temp);
-	return (u->color == RED) ? RED : BLACK;
+	generic_node *u = uncle(temp);
+	return (node_color(u) == RED) ? RED : BLACK;
 }
 
 static inline void recolor(generic_node *node) {
 	generic_node *temp = node;
-	generic_node *p = temp->parent;
-	generic_node *u = temp->uncle(temp);
-	generic_node *g = temp->grandparent(temp);
-	p->color = BLACK;
-	u->color = BLACK;
-	g->color = RED;
+	generic_node *p = node_parent(temp);
+	generic_node *u = uncle(temp);
+	generic_node *g = grandparent(temp);
+	set_color(p, BLACK);
+	set_color(u, BLACK);
+	set_color(g, RED);
 }
 
 /* 
  * Root is the tree's pointer to root. Doing it this way has allowed
  * several extra functions to be generalized
  */
-static inline void rotate_left(generic_node **root, generic_node *node) {
+static inline void rotate_left(generic_node **root, generic_node *node, bool counted) {
 	generic_node *temp = node;
 	generic_node *pivot = temp->rchild;
-	generic_node *p = temp->parent;
-	pivot->parent = p;
+	generic_node *p = node_parent(temp);
+	set_parent(pivot, p);
 	temp->rchild = pivot->lchild;
 	pivot->lchild = temp;
 	/* Check if temp's rchild is a sentinel */
-	if (!temp->rchild->is_sentinel(temp->rchild)) {
-		temp->rchild->parent = temp;
+	if (!is_sentinel(temp->rchild)) {
+		set_parent(temp->rchild, temp);
 	}
-	temp->parent = pivot;
+	set_parent(temp, pivot);
 	if (p != NULL) {
 		(p->rchild == temp) ? (p->rchild = pivot) : (p->lchild = pivot);
 	}
 	if (*root == temp) {
 		*root = pivot;
 	}
+	/* pivot now holds what temp's subtree held */
+	if (counted) {
+		set_count(pivot, node_count(temp));
+		update_count(temp);
+	}
 }
 
-static inline void rotate_right(generic_node **root, generic_node *node) {
+static inline void rotate_right(generic_node **root, generic_node *node, bool counted) {
 	generic_node *temp = node;
-	generic_node *p = temp->parent;
+	generic_node *p = node_parent(temp);
 	generic_node *pivot = temp->lchild;
-	pivot->parent = p;
+	set_parent(pivot, p);
 	temp->lchild = pivot->rchild;
 	pivot->rchild = temp;
 	/* check if temp's lchild is a sentinel */
-	if (!temp->lchild->is_sentinel(temp->lchild)) {
-		temp->lchild->parent = temp;
+	if (!is_sentinel(temp->lchild)) {
+		set_parent(temp->lchild, temp);
 	}
-	temp->parent = pivot;
+	set_parent(temp, pivot);
 	/* check case where node is root */
 	if (p != NULL) {
 		(p->rchild == temp) ? (p->rchild = pivot) : (p->lchild = pivot);
@@ -339,134 +480,221 @@ static inline void rotate_right(generic_node **root, generic_node *node) {
 	if (*root == temp) {
 		*root = pivot;
 	}
+	/* pivot now holds what temp's subtree held */
+	if (counted) {
+		set_count(pivot, node_count(temp));
+		update_count(temp);
+	}
 }
 
-static inline void rotate(generic_node **root, generic_node *node) {
+static inline void rotate(generic_node **root, generic_node *node, bool counted) {
 	generic_node *temp = node;
-	generic_node *p = temp->parent;
-	generic_node *g = temp->grandparent(temp);
+	generic_node *p = node_parent(temp);
+	generic_node *g = grandparent(temp);
 	if (temp == p->rchild && p == g->lchild) {
-		rotate_left(root, p);
+		rotate_left(root, p, counted);
 		temp = temp->lchild;
 	}
 	else if (temp == p->lchild && p == g->rchild) {
-		rotate_right(root, p);
+		rotate_right(root, p, counted);
 		temp = temp->rchild;
 	}
-	p = temp->parent;
-	g = temp->grandparent(temp);
+	p = node_parent(temp);
+	g = grandparent(temp);
 	if (temp == p->lchild) {
-		rotate_right(root, g);
+		rotate_right(root, g, counted);
 	}
 	else {
-		rotate_left(root, g);
+		rotate_left(root, g, counted);
 	}
-	p->color = BLACK; 
-	g->color = RED; 
+	set_color(p, BLACK); 
+	set_color(g, RED); 
 }
 
-static inline void repair_tree_insert(generic_node **root, generic_node *node) {
+static inline void repair_tree_insert(generic_node **root, generic_node *node, bool counted) {
 	generic_node *temp = node;
 	while (true) {
 		/* The only case that doesn't immediately exit is case 3. */
 		/* In this case, temp is root */
-		if (temp->parent == NULL) {
-			temp->color = BLACK;
+		if (node_parent(temp) == NULL) {
+			set_color(temp, BLACK);
 			return;
 		}
 		/* In this case, temp is red and parent is black. No need to modify */
-		else if (temp->parent->color == BLACK) {
+		else if (node_color(node_parent(temp)) == BLACK) {
 			return;
 		}
 		/* Recolor and then work up the tree doing modifications as necessary */
-		else if (temp->uncle(temp) != NULL && uncle_color(temp) == RED) {
+		else if (uncle(temp) != NULL && uncle_color(temp) == RED) {
 			recolor(temp);
-			temp = temp->grandparent(temp);
+			temp = grandparent(temp);
 		}
-		else if (temp->uncle(temp) != NULL && uncle_color(temp) == BLACK) {
-			rotate(root, temp);
+		else if (uncle(temp) != NULL && uncle_color(temp) == BLACK) {
+			rotate(root, temp, counted);
 			return;
 		}
 	}
 }
 
-/* Switch node and child */
-static inline void transplant(generic_node *node, generic_node *child) {
-	generic_node *ngen = node;
-	generic_node *cgen = child;
-	cgen->parent = ngen->parent;
-	(ngen == ngen->parent->lchild) ? (ngen->parent->lchild = cgen) 
-									: (ngen->parent->rchild = cgen);
+/* Put child where node was. child may be the sentinel, in which case the sentinel's
+ * parent is set too. erase_node relies on that.
+ */
+static inline void transplant(generic_node **root, generic_node *node, generic_node *child) {
+	generic_node *p = node_parent(node);
+	set_parent(child, p);
+	if (p == NULL)
+		*root = child;
+	else if (node == p->lchild)
+		p->lchild = child;
+	else
+		p->rchild = child;
 }
 
-/* Altering node/child does not actually matter since the caller never uses it
- * after repair tree returns. Since I have a temp node equal to the node parameter 
- * for every other function, I'm going to do that here as well in order to avoid confusion 
- * This code is based on code from Wikipedia. The algorithm has been altered in multiple ways, however.
+/* node has taken the place of a black node that was removed, so every path through
+ * it is one black node short. This is the usual fix up (see CLRS, chapter 13).
+ * node can be the sentinel, so its parent is read once per pass and kept in p,
+ * since the rotations below may point the sentinel's parent somewhere else.
  */
-void repair_tree_delete(generic_node **root, generic_node *node) {
+void repair_tree_delete(generic_node **root, generic_node *node, bool counted) {
 	generic_node *temp = node;
-	/* Using while loop avoid recursion */
-	while (true) {
-		/* inverse of case 1 */
-		if (temp->parent == NULL) {
-			return;
-		}
-		generic_node *sibling = temp->sibling(temp);
-		/* case two moves to case three */
-		if (sibling->color == RED) {
-			temp->parent->color = RED;
-			sibling->color = BLACK;
-			/* rotate right or left depending on which child temp is */
-			(temp == temp->parent->rchild) ? rotate_right(root, temp->parent)
-											: rotate_left(root, temp->parent);
-		}
-		sibling = temp->sibling(temp);
-		/* case three goes back to case one */
-		if (temp->parent->color == BLACK && sibling->color == BLACK && 
-			sibling->rchild->color == BLACK && sibling->lchild->color == BLACK) {
-			sibling->color = RED;
-			temp = temp->parent;
-			continue;
-		}
-		sibling = temp->sibling(temp);
-		/* case four exits when it is finished */
-		if (temp->parent->color == RED && sibling->color == BLACK &&
-			sibling->lchild->color == BLACK && sibling->rchild->color == BLACK) {
-			sibling->color = RED;
-			temp->parent->color = BLACK;
-			return;
-		}
-		sibling = temp->sibling(temp);
-		/* case five proceeds to case six */
-		if (sibling->color == BLACK) {
-			if (temp == temp->parent->lchild && sibling->rchild->color == BLACK &&
-				sibling->lchild->color == RED) {
-				sibling->color = RED;
-				sibling->lchild->color = BLACK;
-				rotate_right(root, sibling);
+	while (temp != *root && node_color(temp) == BLACK) {
+		generic_node *p = node_parent(temp);
+		generic_node *sib = NULL;
+		if (temp == p->lchild) {
+			sib = p->rchild;
+			if (node_color(sib) == RED) {
+				set_color(sib, BLACK);
+				set_color(p, RED);
+				rotate_left(root, p, counted);
+				sib = p->rchild;
+			}
+			if (node_color(sib->lchild) == BLACK && node_color(sib->rchild) == BLACK) {
+				set_color(sib, RED);
+				temp = p;
+				continue;
 			}
-			else if (temp == temp->parent->rchild && sibling->lchild->color == BLACK &&
-					sibling->rchild->color == RED) {
-				sibling->color = RED;
-				sibling->rchild->color = BLACK;
-				rotate_left(root, sibling);
+			if (node_color(sib->rchild) == BLACK) {
+				set_color(sib->lchild, BLACK);
+				set_color(sib, RED);
+				rotate_right(root, sib, counted);
+				sib = p->rchild;
 			}
+			set_color(sib, node_color(p));
+			set_color(p, BLACK);
+			set_color(sib->rchild, BLACK);
+			rotate_left(root, p, counted);
 		}
-		sibling = temp->sibling(temp);
-		sibling->color = temp->parent->color;
-		temp->parent->color = BLACK;
-		/* case six exits on finish */
-		if (temp == temp->parent->lchild) {
-			sibling->rchild->color = BLACK;
-			rotate_left(root, temp->parent);
+		else {
+			sib = p->lchild;
+			if (node_color(sib) == RED) {
+				set_color(sib, BLACK);
+				set_color(p, RED);
+				rotate_right(root, p, counted);
+				sib = p->lchild;
+			}
+			if (node_color(sib->rchild) == BLACK && node_color(sib->lchild) == BLACK) {
+				set_color(sib, RED);
+				temp = p;
+				continue;
+			}
+			if (node_color(sib->lchild) == BLACK) {
+				set_color(sib->rchild, BLACK);
+				set_color(sib, RED);
+				rotate_left(root, sib, counted);
+				sib = p->lchild;
+			}
+			set_color(sib, node_color(p));
+			set_color(p, BLACK);
+			set_color(sib->lchild, BLACK);
+			rotate_right(root, p, counted);
 		}
+		temp = *root;
+	}
+	set_color(temp, BLACK);
+}
+
+/* Unlink node from the tree and rebalance it. node isn't freed. A node with two
+ * children is replaced by its successor node, rather than having the successor's key
+ * and value copied into it, so every other node stays where it is in memory and
+ * cursors on them stay valid.
+ */
+void erase_node(generic_node **root, generic_node *node, generic_node *sentinel, bool counted) {
+	generic_node *replace = node;
+	generic_node *child = NULL;
+	color_t removed = node_color(node);
+	/* Every node above the one that actually leaves its place loses one from its */
+	/* count. That is node itself, or the successor that is moved up to replace it */
+	if (counted) {
+		generic_node *gone = (node->lchild == sentinel || node->rchild == sentinel) ? node : minimum(node->rchild);
+		for (generic_node *p = node_parent(gone); p != NULL; p = node_parent(p))
+			set_count(p, node_count(p) - 1);
+	}
+	if (node->lchild == sentinel) {
+		child = node->rchild;
+		transplant(root, node, child);
+	}
+	else if (node->rchild == sentinel) {
+		child = node->lchild;
+		transplant(root, node, child);
+	}
+	else {
+		replace = minimum(node->rchild);
+		removed = node_color(replace);
+		child = replace->rchild;
+		if (node_parent(replace) == node)
+			set_parent(child, replace);
 		else {
-			sibling->lchild->color = BLACK;
-			rotate_right(root, temp->parent);
+			transplant(root, replace, child);
+			replace->rchild = node->rchild;
+			set_parent(replace->rchild, replace);
 		}
-		return;
+		transplant(root, node, replace);
+		replace->lchild = node->lchild;
+		set_parent(replace->lchild, replace);
+		set_color(replace, node_color(node));
+		if (counted)
+			set_count(replace, node_count(node));
 	}
+	if (removed == BLACK)
+		repair_tree_delete(root, child, counted);
+	/* The tree uses NULL for an empty tree, not the sentinel */
+	if (*root == sentinel)
+		*root = NULL;
+}
+
+/* The depth whose nodes build_from_sorted colors red. Splitting a sorted run at its
+ * middle fills every level but the deepest, so making the deepest level red and
+ * the rest black gives every path the same number of black nodes. A tree that is a
+ * single node has no red level, since the root has to be black.
+ */
+static inline size_t sorted_red_depth(size_t count) {
+	size_t depth = 0;
+	while ((count >> (depth + 1)) != 0)
+		++depth;
+	return (depth == 0) ? SIZE_MAX : depth;
+}
+
+/* Links nodes lo to hi - 1 of a contiguous array of nodes, which already hold their
+ * keys in order, into a balanced subtree and returns its root. An empty range
+ * returns the sentinel. The recursion is only as deep as the tree.
+ */
+generic_node *link_sorted_nodes(char *base, size_t node_size, size_t lo, size_t hi, size_t depth,
+				size_t red_depth, generic_node *sentinel, bool counted) {
+	size_t mid = lo + (hi - lo) / 2;
+	generic_node *node = NULL;
+	if (lo == hi)
+		return sentinel;
+	node = (generic_node *) (base + mid*node_size);
+	node->parent_color = (depth == red_depth) ? RED : BLACK;
+	node->lchild = link_sorted_nodes(base, node_size, lo, mid, depth + 1, red_depth, sentinel, counted);
+	node->rchild = link_sorted_nodes(base, node_size, mid + 1, hi, depth + 1, red_depth, sentinel, counted);
+	if (counted)
+		set_count(node, hi - lo);
+	if (node->lchild != sentinel)
+		set_parent(node->lchild, node);
+	if (node->rchild != sentinel)
+		set_parent(node->rchild, node);
+	return node;
 }
 
 /* rb_tree(K,V) is a structure that is used to represent the red and black tree
@@ -488,13 +716,86 @@ void repair_tree_delete(generic_node **root, generic_node *node) {
  * 
  * All of this can be optimized later for readability. For now, the focus
  * will be on writing the map, however. 
+ *
+ * node(K,V) *first_node_##K##_##V(rb_tree(K,V) *tree)
+ * node(K,V) *last_node_##K##_##V(rb_tree(K,V) *tree)
+ * node(K,V) *next_node_##K##_##V(node(K,V) *node)
+ * node(K,V) *prev_node_##K##_##V(node(K,V) *node)
+ * INPUT: the tree, or the node the cursor is on
+ * OUTPUT: the smallest, largest, next or previous node, or NULL if there isn't one
+ * USAGE: for (node(int,char) *n = first_node_int_char(tree); n != NULL; n = next_node_int_char(n))
+ * NOTES: These follow the parent and child pointers instead of searching from the
+ * root, so a full walk in either direction is O(n). A node stays valid until it is
+ * deleted from the tree.
+ *
+ * node(K,V) *lower_bound_node_##K##_##V(rb_tree(K,V) *tree, K key)
+ * node(K,V) *upper_bound_node_##K##_##V(rb_tree(K,V) *tree, K key)
+ * node(K,V) *floor_node_##K##_##V(rb_tree(K,V) *tree, K key)
+ * node(K,V) *ceiling_node_##K##_##V(rb_tree(K,V) *tree, K key)
+ * INPUT: the tree, and a key that doesn't have to be in it
+ * OUTPUT: the first node whose key is >= key (lower_bound and ceiling) or > key
+ * (upper_bound), or the last node whose key is <= key (floor). NULL if there is none.
+ * USAGE: for (n = lower_bound_node_int_char(tree, a); n != NULL && n->key < b; n = next_node_int_char(n))
+ * NOTES: One O(log n) descent from the root. Stepping on from the node with
+ * next_node or prev_node doesn't search again, so visiting the k keys in a range
+ * costs O(log n + k).
+ *
+ * error_code build_from_sorted_##K##_##V(rb_tree(K,V) *tree, const K *keys, const V *values, size_t n)
+ * INPUT: rb_tree(K,V) *tree -> tree to fill, const K *keys, const V *values -> n pairs
+ * in increasing key order
+ * OUTPUT: success, or new_node_failed if the nodes couldn't be allocated, in which
+ * case the tree is left as it was
+ * USAGE: tree->build_from_sorted(tree, keys, values, n);
+ * NOTES: Replaces everything in the tree with the given pairs in O(n). All the nodes
+ * come from one allocation, which becomes the first chunk of the tree's pool. They
+ * are filled in order and linked into a balanced tree that is already correctly
+ * colored, so there is no searching, comparing against the tree or repairing.
+ * When a key is repeated, the last value given for it wins. Input that turns out
+ * not to be sorted is still accepted, but is inserted one pair at a time.
+ *
+ * size_t rank_##K##_##V(rb_tree(K,V) *tree, K key)
+ * K select_##K##_##V(rb_tree(K,V) *tree, size_t index)
+ * INPUT: the tree, and a key that doesn't have to be in it, or an index from 0
+ * OUTPUT: rank gives the number of keys in the tree that are less than key. select
+ * gives the key at index in sorted order, or a zeroed key with err set to
+ * invalid_index when index isn't less than tree->size.
+ * USAGE: int median = tree->select(tree, tree->size / 2);
+ * NOTES: O(log n) in a counted tree, O(n) in any other. tree->size is the number of
+ * keys in every tree.
+ *
+ * define_rbtree_cmp(K,V, CMP)
+ * INPUT: K -> key data type, V -> value data type, CMP -> comparator for K
+ * OUTPUT: None
+ * USAGE: define_rbtree_cmp(int, char, compare_int)
+ * NOTES: CMP is called as CMP(a, b) on two keys and returns a negative number, zero
+ * or a positive number. It can be a function or a macro, and since it is pasted
+ * into the search and insert loops it gets inlined. See compare.h for the built in
+ * comparators. define_rbtree(K,V) is define_rbtree_cmp with default_compare.
+ *
+ * define_rbtree_counted(K,V)
+ * define_rbtree_counted_cmp(K,V, CMP)
+ * USAGE: define_rbtree_counted(int, char)
+ * NOTES: The same tree, except that every node also stores the size of its subtree,
+ * which is what makes rank and select O(log n). The counts are kept right by the
+ * rotations and the insert and delete repairs, and cost a size_t per node plus a
+ * walk up to the root on each insert and delete. Use one or the other for a given
+ * K and V, as both define the same names.
  */
  
-#define define_rbtree(K,V)	\
-define_node(K,V)	\
+#define define_rbtree(K,V)	define_rbtree_cmp(K,V, default_compare)
+#define define_rbtree_cmp(K,V, CMP)	define_rbtree_mode(K,V, CMP, 0)
+#define define_rbtree_counted(K,V)	define_rbtree_counted_cmp(K,V, default_compare)
+#define define_rbtree_counted_cmp(K,V, CMP)	define_rbtree_mode(K,V, CMP, 1)
+
+/* COUNTED is a literal 0 or 1, so the branches on it fold away */
+#define define_rbtree_mode(K,V, CMP, COUNTED)	\
+define_counted_node(K,V, COUNTED)	\
 typedef struct rb_tree_##K##_##V {	\
 	node(K,V) *root;	\
 	generic_node *sentinel;	\
+	const c_allocator *allocator;	\
+	node_pool pool;	\
+	size_t size;	\
 	struct rb_tree_##K##_##V *(*destroy_rbtree)(struct rb_tree_##K##_##V *);	\
 	error_code (*insert)(struct rb_tree_##K##_##V *, K, V);	\
 	void (*inorder_traverse)(struct rb_tree_##K##_##V *, node(K,V) *);	\
@@ -505,19 +806,19 @@ typedef struct rb_tree_##K##_##V {	\
 	K (*first_key)(struct rb_tree_##K##_##V *);	\
 	error_code (*delete_pair)(struct rb_tree_##K##_##V *, K);	\
 	bool (*check_key)(struct rb_tree_##K##_##V *, K);	\
+	error_code (*build_from_sorted)(struct rb_tree_##K##_##V *, const K*, const V*, size_t);	\
+	size_t (*rank)(struct rb_tree_##K##_##V *, K);	\
+	K (*select)(struct rb_tree_##K##_##V *, size_t);	\
 } rb_tree_##K##_##V;	\
 	\
 	\
 rb_tree(K,V) *destroy_rbtree_##K##_##V(rb_tree(K,V) *tree) {	\
 	if (tree != NULL) {	\
-		if (tree->root != NULL) {	\
-		/* up cast in order to treat root like a generic node */	\
-			generic_node *node = (generic_node *) tree->root;	\
-			node->destroy_gnode(node);	\
-		}	\
-		if (tree->sentinel != NULL)	\
-			free(tree->sentinel);	\
-		free(tree);	\
+		/* Every node lives in the pool, so freeing its chunks frees the whole */	\
+		/* tree without having to walk it */	\
+		destroy_node_pool(&tree->pool);	\
+		allocator_free(tree->allocator, tree->sentinel);	\
+		allocator_free(tree->allocator, tree);	\
 	}	\
 	return NULL;	\
 }	\
@@ -525,12 +826,13 @@ rb_tree(K,V) *destroy_rbtree_##K##_##V(rb_tree(K,V) *tree) {	\
 /* This is inline because it is also used by delete */	\
 static inline node(K,V) *basic_search_##K##_##V(rb_tree(K,V) *tree, K key) {	\
 	generic_node *temp = (generic_node *) tree->root;	\
-	K nkey;	\
 	int result = 0;	\
+	/* root is NULL, but the sentinel isn't, once every key has been deleted */	\
+	if (temp == NULL)	\
+		return NULL;	\
 	while (temp != tree->sentinel) {	\
 		node(K,V) *ntemp = (node(K,V) *) temp;	\
-		nkey = ntemp->key;	\
-		result = compare_bytes(&key, &nkey, sizeof(K));	\
+		result = CMP(key, ntemp->key);	\
 		if (result == 0)	\
 			/* ntemp and temp point to the same locations */	\
 			return ntemp;	\
@@ -561,7 +863,7 @@ V get_value_##K##_##V(rb_tree(K,V) *tree, K key) {	\
 	\
 K last_key_##K##_##V(rb_tree(K,V) *tree) {	\
 	generic_node *groot = (generic_node *) tree->root;	\
-	generic_node *gmax = groot->maximum(groot);	\
+	generic_node *gmax = maximum(groot);	\
 	node(K,V) *max = (node(K,V) *) gmax;	\
 	return max->key;	\
 }	\
@@ -574,7 +876,7 @@ K next_key_##K##_##V(rb_tree(K,V) *tree, K key) {	\
 	if (node == NULL) {	\
 		return k;	\
 	}	\
-	generic_node *gnext =  gnode->successor(gnode);	\
+	generic_node *gnext = successor(gnode);	\
 	/* This will be NULL if there is no successor */	\
 	if (gnext == NULL) {	\
 		return k;	\
@@ -597,29 +899,95 @@ K first_key_##K##_##V(rb_tree(K,V) *tree) {	\
 	return min->key;	\
 }	\
 	\
-static inline node(K,V) *basic_insert_##K##_##V(rb_tree(K,V) *tree, K key, V value) {	\
+/* Cursor stepping. These hand out nodes, so a walk over the tree doesn't search it */	\
+static inline node(K,V) *first_node_##K##_##V(rb_tree(K,V) *tree) {	\
+	if (tree->root == NULL)	\
+		return NULL;	\
+	return (node(K,V) *) minimum((generic_node *) tree->root);	\
+}	\
+	\
+static inline node(K,V) *last_node_##K##_##V(rb_tree(K,V) *tree) {	\
+	if (tree->root == NULL)	\
+		return NULL;	\
+	return (node(K,V) *) maximum((generic_node *) tree->root);	\
+}	\
+	\
+static inline node(K,V) *next_node_##K##_##V(node(K,V) *node) {	\
+	return (node == NULL) ? NULL : (node(K,V) *) successor((generic_node *) node);	\
+}	\
+	\
+static inline node(K,V) *prev_node_##K##_##V(node(K,V) *node) {	\
+	return (node == NULL) ? NULL : (node(K,V) *) predecessor((generic_node *) node);	\
+}	\
+	\
+/* Walks down from the root remembering the last node that qualified. With side > 0 */	\
+/* that is the smallest key >= key (> key if strict), and with side < 0 the largest */	\
+/* key <= key (< key if strict). side and strict are constants at every call. */	\
+static inline node(K,V) *bound_node_##K##_##V(rb_tree(K,V) *tree, K key, int side, bool strict) {	\
+	generic_node *temp = (generic_node *) tree->root;	\
+	node(K,V) *best = NULL;	\
+	if (temp == NULL)	\
+		return NULL;	\
+	while (temp != tree->sentinel) {	\
+		node(K,V) *ntemp = (node(K,V) *) temp;	\
+		int result = CMP(ntemp->key, key);	\
+		bool take = (side > 0) ? (result > 0 || (!strict && result == 0)) : (result < 0 || (!strict && result == 0));	\
+		if (take)	\
+			best = ntemp;	\
+		temp = (take == (side > 0)) ? temp->lchild : temp->rchild;	\
+	}	\
+	return best;	\
+}	\
+	\
+static inline node(K,V) *lower_bound_node_##K##_##V(rb_tree(K,V) *tree, K key) {	\
+	return bound_node_##K##_##V(tree, key, 1, false);	\
+}	\
+	\
+static inline node(K,V) *upper_bound_node_##K##_##V(rb_tree(K,V) *tree, K key) {	\
+	return bound_node_##K##_##V(tree, key, 1, true);	\
+}	\
+	\
+static inline node(K,V) *floor_node_##K##_##V(rb_tree(K,V) *tree, K key) {	\
+	return bound_node_##K##_##V(tree, key, -1, false);	\
+}	\
+	\
+static inline node(K,V) *ceiling_node_##K##_##V(rb_tree(K,V) *tree, K key) {	\
+	return bound_node_##K##_##V(tree, key, 1, false);	\
+}	\
+	\
+/* The last node whose key is < key. This is where a backwards walk of [low, key) starts */	\
+static inline node(K,V) *below_node_##K##_##V(rb_tree(K,V) *tree, K key) {	\
+	return bound_node_##K##_##V(tree, key, -1, true);	\
+}	\
+	\
+/* added is set when key wasn't in the tree yet, so that a node had to be made for it */	\
+static inline node(K,V) *basic_insert_##K##_##V(rb_tree(K,V) *tree, K key, V value, bool *added) {	\
 	generic_node *node = (generic_node *) tree->root;	\
 	generic_node *temp = (generic_node *) tree->root;	\
 	node(K,V) *ntemp = NULL;	\
-	K nkey;	\
 	int result = 0;	\
 	if (node == NULL) {	\
-		temp = (generic_node *) new_node(K,V);	\
+		if (tree->sentinel == NULL) {	\
+			tree->sentinel = make_sentinel(tree->allocator);	\
+			if (tree->sentinel == NULL)	\
+				return NULL;	\
+		}	\
+		temp = (generic_node *) pool_node_##K##_##V(&tree->pool);	\
 		if (temp == NULL)	\
 			return NULL;	\
 		ntemp = (node(K,V) *) temp;	\
 		ntemp->key = key;	\
 		ntemp->value = value;	\
-		tree->sentinel = temp->set_sentinels(temp, tree->sentinel);	\
+		tree->sentinel = set_sentinels(temp, tree->sentinel);	\
 		tree->root = ntemp;	\
+		*added = true;	\
 		return tree->root;	\
 	}	\
 		\
 	while (true) {	\
 		node = temp;	\
 		ntemp = (node(K,V) *) node;	\
-		nkey = ntemp->key;	\
-		result = compare_bytes(&key, &nkey, sizeof(K));	\
+		result = CMP(key, ntemp->key);	\
 		if (result == 0) {	\
 			ntemp->value = value;	\
 			return ntemp;	\
@@ -635,147 +1003,199 @@ static inline node(K,V) *basic_insert_##K##_##V(rb_tree(K,V) *tree, K key, V val
 			break;	\
 		}	\
 	}	\
-	temp = (generic_node *) new_node(K,V);	\
+	temp = (generic_node *) pool_node_##K##_##V(&tree->pool);	\
 	ntemp = (node(K,V) *) temp;	\
 		\
 	if (temp == NULL) {	\
 		return NULL;	\
 	}	\
-	temp->set_sentinels(temp, tree->sentinel);	\
+	set_sentinels(temp, tree->sentinel);	\
 	ntemp->key = key;	\
 	ntemp->value = value;	\
-	temp->color = RED;	\
-	temp->parent = node;	\
+	set_color(temp, RED);	\
+	set_parent(temp, node);	\
 	(result > 0) ? (node->rchild = temp) : (node->lchild = temp);	\
+	*added = true;	\
 	return ntemp;	\
 }	\
 	\
 error_code insert_##K##_##V(rb_tree(K,V) *tree, K key, V value) {	\
 	/* Insert and then perform tree repairs */	\
-	generic_node *temp = (generic_node *) basic_insert_##K##_##V(tree, key, value);	\
+	bool added = false;	\
+	generic_node *temp = (generic_node *) basic_insert_##K##_##V(tree, key, value, &added);	\
 	if (temp == NULL) {	\
 		err = basic_insert_failed;	\
 		set_error_info(__FILE__, "insert", __LINE__);	\
 		return err;	\
 	}	\
-	repair_tree_insert((generic_node **) &tree->root, temp);	\
-	err = success;	\
-	return success;	\
-}	\
-	\
-/* basic delete is basic in the sense that it doesn't handle repair	*/	\
-static inline node(K,V) *basic_delete_##K##_##V(rb_tree(K,V) *tree, node(K,V) *node) {	\
-	static bool successor = true;	\
-	generic_node *temp = (generic_node *) node;	\
-	node(K,V) *ntemp = NULL;	\
-	node(K,V) *nreplace = NULL;	\
-	/* case where both children are not sentinels */	\
-	/* tree does not need its root updated since the node is copied over */	\
-	if (!temp->rchild->is_sentinel(temp->rchild) && !temp->lchild->is_sentinel(temp->lchild)) {	\
-		generic_node *replace = NULL;	\
-		ntemp = (node(K,V) *) temp;	\
-		/* alternating between successor and predecessor could help balance tree */	\
-		if (successor) {	\
-			replace = temp->successor(temp);	\
-			successor = false;	\
-		}	\
-		else {	\
-			replace = temp->predecessor(temp);	\
-			successor = true;	\
-		}	\
-		nreplace = (node(K,V) *) replace;	\
-		ntemp->key = nreplace->key;	\
-		ntemp->value = nreplace->value;	\
-		/* If either child of replace is a non sentinel, then assign to the parent of successor */	\
-		if (!replace->lchild->is_sentinel(replace->lchild))	\
-			transplant(replace, replace->lchild);	\
-			\
-		else if (!replace->rchild->is_sentinel(replace->rchild))	\
-			transplant(replace, replace->rchild);	\
-		/* Both of successor's children are sentinels means that successor's */	\
-		/* spot can be sentinel in the parent of successor */	\
-		else if (replace->rchild->is_sentinel(replace->rchild) &&	\
-				replace->lchild->is_sentinel(replace->lchild)) {	\
-			(replace == replace->parent->lchild)	\
-								? (replace->parent->lchild = tree->sentinel)	\
-								: (replace->parent->rchild = tree->sentinel);	\
-		}	\
-		free(nreplace);	\
-		return NULL;	\
-	}	\
-	/* if both children are sentinels, then we can go ahead and just delete the node */	\
-	else if (temp->rchild->is_sentinel(temp->rchild) && temp->lchild->is_sentinel(temp->lchild)) {	\
-		/* If the node in question is root, then set tree root to null */	\
-		if (ntemp == tree->root)	\
-			tree->root = NULL;	\
-		/* The parent of the node being deleted replaces the node with a sentinel */	\
-		else	\
-			(temp == temp->parent->lchild) ? (temp->parent->lchild = tree->sentinel) 	\
-											: (temp->parent->rchild = tree->sentinel);	\
-		free(node);	\
-		return NULL;	\
-	}	\
-	/* in the final case, one child is non-leaf and the other is a sentinel */	\
-	else {	\
-		generic_node *child = (temp->rchild == tree->sentinel) ? temp->lchild : temp->rchild;	\
-		transplant(temp, child);	\
-		/* The case where temp is red is trivial. This only happens when both children are sentinels */	\
-		/* This was already handled */	\
-		if (temp->color == BLACK) {	\
-			if (child->color == BLACK)	\
-				return (node(K,V) *) child;	\
-			child->color = BLACK;	\
+	if (added) {	\
+		++tree->size;	\
+		/* The new leaf counts itself, and every node above it holds one more */	\
+		if (COUNTED) {	\
+			set_count(temp, 1);	\
+			for (generic_node *p = node_parent(temp); p != NULL; p = node_parent(p))	\
+				set_count(p, node_count(p) + 1);	\
 		}	\
-		free(node);	\
-		return NULL;	\
+		/* Overwriting the value of a key already in the tree leaves its shape alone */	\
+		repair_tree_insert((generic_node **) &tree->root, temp, COUNTED);	\
 	}	\
-	/* The function should never get to this point */	\
-	return NULL;	\
+	err = success;	\
+	return success;	\
 }	\
 	\
 error_code delete_##K##_##V(rb_tree(K,V) *tree, K key) {	\
 	node(K,V) *temp = basic_search_##K##_##V(tree, key);	\
-	node(K,V) *child = NULL;	\
 	if (temp == NULL) {	\
 		err = key_not_found;	\
 		set_error_info(__FILE__, "delete", __LINE__);	\
 		return err;	\
 	}	\
-	\
-	child = basic_delete_##K##_##V(tree, temp);		\
-	/* NULL indicates that no tree repair is necessary */	\
-	if (child == NULL) {	\
+	erase_node((generic_node **) &tree->root, (generic_node *) temp, tree->sentinel, COUNTED);	\
+	pool_release(&tree->pool, temp);	\
+	--tree->size;	\
+	err = success;	\
+	return success;	\
+}	\
+error_code build_from_sorted_##K##_##V(rb_tree(K,V) *tree, const K *keys, const V *values, size_t n) {	\
+	node_pool pool;	\
+	char *base = NULL;	\
+	size_t count = 0;	\
+	bool sorted = true;	\
+	/* Count the distinct keys, and make sure they really are sorted */	\
+	for (size_t i = 0; i < n; ++i) {	\
+		int result = (i + 1 < n) ? CMP(keys[i], keys[i + 1]) : -1;	\
+		if (result > 0) {	\
+			sorted = false;	\
+			break;	\
+		}	\
+		count += (result != 0);	\
+	}	\
+	if (tree->sentinel == NULL) {	\
+		tree->sentinel = make_sentinel(tree->allocator);	\
+		if (tree->sentinel == NULL) {	\
+			err = make_sentinels_failed;	\
+			set_error_info(__FILE__, "build_from_sorted", __LINE__);	\
+			return err;	\
+		}	\
+	}	\
+	/* The new pool replaces the old one only once its nodes have been allocated */	\
+	init_node_pool(&pool, sizeof(node(K,V)), tree->allocator);	\
+	if (sorted && count > 0 && !pool_add_chunk(&pool, count)) {	\
+		err = new_node_failed;	\
+		set_error_info(__FILE__, "build_from_sorted", __LINE__);	\
+		return err;	\
+	}	\
+	destroy_node_pool(&tree->pool);	\
+	tree->pool = pool;	\
+	tree->root = NULL;	\
+	tree->size = 0;	\
+	if (!sorted) {	\
+		for (size_t i = 0; i < n; ++i) {	\
+			if (insert_##K##_##V(tree, keys[i], values[i]) != success)	\
+				return err;	\
+		}	\
 		err = success;	\
 		return success;	\
 	}	\
-	/* basic delete does not delete the node in question when a child */	\
-	/* is returned. This is necessary for tree repair. */	\
-	/* For this reason, temp is freed after repair tree returns */	\
-	else {	\
-		repair_tree_delete((generic_node **) &tree->root, (generic_node *) child);	\
-		/* if the deleted node is root, then child replaces node as root */	\
-		if (temp == tree->root)	\
-			tree->root = child;	\
-		free(temp);	\
+	if (count == 0) {	\
+		err = success;	\
+		return success;	\
 	}	\
-	\
+	/* The chunk is used up here, so the next insert starts a chunk of its own */	\
+	base = tree->pool.next;	\
+	tree->pool.next = tree->pool.end;	\
+	for (size_t i = 0, j = 0; i < n; ++i) {	\
+		node(K,V) *node = NULL;	\
+		if (i + 1 < n && CMP(keys[i], keys[i + 1]) == 0)	\
+			continue;	\
+		node = (node(K,V) *) (base + (j++)*sizeof(node(K,V)));	\
+		node->key = keys[i];	\
+		node->value = values[i];	\
+	}	\
+	tree->root = (node(K,V) *) link_sorted_nodes(base, sizeof(node(K,V)), 0, count, 0,	\
+					sorted_red_depth(count), tree->sentinel, COUNTED);	\
+	set_parent((generic_node *) tree->root, NULL);	\
+	tree->size = count;	\
 	err = success;	\
 	return success;	\
 }	\
+	\
+/* A counted tree answers rank and select with one descent, using the subtree */	\
+/* counts to skip whole subtrees. Any other tree has to walk the nodes in order. */	\
+size_t rank_##K##_##V(rb_tree(K,V) *tree, K key) {	\
+	generic_node *temp = (generic_node *) tree->root;	\
+	size_t rank = 0;	\
+	if (temp == NULL)	\
+		return 0;	\
+	if (!COUNTED) {	\
+		for (node(K,V) *node = first_node_##K##_##V(tree); node != NULL && CMP(node->key, key) < 0;	\
+			node = next_node_##K##_##V(node))	\
+			++rank;	\
+		return rank;	\
+	}	\
+	while (temp != tree->sentinel) {	\
+		node(K,V) *ntemp = (node(K,V) *) temp;	\
+		if (CMP(key, ntemp->key) <= 0)	\
+			temp = temp->lchild;	\
+		else {	\
+			rank += node_count(temp->lchild) + 1;	\
+			temp = temp->rchild;	\
+		}	\
+	}	\
+	return rank;	\
+}	\
+	\
+static inline node(K,V) *select_node_##K##_##V(rb_tree(K,V) *tree, size_t index) {	\
+	generic_node *temp = (generic_node *) tree->root;	\
+	if (index >= tree->size)	\
+		return NULL;	\
+	if (!COUNTED) {	\
+		node(K,V) *node = first_node_##K##_##V(tree);	\
+		while (index-- > 0)	\
+			node = next_node_##K##_##V(node);	\
+		return node;	\
+	}	\
+	while (true) {	\
+		size_t left = node_count(temp->lchild);	\
+		if (index == left)	\
+			return (node(K,V) *) temp;	\
+		if (index < left)	\
+			temp = temp->lchild;	\
+		else {	\
+			index -= left + 1;	\
+			temp = temp->rchild;	\
+		}	\
+	}	\
+}	\
+	\
+K select_##K##_##V(rb_tree(K,V) *tree, size_t index) {	\
+	K key;	\
+	node(K,V) *node = select_node_##K##_##V(tree, index);	\
+	if (node != NULL)	\
+		return node->key;	\
+	memset(&key, 0, sizeof(K));	\
+	err = invalid_index;	\
+	set_error_info(__FILE__, "select", __LINE__);	\
+	return key;	\
+}	\
+	\
 void inorder_traverse_##K##_##V(rb_tree(K,V) *tree, node(K,V) *node)	{	\
 	generic_node *temp = (generic_node *) node;	\
 	/* No need to print sentinel */	\
-	if (temp->is_sentinel(temp))	\
+	if (is_sentinel(temp))	\
 		return;	\
 	inorder_traverse_##K##_##V(tree, (node(K,V) *) temp->lchild);	\
-	if (temp->parent != NULL) {	\
-		node(K,V) *parent = (node(K,V) *) temp->parent;	\
-		fprintf(stderr, "Node is the child of %d\n", parent->key);	\
+	if (node_parent(temp) != NULL) {	\
+		node(K,V) *parent = (node(K,V) *) node_parent(temp);	\
+		fprintf(stderr, "Node is the child of ");	\
+		PRINT_ELEMENT(parent->key);	\
+		fprintf(stderr, "\n");	\
 	}	\
 	else	\
 		fprintf(stderr, "Node is root\n");	\
 		\
-	fprintf(stderr, "Key: %d, Value: %c\n", node->key, node->value);	\
+	fprintf(stderr, "Key: "); PRINT_ELEMENT(node->key);	\
+	fprintf(stderr, ", Value: "); PRINT_ELEMENT(node->value); fprintf(stderr, "\n");	\
 	fprintf(stderr, "Color: "); PRINT_COLOR(temp); fprintf(stderr, "\n");	\
 	inorder_traverse_##K##_##V(tree, (node(K,V) *) temp->rchild);	\
 }	\
@@ -790,22 +1210,29 @@ void set_rbtree_ptr_##K##_##V(rb_tree(K,V) *tree) {	\
 	tree->last_key = &last_key_##K##_##V;	\
 	tree->next_key = &next_key_##K##_##V;	\
 	tree->first_key = &first_key_##K##_##V;	\
+	tree->build_from_sorted = &build_from_sorted_##K##_##V;	\
+	tree->rank = &rank_##K##_##V;	\
+	tree->select = &select_##K##_##V;	\
 }	\
 	\
-rb_tree(K,V) *new_rbtree_##K##_##V() {	\
+rb_tree(K,V) *new_rbtree_##K##_##V(const c_allocator *allocator) {	\
 	rb_tree(K,V) *tree = NULL;	\
 		\
-	tree = (rb_tree(K,V)*) calloc(1, sizeof(rb_tree(K,V)));	\
+	tree = (rb_tree(K,V)*) allocator_calloc(allocator, sizeof(rb_tree(K,V)));	\
 		\
 	if (tree == NULL) {	\
 		return NULL;	\
 	}	\
+	tree->allocator = allocator;	\
+	init_node_pool(&tree->pool, sizeof(node(K,V)), allocator);	\
 	set_rbtree_ptr_##K##_##V(tree);	\
 	return tree;	\
 }	\
 
 #define node(K,V)	node_##K##_##V
 #define rb_tree(K,V)	rb_tree_##K##_##V
-#define new_rbtree(K,V)	new_rbtree_##K##_##V()
-#define new_node(K,V)	new_node_##K##_##V()
+#define new_rbtree(K,V)	new_rbtree_##K##_##V(&default_allocator)
+/* Same as new_rbtree, except that the tree and its nodes come from ALLOCATOR */
+#define new_rbtree_with(K,V, ALLOCATOR)	new_rbtree_##K##_##V(ALLOCATOR)
+#define new_node(K,V)	new_node_##K##_##V(&default_allocator)
 #endif
@@ -0,0 +1,274 @@
+#ifndef RING_H
+#define RING_H
+#ifndef __cplusplus
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdbool.h>
+#else
+#include <cstdlib>
+#include <cstddef>
+#include <cstring>
+#endif
+#include "c_vector.h"
+#include "error.h"
+#include "allocator.h"
+
+/* c_ring is a FIFO queue in a circular buffer. Elements are pushed at the back
+ * and popped from the front in O(1), with no shifting, so it can sit between two
+ * pipeline stages in place of a c_vector that has to be drained by hand.
+ *
+ * head and tail count every element ever popped and pushed. They are never wrapped,
+ * so tail - head is the length, and an element's slot is its count masked by the
+ * capacity, which is always a power of two.
+ *
+ * A ring made with new_c_ring grows when it is full, the same way a c_vector does:
+ * the buffer comes from the ring's allocator and the new size from next_capacity
+ * and the ring's vector_policy, rounded up to a power of two. Growing never has to
+ * unwrap the whole buffer. The buffer is reallocated and the part that had wrapped
+ * around to the start is copied to just past the old end.
+ *
+ * A ring made with new_c_ring_spsc has a fixed capacity, and one producer thread
+ * and one consumer thread can use it at the same time without a lock. Only the
+ * producer writes tail and only the consumer writes head, and each publishes its
+ * index with a release store. The two indices are padded onto cache lines of their
+ * own, so the threads don't fight over a line that only one of them writes. Each
+ * side also keeps its own copy of the other's index, and only loads the real one
+ * when the copy says the ring is full or empty. A push to a full SPSC ring fails
+ * with queue_full instead of growing.
+ */
+
+#define RING_CACHE_LINE	64
+
+/* define_ring(DATA)
+ * INPUT: DATA -> data type of the ring
+ * OUTPUT: None
+ * USAGE: define_vector(int) define_ring(int)
+ *
+ * error_code push_back_ring_##DATA(c_ring_##DATA *ring, DATA value)
+ * OUTPUT: success, realloc_failed if the ring couldn't grow, or queue_full for a
+ * full SPSC ring
+ * USAGE: ring->ops->push_back(ring, value); or c_ring_push(int, ring, value);
+ *
+ * error_code pop_front_ring_##DATA(c_ring_##DATA *ring, DATA *value)
+ * OUTPUT: success with the oldest element in *value, or queue_empty
+ * USAGE: while (c_ring_pop(int, ring, &value) == success)
+ *
+ * size_t enqueue_ring_##DATA(c_ring_##DATA *ring, const DATA *values, size_t count)
+ * OUTPUT: how many of the values were pushed. A growable ring pushes them all
+ * unless it runs out of memory. An SPSC ring pushes as many as fit.
+ * USAGE: size_t pushed = ring->ops->enqueue(ring, batch, 64);
+ * NOTES: The span is copied in at most two memcpys and published with one store.
+ *
+ * size_t dequeue_ring_##DATA(c_ring_##DATA *ring, DATA *values, size_t count)
+ * OUTPUT: how many elements were popped into values, at most count
+ *
+ * size_t length_ring_##DATA(c_ring_##DATA *ring)
+ * NOTES: In an SPSC ring the other thread may change the length at any moment.
+ */
+#define define_ring(DATA)	\
+	typedef struct c_ring_##DATA {	\
+		char pad_front[RING_CACHE_LINE];	\
+		/* Written by the consumer */	\
+		size_t head;	\
+		size_t cached_tail;	\
+		char pad_head[RING_CACHE_LINE - 2*sizeof(size_t)];	\
+		/* Written by the producer */	\
+		size_t tail;	\
+		size_t cached_head;	\
+		char pad_tail[RING_CACHE_LINE - 2*sizeof(size_t)];	\
+		DATA *data;	\
+		size_t capacity;	\
+		size_t mask;	\
+		bool spsc;	\
+		vector_policy *policy;	\
+		const struct c_ring_ops_##DATA *ops;	\
+		const c_allocator *allocator;	\
+	} c_ring_##DATA;	\
+		\
+	typedef struct c_ring_ops_##DATA {	\
+		struct c_ring_##DATA *(*destroy_ring)(struct c_ring_##DATA*);	\
+		error_code (*push_back)(struct c_ring_##DATA*, DATA);	\
+		error_code (*pop_front)(struct c_ring_##DATA*, DATA*);	\
+		size_t (*enqueue)(struct c_ring_##DATA*, const DATA*, size_t);	\
+		size_t (*dequeue)(struct c_ring_##DATA*, DATA*, size_t);	\
+		size_t (*length)(struct c_ring_##DATA*);	\
+	} c_ring_ops_##DATA;	\
+		\
+	/* Makes room for at least needed elements. Only for rings that aren't SPSC */	\
+	static error_code grow_ring_##DATA(c_ring_##DATA *ring, size_t needed, const char *functname) {	\
+		size_t length = ring->tail - ring->head;	\
+		size_t start = ring->head & ring->mask;	\
+		size_t elements = next_capacity(ring->policy, ring->capacity*sizeof(DATA), needed*sizeof(DATA), sizeof(DATA)) / sizeof(DATA);	\
+		size_t capacity = ring->capacity;	\
+		DATA *temp = NULL;	\
+		while (capacity < elements)	\
+			capacity *= 2;	\
+		temp = (DATA *) ring->allocator->reallocate(ring->allocator->context, (void *) ring->data,	\
+				ring->capacity*sizeof(DATA), capacity*sizeof(DATA));	\
+		if (temp == NULL) {	\
+			err = realloc_failed;	\
+			set_error_info(__FILE__, functname, __LINE__);	\
+			return err;	\
+		}	\
+		add_growth_stat(&ring->policy->stats.grow_count, 1);	\
+		add_growth_stat(&ring->policy->stats.bytes_reserved, (capacity - ring->capacity)*sizeof(DATA));	\
+		if (temp != ring->data)	\
+			add_growth_stat(&ring->policy->stats.bytes_moved, ring->capacity*sizeof(DATA));	\
+		/* The elements that wrapped around to the start go after the old end instead */	\
+		if (start + length > ring->capacity)	\
+			memcpy((void *) &temp[ring->capacity], (const void *) temp, (start + length - ring->capacity)*sizeof(DATA));	\
+		ring->data = temp;	\
+		ring->capacity = capacity;	\
+		ring->mask = capacity - 1;	\
+		ring->head = ring->cached_head = start;	\
+		ring->tail = ring->cached_tail = start + length;	\
+		return success;	\
+	}	\
+		\
+	/* Room left for the producer. Only loads head when the cached copy says there isn't enough */	\
+	static inline size_t ring_space_##DATA(c_ring_##DATA *ring, size_t tail, size_t wanted) {	\
+		size_t space = ring->capacity - (tail - ring->cached_head);	\
+		if (space < wanted) {	\
+			ring->cached_head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);	\
+			space = ring->capacity - (tail - ring->cached_head);	\
+		}	\
+		return space;	\
+	}	\
+		\
+	/* Elements ready for the consumer. Only loads tail when the cached copy says there aren't enough */	\
+	static inline size_t ring_ready_##DATA(c_ring_##DATA *ring, size_t head, size_t wanted) {	\
+		size_t ready = ring->cached_tail - head;	\
+		if (ready < wanted) {	\
+			ring->cached_tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);	\
+			ready = ring->cached_tail - head;	\
+		}	\
+		return ready;	\
+	}	\
+		\
+	error_code push_back_ring_##DATA(c_ring_##DATA *ring, DATA value) {	\
+		size_t tail = ring->tail;	\
+		if (ring_space_##DATA(ring, tail, 1) == 0) {	\
+			if (ring->spsc) {	\
+				err = queue_full;	\
+				set_error_info(__FILE__, "push_back", __LINE__);	\
+				return err;	\
+			}	\
+			if (grow_ring_##DATA(ring, ring->capacity + 1, "push_back") != success)	\
+				return err;	\
+			tail = ring->tail;	\
+		}	\
+		ring->data[tail & ring->mask] = value;	\
+		__atomic_store_n(&ring->tail, tail + 1, __ATOMIC_RELEASE);	\
+		return success;	\
+	}	\
+		\
+	error_code pop_front_ring_##DATA(c_ring_##DATA *ring, DATA *value) {	\
+		size_t head = ring->head;	\
+		if (ring_ready_##DATA(ring, head, 1) == 0) {	\
+			err = queue_empty;	\
+			set_error_info(__FILE__, "pop_front", __LINE__);	\
+			return err;	\
+		}	\
+		*value = ring->data[head & ring->mask];	\
+		__atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);	\
+		return success;	\
+	}	\
+		\
+	size_t enqueue_ring_##DATA(c_ring_##DATA *ring, const DATA *values, size_t count) {	\
+		size_t tail = ring->tail;	\
+		size_t space = ring_space_##DATA(ring, tail, count);	\
+		size_t start = 0, first = 0;	\
+		if (space < count && !ring->spsc &&	\
+			grow_ring_##DATA(ring, (tail - ring->head) + count, "enqueue") == success) {	\
+			tail = ring->tail;	\
+			space = ring_space_##DATA(ring, tail, count);	\
+		}	\
+		if (count > space)	\
+			count = space;	\
+		start = tail & ring->mask;	\
+		first = (count < ring->capacity - start) ? count : ring->capacity - start;	\
+		memcpy((void *) &ring->data[start], (const void *) values, first*sizeof(DATA));	\
+		memcpy((void *) ring->data, (const void *) &values[first], (count - first)*sizeof(DATA));	\
+		__atomic_store_n(&ring->tail, tail + count, __ATOMIC_RELEASE);	\
+		return count;	\
+	}	\
+		\
+	size_t dequeue_ring_##DATA(c_ring_##DATA *ring, DATA *values, size_t count) {	\
+		size_t head = ring->head;	\
+		size_t ready = ring_ready_##DATA(ring, head, count);	\
+		size_t start = head & ring->mask, first = 0;	\
+		if (count > ready)	\
+			count = ready;	\
+		first = (count < ring->capacity - start) ? count : ring->capacity - start;	\
+		memcpy((void *) values, (const void *) &ring->data[start], first*sizeof(DATA));	\
+		memcpy((void *) &values[first], (const void *) ring->data, (count - first)*sizeof(DATA));	\
+		__atomic_store_n(&ring->head, head + count, __ATOMIC_RELEASE);	\
+		return count;	\
+	}	\
+		\
+	size_t length_ring_##DATA(c_ring_##DATA *ring) {	\
+		size_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);	\
+		return __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) - head;	\
+	}	\
+		\
+	c_ring_##DATA *destroy_ring_##DATA(c_ring_##DATA *ring) {	\
+		if (ring == NULL) {	\
+			return NULL;	\
+		}	\
+		allocator_free(ring->allocator, ring->data);	\
+		allocator_free(ring->allocator, ring);	\
+		return NULL;	\
+	}	\
+		\
+	static const c_ring_ops_##DATA ring_ops_##DATA = {	\
+		&destroy_ring_##DATA,	\
+		&push_back_ring_##DATA,	\
+		&pop_front_ring_##DATA,	\
+		&enqueue_ring_##DATA,	\
+		&dequeue_ring_##DATA,	\
+		&length_ring_##DATA	\
+	};	\
+		\
+	/* number is rounded up to a power of two, and is at least 2 like new_c_vector */	\
+	c_ring_##DATA *new_ring_##DATA(size_t number, bool spsc, const c_allocator *allocator) {	\
+		c_ring_##DATA *ring = NULL;	\
+		size_t capacity = 2;	\
+			\
+		ring = (c_ring_##DATA *) allocator_calloc(allocator, sizeof(c_ring_##DATA));	\
+			\
+		if (ring == NULL) {	\
+			return NULL;	\
+		}	\
+			\
+		while (capacity < number)	\
+			capacity *= 2;	\
+		ring->data = (DATA *) allocator->allocate(allocator->context, capacity*sizeof(DATA));	\
+			\
+		if (ring->data == NULL) {	\
+			allocator_free(allocator, ring);	\
+			return NULL;	\
+		}	\
+			\
+		ring->capacity = capacity;	\
+		ring->mask = capacity - 1;	\
+		ring->spsc = spsc;	\
+		ring->policy = &default_vector_policy;	\
+		ring->ops = &ring_ops_##DATA;	\
+		ring->allocator = allocator;	\
+		return ring;	\
+	}	\
+
+#define c_ring(DATA)	c_ring_##DATA
+#define new_c_ring(DATA, NUMBER)	new_ring_##DATA((size_t) NUMBER, false, &default_allocator)
+#define new_c_ring_with(DATA, NUMBER, ALLOCATOR)	new_ring_##DATA((size_t) NUMBER, false, ALLOCATOR)
+/* An SPSC ring holds NUMBER elements, rounded up to a power of two, and never grows */
+#define new_c_ring_spsc(DATA, NUMBER)	new_ring_##DATA((size_t) NUMBER, true, &default_allocator)
+#define new_c_ring_spsc_with(DATA, NUMBER, ALLOCATOR)	new_ring_##DATA((size_t) NUMBER, true, ALLOCATOR)
+#define c_ring_push(DATA, RING, VALUE)	push_back_ring_##DATA(RING, VALUE)
+#define c_ring_pop(DATA, RING, VALUE)	pop_front_ring_##DATA(RING, VALUE)
+#define c_ring_length(DATA, RING)	length_ring_##DATA(RING)
+/* The policy must outlive the ring. NULL goes back to default_vector_policy */
+#define c_ring_set_policy(DATA, RING, POLICY)	((RING)->policy = ((POLICY) != NULL) ? (POLICY) : &default_vector_policy)
+
+#endif
@@ -0,0 +1,279 @@
+#ifndef SOA_VECTOR_H
+#define SOA_VECTOR_H
+#ifndef __cplusplus
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdbool.h>
+#else
+#include <cstdlib>
+#include <cstddef>
+#include <cstring>
+#endif
+#include "c_vector.h"
+#include "error.h"
+#include "allocator.h"
+
+/* A soa vector stores a record type column by column. Every field gets an array of
+ * its own and the arrays grow together, so a row is the same index in each of them.
+ * A loop that only reads one field walks one dense array instead of striding over
+ * whole records, which uses every byte of every cache line it loads and lets the
+ * compiler vectorize it.
+ *
+ * The columns are plain pointers named after the fields, so they can be handed
+ * straight to such loops:
+ *
+ *	define_soa_vector(particle, (float, x), (float, y), (int, id))
+ *	soa_vector(particle) *particles = new_soa_vector(particle, 0);
+ *	soa_vector_push(particle, particles, ((soa_row(particle)) { 1.0f, 2.0f, 7 }));
+ *	for (size_t i = 0; i < particles->length; ++i)
+ *		sum += particles->x[i];
+ *
+ * Growth goes through the vector's vector_policy, the same as a c_vector. The
+ * policy sees the vector as an array of rows, each the size of all its fields put
+ * together, and every column is reallocated to the capacity it picks.
+ *
+ * A soa vector can have up to SOA_MAX_FIELDS fields.
+ */
+
+#define SOA_MAX_FIELDS	8
+
+/* Applying a macro to every (TYPE, FIELD) pair of a soa vector */
+#define SOA_EXPAND(...)	__VA_ARGS__
+#define SOA_CAT(A, B)	SOA_CAT_(A, B)
+#define SOA_CAT_(A, B)	A##B
+#define SOA_COUNT(...)	SOA_COUNT_(__VA_ARGS__, 8, 7, 6, 5, 4, 3, 2, 1)
+#define SOA_COUNT_(_1, _2, _3, _4, _5, _6, _7, _8, N, ...)	N
+#define SOA_CALL(M, NAME, FIELD)	SOA_CALL_(M, NAME, SOA_EXPAND FIELD)
+#define SOA_CALL_(M, NAME, ...)	SOA_CALL__(M, NAME, __VA_ARGS__)
+#define SOA_CALL__(M, NAME, TYPE, FIELD)	M(NAME, TYPE, FIELD)
+#define SOA_FOR_EACH(M, NAME, ...)	SOA_CAT(SOA_FOR_EACH_, SOA_COUNT(__VA_ARGS__))(M, NAME, __VA_ARGS__)
+#define SOA_FOR_EACH_1(M, NAME, F)	SOA_CALL(M, NAME, F)
+#define SOA_FOR_EACH_2(M, NAME, F, ...)	SOA_CALL(M, NAME, F) SOA_FOR_EACH_1(M, NAME, __VA_ARGS__)
+#define SOA_FOR_EACH_3(M, NAME, F, ...)	SOA_CALL(M, NAME, F) SOA_FOR_EACH_2(M, NAME, __VA_ARGS__)
+#define SOA_FOR_EACH_4(M, NAME, F, ...)	SOA_CALL(M, NAME, F) SOA_FOR_EACH_3(M, NAME, __VA_ARGS__)
+#define SOA_FOR_EACH_5(M, NAME, F, ...)	SOA_CALL(M, NAME, F) SOA_FOR_EACH_4(M, NAME, __VA_ARGS__)
+#define SOA_FOR_EACH_6(M, NAME, F, ...)	SOA_CALL(M, NAME, F) SOA_FOR_EACH_5(M, NAME, __VA_ARGS__)
+#define SOA_FOR_EACH_7(M, NAME, F, ...)	SOA_CALL(M, NAME, F) SOA_FOR_EACH_6(M, NAME, __VA_ARGS__)
+#define SOA_FOR_EACH_8(M, NAME, F, ...)	SOA_CALL(M, NAME, F) SOA_FOR_EACH_7(M, NAME, __VA_ARGS__)
+
+/* The pieces define_soa_vector generates for each field */
+#define SOA_ROW_FIELD(NAME, TYPE, FIELD)	TYPE FIELD;
+#define SOA_COLUMN_FIELD(NAME, TYPE, FIELD)	TYPE *FIELD;
+#define SOA_ROW_BYTES(NAME, TYPE, FIELD)	+ sizeof(TYPE)
+#define SOA_STORE_ROW(NAME, TYPE, FIELD)	soa->FIELD[index] = row.FIELD;
+#define SOA_LOAD_ROW(NAME, TYPE, FIELD)	row.FIELD = soa->FIELD[index];
+#define SOA_FREE_COLUMN(NAME, TYPE, FIELD)	allocator_free(soa->allocator, soa->FIELD);
+#define SOA_ALLOCATE_COLUMN(NAME, TYPE, FIELD)	\
+	if (allocated && (soa->FIELD = (TYPE *) allocator->allocate(allocator->context, capacity*sizeof(TYPE))) == NULL)	\
+		allocated = false;
+/* A column that grew before a later one failed keeps its new size. Only capacity rows count */
+#define SOA_GROW_COLUMN(NAME, TYPE, FIELD)	\
+	if (grown) {	\
+		TYPE *temp = (TYPE *) soa->allocator->reallocate(soa->allocator->context, (void *) soa->FIELD,	\
+				soa->capacity*sizeof(TYPE), capacity*sizeof(TYPE));	\
+		if (temp == NULL)	\
+			grown = false;	\
+		else {	\
+			if (temp != soa->FIELD)	\
+				add_growth_stat(&policy->stats.bytes_moved, soa->capacity*sizeof(TYPE));	\
+			if (policy->zero_on_grow)	\
+				memset((void *) &temp[soa->capacity], 0, (capacity - soa->capacity)*sizeof(TYPE));	\
+			soa->FIELD = temp;	\
+		}	\
+	}
+
+/* define_soa_vector(NAME, (TYPE, FIELD), ...)
+ * INPUT: NAME -> name for the record type, then one (TYPE, FIELD) pair per field
+ * OUTPUT: None
+ * USAGE: define_soa_vector(particle, (float, x), (float, y), (int, id))
+ * NOTES: Generates soa_##NAME##_row, a struct with one member per field, and
+ * soa_##NAME, a vector with one column pointer per field plus length and capacity.
+ * Columns may be read and written directly for any index below length.
+ *
+ * error_code push_soa_##NAME(soa_##NAME *soa, soa_##NAME##_row row)
+ * OUTPUT: success, or realloc_failed if the columns couldn't grow
+ * USAGE: soa->ops->push(soa, row); or soa_vector_push(particle, soa, row);
+ *
+ * soa_##NAME##_row get_soa_##NAME(soa_##NAME *soa, size_t index)
+ * OUTPUT: the fields of the row gathered into a struct. An index past the end sets
+ * err to invalid_index and returns a zeroed row.
+ *
+ * error_code set_soa_##NAME(soa_##NAME *soa, size_t index, soa_##NAME##_row row)
+ * OUTPUT: success, or invalid_index if index is past the end
+ *
+ * error_code remove_top_soa_##NAME(soa_##NAME *soa)
+ * OUTPUT: success, or invalid_index if the vector is empty
+ *
+ * error_code reserve_soa_##NAME(soa_##NAME *soa, size_t rows)
+ * OUTPUT: success, or realloc_failed
+ * NOTES: Makes room for at least rows rows, so that many pushes won't reallocate.
+ */
+#define define_soa_vector(NAME, ...)	\
+	typedef struct soa_##NAME##_row {	\
+		SOA_FOR_EACH(SOA_ROW_FIELD, NAME, __VA_ARGS__)	\
+	} soa_##NAME##_row;	\
+		\
+	typedef struct soa_##NAME {	\
+		SOA_FOR_EACH(SOA_COLUMN_FIELD, NAME, __VA_ARGS__)	\
+		size_t length;	\
+		size_t capacity;	\
+		vector_policy *policy;	\
+		const struct soa_##NAME##_ops *ops;	\
+		const c_allocator *allocator;	\
+	} soa_##NAME;	\
+		\
+	typedef struct soa_##NAME##_ops {	\
+		struct soa_##NAME *(*destroy_vector)(struct soa_##NAME*);	\
+		error_code (*push)(struct soa_##NAME*, soa_##NAME##_row);	\
+		soa_##NAME##_row (*get)(struct soa_##NAME*, size_t);	\
+		error_code (*set)(struct soa_##NAME*, size_t, soa_##NAME##_row);	\
+		error_code (*remove_top)(struct soa_##NAME*);	\
+		error_code (*reserve)(struct soa_##NAME*, size_t);	\
+		size_t (*length)(struct soa_##NAME*);	\
+	} soa_##NAME##_ops;	\
+		\
+	/* Bytes in one row across all the columns */	\
+	static const size_t soa_row_bytes_##NAME = 0 SOA_FOR_EACH(SOA_ROW_BYTES, NAME, __VA_ARGS__);	\
+		\
+	static error_code grow_soa_##NAME(soa_##NAME *soa, size_t rows, const char *functname) {	\
+		vector_policy *policy = soa->policy;	\
+		size_t capacity = next_capacity(policy, soa->capacity*soa_row_bytes_##NAME,	\
+				rows*soa_row_bytes_##NAME, soa_row_bytes_##NAME) / soa_row_bytes_##NAME;	\
+		bool grown = true;	\
+		SOA_FOR_EACH(SOA_GROW_COLUMN, NAME, __VA_ARGS__)	\
+		if (!grown) {	\
+			err = realloc_failed;	\
+			set_error_info(__FILE__, functname, __LINE__);	\
+			return err;	\
+		}	\
+		add_growth_stat(&policy->stats.grow_count, 1);	\
+		add_growth_stat(&policy->stats.bytes_reserved, (capacity - soa->capacity)*soa_row_bytes_##NAME);	\
+		if (policy->zero_on_grow)	\
+			add_growth_stat(&policy->stats.bytes_zeroed, (capacity - soa->capacity)*soa_row_bytes_##NAME);	\
+		soa->capacity = capacity;	\
+		return success;	\
+	}	\
+		\
+	error_code push_soa_##NAME(soa_##NAME *soa, soa_##NAME##_row row) {	\
+		size_t index = soa->length;	\
+		if (index == soa->capacity && grow_soa_##NAME(soa, index + 1, "push") != success)	\
+			return err;	\
+		SOA_FOR_EACH(SOA_STORE_ROW, NAME, __VA_ARGS__)	\
+		++soa->length;	\
+		err = success;	\
+		return success;	\
+	}	\
+		\
+	/* The common case of pushing into spare capacity, without going through ops */	\
+	static inline error_code push_inline_soa_##NAME(soa_##NAME *soa, soa_##NAME##_row row) {	\
+		size_t index = soa->length;	\
+		if (index == soa->capacity)	\
+			return push_soa_##NAME(soa, row);	\
+		SOA_FOR_EACH(SOA_STORE_ROW, NAME, __VA_ARGS__)	\
+		++soa->length;	\
+		return success;	\
+	}	\
+		\
+	soa_##NAME##_row get_soa_##NAME(soa_##NAME *soa, size_t index) {	\
+		soa_##NAME##_row row;	\
+		if (index >= soa->length) {	\
+			memset((void *) &row, 0, sizeof(row));	\
+			err = invalid_index;	\
+			set_error_info(__FILE__, "get", __LINE__);	\
+			return row;	\
+		}	\
+		SOA_FOR_EACH(SOA_LOAD_ROW, NAME, __VA_ARGS__)	\
+		return row;	\
+	}	\
+		\
+	error_code set_soa_##NAME(soa_##NAME *soa, size_t index, soa_##NAME##_row row) {	\
+		if (index >= soa->length) {	\
+			err = invalid_index;	\
+			set_error_info(__FILE__, "set", __LINE__);	\
+			return err;	\
+		}	\
+		SOA_FOR_EACH(SOA_STORE_ROW, NAME, __VA_ARGS__)	\
+		err = success;	\
+		return success;	\
+	}	\
+		\
+	error_code remove_top_soa_##NAME(soa_##NAME *soa) {	\
+		if (soa->length == 0) {	\
+			err = invalid_index;	\
+			set_error_info(__FILE__, "remove_top", __LINE__);	\
+			return err;	\
+		}	\
+		--soa->length;	\
+		err = success;	\
+		return success;	\
+	}	\
+		\
+	error_code reserve_soa_##NAME(soa_##NAME *soa, size_t rows) {	\
+		if (rows > soa->capacity && grow_soa_##NAME(soa, rows, "reserve") != success)	\
+			return err;	\
+		err = success;	\
+		return success;	\
+	}	\
+		\
+	size_t length_soa_##NAME(soa_##NAME *soa) {	\
+		return soa->length;	\
+	}	\
+		\
+	soa_##NAME *destroy_soa_##NAME(soa_##NAME *soa) {	\
+		if (soa == NULL) {	\
+			return NULL;	\
+		}	\
+		SOA_FOR_EACH(SOA_FREE_COLUMN, NAME, __VA_ARGS__)	\
+		allocator_free(soa->allocator, soa);	\
+		return NULL;	\
+	}	\
+		\
+	static const soa_##NAME##_ops soa_ops_##NAME = {	\
+		&destroy_soa_##NAME,	\
+		&push_soa_##NAME,	\
+		&get_soa_##NAME,	\
+		&set_soa_##NAME,	\
+		&remove_top_soa_##NAME,	\
+		&reserve_soa_##NAME,	\
+		&length_soa_##NAME	\
+	};	\
+		\
+	/* Like new_c_vector, there is always room for at least two rows */	\
+	soa_##NAME *new_soa_##NAME(size_t number, const c_allocator *allocator) {	\
+		soa_##NAME *soa = NULL;	\
+		size_t capacity = (number < 2) ? 2 : number;	\
+		bool allocated = true;	\
+			\
+		soa = (soa_##NAME *) allocator_calloc(allocator, sizeof(soa_##NAME));	\
+			\
+		if (soa == NULL) {	\
+			return NULL;	\
+		}	\
+			\
+		soa->allocator = allocator;	\
+		SOA_FOR_EACH(SOA_ALLOCATE_COLUMN, NAME, __VA_ARGS__)	\
+		if (!allocated) {	\
+			return destroy_soa_##NAME(soa);	\
+		}	\
+			\
+		soa->capacity = capacity;	\
+		soa->policy = &default_vector_policy;	\
+		soa->ops = &soa_ops_##NAME;	\
+		return soa;	\
+	}	\
+
+#define soa_vector(NAME)	soa_##NAME
+#define soa_row(NAME)	soa_##NAME##_row
+#define new_soa_vector(NAME, NUMBER)	new_soa_##NAME((size_t) NUMBER, &default_allocator)
+#define new_soa_vector_with(NAME, NUMBER, ALLOCATOR)	new_soa_##NAME((size_t) NUMBER, ALLOCATOR)
+#define soa_vector_push(NAME, VECTOR, ROW)	push_inline_soa_##NAME(VECTOR, ROW)
+#define soa_vector_get(NAME, VECTOR, INDEX)	get_soa_##NAME(VECTOR, (size_t) INDEX)
+#define soa_vector_set(NAME, VECTOR, INDEX, ROW)	set_soa_##NAME(VECTOR, (size_t) INDEX, ROW)
+#define soa_vector_length(NAME, VECTOR)	((VECTOR)->length)
+/* The array holding FIELD for every row. It moves when the vector grows */
+#define soa_vector_column(VECTOR, FIELD)	((VECTOR)->FIELD)
+/* The policy must outlive the vector. NULL goes back to default_vector_policy */
+#define soa_vector_set_policy(NAME, VECTOR, POLICY)	((VECTOR)->policy = ((POLICY) != NULL) ? (POLICY) : &default_vector_policy)
+
+#endif
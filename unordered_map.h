@@ -0,0 +1,367 @@
+#ifndef UNORDERED_MAP_H
+#define UNORDERED_MAP_H
+#ifndef __cplusplus
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#else
+#include <cstdlib>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#endif
+#include "hash.h"
+#include "compare.h"
+#include "iterator.h"
+#include "error.h"
+#include "allocator.h"
+
+/* c_unordered_map is the unordered scheme that c_map was written to leave room for.
+ * It has the same insert, delete_pair, get_value and is_key as c_map, but keeps
+ * no order, so a lookup is a hash and a short probe instead of a walk down a tree.
+ *
+ * The table is open addressed with robin hood probing. Each slot holds the key,
+ * the value, and the slot's distance from the one its key hashes to, so there is
+ * no separate array of metadata to touch. A key goes in the first slot whose
+ * occupant is closer to home than it would be, and the occupant moves on instead.
+ * That keeps every key near its home slot, and lets a search stop as soon as it
+ * reaches a slot that is closer to home than the key would be. Deletes shift the
+ * keys after the slot back by one, so there are never any tombstones.
+ *
+ * The table is a power of two in size and doubles once it is three quarters full.
+ * At that load a search looks at one or two neighboring slots on average, so a hit
+ * or a miss usually costs the single cache miss for the key's home slot.
+ */
+
+/* Number of slots a table starts with once something is inserted */
+#define UNORDERED_MAP_MIN_CAPACITY	8
+
+/* The table grows rather than let count go past three quarters of capacity */
+static inline bool unordered_map_too_full(size_t count, size_t capacity) {
+	return 4*count > 3*capacity;
+}
+
+/* define_unordered_map_hash(K, V, HASH, CMP)
+ * INPUT: K -> key data type, V -> value data type, HASH -> hash for K, CMP ->
+ * comparator for K
+ * OUTPUT: None
+ * USAGE: define_unordered_map_hash(string, int, hash_ptr, compare_ptr)
+ * NOTES: HASH is called as HASH(a) on a key and returns a uint64_t, and CMP is only
+ * used to ask whether two keys are equal. Keys that CMP calls equal must hash the
+ * same. See hash.h and compare.h. define_unordered_map(K, V) uses default_hash
+ * and default_compare.
+ *
+ * error_code insert_unordered_map_##K##_##V(c_unordered_map(K,V) *map, K key, V value)
+ * INPUT: map -> the map, key -> key to insert, value -> value for the key
+ * OUTPUT: success, or realloc_failed if the table needed to grow and couldn't
+ * USAGE: map->insert(map, key, value);
+ * NOTES: If the key is already in the map, its value is replaced. Expected O(1).
+ *
+ * error_code delete_pair_unordered_map_##K##_##V(c_unordered_map(K,V) *map, K key)
+ * V get_value_unordered_map_##K##_##V(c_unordered_map(K,V) *map, K key)
+ * bool is_key_unordered_map_##K##_##V(c_unordered_map(K,V) *map, K key)
+ * INPUT: map -> the map, key -> key to find
+ * OUTPUT: delete_pair gives success, and get_value the value. Both set err to
+ * key_not_found if the key isn't in the map, and get_value then returns a zeroed V.
+ * USAGE: if (map->is_key(map, key)) value = map->get_value(map, key);
+ *
+ * error_code reserve_unordered_map_##K##_##V(c_unordered_map(K,V) *map, size_t count)
+ * INPUT: map -> the map, count -> number of keys the map should hold
+ * OUTPUT: success, or realloc_failed
+ * USAGE: map->reserve(map, n);
+ * NOTES: Grows the table once up front, so that inserting count keys never rehashes.
+ */
+#define define_unordered_map(K, V)	define_unordered_map_hash(K, V, default_hash, default_compare)
+
+#define define_unordered_map_hash(K, V, HASH, CMP)	\
+	/* distance is 0 for an empty slot, and otherwise one more than the number */	\
+	/* of slots between the key and its home slot */	\
+	typedef struct unordered_slot_##K##_##V {	\
+		uint32_t distance;	\
+		K key;	\
+		V value;	\
+	} unordered_slot_##K##_##V;	\
+		\
+	typedef struct c_unordered_map_##K##_##V {	\
+		unordered_slot_##K##_##V *slots;	\
+		size_t capacity;	\
+		size_t mask;	\
+		size_t count;	\
+		const c_allocator *allocator;	\
+		struct c_unordered_map_##K##_##V *(*destroy_map)(struct c_unordered_map_##K##_##V*);	\
+		error_code (*insert)(struct c_unordered_map_##K##_##V*, K, V);	\
+		error_code (*delete_pair)(struct c_unordered_map_##K##_##V*, K);	\
+		V (*get_value)(struct c_unordered_map_##K##_##V*, K);	\
+		bool (*is_key)(struct c_unordered_map_##K##_##V*, K);	\
+		size_t (*size)(struct c_unordered_map_##K##_##V*);	\
+		error_code (*reserve)(struct c_unordered_map_##K##_##V*, size_t);	\
+	} c_unordered_map_##K##_##V;	\
+		\
+	/* Index of the slot holding key, or capacity if it isn't in the map */	\
+	static inline size_t find_slot_##K##_##V(const c_unordered_map(K,V) *map, K key) {	\
+		size_t index = 0;	\
+		uint32_t distance = 1;	\
+		if (map->count == 0)	\
+			return map->capacity;	\
+		index = (size_t) HASH(key) & map->mask;	\
+		while (true) {	\
+			const unordered_slot_##K##_##V *slot = &map->slots[index];	\
+			/* key would have taken this slot from anything closer to home */	\
+			if (slot->distance < distance)	\
+				return map->capacity;	\
+			if (slot->distance == distance && CMP(slot->key, key) == 0)	\
+				return index;	\
+			index = (index + 1) & map->mask;	\
+			++distance;	\
+		}	\
+	}	\
+		\
+	/* Puts a key that isn't in the table yet into it. There has to be a free slot */	\
+	static inline void place_slot_##K##_##V(c_unordered_map(K,V) *map, K key, V value) {	\
+		unordered_slot_##K##_##V entry, temp;	\
+		size_t index = (size_t) HASH(key) & map->mask;	\
+		entry.distance = 1;	\
+		entry.key = key;	\
+		entry.value = value;	\
+		while (true) {	\
+			unordered_slot_##K##_##V *slot = &map->slots[index];	\
+			if (slot->distance == 0) {	\
+				*slot = entry;	\
+				return;	\
+			}	\
+			/* Take from the rich. The displaced key carries on looking */	\
+			if (slot->distance < entry.distance) {	\
+				temp = *slot;	\
+				*slot = entry;	\
+				entry = temp;	\
+			}	\
+			index = (index + 1) & map->mask;	\
+			++entry.distance;	\
+		}	\
+	}	\
+		\
+	/* Moves every key into a new table of capacity slots */	\
+	static error_code rehash_unordered_map_##K##_##V(c_unordered_map(K,V) *map, size_t capacity, const char *functname) {	\
+		unordered_slot_##K##_##V *old = map->slots;	\
+		size_t old_capacity = map->capacity;	\
+		unordered_slot_##K##_##V *slots = (unordered_slot_##K##_##V *)	\
+			allocator_calloc(map->allocator, capacity*sizeof(unordered_slot_##K##_##V));	\
+		if (slots == NULL) {	\
+			err = realloc_failed;	\
+			set_error_info(__FILE__, functname, __LINE__);	\
+			return err;	\
+		}	\
+		map->slots = slots;	\
+		map->capacity = capacity;	\
+		map->mask = capacity - 1;	\
+		for (size_t i = 0; i < old_capacity; ++i) {	\
+			if (old[i].distance != 0)	\
+				place_slot_##K##_##V(map, old[i].key, old[i].value);	\
+		}	\
+		allocator_free(map->allocator, old);	\
+		return success;	\
+	}	\
+		\
+	static inline error_code grow_unordered_map_##K##_##V(c_unordered_map(K,V) *map, size_t count, const char *functname) {	\
+		size_t capacity = (map->capacity == 0) ? UNORDERED_MAP_MIN_CAPACITY : map->capacity;	\
+		while (unordered_map_too_full(count, capacity))	\
+			capacity *= 2;	\
+		if (capacity == map->capacity)	\
+			return success;	\
+		return rehash_unordered_map_##K##_##V(map, capacity, functname);	\
+	}	\
+		\
+	c_unordered_map(K,V) *destroy_unordered_map_##K##_##V(c_unordered_map(K,V) *map) {	\
+		if (map == NULL) {	\
+			return NULL;	\
+		}	\
+		allocator_free(map->allocator, map->slots);	\
+		allocator_free(map->allocator, map);	\
+		return NULL;	\
+	}	\
+		\
+	error_code insert_unordered_map_##K##_##V(c_unordered_map(K,V) *map, K key, V value) {	\
+		size_t index = find_slot_##K##_##V(map, key);	\
+		if (index != map->capacity) {	\
+			map->slots[index].value = value;	\
+			return success;	\
+		}	\
+		if (grow_unordered_map_##K##_##V(map, map->count + 1, "insert") != success)	\
+			return err;	\
+		place_slot_##K##_##V(map, key, value);	\
+		++map->count;	\
+		return success;	\
+	}	\
+		\
+	error_code delete_pair_unordered_map_##K##_##V(c_unordered_map(K,V) *map, K key) {	\
+		size_t index = find_slot_##K##_##V(map, key);	\
+		size_t next = 0;	\
+		if (index == map->capacity) {	\
+			err = key_not_found;	\
+			set_error_info(__FILE__, "delete_pair", __LINE__);	\
+			return err;	\
+		}	\
+		/* Pull back the keys after it until one is already home or the slot is empty */	\
+		next = (index + 1) & map->mask;	\
+		while (map->slots[next].distance > 1) {	\
+			map->slots[index] = map->slots[next];	\
+			--map->slots[index].distance;	\
+			index = next;	\
+			next = (next + 1) & map->mask;	\
+		}	\
+		map->slots[index].distance = 0;	\
+		--map->count;	\
+		return success;	\
+	}	\
+		\
+	bool is_key_unordered_map_##K##_##V(c_unordered_map(K,V) *map, K key) {	\
+		return find_slot_##K##_##V(map, key) != map->capacity;	\
+	}	\
+		\
+	V get_value_unordered_map_##K##_##V(c_unordered_map(K,V) *map, K key) {	\
+		V val;	\
+		size_t index = find_slot_##K##_##V(map, key);	\
+		if (index != map->capacity)	\
+			val = map->slots[index].value;	\
+		else {	\
+			memset(&val, 0, sizeof(V));	\
+			err = key_not_found;	\
+			set_error_info(__FILE__, "get_value", __LINE__);	\
+		}	\
+		return val;	\
+	}	\
+		\
+	size_t size_unordered_map_##K##_##V(c_unordered_map(K,V) *map) {	\
+		return map->count;	\
+	}	\
+		\
+	error_code reserve_unordered_map_##K##_##V(c_unordered_map(K,V) *map, size_t count) {	\
+		return grow_unordered_map_##K##_##V(map, count, "reserve");	\
+	}	\
+		\
+	static inline void set_unordered_map_ptr_##K##_##V(c_unordered_map(K,V) *map) {	\
+		map->destroy_map = &destroy_unordered_map_##K##_##V;	\
+		map->insert = &insert_unordered_map_##K##_##V;	\
+		map->delete_pair = &delete_pair_unordered_map_##K##_##V;	\
+		map->get_value = &get_value_unordered_map_##K##_##V;	\
+		map->is_key = &is_key_unordered_map_##K##_##V;	\
+		map->size = &size_unordered_map_##K##_##V;	\
+		map->reserve = &reserve_unordered_map_##K##_##V;	\
+	}	\
+		\
+	c_unordered_map(K,V) *new_unordered_map_##K##_##V(const c_allocator *allocator) {	\
+		c_unordered_map(K,V) *map = NULL;	\
+			\
+		map = (c_unordered_map(K,V) *) allocator_calloc(allocator, sizeof(c_unordered_map(K,V)));	\
+			\
+		if (map == NULL) {	\
+			return NULL;	\
+		}	\
+			\
+		/* The table itself is allocated by the first insert */	\
+		map->allocator = allocator;	\
+		set_unordered_map_ptr_##K##_##V(map);	\
+		return map;	\
+	}	\
+	define_unordered_map_iterator(K,V)	\
+
+/* unordered_map_iterator visits every pair once, in the order of the slots, which
+ * has nothing to do with the order of the keys. prev walks the slots backwards.
+ * Its members up to value are the same as map_iterator's. Inserting or deleting
+ * moves keys between slots, so the iterator has to be restarted with first or last
+ * after the map changes, although values may be written through it.
+ *
+ * USAGE: generic_iterator *giter = new_unordered_map_iterator(long, double, map);
+ *        unordered_map_iterator(long, double) *iter = (unordered_map_iterator(long, double) *) giter;
+ *        for (giter->first(giter); !giter->end(giter); giter->next(giter))
+ *            total += *iter->value;
+ */
+#define define_unordered_map_iterator(K,V)	\
+typedef struct unordered_map_iterator_##K##_##V {	\
+	generic_iterator geniter;	\
+	void (*prev)(generic_iterator*);	\
+	K *key;	\
+	V *value;	\
+	size_t index;	\
+	c_unordered_map(K,V) *map;	\
+} unordered_map_iterator_##K##_##V;	\
+	\
+/* Moves to slot index, or off the end if index is capacity */	\
+static inline void move_unordered_map_iterator_##K##_##V(unordered_map_iterator(K,V) *iter, size_t index) {	\
+	bool end = (index == iter->map->capacity);	\
+	iter->index = index;	\
+	iter->key = end ? NULL : &iter->map->slots[index].key;	\
+	iter->value = end ? NULL : &iter->map->slots[index].value;	\
+}	\
+	\
+/* The first full slot at or after index */	\
+static inline size_t next_full_slot_##K##_##V(const c_unordered_map(K,V) *map, size_t index) {	\
+	while (index < map->capacity && map->slots[index].distance == 0)	\
+		++index;	\
+	return index;	\
+}	\
+	\
+/* The last full slot before index, or capacity if there isn't one */	\
+static inline size_t prev_full_slot_##K##_##V(const c_unordered_map(K,V) *map, size_t index) {	\
+	while (index > 0) {	\
+		if (map->slots[--index].distance != 0)	\
+			return index;	\
+	}	\
+	return map->capacity;	\
+}	\
+	\
+void first_unordered_map_iterator_##K##_##V(generic_iterator *generic) {	\
+	unordered_map_iterator(K,V) *iter = (unordered_map_iterator(K,V) *) generic;	\
+	move_unordered_map_iterator_##K##_##V(iter, next_full_slot_##K##_##V(iter->map, 0));	\
+}	\
+	\
+void next_unordered_map_iterator_##K##_##V(generic_iterator *generic) {	\
+	unordered_map_iterator(K,V) *iter = (unordered_map_iterator(K,V) *) generic;	\
+	if (iter->key != NULL)	\
+		move_unordered_map_iterator_##K##_##V(iter, next_full_slot_##K##_##V(iter->map, iter->index + 1));	\
+}	\
+	\
+void prev_unordered_map_iterator_##K##_##V(generic_iterator *generic) {	\
+	unordered_map_iterator(K,V) *iter = (unordered_map_iterator(K,V) *) generic;	\
+	if (iter->key != NULL)	\
+		move_unordered_map_iterator_##K##_##V(iter, prev_full_slot_##K##_##V(iter->map, iter->index));	\
+}	\
+	\
+void last_unordered_map_iterator_##K##_##V(generic_iterator *generic) {	\
+	unordered_map_iterator(K,V) *iter = (unordered_map_iterator(K,V) *) generic;	\
+	move_unordered_map_iterator_##K##_##V(iter, prev_full_slot_##K##_##V(iter->map, iter->map->capacity));	\
+}	\
+	\
+bool end_unordered_map_iterator_##K##_##V(generic_iterator *generic) {	\
+	unordered_map_iterator(K,V) *iter = (unordered_map_iterator(K,V) *) generic;	\
+	return iter->key == NULL;	\
+}	\
+	\
+generic_iterator *new_unordered_map_iterator_##K##_##V(c_unordered_map(K,V) *map) {	\
+	if (map == NULL)	\
+		return NULL;	\
+	generic_iterator *ui = (generic_iterator *) calloc(1, sizeof(unordered_map_iterator(K,V)));	\
+	unordered_map_iterator(K,V) *iter = (unordered_map_iterator(K,V) *) ui;	\
+	if (ui == NULL)	\
+		return NULL;	\
+	iter->map = map;	\
+	ui->first = &first_unordered_map_iterator_##K##_##V;	\
+	ui->next = &next_unordered_map_iterator_##K##_##V;	\
+	ui->last = &last_unordered_map_iterator_##K##_##V;	\
+	ui->end = &end_unordered_map_iterator_##K##_##V;	\
+	ui->destroy_iterator = &destroy_iterator;	\
+	iter->prev = &prev_unordered_map_iterator_##K##_##V;	\
+	first_unordered_map_iterator_##K##_##V(ui);	\
+	return ui;	\
+}	\
+
+#define c_unordered_map(K,V)	c_unordered_map_##K##_##V
+#define new_c_unordered_map(K, V)	new_unordered_map_##K##_##V(&default_allocator)
+/* Same as new_c_unordered_map, except that the map and its table come from ALLOCATOR */
+#define new_c_unordered_map_with(K, V, ALLOCATOR)	new_unordered_map_##K##_##V(ALLOCATOR)
+#define unordered_map_iterator(K,V)	unordered_map_iterator_##K##_##V
+#define new_unordered_map_iterator(K,V, MAP)	new_unordered_map_iterator_##K##_##V(MAP)
+
+#endif
@@ -0,0 +1,367 @@
+#ifndef VECTOR_KERNELS_H
+#define VECTOR_KERNELS_H
+#ifndef __cplusplus
+#include <stddef.h>
+#include <stdbool.h>
+#else
+#include <cstddef>
+#endif
+#include "c_vector.h"
+#include "error.h"
+
+/* Scans over the elements of numeric c_vectors: find, count, contains, min, max
+ * and sum. They read vector->data directly, so there is no iterator and no
+ * indirect call per element.
+ *
+ * Every kernel exists in three builds. The scalar build is a plain loop. The
+ * SSE2 and AVX2 builds are the same block code, written with GCC vector types and
+ * compiled for those instruction sets. They handle KERNEL_BLOCK bytes of elements
+ * per step. Each lane keeps its own count, minimum or sum, and the lanes are only
+ * combined at the end. The build is picked the first time a type's kernels are used:
+ * AVX2 if the CPU has it, otherwise SSE2. Anything that isn't x86, and any build
+ * with -DNO_SIMD_KERNELS, uses the scalar kernels.
+ *
+ * Float and double sums are added up lane by lane, so their rounding can differ
+ * a little from a left to right sum. Integer sums are computed in a wider type
+ * (see kernel_sum_##DATA) and wrap on overflow. NaN is never equal to anything
+ * and is not ordered, so find and count never match it, and min and max may
+ * skip it.
+ *
+ * Kernels are defined for short, int, long, float and double.
+ */
+
+#define VECTOR_NPOS	((size_t) -1)
+/* Bytes of elements handled per step, which is one AVX2 register */
+#define KERNEL_BLOCK	32
+#define KERNEL_LANES(TYPE)	(KERNEL_BLOCK / sizeof(TYPE))
+
+#if !defined(NO_SIMD_KERNELS) && defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+	#define SIMD_KERNELS
+	/* The kernels are vectorized even when the rest of the program is built with -O0 */
+	#if defined(__clang__)
+		#define KERNEL_OPTIMIZE
+	#else
+		#define KERNEL_OPTIMIZE	optimize("O3"),
+	#endif
+	#define KERNEL_SSE2	__attribute__((KERNEL_OPTIMIZE target("sse2")))
+	#define KERNEL_AVX2	__attribute__((KERNEL_OPTIMIZE target("avx2")))
+#endif
+
+typedef long long kernel_sum_short;
+typedef long long kernel_sum_int;
+typedef long kernel_sum_long;
+typedef double kernel_sum_float;
+typedef double kernel_sum_double;
+
+/* Signed integers as wide as each type, for the lanes of a comparison mask */
+typedef short kernel_lane_short;
+typedef int kernel_lane_int;
+typedef long kernel_lane_long;
+typedef int kernel_lane_float;
+typedef long kernel_lane_double;
+
+/* One set of kernels for one element type. The min and max kernels need n > 0 */
+#define define_kernel_table(TYPE)	\
+	typedef struct vector_kernels_##TYPE {	\
+		const char *name;	\
+		size_t (*find)(const TYPE*, size_t, TYPE);	\
+		size_t (*count)(const TYPE*, size_t, TYPE);	\
+		TYPE (*min)(const TYPE*, size_t);	\
+		TYPE (*max)(const TYPE*, size_t);	\
+		kernel_sum_##TYPE (*sum)(const TYPE*, size_t);	\
+	} vector_kernels_##TYPE;	\
+
+/* The plain one element at a time loops */
+#define define_scalar_kernels(TYPE)	\
+	static size_t find_scalar_##TYPE(const TYPE *data, size_t n, TYPE value) {	\
+		for (size_t i = 0; i < n; ++i) {	\
+			if (data[i] == value)	\
+				return i;	\
+		}	\
+		return VECTOR_NPOS;	\
+	}	\
+		\
+	static size_t count_scalar_##TYPE(const TYPE *data, size_t n, TYPE value) {	\
+		size_t count = 0;	\
+		for (size_t i = 0; i < n; ++i)	\
+			count += (data[i] == value);	\
+		return count;	\
+	}	\
+		\
+	static TYPE min_scalar_##TYPE(const TYPE *data, size_t n) {	\
+		TYPE best = data[0];	\
+		for (size_t i = 1; i < n; ++i)	\
+			best = (data[i] < best) ? data[i] : best;	\
+		return best;	\
+	}	\
+		\
+	static TYPE max_scalar_##TYPE(const TYPE *data, size_t n) {	\
+		TYPE best = data[0];	\
+		for (size_t i = 1; i < n; ++i)	\
+			best = (data[i] > best) ? data[i] : best;	\
+		return best;	\
+	}	\
+		\
+	static kernel_sum_##TYPE sum_scalar_##TYPE(const TYPE *data, size_t n) {	\
+		kernel_sum_##TYPE sum = 0;	\
+		for (size_t i = 0; i < n; ++i)	\
+			sum += data[i];	\
+		return sum;	\
+	}	\
+		\
+	static const vector_kernels_##TYPE scalar_kernels_##TYPE = {	\
+		"scalar",	\
+		&find_scalar_##TYPE,	\
+		&count_scalar_##TYPE,	\
+		&min_scalar_##TYPE,	\
+		&max_scalar_##TYPE,	\
+		&sum_scalar_##TYPE	\
+	};	\
+
+/* The block kernels work on kernel_vector_##TYPE, a GCC vector type that holds
+ * KERNEL_BLOCK bytes of elements. The SSE2 build splits each of its operations in
+ * two and the AVX2 build does it in one. Comparing two of them gives a mask with
+ * all bits set in the lanes that matched, which is kept as a kernel_mask_##TYPE.
+ * C has no ?: for vector types, so min and max pick lanes with the mask.
+ * Loads go through memcpy, since vector->data has no alignment beyond TYPE's.
+ */
+#define define_kernel_vectors(TYPE)	\
+	typedef TYPE kernel_vector_##TYPE __attribute__((vector_size(KERNEL_BLOCK)));	\
+	typedef kernel_sum_##TYPE kernel_sum_vector_##TYPE	\
+		__attribute__((vector_size(KERNEL_LANES(TYPE)*sizeof(kernel_sum_##TYPE))));	\
+	typedef kernel_lane_##TYPE kernel_mask_##TYPE __attribute__((vector_size(KERNEL_BLOCK)));	\
+
+/* Mask lanes are at least 16 bits wide, so count adds them up in chunks of this many blocks */
+#define KERNEL_COUNT_CHUNK	32767
+
+/* ISA names the build and ATTR is its target attribute. find only checks whether
+ * anything in a block matched, and goes back over that block for the first match.
+ */
+#define define_block_kernels(TYPE, ISA, ATTR)	\
+	ATTR static size_t find_##ISA##_##TYPE(const TYPE *data, size_t n, TYPE value) {	\
+		size_t i = 0;	\
+		for (; i + 2*KERNEL_LANES(TYPE) <= n; i += 2*KERNEL_LANES(TYPE)) {	\
+			kernel_vector_##TYPE first, second;	\
+			kernel_mask_##TYPE hits;	\
+			unsigned long long bits[KERNEL_BLOCK / sizeof(unsigned long long)];	\
+			unsigned long long any = 0;	\
+			memcpy(&first, data + i, KERNEL_BLOCK);	\
+			memcpy(&second, data + i + KERNEL_LANES(TYPE), KERNEL_BLOCK);	\
+			hits = (kernel_mask_##TYPE) (first == value) | (kernel_mask_##TYPE) (second == value);	\
+			memcpy(bits, &hits, KERNEL_BLOCK);	\
+			for (size_t j = 0; j < KERNEL_BLOCK / sizeof(unsigned long long); ++j)	\
+				any |= bits[j];	\
+			if (any != 0)	\
+				break;	\
+		}	\
+		for (; i < n; ++i) {	\
+			if (data[i] == value)	\
+				return i;	\
+		}	\
+		return VECTOR_NPOS;	\
+	}	\
+		\
+	ATTR static size_t count_##ISA##_##TYPE(const TYPE *data, size_t n, TYPE value) {	\
+		size_t count = 0;	\
+		size_t i = 0;	\
+		while (i + KERNEL_LANES(TYPE) <= n) {	\
+			kernel_mask_##TYPE lanes = { 0 };	\
+			for (size_t block = 0; block < KERNEL_COUNT_CHUNK && i + KERNEL_LANES(TYPE) <= n;	\
+				++block, i += KERNEL_LANES(TYPE)) {	\
+				kernel_vector_##TYPE current;	\
+				memcpy(&current, data + i, KERNEL_BLOCK);	\
+				/* A match is -1 */	\
+				lanes -= (kernel_mask_##TYPE) (current == value);	\
+			}	\
+			for (size_t j = 0; j < KERNEL_LANES(TYPE); ++j)	\
+				count += (size_t) lanes[j];	\
+		}	\
+		for (; i < n; ++i)	\
+			count += (data[i] == value);	\
+		return count;	\
+	}	\
+		\
+	ATTR static TYPE min_##ISA##_##TYPE(const TYPE *data, size_t n) {	\
+		TYPE best = data[0];	\
+		size_t i = 0;	\
+		if (n >= KERNEL_LANES(TYPE)) {	\
+			kernel_vector_##TYPE lanes;	\
+			memcpy(&lanes, data, KERNEL_BLOCK);	\
+			for (i = KERNEL_LANES(TYPE); i + KERNEL_LANES(TYPE) <= n; i += KERNEL_LANES(TYPE)) {	\
+				kernel_vector_##TYPE current;	\
+				kernel_mask_##TYPE smaller;	\
+				memcpy(&current, data + i, KERNEL_BLOCK);	\
+				smaller = (kernel_mask_##TYPE) (current < lanes);	\
+				lanes = (kernel_vector_##TYPE) (((kernel_mask_##TYPE) current & smaller) |	\
+												((kernel_mask_##TYPE) lanes & ~smaller));	\
+			}	\
+			for (size_t j = 0; j < KERNEL_LANES(TYPE); ++j)	\
+				best = (lanes[j] < best) ? lanes[j] : best;	\
+		}	\
+		for (; i < n; ++i)	\
+			best = (data[i] < best) ? data[i] : best;	\
+		return best;	\
+	}	\
+		\
+	ATTR static TYPE max_##ISA##_##TYPE(const TYPE *data, size_t n) {	\
+		TYPE best = data[0];	\
+		size_t i = 0;	\
+		if (n >= KERNEL_LANES(TYPE)) {	\
+			kernel_vector_##TYPE lanes;	\
+			memcpy(&lanes, data, KERNEL_BLOCK);	\
+			for (i = KERNEL_LANES(TYPE); i + KERNEL_LANES(TYPE) <= n; i += KERNEL_LANES(TYPE)) {	\
+				kernel_vector_##TYPE current;	\
+				kernel_mask_##TYPE larger;	\
+				memcpy(&current, data + i, KERNEL_BLOCK);	\
+				larger = (kernel_mask_##TYPE) (current > lanes);	\
+				lanes = (kernel_vector_##TYPE) (((kernel_mask_##TYPE) current & larger) |	\
+												((kernel_mask_##TYPE) lanes & ~larger));	\
+			}	\
+			for (size_t j = 0; j < KERNEL_LANES(TYPE); ++j)	\
+				best = (lanes[j] > best) ? lanes[j] : best;	\
+		}	\
+		for (; i < n; ++i)	\
+			best = (data[i] > best) ? data[i] : best;	\
+		return best;	\
+	}	\
+		\
+	ATTR static kernel_sum_##TYPE sum_##ISA##_##TYPE(const TYPE *data, size_t n) {	\
+		kernel_sum_vector_##TYPE lanes = { 0 };	\
+		kernel_sum_##TYPE sum = 0;	\
+		size_t i = 0;	\
+		for (; i + KERNEL_LANES(TYPE) <= n; i += KERNEL_LANES(TYPE)) {	\
+			kernel_vector_##TYPE current;	\
+			memcpy(&current, data + i, KERNEL_BLOCK);	\
+			lanes += __builtin_convertvector(current, kernel_sum_vector_##TYPE);	\
+		}	\
+		for (size_t j = 0; j < KERNEL_LANES(TYPE); ++j)	\
+			sum += lanes[j];	\
+		for (; i < n; ++i)	\
+			sum += data[i];	\
+		return sum;	\
+	}	\
+		\
+	static const vector_kernels_##TYPE ISA##_kernels_##TYPE = {	\
+		#ISA,	\
+		&find_##ISA##_##TYPE,	\
+		&count_##ISA##_##TYPE,	\
+		&min_##ISA##_##TYPE,	\
+		&max_##ISA##_##TYPE,	\
+		&sum_##ISA##_##TYPE	\
+	};	\
+
+#ifdef SIMD_KERNELS
+#define define_kernels(TYPE)	\
+	define_kernel_table(TYPE)	\
+	define_scalar_kernels(TYPE)	\
+	define_kernel_vectors(TYPE)	\
+	define_block_kernels(TYPE, sse2, KERNEL_SSE2)	\
+	define_block_kernels(TYPE, avx2, KERNEL_AVX2)	\
+		\
+	static const vector_kernels_##TYPE *selected_kernels_##TYPE = NULL;	\
+		\
+	/* Threads making their first call at once may each pick the table, but they */	\
+	/* all pick the same one, so the pointer only has to be read and written atomically */	\
+	static inline const vector_kernels_##TYPE *kernels_##TYPE() {	\
+		const vector_kernels_##TYPE *kernels = __atomic_load_n(&selected_kernels_##TYPE, __ATOMIC_ACQUIRE);	\
+		if (kernels == NULL) {	\
+			__builtin_cpu_init();	\
+			kernels = __builtin_cpu_supports("avx2") ? &avx2_kernels_##TYPE : &sse2_kernels_##TYPE;	\
+			__atomic_store_n(&selected_kernels_##TYPE, kernels, __ATOMIC_RELEASE);	\
+		}	\
+		return kernels;	\
+	}	\
+
+#else
+#define define_kernels(TYPE)	\
+	define_kernel_table(TYPE)	\
+	define_scalar_kernels(TYPE)	\
+		\
+	static inline const vector_kernels_##TYPE *kernels_##TYPE() {	\
+		return &scalar_kernels_##TYPE;	\
+	}	\
+
+#endif
+
+define_kernels(short)
+define_kernels(int)
+define_kernels(long)
+define_kernels(float)
+define_kernels(double)
+
+/* define_vector_kernels(DATA)
+ * INPUT: DATA -> short, int, long, float or double
+ * OUTPUT: None
+ * USAGE: define_vector(int) define_vector_kernels(int)
+ * NOTES: define_vector(DATA) must be called first. This defines the c_vector wrappers
+ * below for DATA. Use them through the c_vector_find family of macros.
+ *
+ * size_t find_vector_##DATA(const c_vector_##DATA *vector, DATA value)
+ * INPUT: the vector, the value to look for
+ * OUTPUT: index of the first element equal to value, or VECTOR_NPOS
+ * USAGE: size_t index = c_vector_find(int, vector, 42);
+ * NOTES:
+ *
+ * size_t count_vector_##DATA(const c_vector_##DATA *vector, DATA value)
+ * bool contains_vector_##DATA(const c_vector_##DATA *vector, DATA value)
+ * INPUT: the vector, the value to look for
+ * OUTPUT: the number of elements equal to value, or whether there are any
+ * USAGE: if (c_vector_contains(int, vector, 42))
+ * NOTES:
+ *
+ * DATA min_vector_##DATA(const c_vector_##DATA *vector)
+ * DATA max_vector_##DATA(const c_vector_##DATA *vector)
+ * INPUT: the vector
+ * OUTPUT: the smallest or largest element
+ * USAGE: int low = c_vector_min(int, vector);
+ * NOTES: An empty vector returns 0 and sets err to invalid_index
+ *
+ * kernel_sum_##DATA sum_vector_##DATA(const c_vector_##DATA *vector)
+ * INPUT: the vector
+ * OUTPUT: the sum of the elements, 0 for an empty vector
+ * USAGE: long long total = c_vector_sum(int, vector);
+ * NOTES:
+ */
+#define define_vector_kernels(DATA)	\
+	static inline size_t find_vector_##DATA(const c_vector_##DATA *vector, DATA value) {	\
+		return kernels_##DATA()->find(vector->data, vector->curr_index, value);	\
+	}	\
+		\
+	static inline size_t count_vector_##DATA(const c_vector_##DATA *vector, DATA value) {	\
+		return kernels_##DATA()->count(vector->data, vector->curr_index, value);	\
+	}	\
+		\
+	static inline bool contains_vector_##DATA(const c_vector_##DATA *vector, DATA value) {	\
+		return find_vector_##DATA(vector, value) != VECTOR_NPOS;	\
+	}	\
+		\
+	static inline DATA min_vector_##DATA(const c_vector_##DATA *vector) {	\
+		if (vector->curr_index == 0) {	\
+			err = invalid_index;	\
+			set_error_info(__FILE__, "min", __LINE__);	\
+			return 0;	\
+		}	\
+		return kernels_##DATA()->min(vector->data, vector->curr_index);	\
+	}	\
+		\
+	static inline DATA max_vector_##DATA(const c_vector_##DATA *vector) {	\
+		if (vector->curr_index == 0) {	\
+			err = invalid_index;	\
+			set_error_info(__FILE__, "max", __LINE__);	\
+			return 0;	\
+		}	\
+		return kernels_##DATA()->max(vector->data, vector->curr_index);	\
+	}	\
+		\
+	static inline kernel_sum_##DATA sum_vector_##DATA(const c_vector_##DATA *vector) {	\
+		return kernels_##DATA()->sum(vector->data, vector->curr_index);	\
+	}	\
+
+#define c_vector_find(DATA, VECTOR, VALUE)	find_vector_##DATA(VECTOR, VALUE)
+#define c_vector_count(DATA, VECTOR, VALUE)	count_vector_##DATA(VECTOR, VALUE)
+#define c_vector_contains(DATA, VECTOR, VALUE)	contains_vector_##DATA(VECTOR, VALUE)
+#define c_vector_min(DATA, VECTOR)	min_vector_##DATA(VECTOR)
+#define c_vector_max(DATA, VECTOR)	max_vector_##DATA(VECTOR)
+#define c_vector_sum(DATA, VECTOR)	sum_vector_##DATA(VECTOR)
+
+#endif
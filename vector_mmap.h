@@ -0,0 +1,280 @@
+#ifndef VECTOR_MMAP_H
+#define VECTOR_MMAP_H
+#ifndef __cplusplus
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#else
+#include <cstdlib>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#endif
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "c_vector.h"
+#include "error.h"
+#include "allocator.h"
+
+/* A mapped c_vector keeps its elements in a file instead of on the heap. data
+ * points straight into a shared mapping of the file, so opening a vector that was
+ * written earlier costs an open, an fstat and an mmap, no matter how large it is.
+ * Nothing is copied or parsed, and pages are only read in once they are touched.
+ *
+ * The file is a 64 byte header followed by the elements exactly as they sit in
+ * memory. The header records the element size, the type name given to
+ * define_vector and the number of elements, and a file whose header doesn't match
+ * DATA is refused. Since the elements are stored raw, a file can only be read on
+ * a machine with the same byte order and struct layout, and DATA must not hold
+ * pointers.
+ *
+ * All of this is hidden behind the vector's allocator. Its reallocate grows the
+ * file with ftruncate and the mapping with mremap (or a second mmap where mremap is
+ * missing), and its deallocate unmaps the file. Every c_vector operation,
+ * including sorting and the inline push, works on a mapped vector unchanged.
+ * Anything else allocated through it, like a sort's scratch buffer, comes from
+ * malloc.
+ *
+ * The element count in the header is only written by c_vector_sync and by
+ * destroy_vector. Elements pushed after the last sync are in the file, but will
+ * not be seen when the file is opened again if the process dies first.
+ *
+ * mremap is only declared when _GNU_SOURCE is defined before the first system
+ * header is included.
+ */
+
+/* map_open -> open an existing vector file
+ * map_create -> create the file, or throw away what is in it
+ * map_open_or_create -> open the file if it exists, or start an empty one
+ * map_private -> open an existing file read only. Changes are copy on write and
+ * never reach the file, and the vector moves to the heap the first time it grows.
+ */
+typedef enum vector_map_mode { map_open, map_create, map_open_or_create, map_private } vector_map_mode;
+
+#define MAPPED_MAGIC	"CVECMAP1"
+#define MAPPED_HEADER_SIZE	64
+
+typedef struct mapped_header {
+	char magic[8];
+	uint64_t element_size;
+	uint64_t count;
+	char type[MAPPED_HEADER_SIZE - 24];
+} mapped_header;
+
+/* base is NULL once the elements are no longer in the file */
+typedef struct mapped_file {
+	c_allocator allocator;
+	char *base;
+	size_t length;
+	int fd;
+	bool shared;
+	const size_t *count;
+} mapped_file;
+
+/* The file is already zero past its old end, so growth never zeroes anything */
+vector_policy mapped_vector_policy = VECTOR_POLICY_FACTOR(2, 1, 0, false);
+
+static inline char *mapped_data(const mapped_file *file) {
+	return (file->base == NULL) ? NULL : file->base + MAPPED_HEADER_SIZE;
+}
+
+static inline void close_mapped_file(mapped_file *file) {
+	if (file->base != NULL) {
+		if (file->shared)
+			((mapped_header *) file->base)->count = *file->count;
+		munmap(file->base, file->length);
+		file->base = NULL;
+	}
+	if (file->fd >= 0)
+		close(file->fd);
+	file->fd = -1;
+}
+
+/* Without mremap, the new mapping is made before the old one goes, so a failure loses nothing */
+static inline char *remap_file(mapped_file *file, size_t length) {
+	void *base = NULL;
+#ifdef MREMAP_MAYMOVE
+	base = mremap(file->base, file->length, length, MREMAP_MAYMOVE);
+#else
+	base = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED, file->fd, 0);
+	if (base != MAP_FAILED)
+		munmap(file->base, file->length);
+#endif
+	return (base == MAP_FAILED) ? NULL : (char *) base;
+}
+
+void *mapped_allocate(void *context, size_t bytes) {
+	(void) context;
+	return malloc(bytes);
+}
+
+void *mapped_reallocate(void *context, void *ptr, size_t old_bytes, size_t new_bytes) {
+	mapped_file *file = (mapped_file *) context;
+	size_t length = MAPPED_HEADER_SIZE + new_bytes;
+	char *base = NULL;
+	if (ptr == NULL || (char *) ptr != mapped_data(file))
+		return realloc(ptr, new_bytes);
+	/* A private mapping can't grow past the end of the file, so it moves to the heap */
+	if (!file->shared) {
+		void *temp = malloc(new_bytes);
+		if (temp == NULL)
+			return NULL;
+		memcpy(temp, ptr, (old_bytes < new_bytes) ? old_bytes : new_bytes);
+		close_mapped_file(file);
+		return temp;
+	}
+	/* If the mapping can't grow, the file is just longer than it has to be */
+	if (ftruncate(file->fd, (off_t) length) != 0 || (base = remap_file(file, length)) == NULL)
+		return NULL;
+	file->base = base;
+	file->length = length;
+	return mapped_data(file);
+}
+
+void mapped_deallocate(void *context, void *ptr) {
+	mapped_file *file = (mapped_file *) context;
+	if (ptr != NULL && (char *) ptr == mapped_data(file))
+		close_mapped_file(file);
+	else
+		free(ptr);
+}
+
+static inline bool fail_mapped_file(mapped_file *file) {
+	if (file->base != NULL)
+		munmap(file->base, file->length);
+	file->base = NULL;
+	if (file->fd >= 0)
+		close(file->fd);
+	file->fd = -1;
+	err = map_failed;
+	set_error_info(__FILE__, "new_c_vector_mmap", __LINE__);
+	return false;
+}
+
+/* Maps path into file, creating it if mode allows. Returns false with err set on failure */
+bool open_mapped_file(mapped_file *file, const char *path, vector_map_mode mode, size_t elemsize, const char *type) {
+	static const int flags[] = { O_RDWR, O_RDWR | O_CREAT | O_TRUNC, O_RDWR | O_CREAT, O_RDONLY };
+	mapped_header *header = NULL;
+	struct stat info;
+	void *base = NULL;
+
+	file->fd = open(path, flags[mode], 0644);
+	file->base = NULL;
+	file->shared = (mode != map_private);
+	if (file->fd < 0 || fstat(file->fd, &info) != 0)
+		return fail_mapped_file(file);
+	file->length = (size_t) info.st_size;
+	/* A new file starts out with room for two elements, the same as new_c_vector */
+	if (file->length == 0 && file->shared) {
+		file->length = MAPPED_HEADER_SIZE + 2*elemsize;
+		if (ftruncate(file->fd, (off_t) file->length) != 0)
+			return fail_mapped_file(file);
+	}
+	else if (file->length < MAPPED_HEADER_SIZE)
+		return fail_mapped_file(file);
+	base = mmap(NULL, file->length, PROT_READ | PROT_WRITE, file->shared ? MAP_SHARED : MAP_PRIVATE, file->fd, 0);
+	if (base == MAP_FAILED)
+		return fail_mapped_file(file);
+	file->base = (char *) base;
+	header = (mapped_header *) base;
+	if (info.st_size == 0) {
+		memcpy(header->magic, MAPPED_MAGIC, sizeof(header->magic));
+		header->element_size = elemsize;
+		header->count = 0;
+		strncpy(header->type, type, sizeof(header->type) - 1);
+	}
+	if (memcmp(header->magic, MAPPED_MAGIC, sizeof(header->magic)) != 0 || header->element_size != elemsize ||
+		strncmp(header->type, type, sizeof(header->type) - 1) != 0 ||
+		header->count > (file->length - MAPPED_HEADER_SIZE) / elemsize)
+		return fail_mapped_file(file);
+	file->allocator.allocate = &mapped_allocate;
+	file->allocator.reallocate = &mapped_reallocate;
+	file->allocator.deallocate = &mapped_deallocate;
+	file->allocator.context = file;
+	return true;
+}
+
+/* define_vector_mmap(DATA)
+ * INPUT: DATA -> data type of the vector
+ * OUTPUT: None
+ * USAGE: define_vector(record) define_vector_mmap(record)
+ * NOTES: define_vector(DATA) must be called first.
+ *
+ * c_vector_##DATA *new_mapped_vector_##DATA(const char *path, vector_map_mode mode)
+ * INPUT: const char *path -> the vector's file, vector_map_mode mode -> how to open it
+ * OUTPUT: c_vector struct pointer, or NULL with err set to map_failed if the file
+ * couldn't be opened or mapped, or holds a different type
+ * USAGE: internal use only, use new_c_vector_mmap
+ * NOTES: The vector comes back holding every element the file had at its last sync.
+ * destroy_vector writes the element count, unmaps the file and closes it.
+ *
+ * error_code sync_mapped_vector_##DATA(c_vector_##DATA *vector)
+ * INPUT: c_vector_##DATA *vector -> a mapped vector
+ * OUTPUT: success, or map_failed if msync failed
+ * USAGE: c_vector_sync(record, vector);
+ * NOTES: Records the element count and waits for the elements and header to be
+ * written to the file. Vectors that aren't in a shared mapping have nothing to sync.
+ */
+#define define_vector_mmap(DATA)	\
+	typedef struct mapped_vector_##DATA {	\
+		c_vector_##DATA vector;	\
+		mapped_file file;	\
+	} mapped_vector_##DATA;	\
+		\
+	c_vector_##DATA *new_mapped_vector_##DATA(const char *path, vector_map_mode mode) {	\
+		mapped_vector_##DATA *mapped = NULL;	\
+		c_vector_##DATA *vector = NULL;	\
+			\
+		mapped = (mapped_vector_##DATA *) calloc(1, sizeof(mapped_vector_##DATA));	\
+			\
+		if (mapped == NULL) {	\
+			return NULL;	\
+		}	\
+			\
+		if (!open_mapped_file(&mapped->file, path, mode, sizeof(DATA), type_name(DATA))) {	\
+			free(mapped);	\
+			return NULL;	\
+		}	\
+			\
+		vector = &(mapped->vector);	\
+		vector->data = (DATA *) mapped_data(&mapped->file);	\
+		vector->max_size = ((mapped->file.length - MAPPED_HEADER_SIZE) / sizeof(DATA))*sizeof(DATA);	\
+		vector->curr_index = ((mapped_header *) mapped->file.base)->count;	\
+		vector->current_size = vector->curr_index*sizeof(DATA);	\
+		vector->data_type = type_name(DATA);	\
+		vector->ops = &vector_ops_##DATA;	\
+		vector->policy = &mapped_vector_policy;	\
+		vector->storage = heap_storage;	\
+		vector->allocator = &mapped->file.allocator;	\
+		mapped->file.count = &vector->curr_index;	\
+		return vector;	\
+	}	\
+		\
+	error_code sync_mapped_vector_##DATA(c_vector_##DATA *vector) {	\
+		mapped_file *file = (mapped_file *) vector->allocator->context;	\
+		if (vector->allocator->reallocate != &mapped_reallocate || file->base == NULL || !file->shared) {	\
+			err = success;	\
+			return success;	\
+		}	\
+		((mapped_header *) file->base)->count = vector->curr_index;	\
+		if (msync(file->base, file->length, MS_SYNC) != 0) {	\
+			err = map_failed;	\
+			set_error_info(__FILE__, "sync", __LINE__);	\
+			return err;	\
+		}	\
+		err = success;	\
+		return success;	\
+	}	\
+
+/* new_c_vector_mmap(DATA, PATH, MODE)
+ * USAGE: c_vector(record) *vector = new_c_vector_mmap(record, "records.vec", map_open_or_create);
+ * NOTES: See define_vector_mmap
+ */
+#define new_c_vector_mmap(DATA, PATH, MODE)	new_mapped_vector_##DATA(PATH, MODE)
+#define c_vector_sync(DATA, VECTOR)	sync_mapped_vector_##DATA(VECTOR)
+
+#endif
@@ -0,0 +1,416 @@
+#ifndef VECTOR_SORT_H
+#define VECTOR_SORT_H
+#ifndef __cplusplus
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#else
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#endif
+#include <pthread.h>
+#include <unistd.h>
+#include "c_vector.h"
+#include "compare.h"
+#include "error.h"
+#include "allocator.h"
+
+/* Sorting for c_vector. define_vector_sort(DATA) adds c_vector_sort(DATA, VECTOR),
+ * which sorts the vector in place, smallest first.
+ *
+ * Integer and floating point DATA are sorted with an LSD radix sort. It does one
+ * counting pass over the keys a byte at a time, and skips bytes that are the same
+ * for every element. Negative numbers sort before positive ones. -0.0 sorts before
+ * 0.0, and NaNs go to the ends by sign. Everything else is sorted with an introsort
+ * that orders elements with default_compare, or with the comparator given to
+ * define_vector_sort_cmp. It is a quicksort that falls back to heapsort if it
+ * recurses too deeply, plus an insertion sort for short ranges.
+ *
+ * Vectors with at least parallel_threshold elements are sorted by several threads.
+ * Each thread sorts an equal slice of the vector the same way, and then the slices
+ * are merged in rounds. Each round is also split evenly between the threads, no
+ * matter how many merges are left, so the last merge doesn't run on one core.
+ *
+ * The radix sort and the merges need a scratch buffer as large as the vector. It
+ * comes from the vector's allocator and is freed before the sort returns. If it
+ * can't be allocated, the vector is sorted in place by the introsort instead. If a
+ * thread can't be started, its share of the work is done on the calling thread.
+ */
+
+/* sort_config
+ * parallel_threshold -> vectors with at least this many elements are sorted in parallel
+ * threads -> how many threads to use, or 0 for one per online CPU
+ */
+typedef struct sort_config {
+	size_t parallel_threshold;
+	unsigned int threads;
+} sort_config;
+
+#define SORT_CONFIG(THRESHOLD, THREADS)	{ THRESHOLD, THREADS }
+
+/* c_vector_sort uses this. Changing it changes every sort that comes after */
+sort_config default_sort_config = SORT_CONFIG(1 << 20, 0);
+
+/* Ranges this short are finished by insertion sort */
+#define SORT_INSERTION_LIMIT	16
+#define SORT_MAX_THREADS	256
+
+typedef enum radix_kind { radix_unsigned, radix_signed, radix_float, radix_none } radix_kind;
+
+/* Which radix sort a type gets, if any. This is a constant, so the sort that isn't
+ * used is thrown out at compile time.
+ */
+#ifndef __cplusplus
+#define radix_kind_of(DATA)	\
+	_Generic((DATA) { 0 },	\
+		bool: radix_unsigned,	\
+		char: ((char) -1 < 0) ? radix_signed : radix_unsigned,	\
+		signed char: radix_signed,	\
+		unsigned char: radix_unsigned,	\
+		short: radix_signed,	\
+		unsigned short: radix_unsigned,	\
+		int: radix_signed,	\
+		unsigned int: radix_unsigned,	\
+		long: radix_signed,	\
+		unsigned long: radix_unsigned,	\
+		long long: radix_signed,	\
+		unsigned long long: radix_unsigned,	\
+		float: radix_float,	\
+		double: radix_float,	\
+		default: radix_none)
+#else
+#define radix_kind_of(DATA)	radix_none
+#endif
+
+/* Types that can't be radix sorted still get a radix sort compiled, and this keeps it small */
+#define RADIX_BYTES(DATA)	((sizeof(DATA) <= sizeof(uint64_t)) ? sizeof(DATA) : 1)
+
+static inline unsigned int sort_thread_count(const sort_config *config) {
+	long cpus = 0;
+	if (config->threads != 0)
+		return (config->threads > SORT_MAX_THREADS) ? SORT_MAX_THREADS : config->threads;
+	cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	if (cpus < 1)
+		return 1;
+	return (cpus > SORT_MAX_THREADS) ? SORT_MAX_THREADS : (unsigned int) cpus;
+}
+
+/* Run job on count threads, with the calling thread taking the first share */
+static inline void sort_run_threads(void *(*job)(void *), void *tasks, size_t task_size, unsigned int count) {
+	pthread_t threads[SORT_MAX_THREADS];
+	bool started[SORT_MAX_THREADS];
+	for (unsigned int t = 1; t < count; ++t) {
+		started[t] = (pthread_create(&threads[t], NULL, job, (char *) tasks + t*task_size) == 0);
+		if (!started[t])
+			job((char *) tasks + t*task_size);
+	}
+	job(tasks);
+	for (unsigned int t = 1; t < count; ++t) {
+		if (started[t])
+			pthread_join(threads[t], NULL);
+	}
+}
+
+/* define_vector_sort(DATA)
+ * INPUT: DATA -> data type of the vector
+ * OUTPUT: None
+ * USAGE: define_vector(int) define_vector_sort(int)
+ * NOTES: define_vector(DATA) must be called first. Elements are ordered by
+ * default_compare when DATA can't be radix sorted.
+ *
+ * define_vector_sort_cmp(DATA, CMP)
+ * INPUT: DATA -> data type of the vector, CMP -> comparator for DATA
+ * OUTPUT: None
+ * USAGE: define_vector_sort_cmp(point, compare_point)
+ * NOTES: CMP is called as CMP(a, b) on two elements, the same way as the comparator
+ * given to define_rbtree_cmp (see compare.h). A type that is given a comparator is
+ * always sorted with it, so there is no radix sort.
+ *
+ * error_code sort_vector_##DATA(c_vector_##DATA *vector, const sort_config *config)
+ * INPUT: c_vector_##DATA *vector -> vector to sort, const sort_config *config -> when
+ * and how to sort in parallel
+ * OUTPUT: success. Running out of memory only means the slower in place sort is used.
+ * USAGE: c_vector_sort(int, vector); c_vector_sort_with(int, vector, &config);
+ * NOTES: The radix and merge sorts are stable and the introsort is not.
+ */
+#define define_vector_sort(DATA)	define_vector_sort_with(DATA, default_compare, radix_kind_of(DATA))
+
+#define define_vector_sort_cmp(DATA, CMP)	define_vector_sort_with(DATA, CMP, radix_none)
+
+/* define_array_sort(DATA, CMP, KIND)
+ * INPUT: DATA -> element type, CMP -> comparator, KIND -> radix_kind of DATA
+ * OUTPUT: None
+ * USAGE: define_array_sort(entry, compare_entry, radix_none)
+ * NOTES: This is everything but the c_vector wrapper, for containers that sort plain
+ * arrays of DATA. It defines
+ * void sort_array_##DATA(DATA *data, size_t n, const sort_config *config, const c_allocator *allocator)
+ * where the allocator is used for the scratch buffer.
+ */
+#define define_array_sort(DATA, CMP, KIND)	\
+	/* The element as an unsigned integer that sorts the same way */	\
+	static inline uint64_t radix_key_##DATA(const DATA *value) {	\
+		const unsigned int bits = 8*sizeof(DATA);	\
+		const uint64_t sign = (uint64_t) 1 << ((bits - 1) % 64);	\
+		uint64_t key = 0;	\
+		memcpy(&key, value, (sizeof(DATA) <= sizeof(uint64_t)) ? sizeof(DATA) : sizeof(uint64_t));	\
+		if ((KIND) == radix_signed)	\
+			key ^= sign;	\
+		else if ((KIND) == radix_float) {	\
+			const uint64_t mask = (bits >= 64) ? ~(uint64_t) 0 : (((uint64_t) 1 << (bits % 64)) - 1);	\
+			key = (key & sign) ? (~key & mask) : (key | sign);	\
+		}	\
+		return key;	\
+	}	\
+		\
+	/* Sorts data, using scratch as the other buffer. The result ends up in data */	\
+	static void radix_sort_##DATA(DATA *data, DATA *scratch, size_t n) {	\
+		size_t counts[RADIX_BYTES(DATA)][256];	\
+		DATA *from = data;	\
+		DATA *to = scratch;	\
+		memset(counts, 0, sizeof(counts));	\
+		for (size_t i = 0; i < n; ++i) {	\
+			uint64_t key = radix_key_##DATA(&data[i]);	\
+			for (size_t byte = 0; byte < RADIX_BYTES(DATA); ++byte)	\
+				++counts[byte][(key >> (8*byte)) & 0xff];	\
+		}	\
+		for (size_t byte = 0; byte < RADIX_BYTES(DATA); ++byte) {	\
+			size_t offset = 0;	\
+			/* Every element has the same value for this byte, so the pass would change nothing */	\
+			if (counts[byte][(radix_key_##DATA(&data[0]) >> (8*byte)) & 0xff] == n)	\
+				continue;	\
+			for (size_t digit = 0; digit < 256; ++digit) {	\
+				size_t count = counts[byte][digit];	\
+				counts[byte][digit] = offset;	\
+				offset += count;	\
+			}	\
+			for (size_t i = 0; i < n; ++i) {	\
+				size_t digit = (radix_key_##DATA(&from[i]) >> (8*byte)) & 0xff;	\
+				to[counts[byte][digit]++] = from[i];	\
+			}	\
+			DATA *temp = from;	\
+			from = to;	\
+			to = temp;	\
+		}	\
+		if (from != data)	\
+			memcpy(data, from, n*sizeof(DATA));	\
+	}	\
+		\
+	static inline void swap_##DATA(DATA *a, DATA *b) {	\
+		DATA temp = *a;	\
+		*a = *b;	\
+		*b = temp;	\
+	}	\
+		\
+	static void insertion_sort_##DATA(DATA *data, size_t n) {	\
+		for (size_t i = 1; i < n; ++i) {	\
+			DATA value = data[i];	\
+			size_t j = i;	\
+			while (j > 0 && CMP(value, data[j - 1]) < 0) {	\
+				data[j] = data[j - 1];	\
+				--j;	\
+			}	\
+			data[j] = value;	\
+		}	\
+	}	\
+		\
+	static void sift_down_##DATA(DATA *data, size_t root, size_t n) {	\
+		while (2*root + 1 < n) {	\
+			size_t child = 2*root + 1;	\
+			if (child + 1 < n && CMP(data[child], data[child + 1]) < 0)	\
+				++child;	\
+			if (CMP(data[root], data[child]) >= 0)	\
+				return;	\
+			swap_##DATA(&data[root], &data[child]);	\
+			root = child;	\
+		}	\
+	}	\
+		\
+	static void heap_sort_##DATA(DATA *data, size_t n) {	\
+		for (size_t i = n / 2; i > 0; --i)	\
+			sift_down_##DATA(data, i - 1, n);	\
+		for (size_t i = n; i > 1; --i) {	\
+			swap_##DATA(&data[0], &data[i - 1]);	\
+			sift_down_##DATA(data, 0, i - 1);	\
+		}	\
+	}	\
+		\
+	/* Leaves ranges shorter than SORT_INSERTION_LIMIT for the final insertion sort */	\
+	static void introsort_loop_##DATA(DATA *data, size_t n, size_t depth) {	\
+		while (n > SORT_INSERTION_LIMIT) {	\
+			size_t middle = n / 2;	\
+			size_t i = 0;	\
+			size_t j = n - 1;	\
+			if (depth == 0) {	\
+				heap_sort_##DATA(data, n);	\
+				return;	\
+			}	\
+			--depth;	\
+			/* Median of three, which also leaves sentinels at both ends */	\
+			if (CMP(data[middle], data[0]) < 0)	\
+				swap_##DATA(&data[middle], &data[0]);	\
+			if (CMP(data[n - 1], data[middle]) < 0) {	\
+				swap_##DATA(&data[n - 1], &data[middle]);	\
+				if (CMP(data[middle], data[0]) < 0)	\
+					swap_##DATA(&data[middle], &data[0]);	\
+			}	\
+			DATA pivot = data[middle];	\
+			while (true) {	\
+				while (CMP(data[i], pivot) < 0)	\
+					++i;	\
+				while (CMP(pivot, data[j]) < 0)	\
+					--j;	\
+				if (i >= j)	\
+					break;	\
+				swap_##DATA(&data[i], &data[j]);	\
+				++i;	\
+				--j;	\
+			}	\
+			/* Recurse into the smaller side so the stack stays O(log n) */	\
+			if (j + 1 < n - j - 1) {	\
+				introsort_loop_##DATA(data, j + 1, depth);	\
+				data += j + 1;	\
+				n -= j + 1;	\
+			}	\
+			else {	\
+				introsort_loop_##DATA(data + j + 1, n - j - 1, depth);	\
+				n = j + 1;	\
+			}	\
+		}	\
+	}	\
+		\
+	static void introsort_##DATA(DATA *data, size_t n) {	\
+		size_t depth = 0;	\
+		for (size_t i = n; i > 1; i >>= 1)	\
+			depth += 2;	\
+		introsort_loop_##DATA(data, n, depth);	\
+		insertion_sort_##DATA(data, n);	\
+	}	\
+		\
+	/* Sorts one slice. scratch may be NULL for the types that don't need it */	\
+	static inline void sort_slice_##DATA(DATA *data, DATA *scratch, size_t n) {	\
+		if ((KIND) != radix_none && scratch != NULL && n > SORT_INSERTION_LIMIT)	\
+			radix_sort_##DATA(data, scratch, n);	\
+		else	\
+			introsort_##DATA(data, n);	\
+	}	\
+		\
+	/* How many elements of a come before the k'th element of the merge of a and b */	\
+	static size_t merge_split_##DATA(const DATA *a, size_t na, const DATA *b, size_t nb, size_t k) {	\
+		size_t low = (k > nb) ? k - nb : 0;	\
+		size_t high = (k < na) ? k : na;	\
+		while (low < high) {	\
+			size_t i = low + (high - low) / 2;	\
+			size_t j = k - i;	\
+			/* Ties go to a, which keeps the merge stable */	\
+			if (j > 0 && i < na && CMP(a[i], b[j - 1]) <= 0)	\
+				low = i + 1;	\
+			else	\
+				high = i;	\
+		}	\
+		return low;	\
+	}	\
+		\
+	typedef struct sort_task_##DATA {	\
+		DATA *from;	\
+		DATA *to;	\
+		size_t n;	\
+		/* Sorted runs in from are this long. 0 means sort the slices first */	\
+		size_t width;	\
+		/* This task's share of the output */	\
+		size_t begin;	\
+		size_t end;	\
+	} sort_task_##DATA;	\
+		\
+	static void *sort_job_##DATA(void *arg) {	\
+		sort_task_##DATA *task = (sort_task_##DATA *) arg;	\
+		size_t position = task->begin;	\
+		if (task->width == 0) {	\
+			sort_slice_##DATA(task->from + task->begin, task->to + task->begin, task->end - task->begin);	\
+			return NULL;	\
+		}	\
+		/* Merge every start of runs that overlaps [begin, end) */	\
+		while (position < task->end) {	\
+			size_t start = position - position % (2*task->width);	\
+			size_t middle = (start + task->width < task->n) ? start + task->width : task->n;	\
+			size_t last = (middle + task->width < task->n) ? middle + task->width : task->n;	\
+			size_t stop = (last < task->end) ? last : task->end;	\
+			const DATA *a = task->from + start;	\
+			const DATA *b = task->from + middle;	\
+			size_t na = middle - start;	\
+			size_t nb = last - middle;	\
+			size_t i = merge_split_##DATA(a, na, b, nb, position - start);	\
+			size_t j = position - start - i;	\
+			for (DATA *out = task->to + position; out < task->to + stop; ++out) {	\
+				if (j >= nb || (i < na && CMP(a[i], b[j]) <= 0))	\
+					*out = a[i++];	\
+				else	\
+					*out = b[j++];	\
+			}	\
+			position = stop;	\
+		}	\
+		return NULL;	\
+	}	\
+		\
+	static void parallel_sort_##DATA(DATA *data, DATA *scratch, size_t n, unsigned int count) {	\
+		sort_task_##DATA tasks[SORT_MAX_THREADS];	\
+		size_t slice = (n + count - 1) / count;	\
+		DATA *from = data;	\
+		DATA *to = scratch;	\
+		for (unsigned int t = 0; t < count; ++t) {	\
+			tasks[t].from = data;	\
+			tasks[t].to = scratch;	\
+			tasks[t].n = n;	\
+			tasks[t].width = 0;	\
+			tasks[t].begin = (t*slice < n) ? t*slice : n;	\
+			tasks[t].end = ((t + 1)*slice < n) ? (t + 1)*slice : n;	\
+		}	\
+		sort_run_threads(&sort_job_##DATA, tasks, sizeof(sort_task_##DATA), count);	\
+		for (size_t width = slice; width < n; width *= 2) {	\
+			for (unsigned int t = 0; t < count; ++t) {	\
+				tasks[t].from = from;	\
+				tasks[t].to = to;	\
+				tasks[t].width = width;	\
+				tasks[t].begin = n*t / count;	\
+				tasks[t].end = n*(t + 1) / count;	\
+			}	\
+			sort_run_threads(&sort_job_##DATA, tasks, sizeof(sort_task_##DATA), count);	\
+			DATA *temp = from;	\
+			from = to;	\
+			to = temp;	\
+		}	\
+		if (from != data)	\
+			memcpy(data, from, n*sizeof(DATA));	\
+	}	\
+		\
+	static inline void sort_array_##DATA(DATA *data, size_t n, const sort_config *config, const c_allocator *allocator) {	\
+		unsigned int count = 1;	\
+		DATA *scratch = NULL;	\
+		if (n >= config->parallel_threshold && n > 1)	\
+			count = sort_thread_count(config);	\
+		if (count > n / SORT_INSERTION_LIMIT)	\
+			count = (n / SORT_INSERTION_LIMIT > 0) ? (unsigned int) (n / SORT_INSERTION_LIMIT) : 1;	\
+		if (n > SORT_INSERTION_LIMIT && ((KIND) != radix_none || count > 1))	\
+			scratch = (DATA *) allocator->allocate(allocator->context, n*sizeof(DATA));	\
+		if (scratch == NULL)	\
+			introsort_##DATA(data, n);	\
+		else if (count > 1)	\
+			parallel_sort_##DATA(data, scratch, n, count);	\
+		else	\
+			sort_slice_##DATA(data, scratch, n);	\
+		allocator_free(allocator, scratch);	\
+	}	\
+
+#define define_vector_sort_with(DATA, CMP, KIND)	\
+	define_array_sort(DATA, CMP, KIND)	\
+		\
+	error_code sort_vector_##DATA(c_vector_##DATA *vector, const sort_config *config) {	\
+		sort_array_##DATA(vector->data, vector->curr_index, config, vector->allocator);	\
+		err = success;	\
+		return success;	\
+	}	\
+
+#define c_vector_sort(DATA, VECTOR)	sort_vector_##DATA(VECTOR, &default_sort_config)
+#define c_vector_sort_with(DATA, VECTOR, CONFIG)	sort_vector_##DATA(VECTOR, CONFIG)
+
+#endif